@@ -47,39 +47,56 @@
 void *
 memcpy(void *dst, const void *src, size_t len)
 {
-	size_t i;
+	char *d = dst;
+	const char *s = src;
+	unsigned long *dw;
+	const unsigned long *sw;
 
 	/*
 	 * memcpy does not support overlapping buffers, so always do it
 	 * forwards. (Don't change this without adjusting memmove.)
 	 *
-	 * For speedy copying, optimize the common case where both pointers
-	 * and the length are word-aligned, and copy word-at-a-time instead
-	 * of byte-at-a-time. Otherwise, copy by bytes.
+	 * For speedy copying, go word-at-a-time whenever the two
+	 * pointers have the same alignment: copy bytes until they're
+	 * word-aligned, then four words per iteration, then single
+	 * words, then whatever bytes are left over. If the pointers
+	 * are aligned differently, one side of every word access
+	 * would be unaligned, which traps on some machines (MIPS
+	 * included), so copy by bytes.
 	 *
 	 * The alignment logic below should be portable. We rely on
 	 * the compiler to be reasonably intelligent about optimizing
 	 * the divides and modulos out. Fortunately, it is.
 	 */
 
-	if ((uintptr_t)dst % sizeof(long) == 0 &&
-	    (uintptr_t)src % sizeof(long) == 0 &&
-	    len % sizeof(long) == 0) {
-
-		long *d = dst;
-		const long *s = src;
+	if (((uintptr_t)d - (uintptr_t)s) % sizeof(long) == 0) {
+		while (len > 0 && (uintptr_t)d % sizeof(long) != 0) {
+			*d++ = *s++;
+			len--;
+		}
 
-		for (i=0; i<len/sizeof(long); i++) {
-			d[i] = s[i];
+		dw = (unsigned long *)d;
+		sw = (const unsigned long *)s;
+		while (len >= 4*sizeof(long)) {
+			dw[0] = sw[0];
+			dw[1] = sw[1];
+			dw[2] = sw[2];
+			dw[3] = sw[3];
+			dw += 4;
+			sw += 4;
+			len -= 4*sizeof(long);
 		}
+		while (len >= sizeof(long)) {
+			*dw++ = *sw++;
+			len -= sizeof(long);
+		}
+		d = (char *)dw;
+		s = (const char *)sw;
 	}
-	else {
-		char *d = dst;
-		const char *s = src;
 
-		for (i=0; i<len; i++) {
-			d[i] = s[i];
-		}
+	while (len > 0) {
+		*d++ = *s++;
+		len--;
 	}
 
 	return dst;
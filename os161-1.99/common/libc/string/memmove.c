@@ -48,7 +48,10 @@
 void *
 memmove(void *dst, const void *src, size_t len)
 {
-	size_t i;
+	char *d;
+	const char *s;
+	unsigned long *dw;
+	const unsigned long *sw;
 
 	/*
 	 * If the buffers don't overlap, it doesn't matter what direction
@@ -84,33 +87,43 @@ memmove(void *dst, const void *src, size_t len)
 	}
 
 	/*
-	 * Copy by words in the common case. Look in memcpy.c for more
-	 * information.
+	 * Copy by words in the common case, the same way memcpy does
+	 * but from the top down; look in memcpy.c for more
+	 * information. Within each group of four the highest word
+	 * goes first, so no word is overwritten before it's read.
 	 */
 
-	if ((uintptr_t)dst % sizeof(long) == 0 &&
-	    (uintptr_t)src % sizeof(long) == 0 &&
-	    len % sizeof(long) == 0) {
+	d = (char *)dst + len;
+	s = (const char *)src + len;
 
-		long *d = dst;
-		const long *s = src;
-
-		/*
-		 * The reason we copy index i-1 and test i>0 is that
-		 * i is unsigned -- so testing i>=0 doesn't work.
-		 */
+	if (((uintptr_t)d - (uintptr_t)s) % sizeof(long) == 0) {
+		while (len > 0 && (uintptr_t)d % sizeof(long) != 0) {
+			*--d = *--s;
+			len--;
+		}
 
-		for (i=len/sizeof(long); i>0; i--) {
-			d[i-1] = s[i-1];
+		dw = (unsigned long *)d;
+		sw = (const unsigned long *)s;
+		while (len >= 4*sizeof(long)) {
+			dw -= 4;
+			sw -= 4;
+			dw[3] = sw[3];
+			dw[2] = sw[2];
+			dw[1] = sw[1];
+			dw[0] = sw[0];
+			len -= 4*sizeof(long);
+		}
+		while (len >= sizeof(long)) {
+			*--dw = *--sw;
+			len -= sizeof(long);
 		}
+		d = (char *)dw;
+		s = (const char *)sw;
 	}
-	else {
-		char *d = dst;
-		const char *s = src;
 
-		for (i=len; i>0; i--) {
-			d[i-1] = s[i-1];
-		}
+	while (len > 0) {
+		*--d = *--s;
+		len--;
 	}
 
 	return dst;
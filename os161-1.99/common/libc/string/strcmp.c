@@ -36,9 +36,15 @@
 #include <types.h>
 #include <lib.h>
 #else
+#include <stdint.h>
 #include <string.h>
 #endif
 
+/* Word-at-a-time zero-byte test; see strlen.c. */
+#define ONES		((unsigned long)-1 / 0xff)
+#define HIGHS		(ONES << 7)
+#define HASZERO(x)	(((x) - ONES) & ~(x) & HIGHS)
+
 /*
  * Standard C string function: compare two strings and return their
  * sort order.
@@ -47,8 +53,35 @@
 int
 strcmp(const char *a, const char *b)
 {
+	const unsigned long *aw, *bw;
 	size_t i;
 
+	/*
+	 * If the strings have the same alignment, skip over the
+	 * matching part a word at a time: compare bytes until both
+	 * are word-aligned, then whole words until they differ or
+	 * one contains the terminator. (If A's word has no zero byte
+	 * and B's word is equal to it, B's hasn't either.) Reading a
+	 * whole aligned word can't fault; see strlen.c.
+	 */
+	if (((uintptr_t)a - (uintptr_t)b) % sizeof(long) == 0) {
+		while ((uintptr_t)a % sizeof(long) != 0 &&
+		       *a != 0 && *a == *b) {
+			a++;
+			b++;
+		}
+		if ((uintptr_t)a % sizeof(long) == 0) {
+			aw = (const unsigned long *)a;
+			bw = (const unsigned long *)b;
+			while (*aw == *bw && !HASZERO(*aw)) {
+				aw++;
+				bw++;
+			}
+			a = (const char *)aw;
+			b = (const char *)bw;
+		}
+	}
+
 	/*
 	 * Walk down both strings until either they're different
 	 * or we hit the end of A.
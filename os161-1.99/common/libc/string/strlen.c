@@ -36,9 +36,22 @@
 #include <types.h>
 #include <lib.h>
 #else
+#include <stdint.h>
 #include <string.h>
 #endif
 
+/*
+ * Word-at-a-time string scanning. ONES has 0x01 in every byte and
+ * HIGHS has 0x80; HASZERO(x) is nonzero exactly when some byte of x
+ * is zero. Subtracting ONES sets the high bit of every zero byte,
+ * and & ~x discards bytes whose high bit was set to begin with. A
+ * borrow can also flag a 0x01 byte, but only one sitting above a
+ * zero byte, so the answer for the word as a whole is exact.
+ */
+#define ONES		((unsigned long)-1 / 0xff)
+#define HIGHS		(ONES << 7)
+#define HASZERO(x)	(((x) - ONES) & ~(x) & HIGHS)
+
 /*
  * C standard string function: get length of a string
  */
@@ -46,10 +59,37 @@
 size_t
 strlen(const char *str)
 {
-	size_t ret = 0;
+	const char *p = str;
+	const unsigned long *wp;
+	unsigned long w;
+
+	/* Check bytes until the pointer is word-aligned. */
+	while ((uintptr_t)p % sizeof(long) != 0) {
+		if (*p == 0) {
+			return p - str;
+		}
+		p++;
+	}
+
+	/*
+	 * Then check a word at a time. This reads past the end of
+	 * the string, but never past the end of the word the
+	 * terminator is in, and an aligned word can't straddle a
+	 * page boundary, so it can't fault.
+	 */
+	wp = (const unsigned long *)p;
+	for (;;) {
+		w = *wp;
+		if (HASZERO(w)) {
+			break;
+		}
+		wp++;
+	}
 
-	while (str[ret]) {
-		ret++;
+	/* Find which byte of the word it was. */
+	p = (const char *)wp;
+	while (*p != 0) {
+		p++;
 	}
-	return ret;
+	return p - str;
 }
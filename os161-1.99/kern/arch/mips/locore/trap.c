@@ -36,9 +36,11 @@
 #include <spl.h>
 #include <thread.h>
 #include <current.h>
+#include <proc.h>
 #include <vm.h>
 #include <mainbus.h>
 #include <syscall.h>
+#include <trace.h>
 
 
 /* in exception.S */
@@ -194,6 +196,18 @@ mips_trap(struct trapframe *tf)
 		}
 
 		curthread->t_in_interrupt = old_in;
+
+		/*
+		 * A thread that's running user code when _exit is
+		 * called elsewhere in its process gets here on the
+		 * next timer tick. Put interrupts back on, as below,
+		 * and leave.
+		 */
+		if (!iskern && proc_isexiting(curproc)) {
+			spl = splhigh();
+			splx(spl);
+			sys___threadexit();
+		}
 		goto done2;
 	}
 
@@ -231,16 +245,19 @@ mips_trap(struct trapframe *tf)
 	 */
 	switch (code) {
 	case EX_MOD:
+		TRACE(TRACE_FAULT, VM_FAULT_READONLY, tf->tf_vaddr);
 		if (vm_fault(VM_FAULT_READONLY, tf->tf_vaddr)==0) {
 			goto done;
 		}
 		break;
 	case EX_TLBL:
+		TRACE(TRACE_FAULT, VM_FAULT_READ, tf->tf_vaddr);
 		if (vm_fault(VM_FAULT_READ, tf->tf_vaddr)==0) {
 			goto done;
 		}
 		break;
 	case EX_TLBS:
+		TRACE(TRACE_FAULT, VM_FAULT_WRITE, tf->tf_vaddr);
 		if (vm_fault(VM_FAULT_WRITE, tf->tf_vaddr)==0) {
 			goto done;
 		}
@@ -314,6 +331,11 @@ mips_trap(struct trapframe *tf)
 	panic("I can't handle this... I think I'll just die now...\n");
 
  done:
+	/* the process called _exit; don't go back to user mode */
+	if (!iskern && proc_isexiting(curproc)) {
+		sys___threadexit();
+	}
+
 	/*
 	 * Turn interrupts off on the processor, without affecting the
 	 * stored interrupt state.
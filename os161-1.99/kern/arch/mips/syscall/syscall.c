@@ -34,7 +34,10 @@
 #include <mips/trapframe.h>
 #include <thread.h>
 #include <current.h>
+#include <copyinout.h>
 #include <syscall.h>
+#include <syscallstats.h>
+#include <trace.h>
 
 
 /*
@@ -88,6 +91,10 @@ syscall(struct trapframe *tf)
 
 	callno = tf->tf_v0;
 
+	/* Start the latency clock; stopped below, or in sys___threadexit. */
+	syscallstats_enter(callno);
+	TRACE(TRACE_SYSCALL, callno, 0);
+
 	/*
 	 * Initialize retval to 0. Many of the system calls don't
 	 * really return a value, just 0 for success and -1 on
@@ -108,13 +115,104 @@ syscall(struct trapframe *tf)
 		err = sys___time((userptr_t)tf->tf_a0,
 				 (userptr_t)tf->tf_a1);
 		break;
+
+	    case SYS_getrusage:
+		err = sys_getrusage(tf->tf_a0, (userptr_t)tf->tf_a1);
+		break;
+
+	    case SYS___vmstats:
+		err = sys___vmstats((userptr_t)tf->tf_a0, tf->tf_a1,
+				    &retval);
+		break;
+
+	    case SYS___threadfork:
+		err = sys___threadfork(tf, (userptr_t)tf->tf_a0,
+				       (userptr_t)tf->tf_a1,
+				       (userptr_t)tf->tf_a2,
+				       (userptr_t)tf->tf_a3);
+		break;
+
+	    case SYS___futex_wait:
+		err = sys___futex_wait((userptr_t)tf->tf_a0, tf->tf_a1);
+		break;
+
+	    case SYS___futex_wake:
+		err = sys___futex_wake((userptr_t)tf->tf_a0, tf->tf_a1,
+				       &retval);
+		break;
+
+	    case SYS___threadexit:
+		sys___threadexit();
+		panic("unexpected return from sys___threadexit");
+		break;
+
+	    case SYS_sbrk:
+		err = sys_sbrk((intptr_t)tf->tf_a0, &retval);
+		break;
+
+	    case SYS_mmap:
+		/* fd is on the stack at sp+16; offset, being 64-bit, at sp+24 */
+		{
+			int fd;
+			off_t offset;
+
+			err = copyin((const_userptr_t)(tf->tf_sp + 16),
+				     &fd, sizeof(fd));
+			if (err) {
+				break;
+			}
+			err = copyin((const_userptr_t)(tf->tf_sp + 24),
+				     &offset, sizeof(offset));
+			if (err) {
+				break;
+			}
+			err = sys_mmap((userptr_t)tf->tf_a0, tf->tf_a1,
+				       tf->tf_a2, tf->tf_a3, fd, offset,
+				       &retval);
+		}
+		break;
+
+	    case SYS_munmap:
+		err = sys_munmap((userptr_t)tf->tf_a0, tf->tf_a1);
+		break;
+
+	    case SYS_msync:
+		err = sys_msync((userptr_t)tf->tf_a0, tf->tf_a1, tf->tf_a2);
+		break;
 #ifdef UW
+	case SYS_open:
+	  err = sys_open((userptr_t)tf->tf_a0,
+			 (int)tf->tf_a1,
+			 (int)tf->tf_a2,
+			 (int *)(&retval));
+	  break;
+	case SYS_fstat:
+	  err = sys_fstat((int)tf->tf_a0,
+			  (userptr_t)tf->tf_a1);
+	  break;
 	case SYS_write:
 	  err = sys_write((int)tf->tf_a0,
 			  (userptr_t)tf->tf_a1,
 			  (int)tf->tf_a2,
 			  (int *)(&retval));
 	  break;
+	case SYS_read:
+	  err = sys_read((int)tf->tf_a0,
+			 (userptr_t)tf->tf_a1,
+			 (int)tf->tf_a2,
+			 (int *)(&retval));
+	  break;
+	case SYS_close:
+	  err = sys_close((int)tf->tf_a0);
+	  break;
+	case SYS_dup2:
+	  err = sys_dup2((int)tf->tf_a0,
+			 (int)tf->tf_a1,
+			 (int *)(&retval));
+	  break;
+	case SYS_pipe:
+	  err = sys_pipe((userptr_t)tf->tf_a0);
+	  break;
 	case SYS__exit:
 	  sys__exit((int)tf->tf_a0);
 	  /* sys__exit does not return, execution should not get here */
@@ -162,6 +260,9 @@ syscall(struct trapframe *tf)
 	
 	tf->tf_epc += 4;
 
+	TRACE(TRACE_SYSRET, callno, err);
+	syscallstats_leave();
+
 	/* Make sure the syscall code didn't forget to lower spl */
 	KASSERT(curthread->t_curspl == 0);
 	/* ...or leak any spinlocks */
@@ -181,3 +282,26 @@ enter_forked_process(struct trapframe *tf)
 {
 	(void)tf;
 }
+
+/*
+ * Enter user mode for a new thread in the current process.
+ *
+ * TF is a copy of the registers of the thread that called
+ * __threadfork, and must be on the new thread's kernel stack. Most of
+ * it is thrown away, but it carries things like the global pointer
+ * over to the new thread; the new thread then starts at ENTRYPOINT
+ * with ARG as its argument and STACKPTR as its stack.
+ */
+void
+enter_new_thread(struct trapframe *tf, vaddr_t entrypoint, vaddr_t arg,
+		 vaddr_t stackptr)
+{
+	tf->tf_epc = entrypoint;
+	tf->tf_a0 = arg;
+	tf->tf_sp = stackptr;
+	tf->tf_ra = 0;		/* returning from ENTRYPOINT is a bug */
+	tf->tf_v0 = 0;
+	tf->tf_a3 = 0;
+
+	mips_usermode(tf);
+}
@@ -173,6 +173,26 @@ cpu_irqonoff(void)
         SET_STATUS(xoff);
 }
 
+/*
+ * Cycle counter.
+ *
+ * Coprocessor 0 register 9 (count) increments once per cycle. It is
+ * a MIPS-II feature, but System/161 provides it.
+ */
+uint32_t
+cpu_getcycles(void)
+{
+	uint32_t x;
+
+	__asm volatile(
+		".set push;"		/* save assembler mode */
+		".set mips32;"		/* allow MIPS32 instructions */
+		"mfc0 %0,$9;"		/* x = count */
+		".set pop"		/* restore assembler mode */
+		: "=r" (x));
+	return x;
+}
+
 ////////////////////////////////////////////////////////////
 
 /*
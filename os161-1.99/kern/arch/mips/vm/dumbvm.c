@@ -29,14 +29,23 @@
 
 #include <types.h>
 #include <kern/errno.h>
+#include <kern/mman.h>
+#include <kern/stat.h>
 #include <lib.h>
 #include <spl.h>
 #include <spinlock.h>
+#include <synch.h>
 #include <proc.h>
 #include <current.h>
+#include <cpu.h>
+#include <thread.h>
+#include <uio.h>
+#include <vnode.h>
+#include <vfs.h>
 #include <mips/tlb.h>
 #include <addrspace.h>
 #include <vm.h>
+#include <uw-vmstats.h>
 
 /*
  * Dumb MIPS-only "VM system" that is intended to only be just barely
@@ -48,15 +57,72 @@
 /* under dumbvm, always have 48k of user stack */
 #define DUMBVM_STACKPAGES    12
 
+/* file mappings are placed from here up, well above the data segment */
+#define DUMBVM_MMAPBASE      0x40000000
+
+/*
+ * A file mapping: NPAGES pages from BASE, backed by VN from OFFSET.
+ * Unlike the rest of dumbvm these aren't allocated up front; each
+ * entry of mr_pages is 0 until the page is first touched, and after
+ * that its physical address, with MR_DIRTY or'd in while a MAP_SHARED
+ * page has stores that haven't been written back to the file.
+ */
+struct mmapregion {
+	vaddr_t mr_base;
+	unsigned mr_npages;
+	int mr_prot;
+	int mr_flags;
+	struct vnode *mr_vn;
+	off_t mr_offset;
+	paddr_t *mr_pages;
+	struct mmapregion *mr_next;
+};
+
+#define MR_DIRTY	0x1
+
+/*
+ * The heap runs from as_heapbase, just past the last segment, up to
+ * the break, which can go as high as DUMBVM_MMAPBASE. Its pages are
+ * only allocated when first touched, so they're found through a
+ * two-level table: as_heapdir has one entry per HEAP_TABLESPAN bytes
+ * of heap, each the physical address of a page holding the physical
+ * addresses of HEAP_TABLEENTRIES heap pages (0 for ones not touched
+ * yet), or 0 if nothing in that span has been touched.
+ */
+#define HEAP_TABLEENTRIES (PAGE_SIZE / sizeof(paddr_t))
+#define HEAP_TABLESPAN    (HEAP_TABLEENTRIES * PAGE_SIZE)
+
 /*
  * Wrap rma_stealmem in a spinlock.
  */
 static struct spinlock stealmem_lock = SPINLOCK_INITIALIZER;
 
+/*
+ * Pages given back by munmap, sbrk and exit. dumbvm can't return
+ * memory in general, but mapped file pages and heap pages are always
+ * single pages, so they go on this list and getppages hands them out
+ * again for one-page requests. The list is threaded through the first
+ * word of each page. Also protected by stealmem_lock.
+ */
+static paddr_t freepages;
+
+/*
+ * TLB shootdowns are sent one at a time, under shootdown_lock, and
+ * each CPU that gets one ups shootdown_sem after it has flushed.
+ */
+static struct lock *shootdown_lock;
+static struct semaphore *shootdown_sem;
+
 void
 vm_bootstrap(void)
 {
-	/* Do nothing. */
+	vmstats_init();
+
+	shootdown_lock = lock_create("tlb shootdown");
+	shootdown_sem = sem_create("tlb shootdown", 0);
+	if (shootdown_lock == NULL || shootdown_sem == NULL) {
+		panic("dumbvm: Out of memory for tlb shootdown\n");
+	}
 }
 
 static
@@ -67,12 +133,30 @@ getppages(unsigned long npages)
 
 	spinlock_acquire(&stealmem_lock);
 
-	addr = ram_stealmem(npages);
+	if (npages == 1 && freepages != 0) {
+		addr = freepages;
+		freepages = *(paddr_t *)PADDR_TO_KVADDR(addr);
+	}
+	else {
+		addr = ram_stealmem(npages);
+	}
 	
 	spinlock_release(&stealmem_lock);
 	return addr;
 }
 
+static
+void
+freeppage(paddr_t addr)
+{
+	KASSERT((addr & PAGE_FRAME) == addr);
+
+	spinlock_acquire(&stealmem_lock);
+	*(paddr_t *)PADDR_TO_KVADDR(addr) = freepages;
+	freepages = addr;
+	spinlock_release(&stealmem_lock);
+}
+
 /* Allocate/free some kernel-space virtual pages */
 vaddr_t 
 alloc_kpages(int npages)
@@ -93,28 +177,36 @@ free_kpages(vaddr_t addr)
 	(void)addr;
 }
 
+static void tlb_flush(void);
+
+/*
+ * Called from interprocessor_interrupt. dumbvm only ever asks for the
+ * whole TLB to go, so both of these flush everything.
+ */
 void
 vm_tlbshootdown_all(void)
 {
-	panic("dumbvm tried to do tlb shootdown?!\n");
+	tlb_flush();
+	V(shootdown_sem);
 }
 
 void
 vm_tlbshootdown(const struct tlbshootdown *ts)
 {
 	(void)ts;
-	panic("dumbvm tried to do tlb shootdown?!\n");
+	vm_tlbshootdown_all();
 }
 
+static void tlb_load(uint32_t ehi, uint32_t elo);
+static int heap_fault(struct addrspace *as, vaddr_t va);
+static int mmap_fault(struct addrspace *as, int faulttype, vaddr_t va);
+
 int
 vm_fault(int faulttype, vaddr_t faultaddress)
 {
 	vaddr_t vbase1, vtop1, vbase2, vtop2, stackbase, stacktop;
 	paddr_t paddr;
-	int i;
-	uint32_t ehi, elo;
 	struct addrspace *as;
-	int spl;
 
 	faultaddress &= PAGE_FRAME;
 
@@ -122,8 +214,10 @@ vm_fault(int faulttype, vaddr_t faultaddress)
 
 	switch (faulttype) {
 	    case VM_FAULT_READONLY:
-		/* We always create pages read-write, so we can't get this */
-		panic("dumbvm: got VM_FAULT_READONLY\n");
+		/*
+		 * Everything but file mappings is mapped read-write,
+		 * so this is a store to a mapped page; see mmap_fault.
+		 */
 	    case VM_FAULT_READ:
 	    case VM_FAULT_WRITE:
 		break;
@@ -179,32 +273,472 @@ vm_fault(int faulttype, vaddr_t faultaddress)
 	else if (faultaddress >= stackbase && faultaddress < stacktop) {
 		paddr = (faultaddress - stackbase) + as->as_stackpbase;
 	}
+	else if (faultaddress >= as->as_heapbase &&
+		 faultaddress < ROUNDUP(as->as_heaptop, PAGE_SIZE)) {
+		return heap_fault(as, faultaddress);
+	}
 	else {
-		return EFAULT;
+		return mmap_fault(as, faulttype, faultaddress);
 	}
 
 	/* make sure it's page-aligned */
 	KASSERT((paddr & PAGE_FRAME) == paddr);
 
+	/* Every page is always in memory, so every fault is a reload. */
+	vmstats_inc(VMSTAT_TLB_FAULT);
+	vmstats_inc(VMSTAT_TLB_RELOAD);
+
+	DEBUG(DB_VM, "dumbvm: 0x%x -> 0x%x\n", faultaddress, paddr);
+	tlb_load(faultaddress, paddr | TLBLO_DIRTY | TLBLO_VALID);
+	return 0;
+}
+
+/*
+ * Put a translation in a free TLB slot, or over a random one if
+ * there isn't one free.
+ */
+static
+void
+tlb_load(uint32_t ehi, uint32_t elo)
+{
+	int i, spl;
+
 	/* Disable interrupts on this CPU while frobbing the TLB. */
 	spl = splhigh();
 
 	for (i=0; i<NUM_TLB; i++) {
-		tlb_read(&ehi, &elo, i);
-		if (elo & TLBLO_VALID) {
+		uint32_t oldhi, oldlo;
+
+		tlb_read(&oldhi, &oldlo, i);
+		if (oldlo & TLBLO_VALID) {
 			continue;
 		}
-		ehi = faultaddress;
-		elo = paddr | TLBLO_DIRTY | TLBLO_VALID;
-		DEBUG(DB_VM, "dumbvm: 0x%x -> 0x%x\n", faultaddress, paddr);
 		tlb_write(ehi, elo, i);
 		splx(spl);
-		return 0;
+		vmstats_inc(VMSTAT_TLB_FAULT_FREE);
+		return;
 	}
 
-	kprintf("dumbvm: Ran out of TLB entries - cannot handle page fault\n");
+	/* No free slot; throw out a random entry. */
+	tlb_random(ehi, elo);
 	splx(spl);
-	return EFAULT;
+	vmstats_inc(VMSTAT_TLB_FAULT_REPLACE);
+}
+
+/*
+ * Invalidate this CPU's whole TLB. Other CPUs may still have
+ * translations for the same address space; see tlb_shootdown.
+ */
+static
+void
+tlb_flush(void)
+{
+	int i, spl;
+
+	/* Disable interrupts on this CPU while frobbing the TLB. */
+	spl = splhigh();
+
+	for (i=0; i<NUM_TLB; i++) {
+		tlb_write(TLBHI_INVALID(i), TLBLO_INVALID(), i);
+	}
+
+	splx(spl);
+
+	vmstats_inc(VMSTAT_TLB_INVALIDATE);
+}
+
+/*
+ * Invalidate every CPU's TLB. Threads of one process can be running
+ * on several CPUs at once, so before pages of AS are freed or cleaned
+ * every CPU has to drop them, not just this one. Doesn't return until
+ * they all have, so after this nothing can reach a page through a
+ * stale translation.
+ */
+static
+void
+tlb_shootdown(struct addrspace *as)
+{
+	struct tlbshootdown ts;
+	unsigned i, others;
+	int spl;
+
+	others = thread_numcpus() - 1;
+	if (others == 0) {
+		tlb_flush();
+		return;
+	}
+
+	ts.ts_addrspace = as;
+	ts.ts_vaddr = 0;
+
+	lock_acquire(shootdown_lock);
+
+	/* don't migrate between the broadcast and the local flush */
+	spl = splhigh();
+	ipi_tlbshootdown_broadcast(&ts);
+	tlb_flush();
+	splx(spl);
+
+	for (i=0; i<others; i++) {
+		P(shootdown_sem);
+	}
+
+	lock_release(shootdown_lock);
+}
+
+/*
+ * The heap.
+ *
+ * Everything here is done holding as_lock.
+ */
+
+/* number of entries in the heap directory */
+static
+unsigned
+heap_dirsize(struct addrspace *as)
+{
+	if (as->as_heapbase >= DUMBVM_MMAPBASE) {
+		return 0;
+	}
+	return DIVROUNDUP(DUMBVM_MMAPBASE - as->as_heapbase, HEAP_TABLESPAN);
+}
+
+/*
+ * Table slot for the heap page at VA, making the table if CREATE is
+ * set. NULL if there's no table (or no memory for one).
+ */
+static
+paddr_t *
+heap_slot(struct addrspace *as, vaddr_t va, bool create)
+{
+	unsigned d, i;
+	paddr_t pa;
+
+	KASSERT(as->as_heapdir != NULL);
+	d = (va - as->as_heapbase) / HEAP_TABLESPAN;
+	i = ((va - as->as_heapbase) % HEAP_TABLESPAN) / PAGE_SIZE;
+
+	if (as->as_heapdir[d] == 0) {
+		if (!create) {
+			return NULL;
+		}
+		pa = getppages(1);
+		if (pa == 0) {
+			return NULL;
+		}
+		bzero((void *)PADDR_TO_KVADDR(pa), PAGE_SIZE);
+		as->as_heapdir[d] = pa;
+	}
+	return (paddr_t *)PADDR_TO_KVADDR(as->as_heapdir[d]) + i;
+}
+
+/*
+ * Free the heap pages wholly at or above FROM, up to the break, and
+ * the tables that only covered them. The caller makes sure none of
+ * them are in the TLB.
+ */
+static
+void
+heap_release(struct addrspace *as, vaddr_t from)
+{
+	vaddr_t va, top;
+	paddr_t *slot;
+	unsigned d;
+
+	if (as->as_heapdir == NULL) {
+		return;
+	}
+
+	from = ROUNDUP(from, PAGE_SIZE);
+	top = ROUNDUP(as->as_heaptop, PAGE_SIZE);
+	va = from;
+	while (va < top) {
+		d = (va - as->as_heapbase) / HEAP_TABLESPAN;
+		if (as->as_heapdir[d] == 0) {
+			/* nothing in this span was ever touched */
+			va = as->as_heapbase + (d + 1) * HEAP_TABLESPAN;
+			continue;
+		}
+		slot = heap_slot(as, va, false);
+		if (*slot != 0) {
+			freeppage(*slot);
+			*slot = 0;
+		}
+		va += PAGE_SIZE;
+	}
+
+	d = DIVROUNDUP(from - as->as_heapbase, HEAP_TABLESPAN);
+	for (; d < heap_dirsize(as); d++) {
+		if (as->as_heapdir[d] != 0) {
+			freeppage(as->as_heapdir[d]);
+			as->as_heapdir[d] = 0;
+		}
+	}
+}
+
+/*
+ * Handle a fault at VA, which is in the heap. The first touch of a
+ * page is what allocates it.
+ */
+static
+int
+heap_fault(struct addrspace *as, vaddr_t va)
+{
+	paddr_t *slot;
+	paddr_t pa;
+
+	lock_acquire(as->as_lock);
+
+	/* the break might have come down while we waited */
+	if (va >= ROUNDUP(as->as_heaptop, PAGE_SIZE)) {
+		lock_release(as->as_lock);
+		return EFAULT;
+	}
+
+	slot = heap_slot(as, va, true);
+	if (slot == NULL) {
+		lock_release(as->as_lock);
+		return ENOMEM;
+	}
+
+	if (*slot == 0) {
+		pa = getppages(1);
+		if (pa == 0) {
+			lock_release(as->as_lock);
+			return ENOMEM;
+		}
+		bzero((void *)PADDR_TO_KVADDR(pa), PAGE_SIZE);
+		*slot = pa;
+		vmstats_inc(VMSTAT_TLB_FAULT);
+		vmstats_inc(VMSTAT_PAGE_FAULT_ZERO);
+	}
+	else {
+		vmstats_inc(VMSTAT_TLB_FAULT);
+		vmstats_inc(VMSTAT_TLB_RELOAD);
+	}
+
+	DEBUG(DB_VM, "dumbvm: heap 0x%x -> 0x%x\n", va, *slot);
+	tlb_load(va, *slot | TLBLO_DIRTY | TLBLO_VALID);
+
+	lock_release(as->as_lock);
+	return 0;
+}
+
+/*
+ * File mappings.
+ *
+ * as_lock is held while a mapped page is read in or written back, so
+ * faults on mappings in one address space are handled one at a time.
+ * The file system takes vfs_biglock for that I/O, and a thread that
+ * already holds vfs_biglock can fault on a mapping while copying to
+ * or from user space. So vfs_biglock always comes first: mmap_fault
+ * and as_msync take it before as_lock (it's recursive, so holding it
+ * already is fine), and nothing takes it while holding as_lock.
+ *
+ * Since any copy to or from user space can end up here waiting for
+ * vfs_biglock, no lock that is taken with vfs_biglock held (as
+ * VOP_RECLAIM is called, for instance) may be held across such a
+ * copy. That's why pipe.c drops pp_lock around its uiomoves.
+ */
+
+/* the mapping containing VA, or NULL */
+static
+struct mmapregion *
+mmap_find(struct addrspace *as, vaddr_t va)
+{
+	struct mmapregion *mr;
+
+	for (mr = as->as_mmaps; mr != NULL; mr = mr->mr_next) {
+		if (va < mr->mr_base) {
+			break;
+		}
+		if (va - mr->mr_base < mr->mr_npages * PAGE_SIZE) {
+			return mr;
+		}
+	}
+	return NULL;
+}
+
+/* read page I of MR in from the file; past EOF it reads as zeros */
+static
+int
+mmap_loadpage(struct mmapregion *mr, unsigned i)
+{
+	struct iovec iov;
+	struct uio u;
+	paddr_t pa;
+	int result;
+
+	pa = getppages(1);
+	if (pa == 0) {
+		return ENOMEM;
+	}
+	bzero((void *)PADDR_TO_KVADDR(pa), PAGE_SIZE);
+
+	uio_kinit(&iov, &u, (void *)PADDR_TO_KVADDR(pa), PAGE_SIZE,
+		  mr->mr_offset + (off_t)i * PAGE_SIZE, UIO_READ);
+	result = VOP_READ(mr->mr_vn, &u);
+	if (result) {
+		freeppage(pa);
+		return result;
+	}
+	/* the only file reads dumbvm counts, so they count as ELF reads */
+	vmstats_inc(VMSTAT_PAGE_FAULT_DISK);
+	vmstats_inc(VMSTAT_ELF_FILE_READ);
+
+	mr->mr_pages[i] = pa;
+	return 0;
+}
+
+/*
+ * Write page I of MR back if it's dirty. Only the part that lies
+ * within the file goes out: as with any mmap, storing past EOF
+ * doesn't make the file bigger.
+ *
+ * Pages belong to one mapping, not to the vnode, so MAP_SHARED isn't
+ * coherent: the whole page goes out and replaces whatever other
+ * mappings or write() put there meanwhile (see mmap(2)).
+ */
+static
+int
+mmap_writepage(struct mmapregion *mr, unsigned i)
+{
+	struct iovec iov;
+	struct uio u;
+	struct stat st;
+	paddr_t pa;
+	off_t pos;
+	size_t len;
+	int result;
+
+	if ((mr->mr_pages[i] & MR_DIRTY) == 0) {
+		return 0;
+	}
+	pa = mr->mr_pages[i] & PAGE_FRAME;
+
+	result = VOP_STAT(mr->mr_vn, &st);
+	if (result) {
+		return result;
+	}
+	pos = mr->mr_offset + (off_t)i * PAGE_SIZE;
+	if (pos < st.st_size) {
+		len = PAGE_SIZE;
+		if (st.st_size - pos < PAGE_SIZE) {
+			len = st.st_size - pos;
+		}
+		uio_kinit(&iov, &u, (void *)PADDR_TO_KVADDR(pa), len,
+			  pos, UIO_WRITE);
+		result = VOP_WRITE(mr->mr_vn, &u);
+		if (result) {
+			return result;
+		}
+	}
+
+	mr->mr_pages[i] = pa;
+	return 0;
+}
+
+/*
+ * Free a mapping that's no longer on any list (and so can't be in
+ * the TLB either), writing back whatever it has that's dirty.
+ * Write-back errors are dropped; there's nobody left to tell.
+ */
+static
+void
+mmap_destroy(struct mmapregion *mr)
+{
+	unsigned i;
+
+	for (i=0; i<mr->mr_npages; i++) {
+		if (mr->mr_pages[i] == 0) {
+			continue;
+		}
+		(void)mmap_writepage(mr, i);
+		freeppage(mr->mr_pages[i] & PAGE_FRAME);
+	}
+	VOP_DECREF(mr->mr_vn);
+	kfree(mr->mr_pages);
+	kfree(mr);
+}
+
+/*
+ * Handle a fault at VA, which isn't in a segment or the stack. The
+ * first touch of a page reads it from the file. Pages of writable
+ * MAP_SHARED mappings are entered read-only until the first store,
+ * so the VM_FAULT_READONLY that store takes is what marks the page
+ * dirty; a page nobody writes is never written back.
+ */
+static
+int
+mmap_fault(struct addrspace *as, int faulttype, vaddr_t va)
+{
+	struct mmapregion *mr;
+	unsigned i;
+	uint32_t elo;
+	bool reload;
+	int result, spl, slot;
+
+	vfs_biglock_acquire();
+	lock_acquire(as->as_lock);
+
+	mr = mmap_find(as, va);
+	if (mr == NULL || mr->mr_prot == PROT_NONE ||
+	    (faulttype != VM_FAULT_READ && (mr->mr_prot & PROT_WRITE) == 0)) {
+		lock_release(as->as_lock);
+		vfs_biglock_release();
+		return EFAULT;
+	}
+	i = (va - mr->mr_base) / PAGE_SIZE;
+
+	reload = mr->mr_pages[i] != 0;
+	if (!reload) {
+		result = mmap_loadpage(mr, i);
+		if (result) {
+			lock_release(as->as_lock);
+			vfs_biglock_release();
+			return result;
+		}
+	}
+
+	elo = (mr->mr_pages[i] & PAGE_FRAME) | TLBLO_VALID;
+	if (mr->mr_prot & PROT_WRITE) {
+		if (mr->mr_flags & MAP_PRIVATE) {
+			elo |= TLBLO_DIRTY;
+		}
+		else if (faulttype != VM_FAULT_READ ||
+			 (mr->mr_pages[i] & MR_DIRTY)) {
+			mr->mr_pages[i] |= MR_DIRTY;
+			elo |= TLBLO_DIRTY;
+		}
+	}
+	DEBUG(DB_VM, "dumbvm: mapped 0x%x -> 0x%x\n", va, elo & TLBLO_PPAGE);
+
+	if (faulttype == VM_FAULT_READONLY) {
+		/*
+		 * The read-only entry is still there; upgrade it in place.
+		 * That's not a TLB miss, so it isn't counted as one.
+		 */
+		spl = splhigh();
+		slot = tlb_probe(va, 0);
+		if (slot >= 0) {
+			tlb_write(va, elo, slot);
+			splx(spl);
+			lock_release(as->as_lock);
+			vfs_biglock_release();
+			return 0;
+		}
+		splx(spl);
+	}
+
+	vmstats_inc(VMSTAT_TLB_FAULT);
+	if (reload) {
+		vmstats_inc(VMSTAT_TLB_RELOAD);
+	}
+	tlb_load(va, elo);
+
+	lock_release(as->as_lock);
+	vfs_biglock_release();
+	return 0;
 }
 
 struct addrspace *
@@ -222,6 +756,16 @@ as_create(void)
 	as->as_pbase2 = 0;
 	as->as_npages2 = 0;
 	as->as_stackpbase = 0;
+	as->as_heapbase = 0;
+	as->as_heaptop = 0;
+	as->as_heapdir = NULL;
+	as->as_mmaps = NULL;
+
+	as->as_lock = lock_create("addrspace");
+	if (as->as_lock == NULL) {
+		kfree(as);
+		return NULL;
+	}
 
 	return as;
 }
@@ -229,13 +773,25 @@ as_create(void)
 void
 as_destroy(struct addrspace *as)
 {
+	struct mmapregion *mr;
+
+	/* this is where MAP_SHARED stores reach the file on exit */
+	while (as->as_mmaps != NULL) {
+		mr = as->as_mmaps;
+		as->as_mmaps = mr->mr_next;
+		mmap_destroy(mr);
+	}
+	if (as->as_heapdir != NULL) {
+		heap_release(as, as->as_heapbase);
+		kfree(as->as_heapdir);
+	}
+	lock_destroy(as->as_lock);
 	kfree(as);
 }
 
 void
 as_activate(void)
 {
-	int i, spl;
 	struct addrspace *as;
 
 	as = curproc_getas();
@@ -246,14 +802,7 @@ as_activate(void)
 		return;
 	}
 
-	/* Disable interrupts on this CPU while frobbing the TLB. */
-	spl = splhigh();
-
-	for (i=0; i<NUM_TLB; i++) {
-		tlb_write(TLBHI_INVALID(i), TLBLO_INVALID(), i);
-	}
-
-	splx(spl);
+	tlb_flush();
 }
 
 void
@@ -340,7 +889,13 @@ as_prepare_load(struct addrspace *as)
 int
 as_complete_load(struct addrspace *as)
 {
-	(void)as;
+	vaddr_t top1, top2;
+
+	/* the heap starts out empty, just past the higher segment */
+	top1 = as->as_vbase1 + as->as_npages1 * PAGE_SIZE;
+	top2 = as->as_vbase2 + as->as_npages2 * PAGE_SIZE;
+	as->as_heapbase = top1 > top2 ? top1 : top2;
+	as->as_heaptop = as->as_heapbase;
 	return 0;
 }
 
@@ -353,10 +908,17 @@ as_define_stack(struct addrspace *as, vaddr_t *stackptr)
 	return 0;
 }
 
+/*
+ * File mappings are not copied; nothing forks yet.
+ */
 int
 as_copy(struct addrspace *old, struct addrspace **ret)
 {
 	struct addrspace *new;
+	paddr_t *oldslot, *newslot;
+	paddr_t pa;
+	vaddr_t va;
+	unsigned d;
 
 	new = as_create();
 	if (new==NULL) {
@@ -389,7 +951,332 @@ as_copy(struct addrspace *old, struct addrspace **ret)
 	memmove((void *)PADDR_TO_KVADDR(new->as_stackpbase),
 		(const void *)PADDR_TO_KVADDR(old->as_stackpbase),
 		DUMBVM_STACKPAGES*PAGE_SIZE);
+
+	/* the heap: just the pages that have been touched */
+	lock_acquire(old->as_lock);
+	new->as_heapbase = old->as_heapbase;
+	new->as_heaptop = old->as_heaptop;
+	if (old->as_heapdir != NULL) {
+		new->as_heapdir = kmalloc(heap_dirsize(old) * sizeof(paddr_t));
+		if (new->as_heapdir == NULL) {
+			lock_release(old->as_lock);
+			as_destroy(new);
+			return ENOMEM;
+		}
+		bzero(new->as_heapdir, heap_dirsize(old) * sizeof(paddr_t));
+
+		va = old->as_heapbase;
+		while (va < ROUNDUP(old->as_heaptop, PAGE_SIZE)) {
+			d = (va - old->as_heapbase) / HEAP_TABLESPAN;
+			if (old->as_heapdir[d] == 0) {
+				va = old->as_heapbase + (d + 1) * HEAP_TABLESPAN;
+				continue;
+			}
+			oldslot = heap_slot(old, va, false);
+			if (*oldslot != 0) {
+				newslot = heap_slot(new, va, true);
+				pa = newslot == NULL ? 0 : getppages(1);
+				if (pa == 0) {
+					lock_release(old->as_lock);
+					as_destroy(new);
+					return ENOMEM;
+				}
+				memmove((void *)PADDR_TO_KVADDR(pa),
+					(const void *)PADDR_TO_KVADDR(*oldslot),
+					PAGE_SIZE);
+				*newslot = pa;
+			}
+			va += PAGE_SIZE;
+		}
+	}
+	lock_release(old->as_lock);
 	
 	*ret = new;
 	return 0;
 }
+
+/*
+ * Is [BASE, BASE+SIZE) clear of the segments, the heap, the stack and
+ * every mapping? SIZE is nonzero.
+ */
+static
+bool
+as_rangefree(struct addrspace *as, vaddr_t base, size_t size)
+{
+	struct mmapregion *mr;
+	vaddr_t stackbase;
+
+	stackbase = USERSTACK - DUMBVM_STACKPAGES * PAGE_SIZE;
+	if (base == 0 || base > stackbase || size > stackbase - base) {
+		return false;
+	}
+
+#define OVERLAPS(b, n) (base < (b) + (n) * PAGE_SIZE && (b) < base + size)
+	if (OVERLAPS(as->as_vbase1, as->as_npages1) ||
+	    OVERLAPS(as->as_vbase2, as->as_npages2) ||
+	    OVERLAPS(as->as_heapbase,
+		     DIVROUNDUP(as->as_heaptop - as->as_heapbase, PAGE_SIZE))) {
+		return false;
+	}
+	for (mr = as->as_mmaps; mr != NULL; mr = mr->mr_next) {
+		if (OVERLAPS(mr->mr_base, mr->mr_npages)) {
+			return false;
+		}
+	}
+#undef OVERLAPS
+	return true;
+}
+
+int
+as_mmap(struct addrspace *as, vaddr_t hint, size_t len, int prot, int flags,
+	struct vnode *v, off_t offset, vaddr_t *ret)
+{
+	struct mmapregion *mr, **pp;
+	size_t size;
+	vaddr_t base;
+	unsigned i;
+
+	if (len == 0 || len > USERSPACETOP || offset < 0 ||
+	    offset % PAGE_SIZE != 0) {
+		return EINVAL;
+	}
+	if ((flags & (MAP_SHARED|MAP_PRIVATE)) == 0 ||
+	    (flags & (MAP_SHARED|MAP_PRIVATE)) == (MAP_SHARED|MAP_PRIVATE)) {
+		return EINVAL;
+	}
+	if ((flags & MAP_FIXED) && (hint & PAGE_FRAME) != hint) {
+		return EINVAL;
+	}
+	size = (len + PAGE_SIZE - 1) & PAGE_FRAME;
+
+	mr = kmalloc(sizeof(*mr));
+	if (mr == NULL) {
+		return ENOMEM;
+	}
+	mr->mr_npages = size / PAGE_SIZE;
+	mr->mr_prot = prot;
+	mr->mr_flags = flags;
+	mr->mr_vn = v;
+	mr->mr_offset = offset;
+	mr->mr_pages = kmalloc(mr->mr_npages * sizeof(paddr_t));
+	if (mr->mr_pages == NULL) {
+		kfree(mr);
+		return ENOMEM;
+	}
+	for (i=0; i<mr->mr_npages; i++) {
+		mr->mr_pages[i] = 0;
+	}
+
+	lock_acquire(as->as_lock);
+
+	if (flags & MAP_FIXED) {
+		/* we don't replace existing mappings; munmap them first */
+		base = hint;
+		if (!as_rangefree(as, base, size)) {
+			lock_release(as->as_lock);
+			kfree(mr->mr_pages);
+			kfree(mr);
+			return EINVAL;
+		}
+	}
+	else {
+		/* first fit, going up from DUMBVM_MMAPBASE */
+		base = DUMBVM_MMAPBASE;
+		for (pp = &as->as_mmaps; *pp != NULL; pp = &(*pp)->mr_next) {
+			if ((*pp)->mr_base >= base &&
+			    (*pp)->mr_base - base >= size) {
+				break;
+			}
+			if ((*pp)->mr_base + (*pp)->mr_npages * PAGE_SIZE > base) {
+				base = (*pp)->mr_base +
+					(*pp)->mr_npages * PAGE_SIZE;
+			}
+		}
+		if (!as_rangefree(as, base, size)) {
+			lock_release(as->as_lock);
+			kfree(mr->mr_pages);
+			kfree(mr);
+			return ENOMEM;
+		}
+	}
+	mr->mr_base = base;
+
+	/* keep the list sorted */
+	for (pp = &as->as_mmaps; *pp != NULL; pp = &(*pp)->mr_next) {
+		if ((*pp)->mr_base > base) {
+			break;
+		}
+	}
+	mr->mr_next = *pp;
+	*pp = mr;
+	VOP_INCREF(v);
+
+	lock_release(as->as_lock);
+
+	*ret = base;
+	return 0;
+}
+
+/*
+ * Mappings have to be removed whole; one that sticks out of the range
+ * makes the call fail with nothing removed.
+ */
+int
+as_munmap(struct addrspace *as, vaddr_t addr, size_t len)
+{
+	struct mmapregion *mr, **pp, *gone;
+	vaddr_t top;
+
+	if ((addr & PAGE_FRAME) != addr || len == 0 ||
+	    len > USERSPACETOP - addr) {
+		return EINVAL;
+	}
+	top = (addr + len + PAGE_SIZE - 1) & PAGE_FRAME;
+
+	lock_acquire(as->as_lock);
+
+	for (mr = as->as_mmaps; mr != NULL; mr = mr->mr_next) {
+		if (mr->mr_base < top &&
+		    addr < mr->mr_base + mr->mr_npages * PAGE_SIZE &&
+		    (mr->mr_base < addr ||
+		     mr->mr_base + mr->mr_npages * PAGE_SIZE > top)) {
+			lock_release(as->as_lock);
+			return EINVAL;
+		}
+	}
+
+	gone = NULL;
+	pp = &as->as_mmaps;
+	while (*pp != NULL) {
+		mr = *pp;
+		if (mr->mr_base >= addr && mr->mr_base < top) {
+			*pp = mr->mr_next;
+			mr->mr_next = gone;
+			gone = mr;
+		}
+		else {
+			pp = &mr->mr_next;
+		}
+	}
+	if (gone != NULL) {
+		tlb_shootdown(as);
+	}
+
+	lock_release(as->as_lock);
+
+	/* nobody can find these any more, so write them back unlocked */
+	while (gone != NULL) {
+		mr = gone;
+		gone = mr->mr_next;
+		mmap_destroy(mr);
+	}
+	return 0;
+}
+
+int
+as_msync(struct addrspace *as, vaddr_t addr, size_t len)
+{
+	struct mmapregion *mr;
+	vaddr_t top, va;
+	unsigned i;
+	int result, err;
+
+	if ((addr & PAGE_FRAME) != addr || len > USERSPACETOP - addr) {
+		return EINVAL;
+	}
+	top = addr + len;
+
+	/* same order as mmap_fault */
+	vfs_biglock_acquire();
+	lock_acquire(as->as_lock);
+
+	/*
+	 * Clean pages are entered read-only, so once the TLB is empty a
+	 * store to anything we write back faults, waits for as_lock, and
+	 * marks the page dirty again after we're done.
+	 */
+	tlb_shootdown(as);
+
+	err = 0;
+	for (mr = as->as_mmaps; mr != NULL; mr = mr->mr_next) {
+		if ((mr->mr_flags & MAP_SHARED) == 0) {
+			continue;
+		}
+		for (i=0; i<mr->mr_npages; i++) {
+			va = mr->mr_base + i * PAGE_SIZE;
+			if (va + PAGE_SIZE <= addr || va >= top ||
+			    mr->mr_pages[i] == 0) {
+				continue;
+			}
+			result = mmap_writepage(mr, i);
+			if (result && err == 0) {
+				err = result;
+			}
+		}
+	}
+
+	lock_release(as->as_lock);
+	vfs_biglock_release();
+	return err;
+}
+
+/*
+ * The break can be anywhere, not just on a page boundary. Growing
+ * only moves it (and makes the heap directory the first time); the
+ * pages come one at a time from heap_fault. Shrinking frees the
+ * pages that end up wholly above it.
+ */
+int
+as_sbrk(struct addrspace *as, intptr_t amount, vaddr_t *oldbreak)
+{
+	vaddr_t old, new, oldpages, newpages;
+	unsigned dirsize;
+
+	lock_acquire(as->as_lock);
+	old = as->as_heaptop;
+
+	if (amount >= 0) {
+		if (old >= DUMBVM_MMAPBASE ||
+		    (vaddr_t)amount > DUMBVM_MMAPBASE - old) {
+			lock_release(as->as_lock);
+			return ENOMEM;
+		}
+		new = old + amount;
+
+		/* don't grow into a mapping placed there with MAP_FIXED */
+		oldpages = ROUNDUP(old, PAGE_SIZE);
+		newpages = ROUNDUP(new, PAGE_SIZE);
+		if (newpages > oldpages &&
+		    !as_rangefree(as, oldpages, newpages - oldpages)) {
+			lock_release(as->as_lock);
+			return ENOMEM;
+		}
+
+		if (as->as_heapdir == NULL && new > as->as_heapbase) {
+			dirsize = heap_dirsize(as);
+			as->as_heapdir = kmalloc(dirsize * sizeof(paddr_t));
+			if (as->as_heapdir == NULL) {
+				lock_release(as->as_lock);
+				return ENOMEM;
+			}
+			bzero(as->as_heapdir, dirsize * sizeof(paddr_t));
+		}
+	}
+	else {
+		if ((vaddr_t)0 - (vaddr_t)amount > old - as->as_heapbase) {
+			lock_release(as->as_lock);
+			return EINVAL;
+		}
+		new = old + amount;
+
+		/* no stale translations to what's about to be freed */
+		tlb_shootdown(as);
+		heap_release(as, new);
+	}
+	as->as_heaptop = new;
+
+	lock_release(as->as_lock);
+
+	*oldbreak = old;
+	return 0;
+}
@@ -30,6 +30,7 @@
 #include <types.h>
 #include <kern/unistd.h>
 #include <lib.h>
+#include <mips/specialreg.h>
 #include <mips/trapframe.h>
 #include <cpu.h>
 #include <spl.h>
@@ -38,6 +39,7 @@
 #include <current.h>
 #include <synch.h>
 #include <mainbus.h>
+#include <prof.h>
 #include <sys161/bus.h>
 #include <lamebus/lamebus.h>
 #include "autoconf.h"
@@ -116,6 +118,15 @@ mainbus_bootstrap(void)
 	mips_timer_set(CPU_FREQUENCY / HZ);
 }
 
+/*
+ * Convert cycles of the CPU clock to nanoseconds.
+ */
+uint64_t
+mainbus_cyclestons(uint64_t cycles)
+{
+	return cycles * (1000000000 / CPU_FREQUENCY);
+}
+
 /*
  * Start all secondary CPUs.
  */
@@ -270,6 +281,10 @@ mainbus_interrupt(struct trapframe *tf)
 	else if (cause & MIPS_TIMER_BIT) {
 		/* Reset the timer (this clears the interrupt) */
 		mips_timer_set(CPU_FREQUENCY / HZ);
+		/* take a profiling sample of where we were */
+		prof_sample(tf->tf_epc, (tf->tf_status & CST_KUp) != 0);
+		/* charge the tick to whoever was running */
+		thread_accounttick((tf->tf_status & CST_KUp) != 0);
 		/* and call hardclock */
 		hardclock();
 	}
@@ -48,6 +48,13 @@
  *
  * Note that we have no input buffering; characters typed too rapidly
  * will be lost.
+ *
+ * Output, on the other hand, is buffered: in interrupt mode putch
+ * queues the character and returns, and con_start, called from the
+ * device's write-done interrupt, feeds the next queued character to
+ * the device. Writers only wait when the queue is full. Polled output
+ * (from interrupt handlers, with interrupts off, or during panic)
+ * drains the queue first so that output stays in order.
  */
 
 #include <types.h>
@@ -111,14 +118,68 @@ flush_delay_buf(void)
 
 //////////////////////////////////////////////////
 
+/*
+ * Output queue. These must be called with cs_outlock held.
+ */
+static
+bool
+con_outq_isempty(struct con_softc *cs)
+{
+	return cs->cs_outchars_head == cs->cs_outchars_tail;
+}
+
+static
+void
+con_outq_add(struct con_softc *cs, int ch)
+{
+	cs->cs_outchars[cs->cs_outchars_head] = ch;
+	cs->cs_outchars_head =
+		(cs->cs_outchars_head + 1) % CONSOLE_OUTPUT_BUFFER_SIZE;
+	/* cs_wsem keeps writers from overrunning the queue */
+	KASSERT(!con_outq_isempty(cs));
+}
+
+static
+int
+con_outq_rem(struct con_softc *cs)
+{
+	unsigned char ch;
+
+	ch = cs->cs_outchars[cs->cs_outchars_tail];
+	cs->cs_outchars_tail =
+		(cs->cs_outchars_tail + 1) % CONSOLE_OUTPUT_BUFFER_SIZE;
+	return ch;
+}
+
+//////////////////////////////////////////////////
+
 /*
  * Print a character, using polling instead of interrupts to wait for
  * I/O completion.
+ *
+ * Anything still sitting in the output queue has to go out first.
+ * If we already hold cs_outlock we're panicking from inside the
+ * console code itself; in that case just print, rather than
+ * deadlock.
  */
 static
 void
 putch_polled(struct con_softc *cs, int ch)
 {
+	unsigned drained = 0;
+
+	if (!spinlock_do_i_hold(&cs->cs_outlock)) {
+		spinlock_acquire(&cs->cs_outlock);
+		while (!con_outq_isempty(cs)) {
+			cs->cs_sendpolled(cs->cs_devdata, con_outq_rem(cs));
+			drained++;
+		}
+		spinlock_release(&cs->cs_outlock);
+	}
+	while (drained-- > 0) {
+		V(cs->cs_wsem);
+	}
+
 	cs->cs_sendpolled(cs->cs_devdata, ch);
 }
 
@@ -144,13 +205,36 @@ putch_complete_polled(struct con_softc *cs)
 
 /*
  * Print a character, using interrupts to wait for I/O completion.
+ *
+ * If the device is idle, hand it the character directly; otherwise
+ * queue it for con_start. Either way, wait only for queue space, not
+ * for the character to actually go out.
  */
 static
 void
 putch_intr(struct con_softc *cs, int ch)
 {
+	bool direct;
+
 	P(cs->cs_wsem);
-	cs->cs_send(cs->cs_devdata, ch);
+
+	spinlock_acquire(&cs->cs_outlock);
+	if (cs->cs_outbusy) {
+		con_outq_add(cs, ch);
+		direct = false;
+	}
+	else {
+		KASSERT(con_outq_isempty(cs));
+		cs->cs_outbusy = true;
+		cs->cs_send(cs->cs_devdata, ch);
+		direct = true;
+	}
+	spinlock_release(&cs->cs_outlock);
+
+	if (direct) {
+		/* didn't use the queue slot after all */
+		V(cs->cs_wsem);
+	}
 }
 
 /*
@@ -198,13 +282,27 @@ con_input(void *vcs, int ch)
 
 /*
  * Called from underlying device when a write-done interrupt occurs.
+ * Send the next queued character, if any.
  */
 void
 con_start(void *vcs)
 {
 	struct con_softc *cs = vcs;
+	bool sent = false;
 
-	V(cs->cs_wsem);
+	spinlock_acquire(&cs->cs_outlock);
+	if (con_outq_isempty(cs)) {
+		cs->cs_outbusy = false;
+	}
+	else {
+		cs->cs_send(cs->cs_devdata, con_outq_rem(cs));
+		sent = true;
+	}
+	spinlock_release(&cs->cs_outlock);
+
+	if (sent) {
+		V(cs->cs_wsem);
+	}
 }
 
 //////////////////////////////////////////////////
@@ -298,12 +396,20 @@ con_close(struct device *dev)
 	return 0;
 }
 
+/*
+ * Size of the chunks user output is copied in with. This saves a
+ * uiomove (and a copyin) per character.
+ */
+#define CON_WRITE_CHUNK 128
+
 static
 int
 con_io(struct device *dev, struct uio *uio)
 {
 	int result;
 	char ch;
+	char buf[CON_WRITE_CHUNK];
+	size_t len, i;
 	struct lock *lk;
 
 	(void)dev;  // unused
@@ -334,15 +440,21 @@ con_io(struct device *dev, struct uio *uio)
 			}
 		}
 		else {
-			result = uiomove(&ch, 1, uio);
+			len = uio->uio_resid;
+			if (len > sizeof(buf)) {
+				len = sizeof(buf);
+			}
+			result = uiomove(buf, len, uio);
 			if (result) {
 				lock_release(lk);
 				return result;
 			}
-			if (ch=='\n') {
-				putch('\r');
+			for (i=0; i<len; i++) {
+				if (buf[i]=='\n') {
+					putch('\r');
+				}
+				putch(buf[i]);
 			}
-			putch(ch);
 		}
 	}
 	lock_release(lk);
@@ -418,7 +530,8 @@ config_con(struct con_softc *cs, int unit)
 	if (rsem == NULL) {
 		return ENOMEM;
 	}
-	wsem = sem_create("console write", 1);
+	/* head==tail means empty, so the queue holds one less than its size */
+	wsem = sem_create("console write", CONSOLE_OUTPUT_BUFFER_SIZE - 1);
 	if (wsem == NULL) {
 		sem_destroy(rsem);
 		return ENOMEM;
@@ -441,6 +554,10 @@ config_con(struct con_softc *cs, int unit)
 	cs->cs_wsem = wsem; 
 	cs->cs_gotchars_head = 0;
 	cs->cs_gotchars_tail = 0;
+	spinlock_init(&cs->cs_outlock);
+	cs->cs_outbusy = false;
+	cs->cs_outchars_head = 0;
+	cs->cs_outchars_tail = 0;
 
 	the_console = cs;
 	con_userlock_read = rlk;
@@ -35,9 +35,17 @@
  *
  * devdata, send, and sendpolled are provided by the underlying
  * device, and are to be initialized by the attach routine.
+ *
+ * Output in interrupt mode is queued in cs_outchars and fed to the
+ * device one character at a time from the write-done interrupt, so
+ * writers only block when the queue is full. cs_wsem counts free
+ * slots in the queue.
  */
 
+#include <spinlock.h>
+
 #define CONSOLE_INPUT_BUFFER_SIZE 32
+#define CONSOLE_OUTPUT_BUFFER_SIZE 1024
 
 struct con_softc {
 	/* initialized by attach routine */
@@ -53,6 +61,11 @@ struct con_softc {
 	unsigned char cs_gotchars[CONSOLE_INPUT_BUFFER_SIZE];
 	unsigned cs_gotchars_head;	/* next slot to put a char in */
 	unsigned cs_gotchars_tail;	/* next slot to take a char out */
+	struct spinlock cs_outlock;	/* protects the fields below */
+	bool cs_outbusy;		/* device is sending a char */
+	unsigned char cs_outchars[CONSOLE_OUTPUT_BUFFER_SIZE];
+	unsigned cs_outchars_head;	/* next slot to put a char in */
+	unsigned cs_outchars_tail;	/* next slot to take a char out */
 };
 
 /*
@@ -38,6 +38,18 @@
  * This makes it unnecessary to copy the system files to the simulated
  * disk, although we recommend doing so and trying running without this
  * device as part of testing your filesystem.
+ *
+ * Every trip through the "hardware" is slow, so file contents are
+ * cached a page at a time, and file sizes are cached too. Writes go
+ * into the cache and are written back at fsync, sync, or when the
+ * vnode is reclaimed (or when the page is recycled). Recently used
+ * files are kept loaded after their last close so that, for example,
+ * running the same program twice only reads it from the host once.
+ *
+ * The cache does not know about changes made on the host side behind
+ * our back. As a cheap check, opening a file with no dirty pages
+ * compares the host's idea of its size against ours and throws the
+ * cached pages away if they differ.
  */
 
 #include <types.h>
@@ -48,6 +60,7 @@
 #include <array.h>
 #include <uio.h>
 #include <synch.h>
+#include <vm.h>
 #include <lamebus/emu.h>
 #include <platform/bus.h>
 #include <vfs.h>
@@ -389,6 +402,429 @@ emu_trunc(struct emu_softc *sc, uint32_t handle, off_t len)
 //
 ////////////////////////////////////////////////////////////
 
+////////////////////////////////////////////////////////////
+//
+// Page cache
+//
+// All of this is called with ef_cachelock held. The hardware ops
+// above take e_lock themselves, so the lock order is vfs_biglock,
+// then ef_cachelock, then e_lock.
+//
+
+/* Most pages moved in one hardware operation */
+#define EMUFS_CLUSTER  (EMU_MAXIO / PAGE_SIZE)
+
+/* Bucket in ef_vnodes. Handles are small integers; the low bits do. */
+#define EMUFS_HASH(handle)  ((handle) & (EMUFS_VNODEHASH - 1))
+
+static
+struct emufs_fs *
+emufs_getfs(struct emufs_vnode *ev)
+{
+	return ev->ev_v.vn_fs->fs_data;
+}
+
+/*
+ * LRU list maintenance. The head is the most recently used page.
+ */
+static
+void
+emufs_lru_remove(struct emufs_fs *ef, struct emufs_page *ep)
+{
+	if (ep->ep_prev != NULL) {
+		ep->ep_prev->ep_next = ep->ep_next;
+	}
+	else {
+		ef->ef_lrutail = ep->ep_next;
+	}
+	if (ep->ep_next != NULL) {
+		ep->ep_next->ep_prev = ep->ep_prev;
+	}
+	else {
+		ef->ef_lruhead = ep->ep_prev;
+	}
+	ep->ep_next = ep->ep_prev = NULL;
+}
+
+static
+void
+emufs_lru_add(struct emufs_fs *ef, struct emufs_page *ep)
+{
+	ep->ep_next = NULL;
+	ep->ep_prev = ef->ef_lruhead;
+	if (ef->ef_lruhead != NULL) {
+		ef->ef_lruhead->ep_next = ep;
+	}
+	else {
+		ef->ef_lrutail = ep;
+	}
+	ef->ef_lruhead = ep;
+}
+
+/*
+ * Move a run of N pages of one file (consecutive page numbers,
+ * starting with pages[0]) to or from the host, in one hardware
+ * operation where possible. Reads zero whatever part of the pages
+ * lies past the end of the host's copy of the file; writes stop at
+ * our idea of the end of the file.
+ */
+static
+int
+emufs_pageio(struct emufs_vnode *ev, struct emufs_page **pages, unsigned n,
+	     enum uio_rw rw)
+{
+	struct iovec iov[EMUFS_CLUSTER];
+	struct uio ku;
+	off_t start;
+	size_t len, done, pos, oldresid;
+	unsigned i;
+	int result;
+
+	KASSERT(n > 0 && n <= EMUFS_CLUSTER);
+
+	start = (off_t)pages[0]->ep_pageno * PAGE_SIZE;
+	len = n * PAGE_SIZE;
+	if (rw == UIO_WRITE) {
+		KASSERT(ev->ev_sizevalid && ev->ev_size > start);
+		if (start + len > ev->ev_size) {
+			len = ev->ev_size - start;
+		}
+	}
+
+	for (i=0; i<n; i++) {
+		iov[i].iov_kbase = pages[i]->ep_data;
+		iov[i].iov_len = PAGE_SIZE;
+	}
+	ku.uio_iov = iov;
+	ku.uio_iovcnt = n;
+	ku.uio_offset = start;
+	ku.uio_resid = len;
+	ku.uio_segflg = UIO_SYSSPACE;
+	ku.uio_rw = rw;
+	ku.uio_space = NULL;
+
+	while (ku.uio_resid > 0) {
+		oldresid = ku.uio_resid;
+		if (rw == UIO_READ) {
+			result = emu_read(ev->ev_emu, ev->ev_handle,
+					  ku.uio_resid, &ku);
+		}
+		else {
+			result = emu_write(ev->ev_emu, ev->ev_handle,
+					   ku.uio_resid, &ku);
+		}
+		if (result) {
+			return result;
+		}
+		if (ku.uio_resid == oldresid) {
+			if (rw == UIO_WRITE) {
+				/* host wrote nothing; don't lose the data */
+				return EIO;
+			}
+			/* EOF */
+			break;
+		}
+	}
+
+	if (rw == UIO_READ) {
+		done = len - ku.uio_resid;
+		for (i=0; i<n; i++) {
+			pos = i * PAGE_SIZE;
+			if (done <= pos) {
+				bzero(pages[i]->ep_data, PAGE_SIZE);
+			}
+			else if (done < pos + PAGE_SIZE) {
+				bzero(pages[i]->ep_data + (done - pos),
+				      pos + PAGE_SIZE - done);
+			}
+		}
+	}
+	return 0;
+}
+
+/*
+ * Write back all of a file's dirty pages, in runs of consecutive
+ * pages.
+ */
+static
+int
+emufs_writeback(struct emufs_vnode *ev)
+{
+	struct emufs_page *run[EMUFS_CLUSTER];
+	struct emufs_page *ep;
+	unsigned i, j, num, n;
+	int result;
+
+	if (ev->ev_ndirty == 0) {
+		return 0;
+	}
+
+	num = array_num(ev->ev_pages);
+	n = 0;
+	for (i=0; i<=num; i++) {
+		ep = (i < num) ? array_get(ev->ev_pages, i) : NULL;
+		if (ep != NULL && ep->ep_dirty) {
+			run[n++] = ep;
+			if (n < EMUFS_CLUSTER) {
+				continue;
+			}
+		}
+		if (n > 0) {
+			result = emufs_pageio(ev, run, n, UIO_WRITE);
+			if (result) {
+				return result;
+			}
+			for (j=0; j<n; j++) {
+				run[j]->ep_dirty = false;
+			}
+			ev->ev_ndirty -= n;
+			n = 0;
+		}
+	}
+	KASSERT(ev->ev_ndirty == 0);
+	return 0;
+}
+
+/*
+ * Take a page away from its file and put it on the free list. Any
+ * dirty data in it is discarded.
+ */
+static
+void
+emufs_page_free(struct emufs_fs *ef, struct emufs_page *ep)
+{
+	struct emufs_vnode *ev = ep->ep_vnode;
+
+	if (ev != NULL) {
+		emufs_lru_remove(ef, ep);
+		array_set(ev->ev_pages, ep->ep_pageno, NULL);
+		if (ep->ep_dirty) {
+			ev->ev_ndirty--;
+		}
+	}
+	ep->ep_vnode = NULL;
+	ep->ep_dirty = false;
+	ep->ep_prev = NULL;
+	ep->ep_next = ef->ef_freepages;
+	ef->ef_freepages = ep;
+}
+
+/*
+ * Get a page to fill: a free one, a new one if we're under
+ * EMUFS_CACHEPAGES, or else the least recently used one (written
+ * back first if need be). The page is returned unowned and off all
+ * lists.
+ */
+static
+int
+emufs_page_alloc(struct emufs_fs *ef, struct emufs_page **ret)
+{
+	struct emufs_page *ep;
+	int result;
+
+	if (ef->ef_freepages == NULL && ef->ef_npages < EMUFS_CACHEPAGES) {
+		ep = kmalloc(sizeof(*ep));
+		if (ep != NULL) {
+			ep->ep_data = kmalloc(PAGE_SIZE);
+			if (ep->ep_data == NULL) {
+				kfree(ep);
+			}
+			else {
+				ef->ef_npages++;
+				ep->ep_vnode = NULL;
+				ep->ep_dirty = false;
+				ep->ep_next = ep->ep_prev = NULL;
+				*ret = ep;
+				return 0;
+			}
+		}
+	}
+
+	if (ef->ef_freepages == NULL) {
+		ep = ef->ef_lrutail;
+		if (ep == NULL) {
+			return ENOMEM;
+		}
+		if (ep->ep_dirty) {
+			result = emufs_pageio(ep->ep_vnode, &ep, 1, UIO_WRITE);
+			if (result) {
+				return result;
+			}
+			ep->ep_dirty = false;
+			ep->ep_vnode->ev_ndirty--;
+		}
+		emufs_page_free(ef, ep);
+	}
+
+	ep = ef->ef_freepages;
+	ef->ef_freepages = ep->ep_next;
+	ep->ep_next = NULL;
+	*ret = ep;
+	return 0;
+}
+
+/*
+ * Drop all of a file's cached pages, dirty or not.
+ */
+static
+void
+emufs_invalidate(struct emufs_vnode *ev)
+{
+	struct emufs_fs *ef = emufs_getfs(ev);
+	struct emufs_page *ep;
+	unsigned i, num;
+
+	num = array_num(ev->ev_pages);
+	for (i=0; i<num; i++) {
+		ep = array_get(ev->ev_pages, i);
+		if (ep != NULL) {
+			emufs_page_free(ef, ep);
+		}
+	}
+	KASSERT(ev->ev_ndirty == 0);
+	array_setsize(ev->ev_pages, 0);
+}
+
+/*
+ * Make sure ev_size is loaded.
+ */
+static
+int
+emufs_loadsize(struct emufs_vnode *ev)
+{
+	int result;
+
+	if (!ev->ev_sizevalid) {
+		result = emu_getsize(ev->ev_emu, ev->ev_handle, &ev->ev_size);
+		if (result) {
+			return result;
+		}
+		ev->ev_sizevalid = true;
+	}
+	return 0;
+}
+
+/*
+ * Find page PAGENO of a file in the cache, or bring it in. If DOREAD
+ * is false the caller is about to overwrite the page and it is just
+ * zeroed. When reading, the following pages, if the file has them
+ * and they aren't cached, are read in the same operation.
+ */
+static
+int
+emufs_getpage(struct emufs_vnode *ev, unsigned pageno, bool doread,
+	      struct emufs_page **ret)
+{
+	struct emufs_fs *ef = emufs_getfs(ev);
+	struct emufs_page *run[EMUFS_CLUSTER];
+	struct emufs_page *ep;
+	unsigned i, n, num;
+	int result;
+
+	num = array_num(ev->ev_pages);
+	if (pageno < num) {
+		ep = array_get(ev->ev_pages, pageno);
+		if (ep != NULL) {
+			emufs_lru_remove(ef, ep);
+			emufs_lru_add(ef, ep);
+			*ret = ep;
+			return 0;
+		}
+	}
+
+	n = 1;
+	if (doread) {
+		while (n < EMUFS_CLUSTER &&
+		       (off_t)(pageno + n) * PAGE_SIZE < ev->ev_size &&
+		       (pageno + n >= num ||
+			array_get(ev->ev_pages, pageno + n) == NULL)) {
+			n++;
+		}
+	}
+
+	if (pageno + n > num) {
+		result = array_setsize(ev->ev_pages, pageno + n);
+		if (result) {
+			return result;
+		}
+		for (i=num; i<pageno + n; i++) {
+			array_set(ev->ev_pages, i, NULL);
+		}
+	}
+
+	for (i=0; i<n; i++) {
+		result = emufs_page_alloc(ef, &run[i]);
+		if (result) {
+			while (i-- > 0) {
+				emufs_page_free(ef, run[i]);
+			}
+			return result;
+		}
+	}
+
+	if (doread) {
+		result = emufs_pageio(ev, run, n, UIO_READ);
+		if (result) {
+			for (i=0; i<n; i++) {
+				emufs_page_free(ef, run[i]);
+			}
+			return result;
+		}
+	}
+	else {
+		bzero(run[0]->ep_data, PAGE_SIZE);
+	}
+
+	/*
+	 * Install the pages, first page last so it's the most
+	 * recently used.
+	 */
+	for (i=n; i-- > 0; ) {
+		run[i]->ep_vnode = ev;
+		run[i]->ep_pageno = pageno + i;
+		array_set(ev->ev_pages, pageno + i, run[i]);
+		emufs_lru_add(ef, run[i]);
+	}
+	*ret = run[0];
+	return 0;
+}
+
+/*
+ * Hold an extra reference to a file so it (and its cached pages)
+ * survives its last close, dropping the reference on the file kept
+ * longest ago to make room. Called without ef_cachelock, because
+ * dropping a reference can call emufs_reclaim.
+ */
+static
+void
+emufs_keep(struct emufs_vnode *ev)
+{
+	struct emufs_fs *ef = emufs_getfs(ev);
+	struct emufs_vnode *victim;
+
+	lock_acquire(ef->ef_cachelock);
+	if (ev->ev_kept) {
+		lock_release(ef->ef_cachelock);
+		return;
+	}
+	VOP_INCREF(&ev->ev_v);
+	ev->ev_kept = true;
+	victim = ef->ef_keep[ef->ef_keepnext];
+	ef->ef_keep[ef->ef_keepnext] = ev;
+	ef->ef_keepnext = (ef->ef_keepnext + 1) % EMUFS_KEEPVNODES;
+	if (victim != NULL) {
+		victim->ev_kept = false;
+	}
+	lock_release(ef->ef_cachelock);
+
+	if (victim != NULL) {
+		VOP_DECREF(&victim->ev_v);
+	}
+}
+
+//
+////////////////////////////////////////////////////////////
+
 ////////////////////////////////////////////////////////////
 //
 // vnode functions 
@@ -414,13 +850,27 @@ emufs_open(struct vnode *v, int openflags)
 	 * to check that either.
 	 */
 
+	struct emufs_vnode *ev = v->vn_data;
+	struct emufs_fs *ef = v->vn_fs->fs_data;
+	off_t size;
+	int result = 0;
+
 	if (openflags & O_APPEND) {
 		return EUNIMP;
 	}
 
-	(void)v;
+	/* Notice if the file changed size on the host side. */
+	lock_acquire(ef->ef_cachelock);
+	if (ev->ev_sizevalid && ev->ev_ndirty == 0) {
+		result = emu_getsize(ev->ev_emu, ev->ev_handle, &size);
+		if (result == 0 && size != ev->ev_size) {
+			emufs_invalidate(ev);
+			ev->ev_size = size;
+		}
+	}
+	lock_release(ef->ef_cachelock);
 
-	return 0;
+	return result;
 }
 
 /*
@@ -468,23 +918,39 @@ emufs_reclaim(struct vnode *v)
 {
 	struct emufs_vnode *ev = v->vn_data;
 	struct emufs_fs *ef = v->vn_fs->fs_data;
-	unsigned ix, i, num;
+	struct emufs_vnode **evp;
 	int result;
 
 	/*
-	 * Need both of these locks, e_lock to protect the device
-	 * and vfs_biglock to protect the fs-related material.
+	 * Need all three of these locks: e_lock to protect the device,
+	 * vfs_biglock to protect the fs-related material, and
+	 * ef_cachelock for writing back the file's pages.
 	 */
 
 	vfs_biglock_acquire();
-	lock_acquire(ef->ef_emu->e_lock);
+	lock_acquire(ef->ef_cachelock);
 
 	if (ev->ev_v.vn_refcount != 1) {
-		lock_release(ef->ef_emu->e_lock);
+		lock_release(ef->ef_cachelock);
 		vfs_biglock_release();
 		return EBUSY;
 	}
 
+	if (!ev->ev_isdir) {
+		result = emufs_writeback(ev);
+		if (result) {
+			lock_release(ef->ef_cachelock);
+			vfs_biglock_release();
+			return result;
+		}
+		emufs_invalidate(ev);
+		array_destroy(ev->ev_pages);
+		ev->ev_pages = NULL;
+	}
+	lock_release(ef->ef_cachelock);
+
+	lock_acquire(ef->ef_emu->e_lock);
+
 	/* emu_close retries on I/O error */
 	result = emu_close(ev->ev_emu, ev->ev_handle);
 	if (result) {
@@ -493,23 +959,14 @@ emufs_reclaim(struct vnode *v)
 		return result;
 	}
 
-	num = vnodearray_num(ef->ef_vnodes);
-	ix = num;
-	for (i=0; i<num; i++) {
-		struct vnode *vx;
-
-		vx = vnodearray_get(ef->ef_vnodes, i);
-		if (vx == v) {
-			ix = i;
-			break;
+	for (evp = &ef->ef_vnodes[EMUFS_HASH(ev->ev_handle)];
+	     *evp != ev; evp = &(*evp)->ev_hashnext) {
+		if (*evp == NULL) {
+			panic("emu%d: reclaim vnode %u not in vnode pool\n",
+			      ef->ef_emu->e_unit, ev->ev_handle);
 		}
 	}
-	if (ix == num) {
-		panic("emu%d: reclaim vnode %u not in vnode pool\n",
-		      ef->ef_emu->e_unit, ev->ev_handle);
-	}
-
-	vnodearray_remove(ef->ef_vnodes, ix);
+	*evp = ev->ev_hashnext;
 	VOP_CLEANUP(&ev->ev_v);
 
 	lock_release(ef->ef_emu->e_lock);
@@ -527,32 +984,43 @@ int
 emufs_read(struct vnode *v, struct uio *uio)
 {
 	struct emufs_vnode *ev = v->vn_data;
-	uint32_t amt;
-	size_t oldresid;
+	struct emufs_fs *ef = v->vn_fs->fs_data;
+	struct emufs_page *ep;
+	unsigned pageno;
+	size_t pgoff, amt;
 	int result;
 
 	KASSERT(uio->uio_rw==UIO_READ);
 
-	while (uio->uio_resid > 0) {
-		amt = uio->uio_resid;
-		if (amt > EMU_MAXIO) {
-			amt = EMU_MAXIO;
-		}
+	lock_acquire(ef->ef_cachelock);
 
-		oldresid = uio->uio_resid;
+	result = emufs_loadsize(ev);
+	while (result == 0 && uio->uio_resid > 0 &&
+	       uio->uio_offset < ev->ev_size) {
+		pageno = uio->uio_offset / PAGE_SIZE;
+		pgoff = uio->uio_offset % PAGE_SIZE;
 
-		result = emu_read(ev->ev_emu, ev->ev_handle, amt, uio);
+		result = emufs_getpage(ev, pageno, true, &ep);
 		if (result) {
-			return result;
-		}
-		
-		if (uio->uio_resid == oldresid) {
-			/* nothing read - EOF */
 			break;
 		}
+
+		amt = PAGE_SIZE - pgoff;
+		if (amt > uio->uio_resid) {
+			amt = uio->uio_resid;
+		}
+		if (amt > ev->ev_size - uio->uio_offset) {
+			amt = ev->ev_size - uio->uio_offset;
+		}
+		result = uiomove(ep->ep_data + pgoff, amt, uio);
 	}
 
-	return 0;
+	lock_release(ef->ef_cachelock);
+
+	if (result == 0) {
+		emufs_keep(ev);
+	}
+	return result;
 }
 
 /*
@@ -577,38 +1045,66 @@ emufs_getdirentry(struct vnode *v, struct uio *uio)
 
 /*
  * VOP_WRITE
+ *
+ * Writes only go into the cache. A page that already has file data
+ * we aren't overwriting in full is read in first.
  */
 static
 int
 emufs_write(struct vnode *v, struct uio *uio)
 {
 	struct emufs_vnode *ev = v->vn_data;
-	uint32_t amt;
-	size_t oldresid;
+	struct emufs_fs *ef = v->vn_fs->fs_data;
+	struct emufs_page *ep;
+	unsigned pageno;
+	size_t pgoff, amt;
+	off_t pagestart, pageend;
+	bool doread;
 	int result;
 
 	KASSERT(uio->uio_rw==UIO_WRITE);
 
-	while (uio->uio_resid > 0) {
-		amt = uio->uio_resid;
-		if (amt > EMU_MAXIO) {
-			amt = EMU_MAXIO;
+	lock_acquire(ef->ef_cachelock);
+
+	result = emufs_loadsize(ev);
+	while (result == 0 && uio->uio_resid > 0) {
+		pageno = uio->uio_offset / PAGE_SIZE;
+		pgoff = uio->uio_offset % PAGE_SIZE;
+		amt = PAGE_SIZE - pgoff;
+		if (amt > uio->uio_resid) {
+			amt = uio->uio_resid;
 		}
 
-		oldresid = uio->uio_resid;
+		/* file data in this page that the write leaves alone? */
+		pagestart = (off_t)pageno * PAGE_SIZE;
+		pageend = pagestart + PAGE_SIZE;
+		if (pageend > ev->ev_size) {
+			pageend = ev->ev_size;
+		}
+		doread = pagestart < ev->ev_size &&
+			(pgoff > 0 || uio->uio_offset + amt < pageend);
 
-		result = emu_write(ev->ev_emu, ev->ev_handle, amt, uio);
+		result = emufs_getpage(ev, pageno, doread, &ep);
 		if (result) {
-			return result;
+			break;
 		}
 
-		if (uio->uio_resid == oldresid) {
-			/* nothing written...? */
-			break;
+		result = uiomove(ep->ep_data + pgoff, amt, uio);
+		if (!ep->ep_dirty) {
+			ep->ep_dirty = true;
+			ev->ev_ndirty++;
+		}
+		if (uio->uio_offset > ev->ev_size) {
+			ev->ev_size = uio->uio_offset;
 		}
 	}
 
-	return 0;
+	lock_release(ef->ef_cachelock);
+
+	if (result == 0) {
+		emufs_keep(ev);
+	}
+	return result;
 }
 
 /*
@@ -637,19 +1133,31 @@ int
 emufs_stat(struct vnode *v, struct stat *statbuf)
 {
 	struct emufs_vnode *ev = v->vn_data;
+	struct emufs_fs *ef = v->vn_fs->fs_data;
 	int result;
 
 	bzero(statbuf, sizeof(struct stat));
 
-	result = emu_getsize(ev->ev_emu, ev->ev_handle, &statbuf->st_size);
-	if (result) {
-		return result;
+	if (ev->ev_isdir) {
+		/* directories aren't cached */
+		result = emu_getsize(ev->ev_emu, ev->ev_handle,
+				     &statbuf->st_size);
+		if (result) {
+			return result;
+		}
+		statbuf->st_mode = S_IFDIR;
 	}
-
-	result = VOP_GETTYPE(v, &statbuf->st_mode);
-	if (result) {
-		return result;
+	else {
+		lock_acquire(ef->ef_cachelock);
+		result = emufs_loadsize(ev);
+		statbuf->st_size = ev->ev_size;
+		lock_release(ef->ef_cachelock);
+		if (result) {
+			return result;
+		}
+		statbuf->st_mode = S_IFREG;
 	}
+
 	statbuf->st_mode |= 0644; /* possibly a lie */
 	statbuf->st_nlink = 1;    /* might be a lie, but doesn't matter much */
 	statbuf->st_blocks = 0;   /* almost certainly a lie */
@@ -705,8 +1213,14 @@ static
 int
 emufs_fsync(struct vnode *v)
 {
-	(void)v;
-	return 0;
+	struct emufs_vnode *ev = v->vn_data;
+	struct emufs_fs *ef = v->vn_fs->fs_data;
+	int result;
+
+	lock_acquire(ef->ef_cachelock);
+	result = emufs_writeback(ev);
+	lock_release(ef->ef_cachelock);
+	return result;
 }
 
 /*
@@ -717,7 +1231,28 @@ int
 emufs_truncate(struct vnode *v, off_t len)
 {
 	struct emufs_vnode *ev = v->vn_data;
-	return emu_trunc(ev->ev_emu, ev->ev_handle, len);
+	struct emufs_fs *ef = v->vn_fs->fs_data;
+	int result;
+
+	/*
+	 * Simplest to push everything out, drop the cache, and let
+	 * the host do the work.
+	 */
+	lock_acquire(ef->ef_cachelock);
+	result = emufs_writeback(ev);
+	if (result == 0) {
+		emufs_invalidate(ev);
+		result = emu_trunc(ev->ev_emu, ev->ev_handle, len);
+	}
+	if (result == 0) {
+		ev->ev_size = len;
+		ev->ev_sizevalid = true;
+	}
+	else {
+		ev->ev_sizevalid = false;
+	}
+	lock_release(ef->ef_cachelock);
+	return result;
 }
 
 /*
@@ -1142,24 +1677,25 @@ static const struct vnode_ops emufs_dirops = {
 
 /*
  * Function to load a vnode into memory.
+ *
+ * Loaded vnodes are kept in ef_vnodes, a hash table keyed by
+ * hardware handle, so this and emufs_reclaim don't depend on the
+ * number of files in use.
  */
 static
 int
 emufs_loadvnode(struct emufs_fs *ef, uint32_t handle, int isdir,
 		struct emufs_vnode **ret)
 {
-	struct vnode *v;
 	struct emufs_vnode *ev;
-	unsigned i, num;
+	unsigned bucket;
 	int result;
 
 	vfs_biglock_acquire();
 	lock_acquire(ef->ef_emu->e_lock);
 
-	num = vnodearray_num(ef->ef_vnodes);
-	for (i=0; i<num; i++) {
-		v = vnodearray_get(ef->ef_vnodes, i);
-		ev = v->vn_data;
+	bucket = EMUFS_HASH(handle);
+	for (ev = ef->ef_vnodes[bucket]; ev != NULL; ev = ev->ev_hashnext) {
 		if (ev->ev_handle == handle) {
 			/* Found */
 
@@ -1177,30 +1713,43 @@ emufs_loadvnode(struct emufs_fs *ef, uint32_t handle, int isdir,
 	ev = kmalloc(sizeof(struct emufs_vnode));
 	if (ev==NULL) {
 		lock_release(ef->ef_emu->e_lock);
+		vfs_biglock_release();
 		return ENOMEM;
 	}
 
 	ev->ev_emu = ef->ef_emu;
 	ev->ev_handle = handle;
+	ev->ev_isdir = isdir;
+	ev->ev_pages = NULL;
+	ev->ev_ndirty = 0;
+	ev->ev_size = 0;
+	ev->ev_sizevalid = false;
+	ev->ev_kept = false;
+
+	if (!isdir) {
+		ev->ev_pages = array_create();
+		if (ev->ev_pages == NULL) {
+			lock_release(ef->ef_emu->e_lock);
+			vfs_biglock_release();
+			kfree(ev);
+			return ENOMEM;
+		}
+	}
 
 	result = VOP_INIT(&ev->ev_v, isdir ? &emufs_dirops : &emufs_fileops,
 			   &ef->ef_fs, ev);
 	if (result) {
 		lock_release(ef->ef_emu->e_lock);
 		vfs_biglock_release();
+		if (ev->ev_pages != NULL) {
+			array_destroy(ev->ev_pages);
+		}
 		kfree(ev);
 		return result;
 	}
 
-	result = vnodearray_add(ef->ef_vnodes, &ev->ev_v, NULL);
-	if (result) {
-		/* note: VOP_CLEANUP undoes VOP_INIT - it does not kfree */
-		VOP_CLEANUP(&ev->ev_v);
-		lock_release(ef->ef_emu->e_lock);
-		vfs_biglock_release();
-		kfree(ev);
-		return result;
-	}
+	ev->ev_hashnext = ef->ef_vnodes[bucket];
+	ef->ef_vnodes[bucket] = ev;
 
 	lock_release(ef->ef_emu->e_lock);
 	vfs_biglock_release();
@@ -1224,8 +1773,29 @@ static
 int
 emufs_sync(struct fs *fs)
 {
-	(void)fs;
-	return 0;
+	struct emufs_fs *ef = fs->fs_data;
+	struct emufs_vnode *ev;
+	unsigned i;
+	int result, ret = 0;
+
+	vfs_biglock_acquire();
+	lock_acquire(ef->ef_cachelock);
+
+	for (i=0; i<EMUFS_VNODEHASH; i++) {
+		for (ev = ef->ef_vnodes[i]; ev != NULL; ev = ev->ev_hashnext) {
+			if (ev->ev_isdir) {
+				continue;
+			}
+			result = emufs_writeback(ev);
+			if (result && ret == 0) {
+				ret = result;
+			}
+		}
+	}
+
+	lock_release(ef->ef_cachelock);
+	vfs_biglock_release();
+	return ret;
 }
 
 /*
@@ -1284,6 +1854,7 @@ int
 emufs_addtovfs(struct emu_softc *sc, const char *devname)
 {
 	struct emufs_fs *ef;
+	unsigned i;
 	int result;
 
 	ef = kmalloc(sizeof(struct emufs_fs));
@@ -1299,14 +1870,26 @@ emufs_addtovfs(struct emu_softc *sc, const char *devname)
 
 	ef->ef_emu = sc;
 	ef->ef_root = NULL;
-	ef->ef_vnodes = vnodearray_create();
-	if (ef->ef_vnodes == NULL) {
+	for (i=0; i<EMUFS_VNODEHASH; i++) {
+		ef->ef_vnodes[i] = NULL;
+	}
+
+	ef->ef_cachelock = lock_create("emufs-cache");
+	if (ef->ef_cachelock == NULL) {
 		kfree(ef);
 		return ENOMEM;
 	}
+	ef->ef_lruhead = ef->ef_lrutail = NULL;
+	ef->ef_freepages = NULL;
+	ef->ef_npages = 0;
+	for (i=0; i<EMUFS_KEEPVNODES; i++) {
+		ef->ef_keep[i] = NULL;
+	}
+	ef->ef_keepnext = 0;
 
 	result = emufs_loadvnode(ef, EMU_ROOTHANDLE, 1, &ef->ef_root);
 	if (result) {
+		lock_destroy(ef->ef_cachelock);
 		kfree(ef);
 		return result;
 	}
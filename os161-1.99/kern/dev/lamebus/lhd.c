@@ -38,6 +38,7 @@
 #include <synch.h>
 #include <platform/bus.h>
 #include <vfs.h>
+#include <trace.h>
 #include <lamebus/lhd.h>
 #include "autoconf.h"
 
@@ -245,6 +246,7 @@ lhd_io(struct device *d, struct uio *uio)
 
 		/* Tell it what sector we want... */
 		lhd_wreg(lh, LHD_REG_SECT, sector+i);
+		TRACE(TRACE_DISKIO, sector+i, uio->uio_rw == UIO_WRITE);
 
 		/* and start the operation. */
 		lhd_wreg(lh, LHD_REG_STAT, statval);
@@ -1110,14 +1110,17 @@ sfs_fsync(struct vnode *v)
 }
 
 /*
- * Called for mmap().
+ * Called for mmap(). Any regular file can be mapped; the VM system
+ * reads and writes the pages itself through sfs_read and sfs_write,
+ * so there's nothing to set up here. (Directories use sfs_dirops,
+ * which says ISDIR.)
  */
 static
 int
-sfs_mmap(struct vnode *v   /* add stuff as needed */)
+sfs_mmap(struct vnode *v)
 {
 	(void)v;
-	return EUNIMP;
+	return 0;
 }
 
 /*
@@ -38,6 +38,8 @@
 #include <vm.h>
 
 struct vnode;
+struct lock;
+struct mmapregion;    /* private to the VM system */
 
 
 /* 
@@ -55,6 +57,11 @@ struct addrspace {
   paddr_t as_pbase2;
   size_t as_npages2;
   paddr_t as_stackpbase;
+  vaddr_t as_heapbase;           /* start of the heap, page-aligned */
+  vaddr_t as_heaptop;            /* the break */
+  paddr_t *as_heapdir;           /* heap page tables, or NULL */
+  struct mmapregion *as_mmaps;   /* file mappings, sorted by address */
+  struct lock *as_lock;          /* protects the heap and as_mmaps */
 };
 
 /*
@@ -91,6 +98,22 @@ struct addrspace {
  *    as_define_stack - set up the stack region in the address space.
  *                (Normally called *after* as_complete_load().) Hands
  *                back the initial stack pointer for the new process.
+ *
+ *    as_sbrk   - move the break by AMOUNT bytes, handing back where it
+ *                was. The heap starts out empty, just past the last
+ *                segment; memory for it is only found when touched.
+ *
+ *    as_mmap   - map LEN bytes of file V, from OFFSET, into the address
+ *                space with PROT_* protections and MAP_* FLAGS (see
+ *                <kern/mman.h>), at HINT if MAP_FIXED is set. Hands
+ *                back the address chosen. Takes its own reference to
+ *                V; pages are read from the file on first touch.
+ *
+ *    as_munmap - remove the mappings lying in the LEN bytes at ADDR,
+ *                writing MAP_SHARED pages back to their files first.
+ *
+ *    as_msync  - write back MAP_SHARED pages in the LEN bytes at ADDR
+ *                that have been stored to since they were last written.
  */
 
 struct addrspace *as_create(void);
@@ -107,6 +130,13 @@ int               as_define_region(struct addrspace *as,
 int               as_prepare_load(struct addrspace *as);
 int               as_complete_load(struct addrspace *as);
 int               as_define_stack(struct addrspace *as, vaddr_t *initstackptr);
+int               as_sbrk(struct addrspace *as, intptr_t amount,
+                          vaddr_t *oldbreak);
+int               as_mmap(struct addrspace *as, vaddr_t hint, size_t len,
+                          int prot, int flags, struct vnode *v, off_t offset,
+                          vaddr_t *ret);
+int               as_munmap(struct addrspace *as, vaddr_t addr, size_t len);
+int               as_msync(struct addrspace *as, vaddr_t addr, size_t len);
 
 
 /*
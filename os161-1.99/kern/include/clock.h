@@ -38,8 +38,8 @@
  * hardclock() is called on every CPU HZ times a second, possibly only
  * when the CPU is not idle, for scheduling.
  *
- * timerclock() is called on one CPU once a second to allow simple
- * timed operations. (This is a fairly simpleminded interface.)
+ * timerclock() is called on one CPU once a second. Nothing uses it
+ * any more; timed operations go through timeouts instead.
  *
  * gettime() may be used to fetch the current time of day.
  * getinterval() computes the time from time1 to time2.
@@ -70,8 +70,48 @@ void getinterval(time_t secs1, uint32_t nsecs,
 /*
  * clocksleep() suspends execution for the requested number of seconds,
  * like userlevel sleep(3). (Don't confuse it with wchan_sleep.)
+ *
+ * thread_sleep_ns() does the same for a number of nanoseconds. The
+ * sleep is rounded up to a whole number of hardclock ticks (1/HZ
+ * second), and is always at least one tick.
  */
 void clocksleep(int seconds);
+void thread_sleep_ns(uint64_t nsecs);
+
+/*
+ * Timeouts.
+ *
+ * A timeout calls a function once, from hardclock on CPU 0, at the
+ * first tick at or after its deadline. Deadlines are in hardclock
+ * ticks since boot; timer_ticks() is the current tick count and
+ * timer_nstoticks() converts a relative time, rounding up.
+ *
+ * The function runs in interrupt context, so it must not sleep; it
+ * is also called without the timer lock held, so it may take other
+ * spinlocks, wake threads, and so on.
+ *
+ * timeout_init    - set up a timeout (which the caller allocates).
+ * timeout_add     - arm it to fire at DEADLINE. Must not be armed.
+ * timeout_cancel  - disarm it. Returns true if it had not fired yet,
+ *                   false if it had. If the function is running at
+ *                   the time, waits for it to finish, so the caller
+ *                   may free the timeout as soon as this returns.
+ */
+struct timeout {
+	struct timeout *to_next;	/* wheel bucket chain */
+	struct timeout **to_prevp;
+	uint64_t to_deadline;
+	void (*to_func)(void *);
+	void *to_data;
+	volatile bool to_pending;	/* on the wheel */
+	volatile bool to_firing;	/* function is running */
+};
+
+void timeout_init(struct timeout *to, void (*func)(void *), void *data);
+void timeout_add(struct timeout *to, uint64_t deadline);
+bool timeout_cancel(struct timeout *to);
+uint64_t timer_ticks(void);
+uint64_t timer_nstoticks(uint64_t nsecs);
 
 
 #endif /* _CLOCK_H_ */
@@ -50,6 +50,14 @@
  * returns the actual length of string found in GOT. DEST is always
  * null-terminated on success. LEN and GOT include the null terminator.
  *
+ * copyinv and copyoutv are vectored versions of copyin and copyout.
+ * Each takes an array of NVEC struct copyvec, each naming a user
+ * address, a kernel address, and a length; the copy direction is
+ * given by the function. All the ranges are checked before anything
+ * is copied, and the whole batch shares a single fault-recovery
+ * setup, so a system call with several pointer arguments can move
+ * them all with one call.
+ *
  * All of these functions return 0 on success, EFAULT if a memory
  * addressing error was encountered, or (for the string versions)
  * ENAMETOOLONG if the space available was insufficient.
@@ -64,10 +72,18 @@
  * vm/copyinout.c.
  */
 
+struct copyvec {
+	userptr_t cv_uaddr;	/* user-space address */
+	void *cv_kaddr;		/* kernel-space address */
+	size_t cv_len;		/* length in bytes */
+};
+
 int copyin(const_userptr_t usersrc, void *dest, size_t len);
 int copyout(const void *src, userptr_t userdest, size_t len);
 int copyinstr(const_userptr_t usersrc, char *dest, size_t len, size_t *got);
 int copyoutstr(const char *src, userptr_t userdest, size_t len, size_t *got);
+int copyinv(const struct copyvec *vec, unsigned nvec);
+int copyoutv(const struct copyvec *vec, unsigned nvec);
 
 
 #endif /* _COPYINOUT_H_ */
@@ -122,6 +122,13 @@ const char *cpu_identify(void);
 void cpu_irqoff(void);
 void cpu_irqon(void);
 
+/*
+ * Read the processor's free-running cycle counter. It is 32 bits
+ * wide and wraps, so only differences between nearby readings are
+ * meaningful; use unsigned subtraction.
+ */
+uint32_t cpu_getcycles(void);
+
 /*
  * Idle or shut down (respectively) the processor.
  *
@@ -152,6 +159,7 @@ void cpu_halt(void);
  * ipi_send sends an IPI to one CPU.
  * ipi_broadcast sends an IPI to all CPUs except the current one.
  * ipi_tlbshootdown is like ipi_send but carries TLB shootdown data.
+ * ipi_tlbshootdown_broadcast sends that to all CPUs except the current one.
  *
  * interprocessor_interrupt is called on the target CPU when an IPI is
  * received.
@@ -166,6 +174,7 @@ void cpu_halt(void);
 void ipi_send(struct cpu *target, int code);
 void ipi_broadcast(int code);
 void ipi_tlbshootdown(struct cpu *target, const struct tlbshootdown *mapping);
+void ipi_tlbshootdown_broadcast(const struct tlbshootdown *mapping);
 
 void interprocessor_interrupt(void);
 
@@ -193,8 +193,51 @@ typedef struct {
 #define	PF_X		0x1	/* Segment is executable */
 
 
+/*
+ * Section header, and symbol table entry. The loader doesn't need
+ * these (it only looks at segments); the profiler uses them to find
+ * the kernel's symbol table.
+ * There are Ehdr.e_shnum section headers at Ehdr.e_shoff in the file.
+ */
+typedef struct {
+	uint32_t	sh_name;     /* Section name (offset in shstrtab) */
+	uint32_t	sh_type;     /* Type of section */
+	uint32_t	sh_flags;    /* Flags */
+	uint32_t	sh_addr;     /* Virtual address, if loaded */
+	uint32_t	sh_offset;   /* Location of data within file */
+	uint32_t	sh_size;     /* Size of data */
+	uint32_t	sh_link;     /* Related section (symtab: its strtab) */
+	uint32_t	sh_info;     /* Extra information */
+	uint32_t	sh_addralign;/* Required alignment */
+	uint32_t	sh_entsize;  /* Size of entries, for tables */
+} Elf32_Shdr;
+
+/* values for sh_type */
+#define	SHT_NULL	0		/* Unused */
+#define	SHT_PROGBITS	1		/* Program contents */
+#define	SHT_SYMTAB	2		/* Symbol table */
+#define	SHT_STRTAB	3		/* String table */
+
+typedef struct {
+	uint32_t	st_name;     /* Name (offset in strtab) */
+	uint32_t	st_value;    /* Value (address, for functions) */
+	uint32_t	st_size;     /* Size of object */
+	unsigned char	st_info;     /* Type and binding */
+	unsigned char	st_other;    /* Visibility */
+	uint16_t	st_shndx;    /* Section it's in */
+} Elf32_Sym;
+
+/* symbol type, in the low 4 bits of st_info */
+#define	ELF32_ST_TYPE(info)	((info) & 0xf)
+#define	STT_NOTYPE	0
+#define	STT_OBJECT	1
+#define	STT_FUNC	2
+
+
 typedef Elf32_Ehdr Elf_Ehdr;
 typedef Elf32_Phdr Elf_Phdr;
+typedef Elf32_Shdr Elf_Shdr;
+typedef Elf32_Sym Elf_Sym;
 
 
 #endif /* _ELF_H_ */
@@ -37,21 +37,74 @@
 #include <fs.h>
 #include <vnode.h>
 
+/*
+ * Page cache tuning.
+ *
+ * EMUFS_CACHEPAGES is the most pages the cache will allocate (per
+ * emufs); after that pages are recycled in LRU order. They are never
+ * freed, since dumbvm can't free kernel pages anyway.
+ *
+ * EMUFS_KEEPVNODES is how many recently used files are kept loaded
+ * (and so keep their cached pages) after their last close.
+ */
+#define EMUFS_CACHEPAGES  64
+#define EMUFS_KEEPVNODES  8
+
+/*
+ * Number of buckets in the table of loaded vnodes, which is keyed by
+ * hardware handle. Must be a power of 2.
+ */
+#define EMUFS_VNODEHASH   64
+
 /*
  * Our structures
  */
 
+struct emufs_vnode;
+
+/*
+ * One cached page of a file. ep_vnode is NULL while the page sits on
+ * the free list; otherwise the page is on the LRU list and in its
+ * vnode's ev_pages at index ep_pageno.
+ */
+struct emufs_page {
+	struct emufs_vnode *ep_vnode;	/* owning file */
+	unsigned ep_pageno;		/* page number within the file */
+	bool ep_dirty;			/* needs writing back */
+	struct emufs_page *ep_next;	/* LRU list (newer), or free list */
+	struct emufs_page *ep_prev;	/* LRU list (older) */
+	char *ep_data;			/* PAGE_SIZE bytes */
+};
+
 struct emufs_vnode {
 	struct vnode ev_v;		/* abstract vnode structure */
 	struct emu_softc *ev_emu;	/* device */
 	uint32_t ev_handle;		/* file handle */
+	bool ev_isdir;			/* directory or file */
+	struct emufs_vnode *ev_hashnext; /* next in ef_vnodes bucket */
+
+	/* Cache state; files only, protected by ef_cachelock */
+	struct array *ev_pages;		/* emufs_page pointers by page no. */
+	unsigned ev_ndirty;		/* number of dirty pages */
+	off_t ev_size;			/* file size, if ev_sizevalid */
+	bool ev_sizevalid;		/* ev_size is known */
+	bool ev_kept;			/* in ef_keep */
 };
 
 struct emufs_fs {
 	struct fs ef_fs;		/* abstract filesystem structure */
 	struct emu_softc *ef_emu;	/* device */
 	struct emufs_vnode *ef_root;	/* root vnode */
-	struct vnodearray *ef_vnodes;	/* table of loaded vnodes */
+	struct emufs_vnode *ef_vnodes[EMUFS_VNODEHASH]; /* loaded vnodes */
+
+	/* Page cache */
+	struct lock *ef_cachelock;	/* protects all cache state */
+	struct emufs_page *ef_lruhead;	/* most recently used page */
+	struct emufs_page *ef_lrutail;	/* least recently used page */
+	struct emufs_page *ef_freepages; /* recycled pages */
+	unsigned ef_npages;		/* pages allocated so far */
+	struct emufs_vnode *ef_keep[EMUFS_KEEPVNODES]; /* extra refs */
+	unsigned ef_keepnext;		/* next slot in ef_keep to reuse */
 };
 
 
@@ -0,0 +1,68 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef _FUTEX_H_
+#define _FUTEX_H_
+
+/*
+ * Futexes: sleeping and waking on a word of user memory.
+ *
+ * These are the kernel half of user-level mutexes and condition
+ * variables. The lock word lives in user memory and is manipulated
+ * there with atomic instructions; the kernel is only asked to put a
+ * thread to sleep when it has to wait, and to wake it when it no
+ * longer does.
+ *
+ * Functions:
+ *    futex_bootstrap - set up the hash table of wait queues.
+ *    futex_wait      - if the int at UADDR in address space AS still
+ *                      holds VAL, sleep until futex_wake is called on
+ *                      it; otherwise return EAGAIN at once. The check
+ *                      and the sleep are atomic with respect to
+ *                      futex_wake, so a wakeup can't slip in between.
+ *    futex_wake      - wake up to N threads sleeping on UADDR in AS,
+ *                      oldest first. Returns how many were woken.
+ *    futex_wakeall   - wake every thread sleeping on any address in
+ *                      AS; used when the process is exiting. After
+ *                      that futex_wait fails with EINTR instead of
+ *                      sleeping, so the threads can leave.
+ *
+ * A futex is named by its address space and user address, so threads
+ * sharing an address space share futexes and nobody else does. Both
+ * functions must be called with AS as the current address space.
+ */
+
+struct addrspace;
+
+void futex_bootstrap(void);
+int futex_wait(struct addrspace *as, userptr_t uaddr, int val);
+unsigned futex_wake(struct addrspace *as, userptr_t uaddr, unsigned n);
+void futex_wakeall(struct addrspace *as);
+
+#endif /* _FUTEX_H_ */
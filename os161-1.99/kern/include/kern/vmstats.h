@@ -0,0 +1,51 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef _KERN_VMSTATS_H_
+#define _KERN_VMSTATS_H_
+
+/*
+ * Indexes of the VM statistics counters (see uw-vmstats.h), as
+ * returned to userlevel by __vmstats().
+ */
+
+#define VMSTAT_TLB_FAULT              (0)
+#define VMSTAT_TLB_FAULT_FREE         (1)
+#define VMSTAT_TLB_FAULT_REPLACE      (2)
+#define VMSTAT_TLB_INVALIDATE         (3)
+#define VMSTAT_TLB_RELOAD             (4)
+#define VMSTAT_PAGE_FAULT_ZERO        (5)
+#define VMSTAT_PAGE_FAULT_DISK        (6)
+#define VMSTAT_ELF_FILE_READ          (7)
+#define VMSTAT_SWAP_FILE_READ         (8)
+#define VMSTAT_SWAP_FILE_WRITE        (9)
+#define VMSTAT_COUNT                 (10)
+
+
+#endif /* _KERN_VMSTATS_H_ */
@@ -52,6 +52,9 @@ void mainbus_interrupt(struct trapframe *);
 /* XXX this interface is not adequately MI */
 size_t mainbus_ramsize(void);
 
+/* Convert a difference of cpu_getcycles() readings to nanoseconds. */
+uint64_t mainbus_cyclestons(uint64_t cycles);
+
 /* Switch on an inter-processor interrupt. (Low-level.) */
 void mainbus_send_ipi(struct cpu *target);
 
@@ -36,6 +36,7 @@
  * Note: curproc is defined by <current.h>.
  */
 
+#include <limits.h>
 #include <spinlock.h>
 #include <thread.h> /* required for struct threadarray */
 
@@ -43,6 +44,7 @@ struct addrspace;
 struct vnode;
 #ifdef UW
 struct semaphore;
+struct lock;
 #endif // UW
 
 /*
@@ -52,6 +54,8 @@ struct proc {
 	char *p_name;			/* Name of this process */
 	struct spinlock p_lock;		/* Lock for this structure */
 	struct threadarray p_threads;	/* Threads in this process */
+	struct threadusage p_usage;	/* CPU used by exited threads */
+	bool p_exiting;			/* _exit called; threads are leaving */
 
 	/* VM */
 	struct addrspace *p_addrspace;	/* virtual address space */
@@ -66,14 +70,40 @@ struct proc {
      system calls, since each process will need to keep track of all files
      it has opened, not just the console. */
   struct vnode *console;                /* a vnode for the console device */
+
+  /* open files, indexed by file descriptor, or NULL if not in use */
+  /* each one holds a reference (VOP_INCREF) to its vnode; 0, 1 and 2 */
+  /* start out as the console */
+  struct vnode *p_fds[OPEN_MAX];
+  int p_fdflags[OPEN_MAX];              /* open() flags of each one */
+  off_t p_fdoff[OPEN_MAX];              /* and its seek position */
+  struct lock *p_fdlock;                /* protects the three arrays */
 #endif
 
 	/* add more material here as needed */
 };
 
+/*
+ * Array of processes.
+ */
+#ifndef PROCINLINE
+#define PROCINLINE INLINE
+#endif
+
+DECLARRAY(proc);
+DEFARRAY(proc, PROCINLINE);
+
 /* This is the process structure for the kernel and for kernel-only threads. */
 extern struct proc *kproc;
 
+/*
+ * Every process that exists, kproc included. allprocs_lock protects
+ * the array and keeps its processes from being destroyed; take it
+ * before any p_lock.
+ */
+extern struct procarray allprocs;
+extern struct spinlock allprocs_lock;
+
 /* Semaphore used to signal when there are no more processes */
 #ifdef UW
 extern struct semaphore *no_proc_sem;
@@ -91,8 +121,22 @@ void proc_destroy(struct proc *proc);
 /* Attach a thread to a process. Must not already have a process. */
 int proc_addthread(struct proc *proc, struct thread *t);
 
-/* Detach a thread from its process. */
-void proc_remthread(struct thread *t);
+/* Detach a thread from its process. Returns how many threads are left. */
+unsigned proc_remthread(struct thread *t);
+
+/*
+ * Total CPU usage of a process: its exited threads plus its live
+ * ones. Takes p_lock.
+ */
+void proc_getusage(struct proc *proc, struct threadusage *tu);
+
+/*
+ * Mark a process as exiting, and check whether it is. Once a process
+ * is exiting each of its threads exits the next time it would go
+ * back to user mode. Take p_lock.
+ */
+void proc_setexiting(struct proc *proc);
+bool proc_isexiting(struct proc *proc);
 
 /* Fetch the address space of the current process. */
 struct addrspace *curproc_getas(void);
@@ -0,0 +1,66 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef _PROF_H_
+#define _PROF_H_
+
+/*
+ * Sampling profiler.
+ *
+ * While profiling is on, every clock tick on every CPU records the
+ * interrupted PC. Kernel PCs go in a per-CPU histogram over the
+ * kernel text with one bucket per 2^PROF_SHIFT bytes; user PCs, which
+ * can belong to any program, go in a small per-CPU table of the
+ * first PROF_NUSERPCS distinct PCs seen; later ones are only counted
+ * in total. Recording takes no locks: each CPU only touches its own
+ * counters, from its own timer interrupt.
+ *
+ * prof_sample  - record one sample; called by the timer interrupt
+ *                handler, which knows the interrupted PC and mode.
+ * prof_start   - allocate the histograms (first time) and start.
+ * prof_stop    - stop.
+ * prof_reset   - zero the counts.
+ * prof_report  - print the NTOP busiest kernel functions and user
+ *                PCs. Kernel addresses are turned into function names
+ *                using the symbol table in the ELF file KERNELPATH,
+ *                which should be the kernel that's running; if that
+ *                can't be read, raw bucket addresses are printed.
+ */
+
+#define PROF_SHIFT	4	/* 16-byte kernel text buckets */
+#define PROF_NUSERPCS	64	/* must be a power of 2 */
+
+void prof_sample(vaddr_t pc, bool usermode);
+int prof_start(void);
+void prof_stop(void);
+void prof_reset(void);
+void prof_report(const char *kernelpath, unsigned ntop);
+
+
+#endif /* _PROF_H_ */
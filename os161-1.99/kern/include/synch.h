@@ -49,11 +49,23 @@ struct semaphore {
 	struct wchan *sem_wchan;
 	struct spinlock sem_lock;
         volatile int sem_count;
+	bool sem_fair;			/* hand off to waiters in order */
+	volatile unsigned sem_nwaiting;	/* sleepers, in fair mode */
 };
 
 struct semaphore *sem_create(const char *name, int initial_count);
 void sem_destroy(struct semaphore *);
 
+/*
+ * Fair mode. By default a thread coming into P can take a count that
+ * V just released ahead of threads already asleep in P, which is
+ * cheap but can starve a sleeper indefinitely. In fair mode, V gives
+ * the count directly to the thread that has been waiting longest and
+ * newcomers queue up behind it. Only change the mode while nobody is
+ * waiting.
+ */
+void sem_setfair(struct semaphore *, bool fair);
+
 /*
  * Operations (both atomic):
  *     P (proberen): decrement count. If the count is 0, block until
@@ -63,6 +75,12 @@ void sem_destroy(struct semaphore *);
 void P(struct semaphore *);
 void V(struct semaphore *);
 
+/*
+ * P_timed is P that gives up after (roughly) NSECS nanoseconds.
+ * Returns 0 if it got the semaphore and ETIMEDOUT if not.
+ */
+int P_timed(struct semaphore *, uint64_t nsecs);
+
 
 /*
  * Simple lock for mutual exclusion.
@@ -82,6 +100,9 @@ struct lock {
         volatile struct thread *holder;
         struct wchan *lk_wchan;
         struct spinlock slock;
+        bool lk_fair;  // hand off to waiters in order
+        volatile bool lk_handoff;  // released to a waiter not yet running
+        volatile unsigned lk_nwaiting;  // sleepers, in fair mode
 };
 
 #else
@@ -98,6 +119,13 @@ void lock_release(struct lock *);
 bool lock_do_i_hold(struct lock *);
 void lock_destroy(struct lock *);
 
+/*
+ * Fair mode, as for semaphores: lock_release passes the lock straight
+ * to the longest waiter instead of letting whoever gets there first
+ * grab it. Only change the mode while the lock is free.
+ */
+void lock_setfair(struct lock *, bool fair);
+
 
 /*
  * Condition variable.
@@ -147,5 +175,57 @@ void cv_wait(struct cv *cv, struct lock *lock);
 void cv_signal(struct cv *cv, struct lock *lock);
 void cv_broadcast(struct cv *cv, struct lock *lock);
 
+/*
+ * cv_timedwait is cv_wait that stops waiting after (roughly) NSECS
+ * nanoseconds. Either way the lock is held again on return. Returns 0
+ * if woken by cv_signal/cv_broadcast and ETIMEDOUT otherwise.
+ */
+int cv_timedwait(struct cv *cv, struct lock *lock, uint64_t nsecs);
+
+
+/*
+ * Reader-writer lock.
+ *
+ * Any number of readers may hold the lock at once, or one writer.
+ * Writers are preferred: once a writer is waiting, new readers block
+ * until it has had its turn, so a steady stream of readers cannot
+ * starve writers out.
+ *
+ * The name field is for easier debugging. A copy of the name is made
+ * internally.
+ */
+struct rwlock {
+        char *rw_name;
+	struct wchan *rw_rwchan;	/* readers sleep here */
+	struct wchan *rw_wwchan;	/* writers sleep here */
+	struct spinlock rw_lock;
+        volatile unsigned rw_nreaders;
+        volatile unsigned rw_nwaitwriters;
+        volatile struct thread *rw_writer;
+};
+
+struct rwlock *rwlock_create(const char *name);
+void rwlock_destroy(struct rwlock *);
+
+/*
+ * Operations:
+ *    rwlock_acquire_read  - Get the lock shared. Blocks while a writer
+ *                           holds the lock or is waiting for it.
+ *    rwlock_acquire_write - Get the lock exclusively.
+ *    rwlock_release       - Release the lock, in whichever mode the
+ *                           current thread holds it.
+ *    rwlock_downgrade     - Turn a write hold into a read hold without
+ *                           letting any other writer in between.
+ *    rwlock_do_i_hold_write - Check whether the current thread holds
+ *                           the lock for writing. (There is no way to
+ *                           ask the same about reading; readers are
+ *                           not tracked individually.)
+ */
+void rwlock_acquire_read(struct rwlock *);
+void rwlock_acquire_write(struct rwlock *);
+void rwlock_release(struct rwlock *);
+void rwlock_downgrade(struct rwlock *);
+bool rwlock_do_i_hold_write(struct rwlock *);
+
 
 #endif /* _SYNCH_H_ */
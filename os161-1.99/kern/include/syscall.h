@@ -50,6 +50,11 @@ void enter_forked_process(struct trapframe *tf);
 void enter_new_process(int argc, userptr_t argv, vaddr_t stackptr,
 		       vaddr_t entrypoint);
 
+/* Enter user mode in a new thread made by __threadfork. Does not return. */
+void enter_new_thread(struct trapframe *tf, vaddr_t entrypoint,
+		      vaddr_t arg, vaddr_t stackptr);
+
+
 
 /*
  * Prototypes for IN-KERNEL entry points for system call implementations.
@@ -57,9 +62,30 @@ void enter_new_process(int argc, userptr_t argv, vaddr_t stackptr,
 
 int sys_reboot(int code);
 int sys___time(userptr_t user_seconds, userptr_t user_nanoseconds);
+int sys_getrusage(int who, userptr_t usage);
+int sys___vmstats(userptr_t counts, unsigned ncounts, int32_t *retval);
+int sys___threadfork(struct trapframe *tf, userptr_t entry, userptr_t arg,
+		     userptr_t stack, userptr_t exitaddr);
+int sys___futex_wait(userptr_t addr, int val);
+int sys___futex_wake(userptr_t addr, unsigned n, int32_t *retval);
+void sys___threadexit(void);
+int sys_sbrk(intptr_t amount, int32_t *retval);
+int sys_mmap(userptr_t addr, size_t len, int prot, int flags, int fd,
+	     off_t offset, int32_t *retval);
+int sys_munmap(userptr_t addr, size_t len);
+int sys_msync(userptr_t addr, size_t len, int flags);
 
 #ifdef UW
+struct vnode;
+int fd_get(int fd, int *flags, struct vnode **ret);
+
+int sys_open(userptr_t path, int flags, int mode, int *retval);
+int sys_fstat(int fdesc, userptr_t statbuf);
 int sys_write(int fdesc,userptr_t ubuf,unsigned int nbytes,int *retval);
+int sys_read(int fdesc,userptr_t ubuf,unsigned int nbytes,int *retval);
+int sys_close(int fdesc);
+int sys_dup2(int oldfd, int newfd, int *retval);
+int sys_pipe(userptr_t fds);
 void sys__exit(int exitcode);
 int sys_getpid(pid_t *retval);
 int sys_waitpid(pid_t pid, userptr_t status, int options, pid_t *retval);
@@ -0,0 +1,60 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef _SYSCALLSTATS_H_
+#define _SYSCALLSTATS_H_
+
+/*
+ * System call latency profiling.
+ *
+ * The system call dispatcher calls syscallstats_enter() with the call
+ * number before dispatching and syscallstats_leave() afterwards.
+ * Calls that never return to the dispatcher (_exit) must call
+ * syscallstats_leave() themselves before the thread goes away. The
+ * entry timestamp is kept in the thread, so nested or interleaved
+ * calls on different threads don't interfere.
+ *
+ * For each call number we keep a count, the total, minimum, and
+ * maximum latency in cycles, and a histogram of latencies in which
+ * bucket N counts calls that took [2^N, 2^(N+1)) cycles.
+ *
+ * syscallstats_print dumps the calls that have been made at least
+ * once; syscallstats_reset zeroes everything.
+ */
+
+#define SYSCALLSTATS_NCALLS	128	/* must exceed the largest SYS_ number */
+#define SYSCALLSTATS_NBUCKETS	32	/* one per bit of a cycle count */
+
+void syscallstats_enter(int callno);
+void syscallstats_leave(void);
+void syscallstats_print(void);
+void syscallstats_reset(void);
+
+
+#endif /* _SYSCALLSTATS_H_ */
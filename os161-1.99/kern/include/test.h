@@ -59,6 +59,11 @@ int threadtest3(int, char **);
 int semtest(int, char **);
 int locktest(int, char **);
 int cvtest(int, char **);
+int rwtest(int, char **);
+int rwbench(int, char **);
+int fairtest(int, char **);
+int timedtest(int, char **);
+int workqueuetest(int, char **);
 
 #ifdef UW
 /* Another thread and synchronization test */
@@ -64,6 +64,22 @@ typedef enum {
 	S_ZOMBIE,	/* zombie; exited but not yet deleted */
 } threadstate_t;
 
+/*
+ * CPU accounting, kept per thread and summed per process (see
+ * proc_getusage). Run and wait times are in cpu_getcycles() cycles;
+ * the tick counts say where the timer interrupt found the thread and
+ * are what getrusage uses to split run time into user and system.
+ * Only the CPU the thread is on updates these, with interrupts off.
+ */
+struct threadusage {
+	uint64_t tu_runcycles;		/* Time spent running */
+	uint64_t tu_waitcycles;		/* Time spent on a run queue */
+	unsigned tu_uticks;		/* Timer ticks taken in user mode */
+	unsigned tu_sticks;		/* Timer ticks taken in the kernel */
+	unsigned tu_nvcsw;		/* Voluntary context switches */
+	unsigned tu_nivcsw;		/* Involuntary (preempted) switches */
+};
+
 /* Thread structure. */
 struct thread {
 	/*
@@ -82,6 +98,7 @@ struct thread {
 	void *t_stack;			/* Kernel-level stack */
 	struct switchframe *t_context;	/* Saved register context (on stack) */
 	struct cpu *t_cpu;		/* CPU thread runs on */
+	bool t_pinned;			/* never migrate off t_cpu */
 	struct proc *t_proc;		/* Process thread belongs to */
 
 	/*
@@ -105,6 +122,18 @@ struct thread {
 	 * Public fields
 	 */
 
+	/* System call profiling; see syscallstats.h */
+	int t_syscallno;		/* Call in progress, or -1 */
+	uint32_t t_syscallstart;	/* Cycle count at syscall entry */
+
+	/* CPU accounting */
+	struct threadusage t_usage;	/* Totals so far */
+	uint32_t t_runstart;		/* Cycle count when last switched in */
+	uint32_t t_readystart;		/* Cycle count when last made runnable */
+
+	/* User threads made by __threadfork; see thread_syscalls.c */
+	userptr_t t_exitaddr;		/* zeroed and woken at exit, or NULL */
+
 	/* add more here as needed */
 };
 
@@ -144,6 +173,16 @@ int thread_fork(const char *name, struct proc *proc,
                 void (*func)(void *, unsigned long),
                 void *data1, unsigned long data2);
 
+/*
+ * Same, but start the thread on CPU number CPUNUM and keep it there;
+ * thread_consider_migration leaves it alone. For per-CPU kernel
+ * threads. thread_numcpus returns the number of CPUs.
+ */
+int thread_fork_oncpu(const char *name, struct proc *proc, unsigned cpunum,
+                      void (*func)(void *, unsigned long),
+                      void *data1, unsigned long data2);
+unsigned thread_numcpus(void);
+
 /*
  * Cause the current thread to exit.
  * Interrupts need not be disabled.
@@ -168,5 +207,14 @@ void schedule(void);
  */
 void thread_consider_migration(void);
 
+/*
+ * CPU accounting. thread_accounttick is called from the timer
+ * interrupt to charge a tick to the current thread. thread_getusage
+ * copies out T's totals including the run or wait period in progress;
+ * T must be kept from exiting, e.g. by holding its process's p_lock.
+ */
+void thread_accounttick(bool usermode);
+void thread_getusage(struct thread *t, struct threadusage *tu);
+
 
 #endif /* _THREAD_H_ */
@@ -0,0 +1,88 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef _TRACE_H_
+#define _TRACE_H_
+
+/*
+ * Kernel event tracing.
+ *
+ * Each CPU has a ring of the last TRACE_NENTRIES events it recorded.
+ * An event is a cycle-count timestamp, the CPU, the current thread,
+ * an event code, and two 32-bit arguments whose meaning depends on
+ * the code (see below). Recording takes no locks: a CPU only ever
+ * writes its own ring, with interrupts off. So it's cheap enough to
+ * leave the tracepoints in hot paths; when tracing is off each one
+ * is a single test of trace_on.
+ *
+ * trace_start allocates the rings the first time and turns tracing
+ * on; trace_stop turns it off; trace_clear empties the rings.
+ * trace_dump stops tracing and prints the events of the types set in
+ * EVENTMASK (bit N for event N), merged across CPUs in time order,
+ * one per line:
+ *
+ *    <cycles> <cpu> <thread> <event> <arg0> <arg1>
+ *
+ * with cycles and cpu in decimal and the rest in hex, except the
+ * event, which is its name. Lines starting with '#' are comments.
+ * This is meant to be easy to pull apart with awk and friends.
+ */
+
+/* Event codes. */
+#define TRACE_SWITCH	0	/* context switch: next thread, new state */
+#define TRACE_SLEEP	1	/* wchan sleep: wchan, deadline tick or 0 */
+#define TRACE_WAKE	2	/* made runnable: thread, target cpu */
+#define TRACE_SYSCALL	3	/* syscall entry: call number, 0 */
+#define TRACE_SYSRET	4	/* syscall exit: call number, error */
+#define TRACE_FAULT	5	/* VM fault: fault type, address */
+#define TRACE_DISKIO	6	/* disk sector I/O: sector, 1 if write */
+#define TRACE_NEVENTS	7
+
+#define TRACE_ALLEVENTS	((1U << TRACE_NEVENTS) - 1)
+
+#define TRACE_NENTRIES	512	/* per cpu; must be a power of 2 */
+
+extern volatile bool trace_on;
+
+#define TRACE(ev, a0, a1) \
+	do { \
+		if (trace_on) { \
+			trace_record((ev), (uint32_t)(a0), (uint32_t)(a1)); \
+		} \
+	} while (0)
+
+void trace_record(unsigned event, uint32_t arg0, uint32_t arg1);
+int trace_start(void);
+void trace_stop(void);
+void trace_clear(void);
+void trace_dump(unsigned eventmask);
+int trace_eventbyname(const char *name);
+
+
+#endif /* _TRACE_H_ */
@@ -26,17 +26,8 @@
  */
 
 /* DO NOT ADD OR CHANGE WITHOUT ALSO CHANGING vmstats.h */
-#define VMSTAT_TLB_FAULT              (0)
-#define VMSTAT_TLB_FAULT_FREE         (1)
-#define VMSTAT_TLB_FAULT_REPLACE      (2)
-#define VMSTAT_TLB_INVALIDATE         (3)
-#define VMSTAT_TLB_RELOAD             (4)
-#define VMSTAT_PAGE_FAULT_ZERO        (5)
-#define VMSTAT_PAGE_FAULT_DISK        (6)
-#define VMSTAT_ELF_FILE_READ          (7)
-#define VMSTAT_SWAP_FILE_READ         (8)
-#define VMSTAT_SWAP_FILE_WRITE        (9)
-#define VMSTAT_COUNT                 (10)
+/* The indexes are in kern/vmstats.h so userlevel can use them too. */
+#include <kern/vmstats.h>
 
 /* ----------------------------------------------------------------------- */
 
@@ -52,6 +43,9 @@ void _vmstats_init(void);                    /* atomicity must be ensured elsewh
 void vmstats_inc(unsigned int index);    /* uses locking */
 void _vmstats_inc(unsigned int index);   /* atomicity must be ensured elsewhere */
 
+/* Copy all VMSTAT_COUNT counts into COUNTS */
+void vmstats_get(unsigned int *counts);      /* uses locking */
+
 /* Print the statistics: assumes that at least vmstats_init has been called */
 void vmstats_print(void);                    /* Does NOT use locking */
 
@@ -71,14 +71,21 @@ void wchan_unlock(struct wchan *wc);
  */
 void wchan_sleep(struct wchan *wc);
 
+/*
+ * Same, but wake up anyway at hardclock tick DEADLINE (see clock.h).
+ * Returns 0 if woken normally and ETIMEDOUT if the deadline passed.
+ */
+int wchan_sleep_until(struct wchan *wc, uint64_t deadline);
+
 /*
  * Wake up one thread, or all threads, sleeping on a wait channel.
- * The queue should not already be locked.
+ * The queue should not already be locked. wchan_wakeone returns
+ * whether there was anyone to wake.
  *
  * The current implementation is FIFO but this is not promised by the
  * interface.
  */
-void wchan_wakeone(struct wchan *wc);
+bool wchan_wakeone(struct wchan *wc);
 void wchan_wakeall(struct wchan *wc);
 
 
@@ -0,0 +1,108 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef _WORKQUEUE_H_
+#define _WORKQUEUE_H_
+
+/*
+ * Work queues.
+ *
+ * A workqueue has one worker thread per CPU, each bound to its CPU,
+ * and each with its own queue of pending work. Work items are run in
+ * order of submission per CPU, one at a time per CPU, and in thread
+ * context, so they may sleep, take locks, do I/O, and so on.
+ *
+ * struct work is allocated by the caller (usually embedded in some
+ * other structure) and must stay valid until its function has been
+ * called. It's fine for the function to free it, or to submit it
+ * again.
+ *
+ * Functions:
+ *    workqueue_create  - make a workqueue and start its workers.
+ *    workqueue_destroy - run everything left on it, stop the workers,
+ *                        and free it.
+ *    work_init         - set up a work item to call FUNC(DATA, NUM).
+ *    workqueue_submit  - queue work on the current CPU's worker.
+ *                        Returns false (and does nothing) if it was
+ *                        already queued. May be called from an
+ *                        interrupt handler.
+ *    workqueue_submit_cpu - same, for a particular CPU's worker.
+ *    workqueue_flush   - wait until everything submitted before the
+ *                        call has finished running.
+ *    workqueue_parallel_for - call FUNC(DATA, i) for every i in
+ *                        [0, N), spread across all the CPUs, and wait
+ *                        for them all. Returns ENOMEM if it can't set
+ *                        up the work, otherwise 0.
+ *
+ * w_queued is kept under the lock of whichever CPU queue the work is
+ * on, so submitting the same work to two different CPUs at the same
+ * moment can't be caught; don't do that.
+ *
+ * Neither workqueue_flush nor workqueue_parallel_for may be called
+ * from work running on the same workqueue; they would wait for
+ * themselves.
+ *
+ * sys_wq is a general-purpose workqueue for the kernel at large,
+ * created by workqueue_bootstrap once all the CPUs are up.
+ */
+
+struct wq_cpu;		/* private to workqueue.c */
+
+struct work {
+	struct work *w_next;			/* queue link */
+	void (*w_func)(void *, unsigned long);	/* what to do */
+	void *w_data;
+	unsigned long w_num;
+	volatile bool w_queued;			/* on a queue now */
+};
+
+struct workqueue {
+	char *wq_name;
+	unsigned wq_ncpus;
+	struct wq_cpu *wq_cpus;		/* one per cpu */
+};
+
+extern struct workqueue *sys_wq;
+
+void workqueue_bootstrap(void);
+
+struct workqueue *workqueue_create(const char *name);
+void workqueue_destroy(struct workqueue *wq);
+
+void work_init(struct work *w, void (*func)(void *, unsigned long),
+	       void *data, unsigned long num);
+bool workqueue_submit(struct workqueue *wq, struct work *w);
+bool workqueue_submit_cpu(struct workqueue *wq, unsigned cpunum,
+			  struct work *w);
+void workqueue_flush(struct workqueue *wq);
+int workqueue_parallel_for(struct workqueue *wq, unsigned long n,
+			   void (*func)(void *, unsigned long), void *data);
+
+
+#endif /* _WORKQUEUE_H_ */
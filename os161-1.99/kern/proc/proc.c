@@ -42,6 +42,8 @@
  * process that will have more than one thread is the kernel process.
  */
 
+#define PROCINLINE
+
 #include <types.h>
 #include <proc.h>
 #include <current.h>
@@ -56,6 +58,12 @@
  */
 struct proc *kproc;
 
+/*
+ * All processes, for ps and friends.
+ */
+struct procarray allprocs;
+struct spinlock allprocs_lock = SPINLOCK_INITIALIZER;
+
 /*
  * Mechanism for making the kernel menu thread sleep while processes are running
  */
@@ -71,6 +79,21 @@ struct semaphore *no_proc_sem;
 
 
 
+/*
+ * Add one set of CPU usage totals into another.
+ */
+static
+void
+usage_add(struct threadusage *sum, const struct threadusage *tu)
+{
+	sum->tu_runcycles += tu->tu_runcycles;
+	sum->tu_waitcycles += tu->tu_waitcycles;
+	sum->tu_uticks += tu->tu_uticks;
+	sum->tu_sticks += tu->tu_sticks;
+	sum->tu_nvcsw += tu->tu_nvcsw;
+	sum->tu_nivcsw += tu->tu_nivcsw;
+}
+
 /*
  * Create a proc structure.
  */
@@ -79,6 +102,7 @@ struct proc *
 proc_create(const char *name)
 {
 	struct proc *proc;
+	int result;
 
 	proc = kmalloc(sizeof(*proc));
 	if (proc == NULL) {
@@ -92,6 +116,8 @@ proc_create(const char *name)
 
 	threadarray_init(&proc->p_threads);
 	spinlock_init(&proc->p_lock);
+	bzero(&proc->p_usage, sizeof(proc->p_usage));
+	proc->p_exiting = false;
 
 	/* VM fields */
 	proc->p_addrspace = NULL;
@@ -101,8 +127,33 @@ proc_create(const char *name)
 
 #ifdef UW
 	proc->console = NULL;
+	bzero(proc->p_fds, sizeof(proc->p_fds));
+	bzero(proc->p_fdflags, sizeof(proc->p_fdflags));
+	bzero(proc->p_fdoff, sizeof(proc->p_fdoff));
+	proc->p_fdlock = lock_create("p_fdlock");
+	if (proc->p_fdlock == NULL) {
+		threadarray_cleanup(&proc->p_threads);
+		spinlock_cleanup(&proc->p_lock);
+		kfree(proc->p_name);
+		kfree(proc);
+		return NULL;
+	}
 #endif // UW
 
+	spinlock_acquire(&allprocs_lock);
+	result = procarray_add(&allprocs, proc, NULL);
+	spinlock_release(&allprocs_lock);
+	if (result) {
+#ifdef UW
+		lock_destroy(proc->p_fdlock);
+#endif // UW
+		threadarray_cleanup(&proc->p_threads);
+		spinlock_cleanup(&proc->p_lock);
+		kfree(proc->p_name);
+		kfree(proc);
+		return NULL;
+	}
+
 	return proc;
 }
 
@@ -112,6 +163,8 @@ proc_create(const char *name)
 void
 proc_destroy(struct proc *proc)
 {
+	unsigned i, num;
+
 	/*
          * note: some parts of the process structure, such as the address space,
          *  are destroyed in sys_exit, before we get here
@@ -124,6 +177,18 @@ proc_destroy(struct proc *proc)
 	KASSERT(proc != NULL);
 	KASSERT(proc != kproc);
 
+	/* Take it off the list first so ps stops looking at it. */
+	spinlock_acquire(&allprocs_lock);
+	num = procarray_num(&allprocs);
+	for (i=0; i<num; i++) {
+		if (procarray_get(&allprocs, i) == proc) {
+			procarray_remove(&allprocs, i);
+			break;
+		}
+	}
+	KASSERT(i < num);
+	spinlock_release(&allprocs_lock);
+
 	/*
 	 * We don't take p_lock in here because we must have the only
 	 * reference to this structure. (Otherwise it would be
@@ -158,6 +223,15 @@ proc_destroy(struct proc *proc)
 #endif // UW
 
 #ifdef UW
+	/* close whatever files are still open; pipes see their ends go */
+	for (i=0; i<OPEN_MAX; i++) {
+	  if (proc->p_fds[i] != NULL) {
+	    VOP_DECREF(proc->p_fds[i]);
+	    proc->p_fds[i] = NULL;
+	  }
+	}
+	lock_destroy(proc->p_fdlock);
+
 	if (proc->console) {
 	  vfs_close(proc->console);
 	}
@@ -193,6 +267,7 @@ proc_destroy(struct proc *proc)
 void
 proc_bootstrap(void)
 {
+  procarray_init(&allprocs);
   kproc = proc_create("[kernel]");
   if (kproc == NULL) {
     panic("proc_create for kproc failed\n");
@@ -221,6 +296,9 @@ proc_create_runprogram(const char *name)
 {
 	struct proc *proc;
 	char *console_path;
+#ifdef UW
+	int i;
+#endif // UW
 
 	proc = proc_create(name);
 	if (proc == NULL) {
@@ -237,6 +315,13 @@ proc_create_runprogram(const char *name)
 	  panic("unable to open the console during process creation\n");
 	}
 	kfree(console_path);
+
+	/* stdin, stdout and stderr all start out as the console */
+	for (i=0; i<3; i++) {
+	  VOP_INCREF(proc->console);
+	  proc->p_fds[i] = proc->console;
+	  proc->p_fdflags[i] = O_RDWR;
+	}
 #endif // UW
 	  
 	/* VM fields */
@@ -297,12 +382,14 @@ proc_addthread(struct proc *proc, struct thread *t)
 
 /*
  * Remove a thread from its process. Either the thread or the process
- * might or might not be current.
+ * might or might not be current. Returns the number of threads still
+ * in the process, so exactly one caller sees it reach zero.
  */
-void
+unsigned
 proc_remthread(struct thread *t)
 {
 	struct proc *proc;
+	struct threadusage tu;
 	unsigned i, num;
 
 	proc = t->t_proc;
@@ -314,14 +401,63 @@ proc_remthread(struct thread *t)
 	for (i=0; i<num; i++) {
 		if (threadarray_get(&proc->p_threads, i) == t) {
 			threadarray_remove(&proc->p_threads, i);
+			/* keep what it used */
+			thread_getusage(t, &tu);
+			usage_add(&proc->p_usage, &tu);
+			num = threadarray_num(&proc->p_threads);
 			spinlock_release(&proc->p_lock);
 			t->t_proc = NULL;
-			return;
+			return num;
 		}
 	}
 	/* Did not find it. */
 	spinlock_release(&proc->p_lock);
 	panic("Thread (%p) has escaped from its process (%p)\n", t, proc);
+	return 0;
+}
+
+/*
+ * Add up the CPU usage of a process.
+ */
+void
+proc_getusage(struct proc *proc, struct threadusage *tu)
+{
+	struct threadusage ttu;
+	unsigned i, num;
+
+	spinlock_acquire(&proc->p_lock);
+	*tu = proc->p_usage;
+	num = threadarray_num(&proc->p_threads);
+	for (i=0; i<num; i++) {
+		thread_getusage(threadarray_get(&proc->p_threads, i), &ttu);
+		usage_add(tu, &ttu);
+	}
+	spinlock_release(&proc->p_lock);
+}
+
+/*
+ * Mark a process as exiting.
+ */
+void
+proc_setexiting(struct proc *proc)
+{
+	spinlock_acquire(&proc->p_lock);
+	proc->p_exiting = true;
+	spinlock_release(&proc->p_lock);
+}
+
+/*
+ * Check whether a process is exiting.
+ */
+bool
+proc_isexiting(struct proc *proc)
+{
+	bool ret;
+
+	spinlock_acquire(&proc->p_lock);
+	ret = proc->p_exiting;
+	spinlock_release(&proc->p_lock);
+	return ret;
 }
 
 /*
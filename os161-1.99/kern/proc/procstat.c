@@ -0,0 +1,270 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * Process CPU usage reports: ps and top.
+ *
+ * Everything is copied out under allprocs_lock and the p_locks into a
+ * kmalloc'd snapshot and printed afterwards, since kprintf can sleep.
+ */
+
+#include <types.h>
+#include <kern/errno.h>
+#include <lib.h>
+#include <cpu.h>
+#include <clock.h>
+#include <mainbus.h>
+#include <thread.h>
+#include <proc.h>
+#include <procstat.h>
+
+#define PS_NAMELEN	20	/* names are cut to fit */
+#define PS_SLACK	8	/* room for procs created while we allocate */
+
+/* One line of output: a process, or one of its threads. */
+struct psentry {
+	char pe_name[PS_NAMELEN];
+	const struct proc *pe_proc;	/* for matching; never dereferenced */
+	bool pe_isproc;
+	threadstate_t pe_state;
+	unsigned pe_nthreads;
+	struct threadusage pe_usage;
+};
+
+/*
+ * Take a snapshot of all processes, and of their threads too if
+ * WITHTHREADS. Returns the number of entries in *RET, which the
+ * caller frees, or 0 if out of memory. If processes appear faster
+ * than we can allocate for them, the latecomers are left out.
+ */
+static
+unsigned
+procstat_snapshot(struct psentry **ret, bool withthreads)
+{
+	struct psentry *pe;
+	struct proc *p;
+	struct thread *t;
+	unsigned i, j, nprocs, nthreads, max, num;
+
+	max = 0;
+	spinlock_acquire(&allprocs_lock);
+	nprocs = procarray_num(&allprocs);
+	for (i=0; i<nprocs; i++) {
+		max++;
+		if (withthreads) {
+			p = procarray_get(&allprocs, i);
+			spinlock_acquire(&p->p_lock);
+			max += threadarray_num(&p->p_threads);
+			spinlock_release(&p->p_lock);
+		}
+	}
+	spinlock_release(&allprocs_lock);
+	max += PS_SLACK;
+
+	pe = kmalloc(max * sizeof(*pe));
+	if (pe == NULL) {
+		*ret = NULL;
+		return 0;
+	}
+
+	num = 0;
+	spinlock_acquire(&allprocs_lock);
+	nprocs = procarray_num(&allprocs);
+	for (i=0; i<nprocs && num < max; i++) {
+		p = procarray_get(&allprocs, i);
+
+		snprintf(pe[num].pe_name, PS_NAMELEN, "%s", p->p_name);
+		pe[num].pe_proc = p;
+		pe[num].pe_isproc = true;
+		pe[num].pe_state = S_RUN;
+		proc_getusage(p, &pe[num].pe_usage);
+		spinlock_acquire(&p->p_lock);
+		nthreads = threadarray_num(&p->p_threads);
+		pe[num].pe_nthreads = nthreads;
+		num++;
+
+		for (j=0; withthreads && j<nthreads && num < max; j++) {
+			t = threadarray_get(&p->p_threads, j);
+			snprintf(pe[num].pe_name, PS_NAMELEN, "%s",
+				 t->t_name);
+			pe[num].pe_proc = p;
+			pe[num].pe_isproc = false;
+			pe[num].pe_state = t->t_state;
+			pe[num].pe_nthreads = 1;
+			thread_getusage(t, &pe[num].pe_usage);
+			num++;
+		}
+		spinlock_release(&p->p_lock);
+	}
+	spinlock_release(&allprocs_lock);
+
+	*ret = pe;
+	return num;
+}
+
+/*
+ * Cycles to whole milliseconds, for printing.
+ */
+static
+unsigned long
+procstat_ms(uint64_t cycles)
+{
+	return (unsigned long)(mainbus_cyclestons(cycles) / 1000000);
+}
+
+static
+const char *
+procstat_statename(threadstate_t state)
+{
+	switch (state) {
+	    case S_RUN: return "run";
+	    case S_READY: return "ready";
+	    case S_SLEEP: return "sleep";
+	    case S_ZOMBIE: return "zombie";
+	}
+	return "?";
+}
+
+void
+procstat_ps(void)
+{
+	struct psentry *pe;
+	struct threadusage *tu;
+	unsigned i, num;
+
+	num = procstat_snapshot(&pe, true);
+	if (pe == NULL) {
+		kprintf("ps: %s\n", strerror(ENOMEM));
+		return;
+	}
+
+	kprintf("%-22s %-6s %9s %7s %7s %7s %7s %9s\n",
+		"NAME", "STATE", "RUN(ms)", "UTICKS", "STICKS",
+		"VCSW", "IVCSW", "WAIT(ms)");
+	for (i=0; i<num; i++) {
+		tu = &pe[i].pe_usage;
+		if (pe[i].pe_isproc) {
+			kprintf("%-22s %2u thr", pe[i].pe_name,
+				pe[i].pe_nthreads);
+		}
+		else {
+			kprintf("  %-20s %-6s", pe[i].pe_name,
+				procstat_statename(pe[i].pe_state));
+		}
+		kprintf(" %9lu %7u %7u %7u %7u %9lu\n",
+			procstat_ms(tu->tu_runcycles),
+			tu->tu_uticks, tu->tu_sticks,
+			tu->tu_nvcsw, tu->tu_nivcsw,
+			procstat_ms(tu->tu_waitcycles));
+	}
+
+	kfree(pe);
+}
+
+void
+procstat_top(unsigned secs)
+{
+	struct psentry *before, *after, tmp;
+	struct threadusage *tu;
+	const struct threadusage *old;
+	unsigned nbefore, nafter, i, j;
+	uint32_t start, elapsed;
+	uint64_t total;
+	unsigned long permille;
+
+	KASSERT(secs > 0 && secs <= PROCSTAT_TOPMAXSECS);
+
+	nbefore = procstat_snapshot(&before, false);
+	if (before == NULL) {
+		kprintf("top: %s\n", strerror(ENOMEM));
+		return;
+	}
+	start = cpu_getcycles();
+
+	clocksleep(secs);
+
+	nafter = procstat_snapshot(&after, false);
+	elapsed = cpu_getcycles() - start;
+	if (after == NULL) {
+		kprintf("top: %s\n", strerror(ENOMEM));
+		kfree(before);
+		return;
+	}
+
+	/*
+	 * Turn the second snapshot into differences. A process that
+	 * wasn't there the first time counts from zero. Then sort,
+	 * busiest first; there aren't many, so insertion sort is fine.
+	 */
+	for (i=0; i<nafter; i++) {
+		tu = &after[i].pe_usage;
+		for (j=0; j<nbefore; j++) {
+			if (before[j].pe_proc == after[i].pe_proc &&
+			    !strcmp(before[j].pe_name, after[i].pe_name)) {
+				break;
+			}
+		}
+		if (j == nbefore) {
+			continue;
+		}
+		old = &before[j].pe_usage;
+		tu->tu_runcycles -= old->tu_runcycles;
+		tu->tu_waitcycles -= old->tu_waitcycles;
+		tu->tu_uticks -= old->tu_uticks;
+		tu->tu_sticks -= old->tu_sticks;
+		tu->tu_nvcsw -= old->tu_nvcsw;
+		tu->tu_nivcsw -= old->tu_nivcsw;
+	}
+	for (i=1; i<nafter; i++) {
+		tmp = after[i];
+		for (j=i; j>0 && after[j-1].pe_usage.tu_runcycles <
+			     tmp.pe_usage.tu_runcycles; j--) {
+			after[j] = after[j-1];
+		}
+		after[j] = tmp;
+	}
+
+	total = (uint64_t)elapsed * thread_numcpus();
+	kprintf("%u second(s), %u cpu(s)\n", secs, thread_numcpus());
+	kprintf("%-22s %6s %9s %7s %7s %9s\n",
+		"NAME", "%CPU", "RUN(ms)", "VCSW", "IVCSW", "WAIT(ms)");
+	for (i=0; i<nafter; i++) {
+		tu = &after[i].pe_usage;
+		permille = total == 0 ? 0 :
+			(unsigned long)(tu->tu_runcycles * 1000 / total);
+		kprintf("%-22s %4lu.%lu %9lu %7u %7u %9lu\n",
+			after[i].pe_name, permille / 10, permille % 10,
+			procstat_ms(tu->tu_runcycles),
+			tu->tu_nvcsw, tu->tu_nivcsw,
+			procstat_ms(tu->tu_waitcycles));
+	}
+
+	kfree(before);
+	kfree(after);
+}
@@ -42,6 +42,8 @@
 #include <proc.h>
 #include <current.h>
 #include <synch.h>
+#include <workqueue.h>
+#include <futex.h>
 #include <vm.h>
 #include <mainbus.h>
 #include <vfs.h>
@@ -125,6 +127,8 @@ boot(void)
 	vm_bootstrap();
 	kprintf_bootstrap();
 	thread_start_cpus();
+	workqueue_bootstrap();
+	futex_bootstrap();
 
 	/* Default bootfs - but ignore failure, in case emu0 doesn't exist */
 	vfs_setbootfs("emu0");
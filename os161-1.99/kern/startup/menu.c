@@ -41,6 +41,10 @@
 #include <vfs.h>
 #include <sfs.h>
 #include <syscall.h>
+#include <syscallstats.h>
+#include <procstat.h>
+#include <trace.h>
+#include <prof.h>
 #include <test.h>
 #include "opt-synchprobs.h"
 #include "opt-sfs.h"
@@ -396,6 +400,181 @@ cmd_kheapstats(int nargs, char **args)
 	return 0;
 }
 
+/*
+ * Command for printing system call latency statistics.
+ */
+static
+int
+cmd_syscallstats(int nargs, char **args)
+{
+	(void)nargs;
+	(void)args;
+
+	syscallstats_print();
+
+	return 0;
+}
+
+/*
+ * Command for clearing system call latency statistics.
+ */
+static
+int
+cmd_syscallstatsreset(int nargs, char **args)
+{
+	(void)nargs;
+	(void)args;
+
+	syscallstats_reset();
+
+	return 0;
+}
+
+/*
+ * Command for listing processes and threads with their CPU usage.
+ */
+static
+int
+cmd_ps(int nargs, char **args)
+{
+	(void)nargs;
+	(void)args;
+
+	procstat_ps();
+
+	return 0;
+}
+
+/*
+ * Command for showing which processes used the CPU over the next
+ * few seconds.
+ *
+ *    top [secs]    sample for SECS seconds (default 1)
+ */
+static
+int
+cmd_top(int nargs, char **args)
+{
+	int secs;
+
+	if (nargs > 2) {
+		kprintf("Usage: top [secs]\n");
+		return EINVAL;
+	}
+	secs = nargs > 1 ? atoi(args[1]) : 1;
+	if (secs <= 0 || secs > PROCSTAT_TOPMAXSECS) {
+		kprintf("top: secs must be between 1 and %d\n",
+			PROCSTAT_TOPMAXSECS);
+		return EINVAL;
+	}
+
+	procstat_top(secs);
+
+	return 0;
+}
+
+/*
+ * Command for the event tracer.
+ *
+ *    trace on             start recording
+ *    trace off            stop recording
+ *    trace clear          throw away what's been recorded
+ *    trace dump [ev...]   stop, and print everything, or only the
+ *                         named events
+ */
+static
+int
+cmd_trace(int nargs, char **args)
+{
+	unsigned mask;
+	int i, ev, result;
+
+	if (nargs < 2) {
+		goto usage;
+	}
+	if (!strcmp(args[1], "on")) {
+		result = trace_start();
+		if (result) {
+			kprintf("trace: %s\n", strerror(result));
+			return result;
+		}
+	}
+	else if (!strcmp(args[1], "off")) {
+		trace_stop();
+	}
+	else if (!strcmp(args[1], "clear")) {
+		trace_clear();
+	}
+	else if (!strcmp(args[1], "dump")) {
+		mask = nargs > 2 ? 0 : TRACE_ALLEVENTS;
+		for (i=2; i<nargs; i++) {
+			ev = trace_eventbyname(args[i]);
+			if (ev < 0) {
+				kprintf("trace: Unknown event %s\n", args[i]);
+				return EINVAL;
+			}
+			mask |= 1U << ev;
+		}
+		trace_dump(mask);
+	}
+	else {
+		goto usage;
+	}
+	return 0;
+
+ usage:
+	kprintf("Usage: trace on | off | clear | dump [event...]\n");
+	kprintf("Events: switch sleep wake syscall sysret fault diskio\n");
+	return EINVAL;
+}
+
+/*
+ * Command for the sampling profiler.
+ *
+ *    prof start                  start sampling
+ *    prof stop                   stop sampling
+ *    prof reset                  zero the counts
+ *    prof report [n [kernel]]    print the top N (default 20) entries,
+ *                                using symbols from the kernel file
+ *                                (default emu0:kernel)
+ */
+static
+int
+cmd_prof(int nargs, char **args)
+{
+	unsigned ntop;
+	int result;
+
+	if (nargs < 2) {
+		goto usage;
+	}
+	if (!strcmp(args[1], "start")) {
+		result = prof_start();
+		if (result) {
+			kprintf("prof: %s\n", strerror(result));
+			return result;
+		}
+	}
+	else if (!strcmp(args[1], "stop")) {
+		prof_stop();
+	}
+	else if (!strcmp(args[1], "reset")) {
+		prof_reset();
+	}
+	else if (!strcmp(args[1], "report") && nargs <= 4) {
+		ntop = nargs > 2 ? atoi(args[2]) : 20;
+		prof_report(nargs > 3 ? args[3] : "emu0:kernel", ntop);
+	}
+	else {
+		goto usage;
+	}
+	return 0;
+
+ usage:
+	kprintf("Usage: prof start | stop | reset | report [n [kernel]]\n");
+	return EINVAL;
+}
+
 ////////////////////////////////////////
 //
 // Menus.
@@ -437,6 +616,8 @@ static const char *opsmenu[] = {
 	"[sync]    Sync filesystems          ",
 	"[panic]   Intentional panic         ",
 	"[dth]	Enable debug output",
+	"[trace]   Event trace on/off/dump   ",
+	"[prof]    Profiler start/stop/report",
 	"[q]       Quit and shut down        ",
 	NULL
 };
@@ -466,6 +647,11 @@ static const char *testmenu[] = {
 	"[sy1] Semaphore test                ",
 	"[sy2] Lock test             (1)     ",
 	"[sy3] CV test               (1)     ",
+	"[rw1] RW lock test                  ",
+	"[rw2] RW lock throughput test       ",
+	"[fr1] Lock fairness test            ",
+	"[tm1] Timed wait test               ",
+	"[wq1] Workqueue test                ",
 #ifdef UW
 	"[uw1] UW lock test          (1)     ",
 	"[uw2] UW vmstats test       (3)     ",
@@ -505,6 +691,10 @@ static const char *mainmenu[] = {
 #endif /* UW */
 #endif
 	"[kh] Kernel heap stats              ",
+	"[ss] Syscall latency stats          ",
+	"[ssr] Reset syscall latency stats   ",
+	"[ps] Process CPU usage              ",
+	"[top] CPU usage over N seconds      ",
 	"[q] Quit and shut down              ",
 	NULL
 };
@@ -574,6 +764,12 @@ static struct {
 
 	/* stats */
 	{ "kh",         cmd_kheapstats },
+	{ "ss",		cmd_syscallstats },
+	{ "ssr",	cmd_syscallstatsreset },
+	{ "ps",		cmd_ps },
+	{ "top",	cmd_top },
+	{ "trace",	cmd_trace },
+	{ "prof",	cmd_prof },
 
 	/* base system tests */
 	{ "at",		arraytest },
@@ -591,6 +787,11 @@ static struct {
 	/* synchronization assignment tests */
 	{ "sy2",	locktest },
 	{ "sy3",	cvtest },
+	{ "rw1",	rwtest },
+	{ "rw2",	rwbench },
+	{ "fr1",	fairtest },
+	{ "tm1",	timedtest },
+	{ "wq1",	workqueuetest },
 #ifdef UW
 	{ "uw1",	uwlocktest1 },
 	{ "uw2",	uwvmstatstest },
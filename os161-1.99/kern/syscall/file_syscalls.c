@@ -1,60 +1,335 @@
 #include <types.h>
 #include <kern/errno.h>
 #include <kern/unistd.h>
+#include <kern/fcntl.h>
+#include <kern/stat.h>
+#include <limits.h>
 #include <lib.h>
 #include <uio.h>
+#include <synch.h>
 #include <syscall.h>
 #include <vnode.h>
 #include <vfs.h>
 #include <current.h>
 #include <proc.h>
+#include <copyinout.h>
+#include <pipe.h>
 
-/* handler for write() system call                  */
 /*
  * n.b.
- * This implementation handles only writes to standard output 
- * and standard error, both of which go to the console.
- * Also, it does not provide any synchronization, so writes
- * are not atomic.
- *
- * You will need to improve this implementation
+ * Files are kept in the per-process table curproc->p_fds, which holds
+ * a vnode reference per descriptor, alongside the flags it was opened
+ * with and its seek position. The console (on 0, 1 and 2 from the
+ * start) and pipes ignore the position. It belongs to the descriptor
+ * rather than to a shared open-file object, so dup2 copies it and the
+ * two copies move independently afterwards; that's enough for the
+ * shell's redirections, which never share a file between processes.
  */
 
+/*
+ * Look up descriptor FD, handing back its vnode with a reference of
+ * its own, so it stays put even if another thread closes FD while
+ * the caller is using it. Drop it with VOP_DECREF. The open flags
+ * come back in *FLAGS.
+ */
 int
-sys_write(int fdesc,userptr_t ubuf,unsigned int nbytes,int *retval)
+fd_get(int fd, int *flags, struct vnode **ret)
 {
+  struct proc *p = curproc;
+  struct vnode *v;
+
+  if (fd < 0 || fd >= OPEN_MAX) {
+    return EBADF;
+  }
+  lock_acquire(p->p_fdlock);
+  v = p->p_fds[fd];
+  if (v != NULL) {
+    VOP_INCREF(v);
+    *flags = p->p_fdflags[fd];
+  }
+  lock_release(p->p_fdlock);
+  if (v == NULL) {
+    return EBADF;
+  }
+  *ret = v;
+  return 0;
+}
+
+/* put V in the lowest free descriptor; the table takes over our reference */
+static
+int
+fd_install(struct vnode *v, int flags, int *retval)
+{
+  struct proc *p = curproc;
+  int i;
+
+  lock_acquire(p->p_fdlock);
+  for (i=0; i<OPEN_MAX; i++) {
+    if (p->p_fds[i] == NULL) {
+      p->p_fds[i] = v;
+      p->p_fdflags[i] = flags;
+      p->p_fdoff[i] = 0;
+      lock_release(p->p_fdlock);
+      *retval = i;
+      return 0;
+    }
+  }
+  lock_release(p->p_fdlock);
+  return EMFILE;
+}
+
+/* read or write NBYTES at UBUF on descriptor FD */
+static
+int
+fd_io(int fdesc, userptr_t ubuf, unsigned int nbytes, enum uio_rw rw,
+      int *retval)
+{
+  struct proc *p = curproc;
   struct iovec iov;
   struct uio u;
-  int res;
+  struct vnode *v;
+  struct stat st;
+  int flags, res;
 
-  DEBUG(DB_SYSCALL,"Syscall: write(%d,%x,%d)\n",fdesc,(unsigned int)ubuf,nbytes);
-  
-  /* only stdout and stderr writes are currently implemented */
-  if (!((fdesc==STDOUT_FILENO)||(fdesc==STDERR_FILENO))) {
-    return EUNIMP;
+  KASSERT(p != NULL);
+  KASSERT(p->p_addrspace != NULL);
+
+  res = fd_get(fdesc, &flags, &v);
+  if (res) {
+    return res;
+  }
+  if ((rw == UIO_READ && (flags & O_ACCMODE) == O_WRONLY) ||
+      (rw == UIO_WRITE && (flags & O_ACCMODE) == O_RDONLY)) {
+    VOP_DECREF(v);
+    return EBADF;
   }
-  KASSERT(curproc != NULL);
-  KASSERT(curproc->console != NULL);
-  KASSERT(curproc->p_addrspace != NULL);
 
   /* set up a uio structure to refer to the user program's buffer (ubuf) */
   iov.iov_ubase = ubuf;
   iov.iov_len = nbytes;
   u.uio_iov = &iov;
   u.uio_iovcnt = 1;
-  u.uio_offset = 0;  /* not needed for the console */
   u.uio_resid = nbytes;
   u.uio_segflg = UIO_USERSPACE;
-  u.uio_rw = UIO_WRITE;
-  u.uio_space = curproc->p_addrspace;
+  u.uio_rw = rw;
+  u.uio_space = p->p_addrspace;
 
-  res = VOP_WRITE(curproc->console,&u);
+  if (rw == UIO_WRITE && (flags & O_APPEND)) {
+    res = VOP_STAT(v, &st);
+    if (res) {
+      VOP_DECREF(v);
+      return res;
+    }
+    u.uio_offset = st.st_size;
+  }
+  else {
+    lock_acquire(p->p_fdlock);
+    u.uio_offset = p->p_fdoff[fdesc];
+    lock_release(p->p_fdlock);
+  }
+
+  if (rw == UIO_READ) {
+    res = VOP_READ(v,&u);
+  }
+  else {
+    res = VOP_WRITE(v,&u);
+  }
   if (res) {
+    VOP_DECREF(v);
     return res;
   }
 
-  /* pass back the number of bytes actually written */
+  /* move the position along, unless FD was closed or reused meanwhile */
+  lock_acquire(p->p_fdlock);
+  if (p->p_fds[fdesc] == v) {
+    p->p_fdoff[fdesc] = u.uio_offset;
+  }
+  lock_release(p->p_fdlock);
+  VOP_DECREF(v);
+
+  /* pass back the number of bytes actually transferred */
   *retval = nbytes - u.uio_resid;
   KASSERT(*retval >= 0);
   return 0;
 }
+
+/* handler for write() system call                  */
+int
+sys_write(int fdesc,userptr_t ubuf,unsigned int nbytes,int *retval)
+{
+  DEBUG(DB_SYSCALL,"Syscall: write(%d,%x,%d)\n",fdesc,(unsigned int)ubuf,nbytes);
+  return fd_io(fdesc, ubuf, nbytes, UIO_WRITE, retval);
+}
+
+/* handler for read() system call                  */
+int
+sys_read(int fdesc,userptr_t ubuf,unsigned int nbytes,int *retval)
+{
+  DEBUG(DB_SYSCALL,"Syscall: read(%d,%x,%d)\n",fdesc,(unsigned int)ubuf,nbytes);
+  return fd_io(fdesc, ubuf, nbytes, UIO_READ, retval);
+}
+
+/* handler for close() system call                  */
+int
+sys_close(int fdesc)
+{
+  struct proc *p = curproc;
+  struct vnode *v;
+
+  DEBUG(DB_SYSCALL,"Syscall: close(%d)\n",fdesc);
+
+  if (fdesc < 0 || fdesc >= OPEN_MAX) {
+    return EBADF;
+  }
+  lock_acquire(p->p_fdlock);
+  v = p->p_fds[fdesc];
+  p->p_fds[fdesc] = NULL;
+  lock_release(p->p_fdlock);
+  if (v == NULL) {
+    return EBADF;
+  }
+  /* for a pipe, this may be what tells the other end */
+  VOP_DECREF(v);
+  return 0;
+}
+
+/* handler for dup2() system call                  */
+int
+sys_dup2(int oldfd, int newfd, int *retval)
+{
+  struct proc *p = curproc;
+  struct vnode *v, *prev;
+
+  DEBUG(DB_SYSCALL,"Syscall: dup2(%d,%d)\n",oldfd,newfd);
+
+  if (oldfd < 0 || oldfd >= OPEN_MAX || newfd < 0 || newfd >= OPEN_MAX) {
+    return EBADF;
+  }
+  lock_acquire(p->p_fdlock);
+  v = p->p_fds[oldfd];
+  if (v == NULL) {
+    lock_release(p->p_fdlock);
+    return EBADF;
+  }
+  prev = p->p_fds[newfd];
+  if (v == prev) {
+    /* includes oldfd == newfd, which does nothing */
+    prev = NULL;
+  }
+  else {
+    VOP_INCREF(v);
+    p->p_fds[newfd] = v;
+    p->p_fdflags[newfd] = p->p_fdflags[oldfd];
+    p->p_fdoff[newfd] = p->p_fdoff[oldfd];
+  }
+  lock_release(p->p_fdlock);
+
+  if (prev != NULL) {
+    VOP_DECREF(prev);
+  }
+  *retval = newfd;
+  return 0;
+}
+
+/* handler for pipe() system call                  */
+int
+sys_pipe(userptr_t fds)
+{
+  struct proc *p = curproc;
+  struct vnode *rv, *wv;
+  int kfds[2];
+  int i, n, res;
+
+  DEBUG(DB_SYSCALL,"Syscall: pipe(%x)\n",(unsigned int)fds);
+
+  res = pipe_create(&rv, &wv);
+  if (res) {
+    return res;
+  }
+
+  /* the two lowest free descriptors, read end first */
+  lock_acquire(p->p_fdlock);
+  n = 0;
+  for (i=0; i<OPEN_MAX && n<2; i++) {
+    if (p->p_fds[i] == NULL) {
+      kfds[n++] = i;
+    }
+  }
+  if (n < 2) {
+    lock_release(p->p_fdlock);
+    VOP_DECREF(rv);
+    VOP_DECREF(wv);
+    return EMFILE;
+  }
+  p->p_fds[kfds[0]] = rv;
+  p->p_fdflags[kfds[0]] = O_RDONLY;
+  p->p_fdoff[kfds[0]] = 0;
+  p->p_fds[kfds[1]] = wv;
+  p->p_fdflags[kfds[1]] = O_WRONLY;
+  p->p_fdoff[kfds[1]] = 0;
+  lock_release(p->p_fdlock);
+
+  res = copyout(kfds, fds, sizeof(kfds));
+  if (res) {
+    sys_close(kfds[0]);
+    sys_close(kfds[1]);
+    return res;
+  }
+  return 0;
+}
+
+/* handler for open() system call                  */
+int
+sys_open(userptr_t upath, int flags, int mode, int *retval)
+{
+  struct vnode *v;
+  char *path;
+  int res;
+
+  DEBUG(DB_SYSCALL,"Syscall: open(%x,%d,%d)\n",(unsigned int)upath,flags,mode);
+
+  path = kmalloc(PATH_MAX);
+  if (path == NULL) {
+    return ENOMEM;
+  }
+  res = copyinstr(upath, path, PATH_MAX, NULL);
+  if (res) {
+    kfree(path);
+    return res;
+  }
+  /* vfs_open takes care of O_CREAT, O_EXCL and O_TRUNC */
+  res = vfs_open(path, flags, mode, &v);
+  kfree(path);
+  if (res) {
+    return res;
+  }
+
+  res = fd_install(v, flags, retval);
+  if (res) {
+    vfs_close(v);
+    return res;
+  }
+  return 0;
+}
+
+/* handler for fstat() system call                  */
+int
+sys_fstat(int fdesc, userptr_t statbuf)
+{
+  struct stat st;
+  struct vnode *v;
+  int flags, res;
+
+  DEBUG(DB_SYSCALL,"Syscall: fstat(%d,%x)\n",fdesc,(unsigned int)statbuf);
+
+  res = fd_get(fdesc, &flags, &v);
+  if (res) {
+    return res;
+  }
+  res = VOP_STAT(v, &st);
+  VOP_DECREF(v);
+  if (res) {
+    return res;
+  }
+  return copyout(&st, statbuf, sizeof(st));
+}
@@ -0,0 +1,115 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#include <types.h>
+#include <kern/errno.h>
+#include <kern/time.h>
+#include <kern/resource.h>
+#include <lib.h>
+#include <mainbus.h>
+#include <thread.h>
+#include <proc.h>
+#include <current.h>
+#include <copyinout.h>
+#include <syscall.h>
+#include <uw-vmstats.h>
+
+/*
+ * Convert nanoseconds to a timeval.
+ */
+static
+void
+ns_to_timeval(uint64_t ns, struct timeval *tv)
+{
+	tv->tv_sec = ns / 1000000000;
+	tv->tv_usec = (ns % 1000000000) / 1000;
+}
+
+/*
+ * getrusage: CPU time and context switches of the current process.
+ *
+ * Run time is measured exactly but the user/system split is only
+ * known from where timer ticks landed, so, as in BSD, the run time
+ * is divided between the two in proportion to the ticks. Everything
+ * other than times and switch counts is reported as zero.
+ *
+ * There is no parent/child tracking, so RUSAGE_CHILDREN always
+ * reports nothing.
+ */
+int
+sys_getrusage(int who, userptr_t usage)
+{
+	struct rusage ru;
+	struct threadusage tu;
+	uint64_t runns, ticks, userns;
+
+	bzero(&ru, sizeof(ru));
+
+	switch (who) {
+	    case RUSAGE_SELF:
+		proc_getusage(curproc, &tu);
+		runns = mainbus_cyclestons(tu.tu_runcycles);
+		ticks = (uint64_t)tu.tu_uticks + tu.tu_sticks;
+		userns = ticks == 0 ? 0 : runns * tu.tu_uticks / ticks;
+		ns_to_timeval(userns, &ru.ru_utime);
+		ns_to_timeval(runns - userns, &ru.ru_stime);
+		ru.ru_nvcsw = tu.tu_nvcsw;
+		ru.ru_nivcsw = tu.tu_nivcsw;
+		break;
+	    case RUSAGE_CHILDREN:
+		break;
+	    default:
+		return EINVAL;
+	}
+
+	return copyout(&ru, usage, sizeof(ru));
+}
+
+/*
+ * __vmstats: copy out up to NCOUNTS of the systemwide VM statistics
+ * counters (indexed by VMSTAT_* in <kern/vmstats.h>). Returns how
+ * many counters there are.
+ */
+int
+sys___vmstats(userptr_t counts, unsigned ncounts, int32_t *retval)
+{
+	unsigned int kcounts[VMSTAT_COUNT];
+	int result;
+
+	if (ncounts > VMSTAT_COUNT) {
+		ncounts = VMSTAT_COUNT;
+	}
+	vmstats_get(kcounts);
+	result = copyout(kcounts, counts, ncounts * sizeof(kcounts[0]));
+	if (result) {
+		return result;
+	}
+	*retval = VMSTAT_COUNT;
+	return 0;
+}
@@ -0,0 +1,222 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * System call latency profiling. See syscallstats.h.
+ */
+
+#include <types.h>
+#include <kern/syscall.h>
+#include <lib.h>
+#include <spinlock.h>
+#include <cpu.h>
+#include <thread.h>
+#include <current.h>
+#include <syscallstats.h>
+
+struct syscallstat {
+	unsigned ss_count;		/* number of completed calls */
+	uint64_t ss_total;		/* sum of latencies */
+	uint32_t ss_min;		/* smallest latency seen */
+	uint32_t ss_max;		/* largest latency seen */
+	unsigned ss_hist[SYSCALLSTATS_NBUCKETS]; /* log2 histogram */
+};
+
+static struct syscallstat syscallstats[SYSCALLSTATS_NCALLS];
+static struct spinlock syscallstats_lock = SPINLOCK_INITIALIZER;
+
+/*
+ * Names for printing. Calls not listed here print by number.
+ */
+static const char *const syscallnames[SYSCALLSTATS_NCALLS] = {
+	[SYS_fork] = "fork",
+	[SYS_vfork] = "vfork",
+	[SYS_execv] = "execv",
+	[SYS__exit] = "_exit",
+	[SYS_waitpid] = "waitpid",
+	[SYS_getpid] = "getpid",
+	[SYS_getppid] = "getppid",
+	[SYS_sbrk] = "sbrk",
+	[SYS_mmap] = "mmap",
+	[SYS_munmap] = "munmap",
+	[SYS_msync] = "msync",
+	[SYS_open] = "open",
+	[SYS_pipe] = "pipe",
+	[SYS_dup] = "dup",
+	[SYS_dup2] = "dup2",
+	[SYS_close] = "close",
+	[SYS_read] = "read",
+	[SYS_pread] = "pread",
+	[SYS_getdirentry] = "getdirentry",
+	[SYS_write] = "write",
+	[SYS_pwrite] = "pwrite",
+	[SYS_lseek] = "lseek",
+	[SYS_ftruncate] = "ftruncate",
+	[SYS_fsync] = "fsync",
+	[SYS_ioctl] = "ioctl",
+	[SYS_remove] = "remove",
+	[SYS_mkdir] = "mkdir",
+	[SYS_rmdir] = "rmdir",
+	[SYS_rename] = "rename",
+	[SYS_chdir] = "chdir",
+	[SYS___getcwd] = "__getcwd",
+	[SYS_stat] = "stat",
+	[SYS_fstat] = "fstat",
+	[SYS___time] = "__time",
+	[SYS_getrusage] = "getrusage",
+	[SYS___vmstats] = "__vmstats",
+	[SYS___threadfork] = "__threadfork",
+	[SYS___futex_wait] = "__futex_wait",
+	[SYS___futex_wake] = "__futex_wake",
+	[SYS___threadexit] = "__threadexit",
+	[SYS_nanosleep] = "nanosleep",
+	[SYS_sync] = "sync",
+	[SYS_reboot] = "reboot",
+};
+
+/*
+ * Return the histogram bucket for a latency: the index of its
+ * highest set bit.
+ */
+static
+unsigned
+syscallstats_bucket(uint32_t cycles)
+{
+	unsigned b;
+
+	b = 0;
+	while (cycles > 1) {
+		cycles >>= 1;
+		b++;
+	}
+	return b;
+}
+
+/*
+ * Note the start of a system call.
+ */
+void
+syscallstats_enter(int callno)
+{
+	curthread->t_syscallno = callno;
+	curthread->t_syscallstart = cpu_getcycles();
+}
+
+/*
+ * Note the end of the current thread's system call, if any, and
+ * charge its latency to the call number recorded on entry.
+ */
+void
+syscallstats_leave(void)
+{
+	struct syscallstat *ss;
+	uint32_t cycles;
+	int callno;
+
+	callno = curthread->t_syscallno;
+	if (callno < 0) {
+		return;
+	}
+	cycles = cpu_getcycles() - curthread->t_syscallstart;
+	curthread->t_syscallno = -1;
+
+	if (callno >= SYSCALLSTATS_NCALLS) {
+		/* bogus call number; not worth a slot */
+		return;
+	}
+	ss = &syscallstats[callno];
+
+	spinlock_acquire(&syscallstats_lock);
+	if (ss->ss_count == 0 || cycles < ss->ss_min) {
+		ss->ss_min = cycles;
+	}
+	if (cycles > ss->ss_max) {
+		ss->ss_max = cycles;
+	}
+	ss->ss_count++;
+	ss->ss_total += cycles;
+	ss->ss_hist[syscallstats_bucket(cycles)]++;
+	spinlock_release(&syscallstats_lock);
+}
+
+/*
+ * Print the statistics.
+ *
+ * kprintf can sleep, so we can't hold the spinlock while printing.
+ * Copy one entry at a time out under the lock instead; the whole
+ * table is too big for a kernel stack.
+ */
+void
+syscallstats_print(void)
+{
+	struct syscallstat ss;
+	unsigned i, b;
+
+	kprintf("%-12s %8s %10s %10s %10s\n",
+		"syscall", "count", "avg", "min", "max");
+	for (i=0; i<SYSCALLSTATS_NCALLS; i++) {
+		spinlock_acquire(&syscallstats_lock);
+		ss = syscallstats[i];
+		spinlock_release(&syscallstats_lock);
+
+		if (ss.ss_count == 0) {
+			continue;
+		}
+
+		if (syscallnames[i] != NULL) {
+			kprintf("%-12s", syscallnames[i]);
+		}
+		else {
+			kprintf("syscall %-4u", i);
+		}
+		kprintf(" %8u %10lu %10lu %10lu\n", ss.ss_count,
+			(unsigned long)(ss.ss_total / ss.ss_count),
+			(unsigned long)ss.ss_min,
+			(unsigned long)ss.ss_max);
+
+		for (b=0; b<SYSCALLSTATS_NBUCKETS; b++) {
+			if (ss.ss_hist[b] == 0) {
+				continue;
+			}
+			kprintf("    < 2^%-2u cycles: %u\n", b+1, ss.ss_hist[b]);
+		}
+	}
+	kprintf("(latencies in cycles)\n");
+}
+
+/*
+ * Reset the statistics.
+ */
+void
+syscallstats_reset(void)
+{
+	spinlock_acquire(&syscallstats_lock);
+	bzero(syscallstats, sizeof(syscallstats));
+	spinlock_release(&syscallstats_lock);
+}
@@ -0,0 +1,220 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * User-level threads and futexes.
+ *
+ * __threadfork starts another thread in the calling process, sharing
+ * its address space and files. The new thread starts at ENTRY with
+ * ARG as its argument and STACK as its stack pointer; the stack is
+ * the caller's to provide. If EXITADDR isn't NULL, the kernel stores
+ * 0 in the int there when the thread exits and does a futex wake on
+ * it, which is all a user-level join needs.
+ *
+ * __threadexit ends only the calling thread; the process goes away
+ * with its last thread. _exit ends every thread in the process (see
+ * sys__exit).
+ */
+#include <types.h>
+#include <kern/errno.h>
+#include <lib.h>
+#include <mips/trapframe.h>
+#include <thread.h>
+#include <proc.h>
+#include <current.h>
+#include <addrspace.h>
+#include <vm.h>
+#include <copyinout.h>
+#include <futex.h>
+#include <syscall.h>
+#include <syscallstats.h>
+
+struct threadfork_args {
+	struct trapframe ta_tf;		/* the creator's registers */
+	vaddr_t ta_entry;
+	vaddr_t ta_arg;
+	vaddr_t ta_stack;
+	userptr_t ta_exitaddr;
+};
+
+/*
+ * First function run by a new user thread.
+ */
+static
+void
+threadfork_start(void *data1, unsigned long data2)
+{
+	struct threadfork_args *ta = data1;
+	struct trapframe tf;	/* must be on our own stack; see mips_usermode */
+	vaddr_t entry, arg, stack;
+
+	(void)data2;
+
+	tf = ta->ta_tf;
+	entry = ta->ta_entry;
+	arg = ta->ta_arg;
+	stack = ta->ta_stack;
+	curthread->t_exitaddr = ta->ta_exitaddr;
+	kfree(ta);
+
+	/* _exit got in first; don't start running user code */
+	if (proc_isexiting(curproc)) {
+		sys___threadexit();
+	}
+
+	enter_new_thread(&tf, entry, arg, stack);
+}
+
+int
+sys___threadfork(struct trapframe *tf, userptr_t entry, userptr_t arg,
+		 userptr_t stack, userptr_t exitaddr)
+{
+	struct threadfork_args *ta;
+	int result;
+
+	if (entry == NULL || stack == NULL) {
+		return EINVAL;
+	}
+	if ((vaddr_t)entry >= USERSPACETOP || (vaddr_t)stack > USERSPACETOP) {
+		return EFAULT;
+	}
+	if ((vaddr_t)stack % 8 != 0) {
+		/* the MIPS calling convention wants it doubleword-aligned */
+		return EINVAL;
+	}
+	if (exitaddr != NULL) {
+		if ((vaddr_t)exitaddr >= USERSPACETOP) {
+			return EFAULT;
+		}
+		if ((vaddr_t)exitaddr % sizeof(int) != 0) {
+			return EINVAL;
+		}
+	}
+
+	ta = kmalloc(sizeof(*ta));
+	if (ta == NULL) {
+		return ENOMEM;
+	}
+	ta->ta_tf = *tf;
+	ta->ta_entry = (vaddr_t)entry;
+	ta->ta_arg = (vaddr_t)arg;
+	ta->ta_stack = (vaddr_t)stack;
+	ta->ta_exitaddr = exitaddr;
+
+	result = thread_fork(curproc->p_name, curproc, threadfork_start, ta, 0);
+	if (result) {
+		kfree(ta);
+		return result;
+	}
+	return 0;
+}
+
+/*
+ * Let anyone joining the current thread know it's gone.
+ */
+static
+void
+threadfork_exiting(void)
+{
+	userptr_t exitaddr = curthread->t_exitaddr;
+	int zero = 0;
+
+	if (exitaddr == NULL) {
+		return;
+	}
+	curthread->t_exitaddr = NULL;
+
+	/* if the word has gone bad, there's nobody to tell */
+	if (copyout(&zero, exitaddr, sizeof(zero)) == 0) {
+		futex_wake(curproc_getas(), exitaddr, (unsigned)-1);
+	}
+}
+
+/*
+ * End the calling thread. The last thread to leave takes the address
+ * space and process along. Besides __threadexit itself, this is how
+ * _exit ends its caller, and how the other threads of an exiting
+ * process leave on their way back to user mode.
+ */
+void
+sys___threadexit(void)
+{
+	struct addrspace *as;
+	struct proc *p = curproc;
+
+	KASSERT(p->p_addrspace != NULL);
+
+	threadfork_exiting();
+
+	/* note: curproc cannot be used after this call */
+	if (proc_remthread(curthread) == 0) {
+		as_deactivate();
+		/*
+		 * Clear p_addrspace before calling as_destroy.
+		 * Otherwise if as_destroy sleeps (which is quite
+		 * possible) when we come back we'll be calling
+		 * as_activate on a half-destroyed address space.
+		 * (We're detached, so curproc is NULL by now and
+		 * as_activate won't find it anyway.)
+		 */
+		as = p->p_addrspace;
+		p->p_addrspace = NULL;
+		as_destroy(as);
+
+		/* if this is the last user process in the system,
+		   proc_destroy() will wake up the kernel menu thread */
+		proc_destroy(p);
+	}
+
+	/* we never return to the dispatcher, so account for it here */
+	syscallstats_leave();
+
+	thread_exit();
+	/* thread_exit() does not return, so we should never get here */
+	panic("return from thread_exit in sys___threadexit\n");
+}
+
+int
+sys___futex_wait(userptr_t addr, int val)
+{
+	if ((vaddr_t)addr % sizeof(int) != 0) {
+		return EINVAL;
+	}
+	return futex_wait(curproc_getas(), addr, val);
+}
+
+int
+sys___futex_wake(userptr_t addr, unsigned n, int32_t *retval)
+{
+	if ((vaddr_t)addr % sizeof(int) != 0) {
+		return EINVAL;
+	}
+	*retval = futex_wake(curproc_getas(), addr, n);
+	return 0;
+}
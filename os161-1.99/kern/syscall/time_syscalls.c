@@ -40,19 +40,17 @@ sys___time(userptr_t user_seconds_ptr, userptr_t user_nanoseconds_ptr)
 {
 	time_t seconds;
 	uint32_t nanoseconds;
-	int result;
+	struct copyvec vec[2];
 
 	gettime(&seconds, &nanoseconds);
 
-	result = copyout(&seconds, user_seconds_ptr, sizeof(time_t));
-	if (result) {
-		return result;
-	}
+	/* Both results go out under one fault-recovery setup. */
+	vec[0].cv_uaddr = user_seconds_ptr;
+	vec[0].cv_kaddr = &seconds;
+	vec[0].cv_len = sizeof(time_t);
+	vec[1].cv_uaddr = user_nanoseconds_ptr;
+	vec[1].cv_kaddr = &nanoseconds;
+	vec[1].cv_len = sizeof(uint32_t);
 
-	result = copyout(&nanoseconds, user_nanoseconds_ptr, sizeof(uint32_t));
-	if (result) {
-		return result;
-	}
-
-	return 0;
+	return copyoutv(vec, 2);
 }
@@ -0,0 +1,146 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * Memory-management system calls.
+ *
+ * sbrk moves the end of the heap; growing it is cheap, since pages
+ * are only found for it as they're touched (see as_sbrk).
+ *
+ * mmap maps regular files only: it asks the file system with
+ * VOP_MMAP, which says no for devices, directories and pipes. The
+ * address space does the rest (see as_mmap in the VM system).
+ */
+#include <types.h>
+#include <kern/errno.h>
+#include <kern/fcntl.h>
+#include <kern/mman.h>
+#include <lib.h>
+#include <proc.h>
+#include <current.h>
+#include <addrspace.h>
+#include <vnode.h>
+#include <vm.h>
+#include <syscall.h>
+
+int
+sys_sbrk(intptr_t amount, int32_t *retval)
+{
+	struct addrspace *as;
+	vaddr_t oldbreak;
+	int result;
+
+	as = curproc_getas();
+	KASSERT(as != NULL);
+
+	result = as_sbrk(as, amount, &oldbreak);
+	if (result) {
+		return result;
+	}
+
+	*retval = (int32_t)oldbreak;
+	return 0;
+}
+
+int
+sys_mmap(userptr_t addr, size_t len, int prot, int flags, int fd,
+	 off_t offset, int32_t *retval)
+{
+	struct addrspace *as;
+	struct vnode *v;
+	vaddr_t base;
+	int fdflags, result;
+
+	as = curproc_getas();
+	KASSERT(as != NULL);
+
+	if (prot & ~(PROT_READ|PROT_WRITE|PROT_EXEC)) {
+		return EINVAL;
+	}
+	if (flags & ~(MAP_SHARED|MAP_PRIVATE|MAP_FIXED)) {
+		return EINVAL;
+	}
+
+	result = fd_get(fd, &fdflags, &v);
+	if (result) {
+		return result;
+	}
+
+	/* the file must be readable, and writable too for shared stores */
+	if ((fdflags & O_ACCMODE) == O_WRONLY ||
+	    ((flags & MAP_SHARED) && (prot & PROT_WRITE) &&
+	     (fdflags & O_ACCMODE) != O_RDWR)) {
+		VOP_DECREF(v);
+		return EACCES;
+	}
+
+	/* whatever the reason, a file that can't be mapped is ENODEV */
+	if (VOP_MMAP(v)) {
+		VOP_DECREF(v);
+		return ENODEV;
+	}
+
+	result = as_mmap(as, (vaddr_t)addr, len, prot, flags, v, offset,
+			 &base);
+	VOP_DECREF(v);
+	if (result) {
+		return result;
+	}
+
+	*retval = (int32_t)base;
+	return 0;
+}
+
+int
+sys_munmap(userptr_t addr, size_t len)
+{
+	struct addrspace *as;
+
+	as = curproc_getas();
+	KASSERT(as != NULL);
+
+	return as_munmap(as, (vaddr_t)addr, len);
+}
+
+int
+sys_msync(userptr_t addr, size_t len, int flags)
+{
+	struct addrspace *as;
+
+	as = curproc_getas();
+	KASSERT(as != NULL);
+
+	if (flags & ~(MS_ASYNC|MS_SYNC|MS_INVALIDATE) ||
+	    (flags & (MS_ASYNC|MS_SYNC)) == (MS_ASYNC|MS_SYNC)) {
+		return EINVAL;
+	}
+
+	/* everything is synchronous, and there's no other copy to drop */
+	return as_msync(as, (vaddr_t)addr, len);
+}
@@ -32,8 +32,10 @@
  */
 
 #include <types.h>
+#include <kern/errno.h>
 #include <lib.h>
 #include <clock.h>
+#include <spinlock.h>
 #include <thread.h>
 #include <synch.h>
 #include <test.h>
@@ -42,6 +44,13 @@
 #define NLOCKLOOPS    120
 #define NCVLOOPS      5
 #define NTHREADS      32
+#define NRWLOOPS      200
+#define NRWWRITERS    4
+#define RWBENCHOPS    2000
+#define RWBENCHHOLD   200
+#define NFAIRTHREADS  8
+#define FAIRSECS      2
+#define FAIRHOLD      200
 
 static volatile unsigned long testval1;
 static volatile unsigned long testval2;
@@ -68,6 +77,11 @@ cleanitems(void)
 	lock_destroy(testlock);
 	cv_destroy(testcv);
 	sem_destroy(donesem);
+	/* so inititems makes new ones next time */
+	testsem = NULL;
+	testlock = NULL;
+	testcv = NULL;
+	donesem = NULL;
 	}
 #endif
 
@@ -347,3 +361,543 @@ cvtest(int nargs, char **args)
 
 	return 0;
 }
+
+/*
+ * RW lock tests.
+ *
+ * rw1 is the correctness/stress test: NRWWRITERS writers update the
+ * testvals under the write lock while the rest of the threads check
+ * them under the read lock. Readers also check that no writer is
+ * inside with them, and count how many readers they saw at once, so
+ * the test says whether any reader overlap happened at all.
+ *
+ * rw2 measures throughput: 1, 2, 4, ... NTHREADS threads each take
+ * the lock RWBENCHOPS times and hold it for a short busy loop, first
+ * with a plain lock and then with the rwlock held for reading. With
+ * more than one CPU, the rwlock numbers should scale and the lock
+ * numbers should not.
+ */
+
+static struct rwlock *testrw;
+static struct spinlock rwcountlock = SPINLOCK_INITIALIZER;
+static volatile unsigned rwinside;
+static volatile unsigned rwwriting;
+static volatile unsigned rwmaxinside;
+
+static
+void
+rwinititems(void)
+{
+	inititems();
+	if (testrw==NULL) {
+		testrw = rwlock_create("testrw");
+		if (testrw == NULL) {
+			panic("synchtest: rwlock_create failed\n");
+		}
+	}
+}
+
+#ifdef UW
+static
+void
+rwcleanitems(void)
+{
+	rwlock_destroy(testrw);
+	testrw = NULL;
+	cleanitems();
+}
+#endif
+
+static
+void
+rwfail(unsigned long num, const char *msg)
+{
+	kprintf("thread %lu: Mismatch on %s\n", num, msg);
+	kprintf("Test failed\n");
+
+	rwlock_release(testrw);
+
+	V(donesem);
+	thread_exit();
+}
+
+static
+void
+rwtestthread(void *junk, unsigned long num)
+{
+	int i;
+	unsigned n;
+	unsigned long v1;
+	(void)junk;
+
+	for (i=0; i<NRWLOOPS; i++) {
+		if (num < NRWWRITERS) {
+			rwlock_acquire_write(testrw);
+			if (rwinside != 0 || rwwriting != 0) {
+				rwfail(num, "writer exclusion");
+			}
+			rwwriting = 1;
+			testval1 = num;
+			thread_yield();
+			testval2 = num*num;
+			testval3 = num%3;
+			if (i % 8 == 0) {
+				/* go on reading what we wrote */
+				rwwriting = 0;
+				rwlock_downgrade(testrw);
+				if (testval1 != num) {
+					rwfail(num, "testval1 after downgrade");
+				}
+			}
+			else {
+				rwwriting = 0;
+			}
+			rwlock_release(testrw);
+		}
+		else {
+			rwlock_acquire_read(testrw);
+			if (rwwriting != 0) {
+				rwfail(num, "reader/writer exclusion");
+			}
+			spinlock_acquire(&rwcountlock);
+			n = ++rwinside;
+			if (n > rwmaxinside) {
+				rwmaxinside = n;
+			}
+			spinlock_release(&rwcountlock);
+
+			v1 = testval1;
+			thread_yield();
+			if (testval1 != v1) {
+				rwfail(num, "testval1 changed under reader");
+			}
+			if (testval2 != v1*v1) {
+				rwfail(num, "testval2/testval1");
+			}
+			if (testval3 != v1%3) {
+				rwfail(num, "testval3/testval1");
+			}
+
+			spinlock_acquire(&rwcountlock);
+			rwinside--;
+			spinlock_release(&rwcountlock);
+			rwlock_release(testrw);
+		}
+	}
+	V(donesem);
+#ifdef UW
+  thread_exit();
+#endif
+}
+
+int
+rwtest(int nargs, char **args)
+{
+	int i, result;
+
+	(void)nargs;
+	(void)args;
+
+	rwinititems();
+	kprintf("Starting rwlock test...\n");
+
+	testval1 = 0;
+	testval2 = 0;
+	testval3 = 0;
+	rwinside = 0;
+	rwwriting = 0;
+	rwmaxinside = 0;
+
+	for (i=0; i<NTHREADS; i++) {
+		result = thread_fork("rwtest", NULL, rwtestthread, NULL, i);
+		if (result) {
+			panic("rwtest: thread_fork failed: %s\n",
+			      strerror(result));
+		}
+	}
+	for (i=0; i<NTHREADS; i++) {
+		P(donesem);
+	}
+
+	kprintf("Most readers inside at once: %u\n", rwmaxinside);
+#ifdef UW
+  rwcleanitems();
+#endif
+	kprintf("RW lock test done.\n");
+
+	return 0;
+}
+
+static volatile bool rwbench_userw;
+
+static
+void
+rwbenchthread(void *junk, unsigned long num)
+{
+	int i;
+	volatile int j;
+	unsigned long v1;
+	(void)junk;
+	(void)num;
+
+	for (i=0; i<RWBENCHOPS; i++) {
+		if (rwbench_userw) {
+			rwlock_acquire_read(testrw);
+		}
+		else {
+			lock_acquire(testlock);
+		}
+		v1 = testval1;
+		for (j=0; j<RWBENCHHOLD; j++);
+		KASSERT(testval1 == v1);
+		if (rwbench_userw) {
+			rwlock_release(testrw);
+		}
+		else {
+			lock_release(testlock);
+		}
+	}
+	V(donesem);
+#ifdef UW
+  thread_exit();
+#endif
+}
+
+static
+void
+rwbenchrun(bool userw, unsigned nthreads)
+{
+	unsigned i;
+	int result;
+	time_t secs1, secs2, secs;
+	uint32_t nsecs1, nsecs2, nsecs;
+	uint64_t usecs, ops;
+
+	rwbench_userw = userw;
+
+	gettime(&secs1, &nsecs1);
+	for (i=0; i<nthreads; i++) {
+		result = thread_fork("rwbench", NULL, rwbenchthread, NULL, i);
+		if (result) {
+			panic("rwbench: thread_fork failed: %s\n",
+			      strerror(result));
+		}
+	}
+	for (i=0; i<nthreads; i++) {
+		P(donesem);
+	}
+	gettime(&secs2, &nsecs2);
+	getinterval(secs1, nsecs1, secs2, nsecs2, &secs, &nsecs);
+
+	usecs = (uint64_t)secs * 1000000 + nsecs / 1000;
+	ops = (uint64_t)nthreads * RWBENCHOPS;
+	kprintf("%-6s %2u threads: %lu.%09lu seconds, %lu acquires/sec\n",
+		userw ? "rwlock" : "lock", nthreads,
+		(unsigned long)secs, (unsigned long)nsecs,
+		usecs ? (unsigned long)(ops * 1000000 / usecs) : 0UL);
+}
+
+int
+rwbench(int nargs, char **args)
+{
+	unsigned n;
+
+	(void)nargs;
+	(void)args;
+
+	rwinititems();
+	kprintf("Starting rwlock throughput test...\n");
+
+	for (n=1; n<=NTHREADS; n*=2) {
+		rwbenchrun(false, n);
+		rwbenchrun(true, n);
+	}
+
+#ifdef UW
+  rwcleanitems();
+#endif
+	kprintf("RW lock throughput test done.\n");
+
+	return 0;
+}
+
+/*
+ * Fairness benchmark.
+ *
+ * NFAIRTHREADS threads hammer on one lock (or one binary semaphore)
+ * for FAIRSECS seconds, releasing it and immediately trying to get it
+ * back. Each counts its acquisitions and remembers the longest it had
+ * to wait for one. Run in the default mode, a thread coming back for
+ * the lock usually beats the sleeper it just woke, so the counts are
+ * lopsided and the maximum waits long; in fair mode the lock goes
+ * round in order.
+ */
+
+static volatile bool fairstop;
+static bool fairusesem;
+static struct semaphore *fairsem;
+static unsigned long faircount[NFAIRTHREADS];
+static uint64_t fairmaxwait[NFAIRTHREADS];	/* microseconds */
+
+static
+void
+fairthread(void *junk, unsigned long num)
+{
+	volatile int j;
+	time_t secs1, secs2, secs;
+	uint32_t nsecs1, nsecs2, nsecs;
+	uint64_t usecs;
+
+	(void)junk;
+
+	while (!fairstop) {
+		gettime(&secs1, &nsecs1);
+		if (fairusesem) {
+			P(fairsem);
+		}
+		else {
+			lock_acquire(testlock);
+		}
+		gettime(&secs2, &nsecs2);
+
+		getinterval(secs1, nsecs1, secs2, nsecs2, &secs, &nsecs);
+		usecs = (uint64_t)secs * 1000000 + nsecs / 1000;
+		if (usecs > fairmaxwait[num]) {
+			fairmaxwait[num] = usecs;
+		}
+		faircount[num]++;
+
+		for (j=0; j<FAIRHOLD; j++);
+
+		if (fairusesem) {
+			V(fairsem);
+		}
+		else {
+			lock_release(testlock);
+		}
+	}
+	V(donesem);
+#ifdef UW
+  thread_exit();
+#endif
+}
+
+static
+void
+fairrun(bool usesem, bool fair)
+{
+	unsigned i;
+	int result;
+	unsigned long total, min, max;
+	uint64_t maxwait;
+
+	fairusesem = usesem;
+	fairstop = false;
+	for (i=0; i<NFAIRTHREADS; i++) {
+		faircount[i] = 0;
+		fairmaxwait[i] = 0;
+	}
+	if (usesem) {
+		sem_setfair(fairsem, fair);
+	}
+	else {
+		lock_setfair(testlock, fair);
+	}
+
+	for (i=0; i<NFAIRTHREADS; i++) {
+		result = thread_fork("fairtest", NULL, fairthread, NULL, i);
+		if (result) {
+			panic("fairtest: thread_fork failed: %s\n",
+			      strerror(result));
+		}
+	}
+	clocksleep(FAIRSECS);
+	fairstop = true;
+	for (i=0; i<NFAIRTHREADS; i++) {
+		P(donesem);
+	}
+
+	kprintf("%s, %s mode:\n", usesem ? "semaphore" : "lock",
+		fair ? "fair" : "default");
+	total = 0;
+	min = max = faircount[0];
+	maxwait = 0;
+	for (i=0; i<NFAIRTHREADS; i++) {
+		kprintf("  thread %u: %8lu acquires, max wait %lu us\n",
+			i, faircount[i], (unsigned long)fairmaxwait[i]);
+		total += faircount[i];
+		if (faircount[i] < min) {
+			min = faircount[i];
+		}
+		if (faircount[i] > max) {
+			max = faircount[i];
+		}
+		if (fairmaxwait[i] > maxwait) {
+			maxwait = fairmaxwait[i];
+		}
+	}
+	kprintf("  total %lu, min %lu, max %lu, worst wait %lu us\n",
+		total, min, max, (unsigned long)maxwait);
+
+	/* leave things as the other tests expect them */
+	if (usesem) {
+		sem_setfair(fairsem, false);
+	}
+	else {
+		lock_setfair(testlock, false);
+	}
+}
+
+int
+fairtest(int nargs, char **args)
+{
+	(void)nargs;
+	(void)args;
+
+	inititems();
+	fairsem = sem_create("fairsem", 1);
+	if (fairsem == NULL) {
+		panic("fairtest: sem_create failed\n");
+	}
+	kprintf("Starting lock fairness test...\n");
+
+	fairrun(false, false);
+	fairrun(false, true);
+	fairrun(true, false);
+	fairrun(true, true);
+
+	sem_destroy(fairsem);
+	fairsem = NULL;
+#ifdef UW
+  cleanitems();
+#endif
+	kprintf("Lock fairness test done.\n");
+
+	return 0;
+}
+
+/*
+ * Timed wait test: checks that thread_sleep_ns, P_timed and
+ * cv_timedwait wait about as long as asked (never less, and not much
+ * more than a tick extra), and that P_timed and cv_timedwait return
+ * early when woken.
+ */
+
+#define TIMEDNSECS    50000000	/* 50 ms */
+
+static
+uint64_t
+elapsedns(time_t secs1, uint32_t nsecs1)
+{
+	time_t secs2, secs;
+	uint32_t nsecs2, nsecs;
+
+	gettime(&secs2, &nsecs2);
+	getinterval(secs1, nsecs1, secs2, nsecs2, &secs, &nsecs);
+	return (uint64_t)secs * 1000000000 + nsecs;
+}
+
+static
+void
+timedcheck(const char *what, uint64_t ns, int result, int expected)
+{
+	kprintf("%-24s %6lu us, %s\n", what, (unsigned long)(ns / 1000),
+		result == 0 ? "woken" : "timed out");
+	if (result != expected) {
+		kprintf("%s: expected %s\n", what,
+			expected == 0 ? "wakeup" : "timeout");
+		panic("Test failed\n");
+	}
+	if (expected == ETIMEDOUT &&
+	    (ns < TIMEDNSECS || ns > TIMEDNSECS + 4 * (1000000000 / HZ) + 10000000)) {
+		panic("%s: slept for %lu us instead of %lu\n", what,
+		      (unsigned long)(ns / 1000),
+		      (unsigned long)(TIMEDNSECS / 1000));
+	}
+}
+
+static
+void
+timedwaker(void *junk, unsigned long num)
+{
+	(void)junk;
+
+	thread_sleep_ns(TIMEDNSECS / 5);
+	if (num == 0) {
+		V(testsem);
+	}
+	else {
+		lock_acquire(testlock);
+		cv_signal(testcv, testlock);
+		lock_release(testlock);
+	}
+	V(donesem);
+#ifdef UW
+  thread_exit();
+#endif
+}
+
+int
+timedtest(int nargs, char **args)
+{
+	time_t secs;
+	uint32_t nsecs;
+	int result;
+
+	(void)nargs;
+	(void)args;
+
+	inititems();
+	kprintf("Starting timed wait test...\n");
+
+	/* testsem starts at 2 */
+	P(testsem);
+	P(testsem);
+
+	gettime(&secs, &nsecs);
+	thread_sleep_ns(TIMEDNSECS);
+	timedcheck("thread_sleep_ns", elapsedns(secs, nsecs), ETIMEDOUT,
+		   ETIMEDOUT);
+
+	gettime(&secs, &nsecs);
+	result = P_timed(testsem, TIMEDNSECS);
+	timedcheck("P_timed", elapsedns(secs, nsecs), result, ETIMEDOUT);
+
+	lock_acquire(testlock);
+	gettime(&secs, &nsecs);
+	result = cv_timedwait(testcv, testlock, TIMEDNSECS);
+	timedcheck("cv_timedwait", elapsedns(secs, nsecs), result, ETIMEDOUT);
+	lock_release(testlock);
+
+	result = thread_fork("timedtest", NULL, timedwaker, NULL, 0);
+	if (result) {
+		panic("timedtest: thread_fork failed: %s\n", strerror(result));
+	}
+	gettime(&secs, &nsecs);
+	result = P_timed(testsem, TIMEDNSECS * 10);
+	timedcheck("P_timed with V", elapsedns(secs, nsecs), result, 0);
+	P(donesem);
+
+	lock_acquire(testlock);
+	result = thread_fork("timedtest", NULL, timedwaker, NULL, 1);
+	if (result) {
+		panic("timedtest: thread_fork failed: %s\n", strerror(result));
+	}
+	gettime(&secs, &nsecs);
+	result = cv_timedwait(testcv, testlock, TIMEDNSECS * 10);
+	timedcheck("cv_timedwait with signal", elapsedns(secs, nsecs),
+		   result, 0);
+	lock_release(testlock);
+	P(donesem);
+
+	/* so we can run it again */
+	V(testsem);
+	V(testsem);
+
+#ifdef UW
+  cleanitems();
+#endif
+	kprintf("Timed wait test done.\n");
+
+	return 0;
+}
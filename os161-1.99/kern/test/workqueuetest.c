@@ -0,0 +1,189 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * Workqueue test code.
+ */
+
+#include <types.h>
+#include <lib.h>
+#include <clock.h>
+#include <cpu.h>
+#include <spinlock.h>
+#include <thread.h>
+#include <current.h>
+#include <workqueue.h>
+#include <test.h>
+
+#define NWQITEMS	1000
+#define NWQWORKS	100
+#define WQSPIN		20000
+
+static struct spinlock wqtest_lock = SPINLOCK_INITIALIZER;
+static volatile unsigned long wqtest_count;
+static unsigned long *wqtest_vals;
+static unsigned wqtest_percpu[32];
+
+static
+void
+wqtest_square(void *data, unsigned long i)
+{
+	unsigned cpunum;
+
+	(void)data;
+	wqtest_vals[i] = i * i;
+
+	cpunum = curcpu->c_number;
+	if (cpunum < sizeof(wqtest_percpu) / sizeof(wqtest_percpu[0])) {
+		spinlock_acquire(&wqtest_lock);
+		wqtest_percpu[cpunum]++;
+		spinlock_release(&wqtest_lock);
+	}
+}
+
+static
+void
+wqtest_spin(void *data, unsigned long i)
+{
+	volatile unsigned j;
+
+	(void)data;
+	(void)i;
+	for (j=0; j<WQSPIN; j++);
+}
+
+static
+void
+wqtest_inc(void *data, unsigned long num)
+{
+	(void)data;
+	(void)num;
+
+	thread_yield();
+	spinlock_acquire(&wqtest_lock);
+	wqtest_count++;
+	spinlock_release(&wqtest_lock);
+}
+
+static
+void
+wqtest_time(const char *what, time_t secs1, uint32_t nsecs1)
+{
+	time_t secs2, secs;
+	uint32_t nsecs2, nsecs;
+
+	gettime(&secs2, &nsecs2);
+	getinterval(secs1, nsecs1, secs2, nsecs2, &secs, &nsecs);
+	kprintf("%s: %lu.%09lu seconds\n", what,
+		(unsigned long)secs, (unsigned long)nsecs);
+}
+
+int
+workqueuetest(int nargs, char **args)
+{
+	struct workqueue *wq;
+	struct work *works;
+	unsigned long i;
+	unsigned ncpus;
+	time_t secs;
+	uint32_t nsecs;
+	int result;
+
+	(void)nargs;
+	(void)args;
+
+	kprintf("Starting workqueue test...\n");
+	ncpus = thread_numcpus();
+
+	wq = workqueue_create("wqtest");
+	if (wq == NULL) {
+		panic("workqueuetest: workqueue_create failed\n");
+	}
+	wqtest_vals = kmalloc(NWQITEMS * sizeof(unsigned long));
+	works = kmalloc(NWQWORKS * sizeof(struct work));
+	if (wqtest_vals == NULL || works == NULL) {
+		panic("workqueuetest: Out of memory\n");
+	}
+
+	/* parallel_for covers every index exactly once */
+	for (i=0; i<NWQITEMS; i++) {
+		wqtest_vals[i] = 0;
+	}
+	for (i=0; i<sizeof(wqtest_percpu) / sizeof(wqtest_percpu[0]); i++) {
+		wqtest_percpu[i] = 0;
+	}
+	result = workqueue_parallel_for(wq, NWQITEMS, wqtest_square, NULL);
+	if (result) {
+		panic("workqueuetest: parallel_for: %s\n", strerror(result));
+	}
+	for (i=0; i<NWQITEMS; i++) {
+		if (wqtest_vals[i] != i * i) {
+			panic("workqueuetest: item %lu was %lu\n",
+			      i, wqtest_vals[i]);
+		}
+	}
+	for (i=0; i<ncpus && i<32; i++) {
+		kprintf("cpu %lu ran %u items\n", i, wqtest_percpu[i]);
+	}
+
+	/* submit + flush: everything submitted is done after flush */
+	wqtest_count = 0;
+	for (i=0; i<NWQWORKS; i++) {
+		work_init(&works[i], wqtest_inc, NULL, i);
+		if (!workqueue_submit_cpu(wq, i % ncpus, &works[i])) {
+			panic("workqueuetest: submit failed\n");
+		}
+	}
+	workqueue_flush(wq);
+	if (wqtest_count != NWQWORKS) {
+		panic("workqueuetest: %lu of %d works ran before flush "
+		      "returned\n", wqtest_count, NWQWORKS);
+	}
+	kprintf("submit/flush: %d works ran\n", NWQWORKS);
+
+	/* speedup over doing it inline */
+	gettime(&secs, &nsecs);
+	for (i=0; i<ncpus * 8; i++) {
+		wqtest_spin(NULL, i);
+	}
+	wqtest_time("serial", secs, nsecs);
+	gettime(&secs, &nsecs);
+	result = workqueue_parallel_for(wq, ncpus * 8, wqtest_spin, NULL);
+	if (result) {
+		panic("workqueuetest: parallel_for: %s\n", strerror(result));
+	}
+	wqtest_time("parallel_for", secs, nsecs);
+
+	kfree(works);
+	kfree(wqtest_vals);
+	workqueue_destroy(wq);
+
+	kprintf("Workqueue test done.\n");
+	return 0;
+}
@@ -30,6 +30,7 @@
 #include <types.h>
 #include <lib.h>
 #include <cpu.h>
+#include <spinlock.h>
 #include <wchan.h>
 #include <clock.h>
 #include <thread.h>
@@ -38,9 +39,12 @@
 /*
  * Time handling.
  *
- * This is pretty primitive. A real kernel will typically have some
- * kind of support for scheduling callbacks to happen at specific
- * points in the future, usually with more resolution that one second.
+ * Callbacks at specific points in the future are kept on a hashed
+ * timer wheel: TIMER_WHEELSIZE buckets, indexed by deadline modulo
+ * the wheel size. Each tick CPU 0 looks only at the bucket for the
+ * current tick and fires whatever in it is due; anything further out
+ * than one turn of the wheel just stays put until its turn comes
+ * round. Adding and cancelling are constant time.
  *
  * A real kernel also has to maintain the time of day; in OS/161 we
  * skimp on that because we have a known-good hardware clock.
@@ -53,10 +57,18 @@
 #define SCHEDULE_HARDCLOCKS	4	/* Reschedule every 4 hardclocks. */
 #define MIGRATE_HARDCLOCKS	16	/* Migrate every 16 hardclocks. */
 
+#define TIMER_WHEELSIZE		256	/* must be a power of 2 */
+
 /*
- * Once a second, everything waiting on lbolt is awakened by CPU 0.
+ * The timer wheel. timer_lock protects everything here, including
+ * the to_next/to_prevp/to_pending/to_firing fields of every timeout.
  */
-static struct wchan *lbolt;
+static struct spinlock timer_lock = SPINLOCK_INITIALIZER;
+static struct timeout *timer_wheel[TIMER_WHEELSIZE];
+static volatile uint64_t timer_now;
+
+/* Where thread_sleep_ns sleepers wait; only their timeouts wake them. */
+static struct wchan *timer_sleepchan;
 
 /*
  * Setup.
@@ -64,21 +76,173 @@ static struct wchan *lbolt;
 void
 hardclock_bootstrap(void)
 {
-	lbolt = wchan_create("lbolt");
-	if (lbolt == NULL) {
-		panic("Couldn't create lbolt\n");
+	timer_sleepchan = wchan_create("nanosleep");
+	if (timer_sleepchan == NULL) {
+		panic("Couldn't create timer sleep channel\n");
+	}
+}
+
+////////////////////////////////////////////////////////////
+//
+// Timeouts.
+
+void
+timeout_init(struct timeout *to, void (*func)(void *), void *data)
+{
+	to->to_next = NULL;
+	to->to_prevp = NULL;
+	to->to_deadline = 0;
+	to->to_func = func;
+	to->to_data = data;
+	to->to_pending = false;
+	to->to_firing = false;
+}
+
+void
+timeout_add(struct timeout *to, uint64_t deadline)
+{
+	struct timeout **bucket;
+
+	spinlock_acquire(&timer_lock);
+	KASSERT(!to->to_pending);
+
+	/*
+	 * Deadlines already past go on the next tick; the bucket
+	 * for the current one has been done.
+	 */
+	if (deadline <= timer_now) {
+		deadline = timer_now + 1;
+	}
+	to->to_deadline = deadline;
+
+	bucket = &timer_wheel[deadline & (TIMER_WHEELSIZE - 1)];
+	to->to_next = *bucket;
+	if (to->to_next != NULL) {
+		to->to_next->to_prevp = &to->to_next;
+	}
+	to->to_prevp = bucket;
+	*bucket = to;
+	to->to_pending = true;
+
+	spinlock_release(&timer_lock);
+}
+
+/*
+ * Take a timeout off its bucket. Call with timer_lock held.
+ */
+static
+void
+timeout_unlink(struct timeout *to)
+{
+	KASSERT(to->to_pending);
+	*to->to_prevp = to->to_next;
+	if (to->to_next != NULL) {
+		to->to_next->to_prevp = to->to_prevp;
+	}
+	to->to_next = NULL;
+	to->to_prevp = NULL;
+	to->to_pending = false;
+}
+
+bool
+timeout_cancel(struct timeout *to)
+{
+	bool ret;
+
+	spinlock_acquire(&timer_lock);
+	if (to->to_pending) {
+		timeout_unlink(to);
+		ret = true;
+	}
+	else {
+		/*
+		 * Already fired, or firing right now on CPU 0. In
+		 * the latter case wait it out; this can't be CPU 0,
+		 * because we'd have interrupts off here.
+		 */
+		while (to->to_firing) {
+			spinlock_release(&timer_lock);
+			spinlock_acquire(&timer_lock);
+		}
+		ret = false;
+	}
+	spinlock_release(&timer_lock);
+	return ret;
+}
+
+uint64_t
+timer_ticks(void)
+{
+	uint64_t ret;
+
+	/* 64-bit loads aren't atomic on a 32-bit machine */
+	spinlock_acquire(&timer_lock);
+	ret = timer_now;
+	spinlock_release(&timer_lock);
+	return ret;
+}
+
+uint64_t
+timer_nstoticks(uint64_t nsecs)
+{
+	uint64_t ticks;
+
+	ticks = (nsecs * HZ + 999999999) / 1000000000;
+	return ticks > 0 ? ticks : 1;
+}
+
+/*
+ * Advance the wheel one tick and run whatever is due. Called from
+ * hardclock on CPU 0.
+ *
+ * Expired timeouts are moved to a private list and marked firing
+ * under the lock, then run without it, so their functions can take
+ * whatever locks they need without worrying about the order.
+ */
+static
+void
+timer_tick(void)
+{
+	struct timeout *to, *next, *expired;
+	uint64_t now;
+
+	expired = NULL;
+
+	spinlock_acquire(&timer_lock);
+	now = ++timer_now;
+	to = timer_wheel[now & (TIMER_WHEELSIZE - 1)];
+	while (to != NULL) {
+		next = to->to_next;
+		if (to->to_deadline <= now) {
+			timeout_unlink(to);
+			to->to_firing = true;
+			to->to_next = expired;
+			expired = to;
+		}
+		to = next;
+	}
+	spinlock_release(&timer_lock);
+
+	while (expired != NULL) {
+		to = expired;
+		/* the function may re-add it, which reuses to_next */
+		expired = to->to_next;
+		to->to_func(to->to_data);
+
+		spinlock_acquire(&timer_lock);
+		to->to_firing = false;
+		spinlock_release(&timer_lock);
 	}
 }
 
 /*
  * This is called once per second, on one processor, by the timer
- * code.
+ * code. Sleepers used to be woken from here all at once; now each
+ * has its own timeout, so there's nothing left to do.
  */
 void
 timerclock(void)
 {
-	/* Just broadcast on lbolt */
-	wchan_wakeall(lbolt);
 }
 
 /*
@@ -93,6 +257,9 @@ hardclock(void)
 	 */
 
 	curcpu->c_hardclocks++;
+	if (curcpu->c_number == 0) {
+		timer_tick();
+	}
 	if ((curcpu->c_hardclocks % SCHEDULE_HARDCLOCKS) == 0) {
 		schedule();
 	}
@@ -108,9 +275,23 @@ hardclock(void)
 void
 clocksleep(int num_secs)
 {
-	while (num_secs > 0) {
-		wchan_lock(lbolt);
-		wchan_sleep(lbolt);
-		num_secs--;
+	if (num_secs > 0) {
+		thread_sleep_ns(num_secs * 1000000000ULL);
+	}
+}
+
+/*
+ * Suspend execution for (at least) nsecs nanoseconds.
+ */
+void
+thread_sleep_ns(uint64_t nsecs)
+{
+	uint64_t deadline;
+
+	deadline = timer_ticks() + timer_nstoticks(nsecs);
+	wchan_lock(timer_sleepchan);
+	while (wchan_sleep_until(timer_sleepchan, deadline) == 0) {
+		/* nobody else should wake this channel */
+		wchan_lock(timer_sleepchan);
 	}
 }
@@ -0,0 +1,222 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * Futexes. See futex.h.
+ *
+ * Waiting threads are kept in a fixed hash table of buckets, hashed
+ * on address space and user address. Each bucket has a lock, a CV
+ * (and thus a wait channel) that everyone waiting in the bucket
+ * sleeps on, and a FIFO list of waiters. A waker marks the waiters it
+ * picks and broadcasts; the others in the bucket see they weren't
+ * picked and go back to sleep. Buckets are small enough that this is
+ * cheaper than a wait channel per futex, which would need to be
+ * allocated and looked up.
+ */
+#include <types.h>
+#include <kern/errno.h>
+#include <lib.h>
+#include <synch.h>
+#include <current.h>
+#include <proc.h>
+#include <copyinout.h>
+#include <futex.h>
+
+#define FUTEX_HASHSIZE 31
+
+/* One of these lives on the stack of each waiting thread. */
+struct futex_waiter {
+	struct addrspace *fw_as;
+	userptr_t fw_addr;
+	bool fw_woken;			/* set by futex_wake */
+	struct futex_waiter *fw_next;
+};
+
+struct futex_bucket {
+	struct lock *fb_lock;
+	struct cv *fb_cv;
+	struct futex_waiter *fb_head;	/* oldest waiter */
+	struct futex_waiter *fb_tail;	/* newest waiter */
+};
+
+static struct futex_bucket futex_table[FUTEX_HASHSIZE];
+
+void
+futex_bootstrap(void)
+{
+	unsigned i;
+
+	for (i=0; i<FUTEX_HASHSIZE; i++) {
+		futex_table[i].fb_lock = lock_create("futex");
+		futex_table[i].fb_cv = cv_create("futex");
+		if (futex_table[i].fb_lock == NULL ||
+		    futex_table[i].fb_cv == NULL) {
+			panic("futex_bootstrap: Out of memory\n");
+		}
+		futex_table[i].fb_head = NULL;
+		futex_table[i].fb_tail = NULL;
+	}
+}
+
+static
+struct futex_bucket *
+futex_bucket(struct addrspace *as, userptr_t uaddr)
+{
+	uintptr_t key;
+
+	key = (uintptr_t)as ^ ((uintptr_t)uaddr >> 2);
+	return &futex_table[key % FUTEX_HASHSIZE];
+}
+
+int
+futex_wait(struct addrspace *as, userptr_t uaddr, int val)
+{
+	struct futex_bucket *fb;
+	struct futex_waiter fw;
+	int cur, result;
+
+	fb = futex_bucket(as, uaddr);
+
+	lock_acquire(fb->fb_lock);
+
+	/* futex_wakeall checks every bucket after the flag is set */
+	if (proc_isexiting(curproc)) {
+		lock_release(fb->fb_lock);
+		return EINTR;
+	}
+
+	/* Wakers take the bucket lock, so nothing can change under us. */
+	result = copyin((const_userptr_t)uaddr, &cur, sizeof(cur));
+	if (result) {
+		lock_release(fb->fb_lock);
+		return result;
+	}
+	if (cur != val) {
+		lock_release(fb->fb_lock);
+		return EAGAIN;
+	}
+
+	fw.fw_as = as;
+	fw.fw_addr = uaddr;
+	fw.fw_woken = false;
+	fw.fw_next = NULL;
+	if (fb->fb_tail == NULL) {
+		fb->fb_head = &fw;
+	}
+	else {
+		fb->fb_tail->fw_next = &fw;
+	}
+	fb->fb_tail = &fw;
+
+	while (!fw.fw_woken) {
+		cv_wait(fb->fb_cv, fb->fb_lock);
+	}
+	/* futex_wake took us off the list */
+
+	lock_release(fb->fb_lock);
+	return 0;
+}
+
+unsigned
+futex_wake(struct addrspace *as, userptr_t uaddr, unsigned n)
+{
+	struct futex_bucket *fb;
+	struct futex_waiter *fw, *prev, *next;
+	unsigned woken = 0;
+
+	fb = futex_bucket(as, uaddr);
+
+	lock_acquire(fb->fb_lock);
+	prev = NULL;
+	for (fw = fb->fb_head; fw != NULL && woken < n; fw = next) {
+		next = fw->fw_next;
+		if (fw->fw_as != as || fw->fw_addr != uaddr) {
+			prev = fw;
+			continue;
+		}
+
+		/* unlink it; once fw_woken is set it may vanish */
+		if (prev == NULL) {
+			fb->fb_head = next;
+		}
+		else {
+			prev->fw_next = next;
+		}
+		if (fb->fb_tail == fw) {
+			fb->fb_tail = prev;
+		}
+		fw->fw_woken = true;
+		woken++;
+	}
+	if (woken > 0) {
+		cv_broadcast(fb->fb_cv, fb->fb_lock);
+	}
+	lock_release(fb->fb_lock);
+
+	return woken;
+}
+
+void
+futex_wakeall(struct addrspace *as)
+{
+	struct futex_bucket *fb;
+	struct futex_waiter *fw, *prev, *next;
+	unsigned i;
+	bool any;
+
+	for (i=0; i<FUTEX_HASHSIZE; i++) {
+		fb = &futex_table[i];
+
+		lock_acquire(fb->fb_lock);
+		any = false;
+		prev = NULL;
+		for (fw = fb->fb_head; fw != NULL; fw = next) {
+			next = fw->fw_next;
+			if (fw->fw_as != as) {
+				prev = fw;
+				continue;
+			}
+			if (prev == NULL) {
+				fb->fb_head = next;
+			}
+			else {
+				prev->fw_next = next;
+			}
+			if (fb->fb_tail == fw) {
+				fb->fb_tail = prev;
+			}
+			fw->fw_woken = true;
+			any = true;
+		}
+		if (any) {
+			cv_broadcast(fb->fb_cv, fb->fb_lock);
+		}
+		lock_release(fb->fb_lock);
+	}
+}
@@ -0,0 +1,597 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * Sampling profiler. See prof.h.
+ */
+
+#include <types.h>
+#include <kern/errno.h>
+#include <kern/fcntl.h>
+#include <lib.h>
+#include <cpu.h>
+#include <thread.h>
+#include <current.h>
+#include <elf.h>
+#include <uio.h>
+#include <vnode.h>
+#include <vfs.h>
+#include <vm.h>
+#include <prof.h>
+
+/*
+ * The kernel text starts at the bottom of KSEG0 (see the ldscript,
+ * which also provides _etext) and everything between there and
+ * _etext gets a bucket.
+ */
+extern const char _etext[];
+#define PROF_TEXTSTART	((vaddr_t)MIPS_KSEG0)
+#define PROF_TEXTEND	((vaddr_t)_etext)
+
+struct prof_userpc {
+	vaddr_t pu_pc;
+	unsigned pu_count;
+};
+
+struct prof_cpu {
+	unsigned *pc_kcounts;		/* kernel text histogram */
+	unsigned pc_kother;		/* kernel PCs outside the text */
+	unsigned pc_user;		/* all user-mode samples */
+	unsigned pc_uother;		/* user PCs the table had no room for */
+	struct prof_userpc pc_upcs[PROF_NUSERPCS];
+};
+
+static volatile bool prof_on;
+static struct prof_cpu *volatile prof_cpus;
+static volatile unsigned prof_ncpus;
+static unsigned prof_nbuckets;
+
+////////////////////////////////////////////////////////////
+//
+// Collection.
+
+/*
+ * Record a sample. Runs in the timer interrupt, so no locks: this cpu
+ * is the only writer of its own counters.
+ */
+void
+prof_sample(vaddr_t pc, bool usermode)
+{
+	struct prof_cpu *pcpu;
+	unsigned cpunum, i, slot;
+
+	if (!prof_on) {
+		return;
+	}
+	cpunum = curcpu->c_number;
+	if (cpunum >= prof_ncpus) {
+		return;
+	}
+	pcpu = &prof_cpus[cpunum];
+
+	if (!usermode) {
+		if (pc >= PROF_TEXTSTART && pc < PROF_TEXTEND) {
+			pcpu->pc_kcounts[(pc - PROF_TEXTSTART) >> PROF_SHIFT]++;
+		}
+		else {
+			pcpu->pc_kother++;
+		}
+		return;
+	}
+
+	pcpu->pc_user++;
+	slot = (pc >> 2) & (PROF_NUSERPCS - 1);
+	for (i=0; i<PROF_NUSERPCS; i++) {
+		struct prof_userpc *pu;
+
+		pu = &pcpu->pc_upcs[(slot + i) & (PROF_NUSERPCS - 1)];
+		if (pu->pu_count == 0) {
+			pu->pu_pc = pc;
+		}
+		if (pu->pu_pc == pc) {
+			pu->pu_count++;
+			return;
+		}
+	}
+	pcpu->pc_uother++;
+}
+
+int
+prof_start(void)
+{
+	struct prof_cpu *cpus;
+	unsigned i, n, nbuckets;
+
+	if (prof_cpus == NULL) {
+		n = thread_numcpus();
+		nbuckets = ((PROF_TEXTEND - PROF_TEXTSTART) >> PROF_SHIFT) + 1;
+		cpus = kmalloc(n * sizeof(*cpus));
+		if (cpus == NULL) {
+			return ENOMEM;
+		}
+		for (i=0; i<n; i++) {
+			cpus[i].pc_kcounts = kmalloc(nbuckets * sizeof(unsigned));
+			if (cpus[i].pc_kcounts == NULL) {
+				while (i > 0) {
+					kfree(cpus[--i].pc_kcounts);
+				}
+				kfree(cpus);
+				return ENOMEM;
+			}
+		}
+		prof_nbuckets = nbuckets;
+		prof_cpus = cpus;
+		prof_reset();
+		prof_ncpus = n;
+	}
+	prof_on = true;
+	return 0;
+}
+
+void
+prof_stop(void)
+{
+	prof_on = false;
+}
+
+void
+prof_reset(void)
+{
+	struct prof_cpu *pcpu;
+	unsigned i, b;
+	bool wason;
+
+	if (prof_cpus == NULL) {
+		return;
+	}
+
+	wason = prof_on;
+	prof_on = false;
+	for (i=0; i<thread_numcpus(); i++) {
+		pcpu = &prof_cpus[i];
+		for (b=0; b<prof_nbuckets; b++) {
+			pcpu->pc_kcounts[b] = 0;
+		}
+		pcpu->pc_kother = 0;
+		pcpu->pc_user = 0;
+		pcpu->pc_uother = 0;
+		for (b=0; b<PROF_NUSERPCS; b++) {
+			pcpu->pc_upcs[b].pu_pc = 0;
+			pcpu->pc_upcs[b].pu_count = 0;
+		}
+	}
+	prof_on = wason;
+}
+
+////////////////////////////////////////////////////////////
+//
+// Kernel symbols.
+
+struct prof_sym {
+	vaddr_t ps_addr;
+	const char *ps_name;
+	unsigned ps_count;
+};
+
+struct prof_symtab {
+	struct prof_sym *st_syms;	/* sorted by address */
+	unsigned st_nsyms;
+	char *st_strings;		/* the ELF string table */
+};
+
+/*
+ * Read LEN bytes at POS in the file into a new buffer. The buffer has
+ * one byte more, set to 0, so string tables come out terminated.
+ */
+static
+int
+prof_readat(struct vnode *vn, off_t pos, size_t len, void **ret)
+{
+	struct iovec iov;
+	struct uio ku;
+	char *buf;
+	int result;
+
+	buf = kmalloc(len + 1);
+	if (buf == NULL) {
+		return ENOMEM;
+	}
+	buf[len] = 0;
+	uio_kinit(&iov, &ku, buf, len, pos, UIO_READ);
+	result = VOP_READ(vn, &ku);
+	if (result == 0 && ku.uio_resid != 0) {
+		result = ENOEXEC;
+	}
+	if (result) {
+		kfree(buf);
+		return result;
+	}
+	*ret = buf;
+	return 0;
+}
+
+/*
+ * Load the function symbols in the kernel text from the ELF file at
+ * PATH. Everything else we read is thrown away again.
+ */
+static
+int
+prof_loadsyms(const char *path, struct prof_symtab *st)
+{
+	struct vnode *vn;
+	char *pathcopy;
+	Elf_Ehdr *eh = NULL;
+	Elf_Shdr *sh = NULL, *symsh, *strsh;
+	Elf_Sym *syms = NULL;
+	struct prof_sym tmp;
+	unsigned i, j, n, gap;
+	int result;
+
+	st->st_syms = NULL;
+	st->st_nsyms = 0;
+	st->st_strings = NULL;
+
+	/* vfs_open destroys the path it's given */
+	pathcopy = kstrdup(path);
+	if (pathcopy == NULL) {
+		return ENOMEM;
+	}
+	result = vfs_open(pathcopy, O_RDONLY, 0, &vn);
+	kfree(pathcopy);
+	if (result) {
+		return result;
+	}
+
+	result = prof_readat(vn, 0, sizeof(*eh), (void **)&eh);
+	if (result) {
+		goto out;
+	}
+	if (eh->e_ident[EI_MAG0] != ELFMAG0 ||
+	    eh->e_ident[EI_MAG1] != ELFMAG1 ||
+	    eh->e_ident[EI_MAG2] != ELFMAG2 ||
+	    eh->e_ident[EI_MAG3] != ELFMAG3 ||
+	    eh->e_ident[EI_CLASS] != ELFCLASS32 ||
+	    eh->e_shentsize != sizeof(Elf_Shdr) ||
+	    eh->e_shnum == 0) {
+		result = ENOEXEC;
+		goto out;
+	}
+
+	result = prof_readat(vn, eh->e_shoff, eh->e_shnum * sizeof(Elf_Shdr),
+			     (void **)&sh);
+	if (result) {
+		goto out;
+	}
+	symsh = NULL;
+	for (i=0; i<eh->e_shnum; i++) {
+		if (sh[i].sh_type == SHT_SYMTAB) {
+			symsh = &sh[i];
+			break;
+		}
+	}
+	if (symsh == NULL || symsh->sh_link >= eh->e_shnum ||
+	    symsh->sh_entsize != sizeof(Elf_Sym)) {
+		/* stripped */
+		result = ENOEXEC;
+		goto out;
+	}
+	strsh = &sh[symsh->sh_link];
+
+	result = prof_readat(vn, symsh->sh_offset, symsh->sh_size,
+			     (void **)&syms);
+	if (result) {
+		goto out;
+	}
+	result = prof_readat(vn, strsh->sh_offset, strsh->sh_size,
+			     (void **)&st->st_strings);
+	if (result) {
+		goto out;
+	}
+
+	n = symsh->sh_size / sizeof(Elf_Sym);
+	st->st_syms = kmalloc(n * sizeof(struct prof_sym));
+	if (st->st_syms == NULL) {
+		result = ENOMEM;
+		goto out;
+	}
+	for (i=0; i<n; i++) {
+		if (ELF32_ST_TYPE(syms[i].st_info) != STT_FUNC ||
+		    syms[i].st_value < PROF_TEXTSTART ||
+		    syms[i].st_value >= PROF_TEXTEND ||
+		    syms[i].st_name >= strsh->sh_size) {
+			continue;
+		}
+		tmp.ps_addr = syms[i].st_value;
+		tmp.ps_name = st->st_strings + syms[i].st_name;
+		tmp.ps_count = 0;
+		st->st_syms[st->st_nsyms++] = tmp;
+	}
+
+	/* Shell sort by address. */
+	for (gap = st->st_nsyms / 2; gap > 0; gap /= 2) {
+		for (i=gap; i<st->st_nsyms; i++) {
+			tmp = st->st_syms[i];
+			for (j=i; j>=gap &&
+				     st->st_syms[j-gap].ps_addr > tmp.ps_addr;
+			     j-=gap) {
+				st->st_syms[j] = st->st_syms[j-gap];
+			}
+			st->st_syms[j] = tmp;
+		}
+	}
+
+ out:
+	if (syms != NULL) {
+		kfree(syms);
+	}
+	if (sh != NULL) {
+		kfree(sh);
+	}
+	if (eh != NULL) {
+		kfree(eh);
+	}
+	vfs_close(vn);
+	if (result) {
+		if (st->st_syms != NULL) {
+			kfree(st->st_syms);
+			st->st_syms = NULL;
+		}
+		if (st->st_strings != NULL) {
+			kfree(st->st_strings);
+			st->st_strings = NULL;
+		}
+		st->st_nsyms = 0;
+	}
+	return result;
+}
+
+/*
+ * Find the function containing ADDR: the last one starting at or
+ * before it.
+ */
+static
+struct prof_sym *
+prof_findsym(struct prof_symtab *st, vaddr_t addr)
+{
+	unsigned lo, hi, mid;
+
+	if (st->st_nsyms == 0 || addr < st->st_syms[0].ps_addr) {
+		return NULL;
+	}
+	lo = 0;
+	hi = st->st_nsyms;
+	while (hi - lo > 1) {
+		mid = (lo + hi) / 2;
+		if (st->st_syms[mid].ps_addr <= addr) {
+			lo = mid;
+		}
+		else {
+			hi = mid;
+		}
+	}
+	return &st->st_syms[lo];
+}
+
+////////////////////////////////////////////////////////////
+//
+// Reporting.
+
+static
+void
+prof_pct(unsigned count, unsigned total)
+{
+	unsigned tenths;
+
+	tenths = total ? (unsigned)((uint64_t)count * 1000 / total) : 0;
+	kprintf("%3u.%u%%", tenths / 10, tenths % 10);
+}
+
+/*
+ * Print the NTOP biggest of N counts, by repeated selection; N is at
+ * most a few thousand and NTOP small, so that's fine. PRINTONE prints
+ * the label for entry I. Entries already printed are marked by
+ * zeroing them, so this eats the counts.
+ */
+static
+void
+prof_printtop(unsigned *counts, unsigned n, unsigned ntop, unsigned total,
+	      void (*printone)(void *, unsigned), void *data)
+{
+	unsigned i, k, best;
+
+	for (k=0; k<ntop; k++) {
+		best = n;
+		for (i=0; i<n; i++) {
+			if (counts[i] > 0 &&
+			    (best == n || counts[i] > counts[best])) {
+				best = i;
+			}
+		}
+		if (best == n) {
+			break;
+		}
+		kprintf("  %8u ", counts[best]);
+		prof_pct(counts[best], total);
+		kprintf("  ");
+		printone(data, best);
+		kprintf("\n");
+		counts[best] = 0;
+	}
+}
+
+static
+void
+prof_printsym(void *data, unsigned i)
+{
+	struct prof_symtab *st = data;
+
+	kprintf("%s", st->st_syms[i].ps_name);
+}
+
+static
+void
+prof_printbucket(void *data, unsigned i)
+{
+	(void)data;
+	kprintf("0x%08x", (unsigned)(PROF_TEXTSTART + (i << PROF_SHIFT)));
+}
+
+static
+void
+prof_printupc(void *data, unsigned i)
+{
+	struct prof_userpc *upcs = data;
+
+	kprintf("0x%08x", (unsigned)upcs[i].pu_pc);
+}
+
+void
+prof_report(const char *kernelpath, unsigned ntop)
+{
+	struct prof_symtab st;
+	struct prof_sym *ps;
+	struct prof_cpu *pcpu;
+	struct prof_userpc *upcs;
+	unsigned *kcounts, *counts;
+	unsigned i, j, b, nupcs;
+	unsigned ktotal, kother, utotal, uother;
+	int result;
+
+	if (prof_cpus == NULL) {
+		kprintf("prof: No samples\n");
+		return;
+	}
+
+	/* Fold the cpus together. */
+	kcounts = kmalloc(prof_nbuckets * sizeof(unsigned));
+	upcs = kmalloc(prof_ncpus * PROF_NUSERPCS * sizeof(*upcs));
+	counts = kmalloc(prof_ncpus * PROF_NUSERPCS * sizeof(unsigned));
+	if (kcounts == NULL || upcs == NULL || counts == NULL) {
+		kprintf("prof: Out of memory\n");
+		goto out;
+	}
+	ktotal = kother = utotal = uother = 0;
+	nupcs = 0;
+	for (b=0; b<prof_nbuckets; b++) {
+		kcounts[b] = 0;
+	}
+	for (i=0; i<prof_ncpus; i++) {
+		pcpu = &prof_cpus[i];
+		for (b=0; b<prof_nbuckets; b++) {
+			kcounts[b] += pcpu->pc_kcounts[b];
+			ktotal += pcpu->pc_kcounts[b];
+		}
+		kother += pcpu->pc_kother;
+		utotal += pcpu->pc_user;
+		uother += pcpu->pc_uother;
+		for (b=0; b<PROF_NUSERPCS; b++) {
+			if (pcpu->pc_upcs[b].pu_count == 0) {
+				continue;
+			}
+			for (j=0; j<nupcs; j++) {
+				if (upcs[j].pu_pc == pcpu->pc_upcs[b].pu_pc) {
+					break;
+				}
+			}
+			if (j == nupcs) {
+				upcs[nupcs].pu_pc = pcpu->pc_upcs[b].pu_pc;
+				upcs[nupcs].pu_count = 0;
+				nupcs++;
+			}
+			upcs[j].pu_count += pcpu->pc_upcs[b].pu_count;
+		}
+	}
+	ktotal += kother;
+
+	kprintf("%u samples: %u kernel, %u user\n",
+		ktotal + utotal, ktotal, utotal);
+
+	kprintf("Kernel:\n");
+	result = prof_loadsyms(kernelpath, &st);
+	if (result) {
+		kprintf("  (no symbols from %s: %s)\n", kernelpath,
+			strerror(result));
+		prof_printtop(kcounts, prof_nbuckets, ntop, ktotal,
+			      prof_printbucket, NULL);
+	}
+	else {
+		for (b=0; b<prof_nbuckets; b++) {
+			if (kcounts[b] == 0) {
+				continue;
+			}
+			ps = prof_findsym(&st,
+					  PROF_TEXTSTART + (b << PROF_SHIFT));
+			if (ps != NULL) {
+				ps->ps_count += kcounts[b];
+			}
+			else {
+				kother += kcounts[b];
+			}
+		}
+		/* reuse kcounts for the per-symbol counts */
+		kfree(kcounts);
+		kcounts = kmalloc((st.st_nsyms + 1) * sizeof(unsigned));
+		if (kcounts != NULL) {
+			for (i=0; i<st.st_nsyms; i++) {
+				kcounts[i] = st.st_syms[i].ps_count;
+			}
+			prof_printtop(kcounts, st.st_nsyms, ntop, ktotal,
+				      prof_printsym, &st);
+		}
+		kfree(st.st_syms);
+		kfree(st.st_strings);
+	}
+	if (kother > 0) {
+		kprintf("  %8u ", kother);
+		prof_pct(kother, ktotal);
+		kprintf("  (elsewhere)\n");
+	}
+
+	kprintf("User:\n");
+	for (i=0; i<nupcs; i++) {
+		counts[i] = upcs[i].pu_count;
+	}
+	prof_printtop(counts, nupcs, ntop, utotal, prof_printupc, upcs);
+	if (uother > 0) {
+		kprintf("  %8u ", uother);
+		prof_pct(uother, utotal);
+		kprintf("  (table full)\n");
+	}
+
+ out:
+	if (kcounts != NULL) {
+		kfree(kcounts);
+	}
+	if (upcs != NULL) {
+		kfree(upcs);
+	}
+	if (counts != NULL) {
+		kfree(counts);
+	}
+}
@@ -33,7 +33,9 @@
  */
 
 #include <types.h>
+#include <kern/errno.h>
 #include <lib.h>
+#include <clock.h>
 #include <spinlock.h>
 #include <wchan.h>
 #include <thread.h>
@@ -72,6 +74,8 @@ sem_create(const char *name, int initial_count)
 
 	spinlock_init(&sem->sem_lock);
         sem->sem_count = initial_count;
+	sem->sem_fair = false;
+	sem->sem_nwaiting = 0;
 
         return sem;
 }
@@ -102,6 +106,19 @@ P(struct semaphore *sem)
         KASSERT(curthread->t_in_interrupt == false);
 
 	spinlock_acquire(&sem->sem_lock);
+	if (sem->sem_fair && sem->sem_count == 0) {
+		/*
+		 * Line up on the wchan (which is FIFO) and wait for V
+		 * to hand us a count. It doesn't go through sem_count,
+		 * so nobody can take it from under us, and there's
+		 * nothing left to do once we wake up.
+		 */
+		sem->sem_nwaiting++;
+		wchan_lock(sem->sem_wchan);
+		spinlock_release(&sem->sem_lock);
+		wchan_sleep(sem->sem_wchan);
+		return;
+	}
         while (sem->sem_count == 0) {
 		/*
 		 * Bridge to the wchan lock, so if someone else comes
@@ -137,6 +154,20 @@ V(struct semaphore *sem)
 
 	spinlock_acquire(&sem->sem_lock);
 
+	if (sem->sem_fair && sem->sem_nwaiting > 0 &&
+	    wchan_wakeone(sem->sem_wchan)) {
+		/*
+		 * Direct handoff. A waiter has the wchan locked until
+		 * it's actually asleep, so wchan_wakeone can't miss
+		 * it; if there was nobody to wake, it's a P_timed
+		 * that timed out and has yet to take itself off
+		 * sem_nwaiting, so leave the count for it.
+		 */
+		sem->sem_nwaiting--;
+		spinlock_release(&sem->sem_lock);
+		return;
+	}
+
         sem->sem_count++;
         KASSERT(sem->sem_count > 0);
 	wchan_wakeone(sem->sem_wchan);
@@ -144,6 +175,65 @@ V(struct semaphore *sem)
 	spinlock_release(&sem->sem_lock);
 }
 
+int
+P_timed(struct semaphore *sem, uint64_t nsecs)
+{
+	uint64_t deadline;
+	int result;
+
+        KASSERT(sem != NULL);
+        KASSERT(curthread->t_in_interrupt == false);
+
+	deadline = timer_ticks() + timer_nstoticks(nsecs);
+
+	spinlock_acquire(&sem->sem_lock);
+	if (sem->sem_fair && sem->sem_count == 0) {
+		sem->sem_nwaiting++;
+		wchan_lock(sem->sem_wchan);
+		spinlock_release(&sem->sem_lock);
+		result = wchan_sleep_until(sem->sem_wchan, deadline);
+		if (result == 0) {
+			/* handed off to us by V */
+			return 0;
+		}
+		spinlock_acquire(&sem->sem_lock);
+		KASSERT(sem->sem_nwaiting > 0);
+		sem->sem_nwaiting--;
+		/* V may have just missed us; see above */
+		if (sem->sem_count > 0) {
+			sem->sem_count--;
+			result = 0;
+		}
+		spinlock_release(&sem->sem_lock);
+		return result;
+	}
+        while (sem->sem_count == 0) {
+		wchan_lock(sem->sem_wchan);
+		spinlock_release(&sem->sem_lock);
+		result = wchan_sleep_until(sem->sem_wchan, deadline);
+		spinlock_acquire(&sem->sem_lock);
+		if (result && sem->sem_count == 0) {
+			spinlock_release(&sem->sem_lock);
+			return result;
+		}
+        }
+        sem->sem_count--;
+	spinlock_release(&sem->sem_lock);
+	return 0;
+}
+
+void
+sem_setfair(struct semaphore *sem, bool fair)
+{
+        KASSERT(sem != NULL);
+
+	spinlock_acquire(&sem->sem_lock);
+	KASSERT(sem->sem_nwaiting == 0);
+	KASSERT(wchan_isempty(sem->sem_wchan));
+	sem->sem_fair = fair;
+	spinlock_release(&sem->sem_lock);
+}
+
 ////////////////////////////////////////////////////////////
 //
 // Lock.
@@ -177,6 +267,9 @@ lock_create(const char *name)
 
         spinlock_init(&lock -> slock);  // init the spinlock
         lock -> holder = NULL; // Init lock holder to nobody
+        lock -> lk_fair = false;
+        lock -> lk_handoff = false;
+        lock -> lk_nwaiting = 0;
 
         return lock;
 }
@@ -199,6 +292,17 @@ lock_acquire(struct lock *lock)
         KASSERT(curthread -> t_in_interrupt == false);
 
 	      spinlock_acquire(&lock -> slock);  // Acquire the spinlock
+        if (lock -> lk_fair && (lock -> holder != NULL || lock -> lk_handoff)) {
+            // Queue up; lock_release hands the lock to the oldest waiter
+            lock -> lk_nwaiting++;
+            wchan_lock(lock -> lk_wchan);
+            spinlock_release(&lock -> slock);
+            wchan_sleep(lock -> lk_wchan);
+            spinlock_acquire(&lock -> slock);
+            // Only lock_release wakes us, and only after handing off
+            KASSERT(lock -> lk_handoff && lock -> holder == NULL);
+            lock -> lk_handoff = false;
+        }
         while (lock -> holder != NULL) {  // If the lock is currently held...
 		        wchan_lock(lock -> lk_wchan);
 		        spinlock_release(&lock -> slock); // Keep spinning
@@ -217,11 +321,28 @@ lock_release(struct lock *lock)
       KASSERT(lock_do_i_hold(lock) == true);
       spinlock_acquire(&lock -> slock); // Grab a spinlock
       lock -> holder = NULL;
+      if (lock -> lk_fair && lock -> lk_nwaiting > 0) {
+        // Keep the lock reserved for the oldest waiter
+        lock -> lk_nwaiting--;
+        lock -> lk_handoff = true;
+      }
       wchan_wakeone(lock -> lk_wchan); // Wake up someone waiting
       spinlock_release(&lock -> slock); // release our spinlock
 
 }
 
+void
+lock_setfair(struct lock *lock, bool fair)
+{
+        KASSERT(lock != NULL);
+
+        spinlock_acquire(&lock -> slock);
+        KASSERT(lock -> holder == NULL && !lock -> lk_handoff);
+        KASSERT(wchan_isempty(lock -> lk_wchan));
+        lock -> lk_fair = fair;
+        spinlock_release(&lock -> slock);
+}
+
 bool  // Quick checker to see if the thread holds a particular lock
 lock_do_i_hold(struct lock *lock)
 {
@@ -267,6 +388,11 @@ bool lock_do_i_hold(struct lock *lock) {
   reutrn true;
 }
 
+void lock_setfair(struct lock *lock, bool fair) {
+  (void) lock;
+  (void) fair;
+}
+
 #endif
 
 
@@ -330,6 +456,24 @@ cv_wait(struct cv *cv, struct lock *lock)
         }
 }
 
+int
+cv_timedwait(struct cv *cv, struct lock *lock, uint64_t nsecs)
+{
+        uint64_t deadline;
+        int result;
+
+        KASSERT(lock != NULL);
+        KASSERT(cv != NULL);
+        KASSERT(lock_do_i_hold(lock));
+
+        deadline = timer_ticks() + timer_nstoticks(nsecs);
+        wchan_lock(cv -> cv_wchan);
+        lock_release(lock);
+        result = wchan_sleep_until(cv -> cv_wchan, deadline);
+        lock_acquire(lock);
+        return result;
+}
+
 void
 cv_signal(struct cv *cv, struct lock *lock)
 {
@@ -398,6 +542,16 @@ cv_wait(struct cv *cv, struct lock *lock)
         (void)lock;  // suppress warning until code gets written
 }
 
+int
+cv_timedwait(struct cv *cv, struct lock *lock, uint64_t nsecs)
+{
+        // Write this
+        (void)cv;    // suppress warning until code gets written
+        (void)lock;  // suppress warning until code gets written
+        (void)nsecs;
+        return 0;
+}
+
 void
 cv_signal(struct cv *cv, struct lock *lock)
 {
@@ -415,3 +569,161 @@ cv_broadcast(struct cv *cv, struct lock *lock)
 }
 
 #endif
+
+////////////////////////////////////////////////////////////
+//
+// RW lock.
+
+struct rwlock *
+rwlock_create(const char *name)
+{
+        struct rwlock *rw;
+
+        rw = kmalloc(sizeof(struct rwlock));
+        if (rw == NULL) {
+                return NULL;
+        }
+
+        rw->rw_name = kstrdup(name);
+        if (rw->rw_name == NULL) {
+                kfree(rw);
+                return NULL;
+        }
+
+	/* the two wchans share the name; wchan_create doesn't copy it */
+	rw->rw_rwchan = wchan_create(rw->rw_name);
+	if (rw->rw_rwchan == NULL) {
+		kfree(rw->rw_name);
+		kfree(rw);
+		return NULL;
+	}
+	rw->rw_wwchan = wchan_create(rw->rw_name);
+	if (rw->rw_wwchan == NULL) {
+		wchan_destroy(rw->rw_rwchan);
+		kfree(rw->rw_name);
+		kfree(rw);
+		return NULL;
+	}
+
+	spinlock_init(&rw->rw_lock);
+        rw->rw_nreaders = 0;
+        rw->rw_nwaitwriters = 0;
+        rw->rw_writer = NULL;
+
+        return rw;
+}
+
+void
+rwlock_destroy(struct rwlock *rw)
+{
+        KASSERT(rw != NULL);
+	KASSERT(rw->rw_nreaders == 0);
+	KASSERT(rw->rw_writer == NULL);
+
+	/* wchan_cleanup will assert if anyone's waiting on it */
+	spinlock_cleanup(&rw->rw_lock);
+	wchan_destroy(rw->rw_wwchan);
+	wchan_destroy(rw->rw_rwchan);
+        kfree(rw->rw_name);
+        kfree(rw);
+}
+
+void
+rwlock_acquire_read(struct rwlock *rw)
+{
+        KASSERT(rw != NULL);
+        KASSERT(curthread->t_in_interrupt == false);
+	KASSERT(rw->rw_writer != curthread);
+
+	spinlock_acquire(&rw->rw_lock);
+	/*
+	 * Stand aside for waiting writers as well as for the current
+	 * one; this is what gives writers preference.
+	 */
+        while (rw->rw_writer != NULL || rw->rw_nwaitwriters > 0) {
+		wchan_lock(rw->rw_rwchan);
+		spinlock_release(&rw->rw_lock);
+                wchan_sleep(rw->rw_rwchan);
+		spinlock_acquire(&rw->rw_lock);
+        }
+        rw->rw_nreaders++;
+	spinlock_release(&rw->rw_lock);
+}
+
+void
+rwlock_acquire_write(struct rwlock *rw)
+{
+        KASSERT(rw != NULL);
+        KASSERT(curthread->t_in_interrupt == false);
+	KASSERT(rw->rw_writer != curthread);
+
+	spinlock_acquire(&rw->rw_lock);
+	rw->rw_nwaitwriters++;
+        while (rw->rw_writer != NULL || rw->rw_nreaders > 0) {
+		wchan_lock(rw->rw_wwchan);
+		spinlock_release(&rw->rw_lock);
+                wchan_sleep(rw->rw_wwchan);
+		spinlock_acquire(&rw->rw_lock);
+        }
+	rw->rw_nwaitwriters--;
+        rw->rw_writer = curthread;
+	spinlock_release(&rw->rw_lock);
+}
+
+void
+rwlock_release(struct rwlock *rw)
+{
+        KASSERT(rw != NULL);
+
+	spinlock_acquire(&rw->rw_lock);
+	if (rw->rw_writer == curthread) {
+		rw->rw_writer = NULL;
+		/*
+		 * Pass the lock on to the next writer if there is
+		 * one; only let the readers in when no writer is
+		 * waiting, or they'd just go straight back to sleep.
+		 */
+		if (rw->rw_nwaitwriters > 0) {
+			wchan_wakeone(rw->rw_wwchan);
+		}
+		else {
+			wchan_wakeall(rw->rw_rwchan);
+		}
+	}
+	else {
+		KASSERT(rw->rw_writer == NULL);
+		KASSERT(rw->rw_nreaders > 0);
+		rw->rw_nreaders--;
+		if (rw->rw_nreaders == 0 && rw->rw_nwaitwriters > 0) {
+			wchan_wakeone(rw->rw_wwchan);
+		}
+	}
+	spinlock_release(&rw->rw_lock);
+}
+
+void
+rwlock_downgrade(struct rwlock *rw)
+{
+        KASSERT(rw != NULL);
+
+	spinlock_acquire(&rw->rw_lock);
+	KASSERT(rw->rw_writer == curthread);
+	KASSERT(rw->rw_nreaders == 0);
+	rw->rw_writer = NULL;
+	rw->rw_nreaders = 1;
+	/*
+	 * Other readers may join us, unless a writer is already
+	 * waiting; it gets the lock when we (and any readers already
+	 * inside) let go.
+	 */
+	if (rw->rw_nwaitwriters == 0) {
+		wchan_wakeall(rw->rw_rwchan);
+	}
+	spinlock_release(&rw->rw_lock);
+}
+
+bool
+rwlock_do_i_hold_write(struct rwlock *rw)
+{
+	return rw->rw_writer == curthread;
+}
@@ -40,6 +40,7 @@
 #include <cpu.h>
 #include <spl.h>
 #include <spinlock.h>
+#include <clock.h>
 #include <wchan.h>
 #include <thread.h>
 #include <threadlist.h>
@@ -50,6 +51,7 @@
 #include <addrspace.h>
 #include <mainbus.h>
 #include <vnode.h>
+#include <trace.h>
 
 #include "opt-synchprobs.h"
 
@@ -142,6 +144,7 @@ thread_create(const char *name)
 	thread->t_stack = NULL;
 	thread->t_context = NULL;
 	thread->t_cpu = NULL;
+	thread->t_pinned = false;
 	thread->t_proc = NULL;
 
 	/* Interrupt state fields */
@@ -149,6 +152,17 @@ thread_create(const char *name)
 	thread->t_curspl = IPL_HIGH;
 	thread->t_iplhigh_count = 1; /* corresponding to t_curspl */
 
+	/* Public fields */
+	thread->t_syscallno = -1;
+	thread->t_syscallstart = 0;
+
+	/* CPU accounting */
+	bzero(&thread->t_usage, sizeof(thread->t_usage));
+	thread->t_runstart = cpu_getcycles();
+	thread->t_readystart = thread->t_runstart;
+
+	thread->t_exitaddr = NULL;
+
 	/* If you add to struct thread, be sure to initialize here */
 
 	return thread;
@@ -449,6 +463,8 @@ thread_make_runnable(struct thread *target, bool already_have_lock)
 		spinlock_acquire(&targetcpu->c_runqueue_lock);
 	}
 
+	TRACE(TRACE_WAKE, target, targetcpu->c_number);
+	target->t_readystart = cpu_getcycles();
 	isidle = targetcpu->c_isidle;
 	threadlist_addtail(&targetcpu->c_runqueue, target);
 	if (isidle) {
@@ -474,11 +490,12 @@ thread_make_runnable(struct thread *target, bool already_have_lock)
  * process is inherited from the caller. It will start on the same CPU
  * as the caller, unless the scheduler intervenes first.
  */
+static
 int
-thread_fork(const char *name,
-	    struct proc *proc,
-	    void (*entrypoint)(void *data1, unsigned long data2),
-	    void *data1, unsigned long data2)
+thread_fork_common(const char *name,
+		   struct proc *proc, struct cpu *cpu, bool pinned,
+		   void (*entrypoint)(void *data1, unsigned long data2),
+		   void *data1, unsigned long data2)
 {
 	struct thread *newthread;
 	int result;
@@ -505,7 +522,8 @@ thread_fork(const char *name,
 	 */
 
 	/* Thread subsystem fields */
-	newthread->t_cpu = curthread->t_cpu;
+	newthread->t_cpu = cpu;
+	newthread->t_pinned = pinned;
 
 	/* Attach the new thread to its process */
 	if (proc == NULL) {
@@ -528,12 +546,43 @@ thread_fork(const char *name,
 	/* Set up the switchframe so entrypoint() gets called */
 	switchframe_init(newthread, entrypoint, data1, data2);
 
-	/* Lock the current cpu's run queue and make the new thread runnable */
+	/* Lock the target cpu's run queue and make the new thread runnable */
 	thread_make_runnable(newthread, false);
 
 	return 0;
 }
 
+int
+thread_fork(const char *name,
+	    struct proc *proc,
+	    void (*entrypoint)(void *data1, unsigned long data2),
+	    void *data1, unsigned long data2)
+{
+	return thread_fork_common(name, proc, curthread->t_cpu, false,
+				  entrypoint, data1, data2);
+}
+
+/*
+ * Create a new thread bound to a particular CPU. Otherwise the same
+ * as thread_fork.
+ */
+int
+thread_fork_oncpu(const char *name,
+		  struct proc *proc, unsigned cpunum,
+		  void (*entrypoint)(void *data1, unsigned long data2),
+		  void *data1, unsigned long data2)
+{
+	KASSERT(cpunum < cpuarray_num(&allcpus));
+	return thread_fork_common(name, proc, cpuarray_get(&allcpus, cpunum),
+				  true, entrypoint, data1, data2);
+}
+
+unsigned
+thread_numcpus(void)
+{
+	return cpuarray_num(&allcpus);
+}
+
 /*
  * High level, machine-independent context switch code.
  *
@@ -580,6 +629,20 @@ thread_switch(threadstate_t newstate, struct wchan *wc)
 		return;
 	}
 
+	/*
+	 * Charge the time since we were switched in. A thread that
+	 * gives up the CPU from an interrupt handler (that is, from
+	 * the timer via thread_yield) was preempted; anything else
+	 * is voluntary. Exiting isn't a switch at all.
+	 */
+	cur->t_usage.tu_runcycles += cpu_getcycles() - cur->t_runstart;
+	if (newstate == S_READY && cur->t_in_interrupt) {
+		cur->t_usage.tu_nivcsw++;
+	}
+	else if (newstate != S_ZOMBIE) {
+		cur->t_usage.tu_nvcsw++;
+	}
+
 	/* Put the thread in the right place. */
 	switch (newstate) {
 	    case S_RUN:
@@ -648,6 +711,9 @@ thread_switch(threadstate_t newstate, struct wchan *wc)
 	 * assume the compiler will optimize one away if they're the
 	 * same.
 	 */
+	TRACE(TRACE_SWITCH, next, newstate);
+	next->t_runstart = cpu_getcycles();
+	next->t_usage.tu_waitcycles += next->t_runstart - next->t_readystart;
 	curcpu->c_curthread = next;
 	curthread = next;
 
@@ -922,6 +988,12 @@ thread_consider_migration(void)
 				to_send--;
 				continue;
 			}
+			/* Pinned threads stay home the same way. */
+			if (t->t_pinned) {
+				threadlist_addtail(&victims, t);
+				to_send--;
+				continue;
+			}
 
 			t->t_cpu = c;
 			threadlist_addtail(&c->c_runqueue, t);
@@ -959,6 +1031,58 @@ thread_consider_migration(void)
 
 ////////////////////////////////////////////////////////////
 
+/*
+ * CPU accounting
+ */
+
+/*
+ * Charge a timer tick to whatever was running. Ticks that land in
+ * the idle loop belong to nobody.
+ */
+void
+thread_accounttick(bool usermode)
+{
+	KASSERT(curthread->t_curspl > 0);
+
+	if (curcpu->c_isidle) {
+		return;
+	}
+	if (usermode) {
+		curthread->t_usage.tu_uticks++;
+	}
+	else {
+		curthread->t_usage.tu_sticks++;
+	}
+}
+
+/*
+ * Copy out T's totals, adding in the run or wait period in progress
+ * so that a thread that hasn't switched lately doesn't look stalled.
+ *
+ * Nothing locks t_usage against the CPU T is on; a reader on another
+ * CPU can see a total in mid-update. That's fine for statistics.
+ */
+void
+thread_getusage(struct thread *t, struct threadusage *tu)
+{
+	uint32_t now;
+
+	now = cpu_getcycles();
+	*tu = t->t_usage;
+	switch (t->t_state) {
+	    case S_RUN:
+		tu->tu_runcycles += now - t->t_runstart;
+		break;
+	    case S_READY:
+		tu->tu_waitcycles += now - t->t_readystart;
+		break;
+	    default:
+		break;
+	}
+}
+
+////////////////////////////////////////////////////////////
+
 /*
  * Wait channel functions
  */
@@ -1025,13 +1149,88 @@ wchan_sleep(struct wchan *wc)
 	/* may not sleep in an interrupt handler */
 	KASSERT(!curthread->t_in_interrupt);
 
+	TRACE(TRACE_SLEEP, wc, 0);
 	thread_switch(S_SLEEP, wc);
 }
 
 /*
- * Wake up one thread sleeping on a wait channel.
+ * State shared between wchan_sleep_until and its timeout.
  */
+struct wchan_timedsleep {
+	struct wchan *ts_wchan;
+	struct thread *ts_thread;
+	volatile bool ts_timedout;
+};
+
+/*
+ * Timeout function for wchan_sleep_until: wake the sleeper, if it's
+ * still asleep on the channel. If someone else got there first it
+ * isn't on the list any more and we leave it be.
+ */
+static
 void
+wchan_timeout(void *data)
+{
+	struct wchan_timedsleep *ts = data;
+	struct wchan *wc = ts->ts_wchan;
+	struct thread *t;
+	bool found = false;
+
+	spinlock_acquire(&wc->wc_lock);
+	THREADLIST_FORALL(t, wc->wc_threads) {
+		if (t == ts->ts_thread) {
+			threadlist_remove(&wc->wc_threads, t);
+			/* before it can run, so it sees this */
+			ts->ts_timedout = true;
+			found = true;
+			break;
+		}
+	}
+	spinlock_release(&wc->wc_lock);
+
+	if (found) {
+		thread_make_runnable(ts->ts_thread, false);
+	}
+}
+
+/*
+ * Like wchan_sleep, but give up at hardclock tick DEADLINE. Returns 0
+ * if woken up normally and ETIMEDOUT if the deadline came first.
+ */
+int
+wchan_sleep_until(struct wchan *wc, uint64_t deadline)
+{
+	struct wchan_timedsleep ts;
+	struct timeout to;
+
+	/* may not sleep in an interrupt handler */
+	KASSERT(!curthread->t_in_interrupt);
+
+	ts.ts_wchan = wc;
+	ts.ts_thread = curthread;
+	ts.ts_timedout = false;
+
+	/*
+	 * We hold the channel lock until we're on the sleep list, so
+	 * the timeout can't look for us there too early.
+	 */
+	timeout_init(&to, wchan_timeout, &ts);
+	timeout_add(&to, deadline);
+
+	TRACE(TRACE_SLEEP, wc, deadline);
+	thread_switch(S_SLEEP, wc);
+
+	/* make sure it's gone before our stack frame is */
+	timeout_cancel(&to);
+
+	return ts.ts_timedout ? ETIMEDOUT : 0;
+}
+
+/*
+ * Wake up one thread sleeping on a wait channel. Returns true if
+ * there was one.
+ */
+bool
 wchan_wakeone(struct wchan *wc)
 {
 	struct thread *target;
@@ -1047,10 +1246,11 @@ wchan_wakeone(struct wchan *wc)
 
 	if (target == NULL) {
 		/* Nobody was sleeping. */
-		return;
+		return false;
 	}
 
 	thread_make_runnable(target, false);
+	return true;
 }
 
 /*
@@ -1162,6 +1362,20 @@ ipi_tlbshootdown(struct cpu *target, const struct tlbshootdown *mapping)
 	spinlock_release(&target->c_ipi_lock);
 }
 
+void
+ipi_tlbshootdown_broadcast(const struct tlbshootdown *mapping)
+{
+	unsigned i;
+	struct cpu *c;
+
+	for (i=0; i < cpuarray_num(&allcpus); i++) {
+		c = cpuarray_get(&allcpus, i);
+		if (c != curcpu->c_self) {
+			ipi_tlbshootdown(c, mapping);
+		}
+	}
+}
+
 void
 interprocessor_interrupt(void)
 {
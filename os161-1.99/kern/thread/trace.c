@@ -0,0 +1,234 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * Kernel event tracing. See trace.h.
+ */
+
+#include <types.h>
+#include <kern/errno.h>
+#include <lib.h>
+#include <spl.h>
+#include <cpu.h>
+#include <thread.h>
+#include <current.h>
+#include <trace.h>
+
+struct trace_entry {
+	uint32_t te_time;		/* cpu_getcycles() */
+	uint32_t te_thread;		/* curthread, as a number */
+	uint16_t te_event;
+	uint16_t te_cpu;
+	uint32_t te_arg0;
+	uint32_t te_arg1;
+};
+
+struct trace_ring {
+	/* only ever incremented; the slot is tr_next % TRACE_NENTRIES */
+	volatile uint32_t tr_next;
+	struct trace_entry tr_entries[TRACE_NENTRIES];
+};
+
+volatile bool trace_on;
+
+/*
+ * One ring per cpu, indexed by c_number. They're allocated the first
+ * time tracing is started and then kept for good.
+ */
+static struct trace_ring **volatile trace_rings;
+static volatile unsigned trace_nrings;
+
+static const char *const trace_eventnames[TRACE_NEVENTS] = {
+	[TRACE_SWITCH] = "switch",
+	[TRACE_SLEEP] = "sleep",
+	[TRACE_WAKE] = "wake",
+	[TRACE_SYSCALL] = "syscall",
+	[TRACE_SYSRET] = "sysret",
+	[TRACE_FAULT] = "fault",
+	[TRACE_DISKIO] = "diskio",
+};
+
+/*
+ * Record an event on the current cpu. Interrupts are turned off so
+ * nothing else on this cpu can get into the same slot, and no other
+ * cpu writes to this ring, so no lock is needed.
+ */
+void
+trace_record(unsigned event, uint32_t arg0, uint32_t arg1)
+{
+	struct trace_ring *tr;
+	struct trace_entry *te;
+	unsigned cpunum;
+	int spl;
+
+	spl = splhigh();
+	cpunum = curcpu->c_number;
+	if (cpunum < trace_nrings) {
+		tr = trace_rings[cpunum];
+		te = &tr->tr_entries[tr->tr_next % TRACE_NENTRIES];
+		te->te_time = cpu_getcycles();
+		te->te_thread = (uint32_t)(uintptr_t)curthread;
+		te->te_event = event;
+		te->te_cpu = cpunum;
+		te->te_arg0 = arg0;
+		te->te_arg1 = arg1;
+		tr->tr_next++;
+	}
+	splx(spl);
+}
+
+int
+trace_start(void)
+{
+	struct trace_ring **rings;
+	unsigned i, n;
+
+	if (trace_rings == NULL) {
+		n = thread_numcpus();
+		rings = kmalloc(n * sizeof(*rings));
+		if (rings == NULL) {
+			return ENOMEM;
+		}
+		for (i=0; i<n; i++) {
+			rings[i] = kmalloc(sizeof(struct trace_ring));
+			if (rings[i] == NULL) {
+				while (i > 0) {
+					kfree(rings[--i]);
+				}
+				kfree(rings);
+				return ENOMEM;
+			}
+			rings[i]->tr_next = 0;
+		}
+		/* set up the rings before trace_record can see them */
+		trace_rings = rings;
+		trace_nrings = n;
+	}
+	trace_on = true;
+	return 0;
+}
+
+void
+trace_stop(void)
+{
+	trace_on = false;
+}
+
+void
+trace_clear(void)
+{
+	unsigned i;
+	bool wason;
+
+	wason = trace_on;
+	trace_on = false;
+	for (i=0; i<trace_nrings; i++) {
+		trace_rings[i]->tr_next = 0;
+	}
+	trace_on = wason;
+}
+
+int
+trace_eventbyname(const char *name)
+{
+	unsigned i;
+
+	for (i=0; i<TRACE_NEVENTS; i++) {
+		if (!strcmp(name, trace_eventnames[i])) {
+			return i;
+		}
+	}
+	return -1;
+}
+
+/*
+ * Dump the rings, merging them by timestamp. Each ring is already in
+ * order, so keep a cursor per ring and repeatedly print the earliest
+ * entry under any cursor. Timestamps are compared by difference so
+ * the cycle counter wrapping doesn't upset the order (as long as the
+ * trace spans less than half the wrap time).
+ */
+void
+trace_dump(unsigned eventmask)
+{
+	uint32_t *pos, *end;
+	struct trace_entry *te, *best;
+	unsigned i, bestring;
+	uint32_t count;
+
+	/* Nothing may be added while we're reading. */
+	trace_on = false;
+
+	kprintf("# cycles cpu thread event arg0 arg1\n");
+	if (trace_nrings == 0) {
+		return;
+	}
+
+	pos = kmalloc(2 * trace_nrings * sizeof(uint32_t));
+	if (pos == NULL) {
+		kprintf("# trace_dump: Out of memory\n");
+		return;
+	}
+	end = pos + trace_nrings;
+	for (i=0; i<trace_nrings; i++) {
+		end[i] = trace_rings[i]->tr_next;
+		count = end[i] < TRACE_NENTRIES ? end[i] : TRACE_NENTRIES;
+		pos[i] = end[i] - count;
+	}
+
+	while (1) {
+		best = NULL;
+		bestring = 0;
+		for (i=0; i<trace_nrings; i++) {
+			if (pos[i] == end[i]) {
+				continue;
+			}
+			te = &trace_rings[i]->tr_entries[pos[i] % TRACE_NENTRIES];
+			if (best == NULL ||
+			    (int32_t)(te->te_time - best->te_time) < 0) {
+				best = te;
+				bestring = i;
+			}
+		}
+		if (best == NULL) {
+			break;
+		}
+		pos[bestring]++;
+
+		if ((eventmask & (1U << best->te_event)) == 0) {
+			continue;
+		}
+		kprintf("%u %u 0x%08x %s 0x%x 0x%x\n",
+			best->te_time, best->te_cpu, best->te_thread,
+			trace_eventnames[best->te_event],
+			best->te_arg0, best->te_arg1);
+	}
+
+	kfree(pos);
+}
@@ -0,0 +1,406 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * Work queues. See workqueue.h.
+ */
+
+#include <types.h>
+#include <kern/errno.h>
+#include <lib.h>
+#include <cpu.h>
+#include <spinlock.h>
+#include <wchan.h>
+#include <thread.h>
+#include <current.h>
+#include <synch.h>
+#include <workqueue.h>
+
+/*
+ * Per-CPU part of a workqueue. wc_lock protects everything here, and
+ * the w_next and w_queued fields of work on the queue.
+ *
+ * wc_nsubmitted and wc_ndone count work put on the queue and work
+ * finished; workqueue_flush waits for ndone to catch up with what
+ * nsubmitted was when it started. (They're compared by difference
+ * so wraparound doesn't matter.)
+ */
+struct wq_cpu {
+	struct spinlock wc_lock;
+	struct wchan *wc_workchan;	/* the worker sleeps here */
+	struct wchan *wc_flushchan;	/* flushers sleep here */
+	struct work *wc_head;
+	struct work **wc_tailp;
+	unsigned long wc_nsubmitted;
+	unsigned long wc_ndone;
+	bool wc_exiting;		/* worker should stop when idle */
+	bool wc_exited;			/* worker has stopped */
+};
+
+/* The general-purpose queue. */
+struct workqueue *sys_wq;
+
+////////////////////////////////////////////////////////////
+//
+// Workers.
+
+static
+void
+wq_worker(void *data, unsigned long cpunum)
+{
+	struct workqueue *wq = data;
+	struct wq_cpu *wc = &wq->wq_cpus[cpunum];
+	struct work *w;
+	void (*func)(void *, unsigned long);
+	void *fdata;
+	unsigned long fnum;
+
+	spinlock_acquire(&wc->wc_lock);
+	while (1) {
+		while (wc->wc_head == NULL && !wc->wc_exiting) {
+			wchan_lock(wc->wc_workchan);
+			spinlock_release(&wc->wc_lock);
+			wchan_sleep(wc->wc_workchan);
+			spinlock_acquire(&wc->wc_lock);
+		}
+		if (wc->wc_head == NULL) {
+			/* told to exit, and nothing left to do */
+			break;
+		}
+
+		w = wc->wc_head;
+		wc->wc_head = w->w_next;
+		if (wc->wc_head == NULL) {
+			wc->wc_tailp = &wc->wc_head;
+		}
+		/*
+		 * Copy out what we need: once w_queued is clear the
+		 * function (or anyone else) may reuse or free W.
+		 */
+		func = w->w_func;
+		fdata = w->w_data;
+		fnum = w->w_num;
+		w->w_next = NULL;
+		w->w_queued = false;
+		spinlock_release(&wc->wc_lock);
+
+		func(fdata, fnum);
+
+		spinlock_acquire(&wc->wc_lock);
+		wc->wc_ndone++;
+		wchan_wakeall(wc->wc_flushchan);
+	}
+	wc->wc_exited = true;
+	wchan_wakeall(wc->wc_flushchan);
+	spinlock_release(&wc->wc_lock);
+
+	thread_exit();
+}
+
+////////////////////////////////////////////////////////////
+//
+// Setup and teardown.
+
+/*
+ * Clean up the per-cpu state for CPUs [0, n). The workers must be
+ * gone, or never have been started.
+ */
+static
+void
+wq_cleanup_cpus(struct workqueue *wq, unsigned n)
+{
+	unsigned i;
+	struct wq_cpu *wc;
+
+	for (i=0; i<n; i++) {
+		wc = &wq->wq_cpus[i];
+		KASSERT(wc->wc_head == NULL);
+		spinlock_cleanup(&wc->wc_lock);
+		wchan_destroy(wc->wc_flushchan);
+		wchan_destroy(wc->wc_workchan);
+	}
+}
+
+/*
+ * Tell workers [0, n) to stop and wait until they have.
+ */
+static
+void
+wq_stop_workers(struct workqueue *wq, unsigned n)
+{
+	unsigned i;
+	struct wq_cpu *wc;
+
+	for (i=0; i<n; i++) {
+		wc = &wq->wq_cpus[i];
+		spinlock_acquire(&wc->wc_lock);
+		wc->wc_exiting = true;
+		wchan_wakeone(wc->wc_workchan);
+		while (!wc->wc_exited) {
+			wchan_lock(wc->wc_flushchan);
+			spinlock_release(&wc->wc_lock);
+			wchan_sleep(wc->wc_flushchan);
+			spinlock_acquire(&wc->wc_lock);
+		}
+		spinlock_release(&wc->wc_lock);
+	}
+}
+
+struct workqueue *
+workqueue_create(const char *name)
+{
+	struct workqueue *wq;
+	struct wq_cpu *wc;
+	char tname[32];
+	unsigned i;
+	int result;
+
+	wq = kmalloc(sizeof(*wq));
+	if (wq == NULL) {
+		return NULL;
+	}
+	wq->wq_name = kstrdup(name);
+	if (wq->wq_name == NULL) {
+		kfree(wq);
+		return NULL;
+	}
+	wq->wq_ncpus = thread_numcpus();
+	wq->wq_cpus = kmalloc(wq->wq_ncpus * sizeof(struct wq_cpu));
+	if (wq->wq_cpus == NULL) {
+		kfree(wq->wq_name);
+		kfree(wq);
+		return NULL;
+	}
+
+	for (i=0; i<wq->wq_ncpus; i++) {
+		wc = &wq->wq_cpus[i];
+		wc->wc_workchan = wchan_create(wq->wq_name);
+		if (wc->wc_workchan == NULL) {
+			goto fail_cpus;
+		}
+		wc->wc_flushchan = wchan_create(wq->wq_name);
+		if (wc->wc_flushchan == NULL) {
+			wchan_destroy(wc->wc_workchan);
+			goto fail_cpus;
+		}
+		spinlock_init(&wc->wc_lock);
+		wc->wc_head = NULL;
+		wc->wc_tailp = &wc->wc_head;
+		wc->wc_nsubmitted = 0;
+		wc->wc_ndone = 0;
+		wc->wc_exiting = false;
+		wc->wc_exited = false;
+	}
+
+	for (i=0; i<wq->wq_ncpus; i++) {
+		snprintf(tname, sizeof(tname), "%s/%u", wq->wq_name, i);
+		result = thread_fork_oncpu(tname, NULL, i, wq_worker, wq, i);
+		if (result) {
+			wq_stop_workers(wq, i);
+			wq_cleanup_cpus(wq, wq->wq_ncpus);
+			goto fail;
+		}
+	}
+
+	return wq;
+
+ fail_cpus:
+	wq_cleanup_cpus(wq, i);
+ fail:
+	kfree(wq->wq_cpus);
+	kfree(wq->wq_name);
+	kfree(wq);
+	return NULL;
+}
+
+void
+workqueue_destroy(struct workqueue *wq)
+{
+	/* workers run whatever is left before they exit */
+	wq_stop_workers(wq, wq->wq_ncpus);
+	wq_cleanup_cpus(wq, wq->wq_ncpus);
+	kfree(wq->wq_cpus);
+	kfree(wq->wq_name);
+	kfree(wq);
+}
+
+void
+workqueue_bootstrap(void)
+{
+	sys_wq = workqueue_create("sys_wq");
+	if (sys_wq == NULL) {
+		panic("workqueue_bootstrap: Out of memory\n");
+	}
+}
+
+////////////////////////////////////////////////////////////
+//
+// Operations.
+
+void
+work_init(struct work *w, void (*func)(void *, unsigned long),
+	  void *data, unsigned long num)
+{
+	w->w_next = NULL;
+	w->w_func = func;
+	w->w_data = data;
+	w->w_num = num;
+	w->w_queued = false;
+}
+
+bool
+workqueue_submit_cpu(struct workqueue *wq, unsigned cpunum, struct work *w)
+{
+	struct wq_cpu *wc;
+
+	KASSERT(cpunum < wq->wq_ncpus);
+	wc = &wq->wq_cpus[cpunum];
+
+	spinlock_acquire(&wc->wc_lock);
+	if (w->w_queued) {
+		spinlock_release(&wc->wc_lock);
+		return false;
+	}
+	w->w_queued = true;
+	w->w_next = NULL;
+	*wc->wc_tailp = w;
+	wc->wc_tailp = &w->w_next;
+	wc->wc_nsubmitted++;
+	wchan_wakeone(wc->wc_workchan);
+	spinlock_release(&wc->wc_lock);
+
+	return true;
+}
+
+bool
+workqueue_submit(struct workqueue *wq, struct work *w)
+{
+	/*
+	 * If we get moved to another cpu right after looking, the
+	 * work just runs on the old one. That's fine.
+	 */
+	return workqueue_submit_cpu(wq, curcpu->c_number, w);
+}
+
+void
+workqueue_flush(struct workqueue *wq)
+{
+	unsigned i;
+	struct wq_cpu *wc;
+	unsigned long target;
+
+	KASSERT(curthread->t_in_interrupt == false);
+
+	for (i=0; i<wq->wq_ncpus; i++) {
+		wc = &wq->wq_cpus[i];
+		spinlock_acquire(&wc->wc_lock);
+		target = wc->wc_nsubmitted;
+		while ((long)(wc->wc_ndone - target) < 0) {
+			wchan_lock(wc->wc_flushchan);
+			spinlock_release(&wc->wc_lock);
+			wchan_sleep(wc->wc_flushchan);
+			spinlock_acquire(&wc->wc_lock);
+		}
+		spinlock_release(&wc->wc_lock);
+	}
+}
+
+/*
+ * Parallel for. The range is cut into one contiguous chunk per CPU
+ * (or per element, if there are fewer elements than CPUs), each chunk
+ * is run by that CPU's worker, and the caller waits on a semaphore
+ * for all of them.
+ */
+struct wq_pfor {
+	void (*pf_func)(void *, unsigned long);
+	void *pf_data;
+	unsigned long pf_n;
+	unsigned pf_nchunks;
+	struct semaphore *pf_done;
+	struct work pf_work[];
+};
+
+static
+void
+wq_pfor_chunk(void *data, unsigned long chunk)
+{
+	struct wq_pfor *pf = data;
+	unsigned long size, extra, lo, hi, i;
+
+	size = pf->pf_n / pf->pf_nchunks;
+	extra = pf->pf_n % pf->pf_nchunks;
+	lo = chunk * size + (chunk < extra ? chunk : extra);
+	hi = lo + size + (chunk < extra ? 1 : 0);
+
+	for (i=lo; i<hi; i++) {
+		pf->pf_func(pf->pf_data, i);
+	}
+	V(pf->pf_done);
+}
+
+int
+workqueue_parallel_for(struct workqueue *wq, unsigned long n,
+		       void (*func)(void *, unsigned long), void *data)
+{
+	struct wq_pfor *pf;
+	unsigned i, nchunks;
+
+	KASSERT(curthread->t_in_interrupt == false);
+
+	if (n == 0) {
+		return 0;
+	}
+	nchunks = n < wq->wq_ncpus ? n : wq->wq_ncpus;
+
+	pf = kmalloc(sizeof(*pf) + nchunks * sizeof(struct work));
+	if (pf == NULL) {
+		return ENOMEM;
+	}
+	pf->pf_done = sem_create("parallel_for", 0);
+	if (pf->pf_done == NULL) {
+		kfree(pf);
+		return ENOMEM;
+	}
+	pf->pf_func = func;
+	pf->pf_data = data;
+	pf->pf_n = n;
+	pf->pf_nchunks = nchunks;
+
+	for (i=0; i<nchunks; i++) {
+		work_init(&pf->pf_work[i], wq_pfor_chunk, pf, i);
+		workqueue_submit_cpu(wq, i, &pf->pf_work[i]);
+	}
+	for (i=0; i<nchunks; i++) {
+		P(pf->pf_done);
+	}
+
+	sem_destroy(pf->pf_done);
+	kfree(pf);
+	return 0;
+}
@@ -0,0 +1,531 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * Pipe objects. See pipe.h.
+ *
+ * Both vnodes live inside struct pipe, and both have it as their
+ * vn_data; the address of the vnode says which end it is. Data goes
+ * through a PIPE_BUFSIZE (2048-byte) ring buffer from kmalloc, and is
+ * moved with at most two uiomoves per wakeup, one on either side of
+ * the wraparound.
+ *
+ * pp_lock is not held across those uiomoves. The user buffer can be
+ * a mapped file page that isn't in yet, and faulting it in takes
+ * vfs_biglock, which VOP_DECREF already holds when it calls
+ * pipe_reclaim. Instead one reader and one writer at a time mark the
+ * pipe busy and copy unlocked; they never touch the same bytes.
+ */
+#include <types.h>
+#include <kern/errno.h>
+#include <limits.h>
+#include <stat.h>
+#include <lib.h>
+#include <synch.h>
+#include <uio.h>
+#include <vm.h>
+#include <vnode.h>
+#include <pipe.h>
+
+/*
+ * Half a page, so the buffer comes from kmalloc's subpage pool and is
+ * reused after the pipe is closed; whole pages are never given back
+ * under dumbvm. Must be at least PIPE_BUF.
+ */
+#define PIPE_BUFSIZE  2048
+
+#if PIPE_BUFSIZE < PIPE_BUF
+#error "PIPE_BUFSIZE must hold a whole PIPE_BUF write"
+#endif
+
+struct pipe {
+	struct vnode pp_readvn;		/* the read end */
+	struct vnode pp_writevn;	/* the write end */
+
+	struct lock *pp_lock;		/* protects everything below */
+	struct cv *pp_readable;		/* signaled when data or EOF arrives */
+	struct cv *pp_writable;		/* signaled when space frees up */
+
+	char *pp_buf;			/* PIPE_BUFSIZE bytes */
+	size_t pp_start;		/* where the next read comes from */
+	size_t pp_count;		/* how much is in the buffer */
+
+	bool pp_readeropen;		/* read end still exists */
+	bool pp_writeropen;		/* write end still exists */
+	bool pp_reading;		/* a reader is in pipe_read */
+	bool pp_writing;		/* a writer is in pipe_write */
+};
+
+static
+void
+pipe_destroy(struct pipe *pp)
+{
+	kfree(pp->pp_buf);
+	cv_destroy(pp->pp_writable);
+	cv_destroy(pp->pp_readable);
+	lock_destroy(pp->pp_lock);
+	kfree(pp);
+}
+
+/*
+ * Called by VOP_DECREF when the last reference to one end goes away.
+ * Tell anyone blocked on the other end, and free the pipe if that
+ * end is already gone as well.
+ */
+static
+int
+pipe_reclaim(struct vnode *v)
+{
+	struct pipe *pp = v->vn_data;
+	bool gone;
+
+	lock_acquire(pp->pp_lock);
+	if (v == &pp->pp_readvn) {
+		pp->pp_readeropen = false;
+		cv_broadcast(pp->pp_writable, pp->pp_lock);
+	}
+	else {
+		pp->pp_writeropen = false;
+		cv_broadcast(pp->pp_readable, pp->pp_lock);
+	}
+	gone = !pp->pp_readeropen && !pp->pp_writeropen;
+	lock_release(pp->pp_lock);
+
+	VOP_CLEANUP(v);
+	if (gone) {
+		pipe_destroy(pp);
+	}
+	return 0;
+}
+
+/*
+ * Wait for something to be in the pipe, then take as much of it as
+ * the caller asked for. Returns with nothing read (EOF) only if the
+ * write end has gone away.
+ */
+static
+int
+pipe_read(struct vnode *v, struct uio *uio)
+{
+	struct pipe *pp = v->vn_data;
+	size_t start, len;
+	int result = 0;
+
+	if (v != &pp->pp_readvn) {
+		return EBADF;
+	}
+	if (uio->uio_resid == 0) {
+		return 0;
+	}
+
+	lock_acquire(pp->pp_lock);
+	while (pp->pp_reading ||
+	       (pp->pp_count == 0 && pp->pp_writeropen)) {
+		cv_wait(pp->pp_readable, pp->pp_lock);
+	}
+	pp->pp_reading = true;
+
+	while (uio->uio_resid > 0 && pp->pp_count > 0) {
+		start = pp->pp_start;
+		len = pp->pp_count;
+		if (len > PIPE_BUFSIZE - start) {
+			len = PIPE_BUFSIZE - start;
+		}
+		if (len > uio->uio_resid) {
+			len = uio->uio_resid;
+		}
+		lock_release(pp->pp_lock);
+		result = uiomove(pp->pp_buf + start, len, uio);
+		lock_acquire(pp->pp_lock);
+		if (result) {
+			break;
+		}
+		pp->pp_start = (start + len) % PIPE_BUFSIZE;
+		pp->pp_count -= len;
+		cv_broadcast(pp->pp_writable, pp->pp_lock);
+	}
+	if (pp->pp_count == 0 && !pp->pp_writing) {
+		/* start over at the front so the next write isn't split */
+		pp->pp_start = 0;
+	}
+
+	pp->pp_reading = false;
+	cv_broadcast(pp->pp_readable, pp->pp_lock);
+	lock_release(pp->pp_lock);
+	return result;
+}
+
+/*
+ * Copy into the pipe, waiting for space as needed, until everything
+ * has been written or the read end goes away. Writers go one at a
+ * time, and a small write also waits until it fits in one go, so it
+ * comes out in one piece.
+ */
+static
+int
+pipe_write(struct vnode *v, struct uio *uio)
+{
+	struct pipe *pp = v->vn_data;
+	size_t len, space, end, orig;
+	bool whole;
+	int result = 0;
+
+	if (v != &pp->pp_writevn) {
+		return EBADF;
+	}
+
+	orig = uio->uio_resid;
+	whole = orig <= PIPE_BUF;
+
+	lock_acquire(pp->pp_lock);
+	while (pp->pp_writing) {
+		cv_wait(pp->pp_writable, pp->pp_lock);
+	}
+	pp->pp_writing = true;
+
+	while (uio->uio_resid > 0) {
+		if (!pp->pp_readeropen) {
+			/* no signals to send; a partial write just stops */
+			result = uio->uio_resid < orig ? 0 : EPIPE;
+			break;
+		}
+
+		space = PIPE_BUFSIZE - pp->pp_count;
+		if (space == 0 || (whole && space < uio->uio_resid)) {
+			cv_wait(pp->pp_writable, pp->pp_lock);
+			continue;
+		}
+
+		end = (pp->pp_start + pp->pp_count) % PIPE_BUFSIZE;
+		len = space;
+		if (len > PIPE_BUFSIZE - end) {
+			len = PIPE_BUFSIZE - end;
+		}
+		if (len > uio->uio_resid) {
+			len = uio->uio_resid;
+		}
+		lock_release(pp->pp_lock);
+		result = uiomove(pp->pp_buf + end, len, uio);
+		lock_acquire(pp->pp_lock);
+		if (result) {
+			break;
+		}
+		pp->pp_count += len;
+		cv_broadcast(pp->pp_readable, pp->pp_lock);
+	}
+
+	pp->pp_writing = false;
+	cv_broadcast(pp->pp_writable, pp->pp_lock);
+	lock_release(pp->pp_lock);
+	return result;
+}
+
+static
+int
+pipe_stat(struct vnode *v, struct stat *statbuf)
+{
+	struct pipe *pp = v->vn_data;
+
+	bzero(statbuf, sizeof(struct stat));
+
+	lock_acquire(pp->pp_lock);
+	statbuf->st_size = pp->pp_count;
+	lock_release(pp->pp_lock);
+
+	statbuf->st_mode = S_IFIFO | 0600;
+	statbuf->st_nlink = 1;
+	statbuf->st_blksize = PIPE_BUFSIZE;
+	return 0;
+}
+
+static
+int
+pipe_gettype(struct vnode *v, mode_t *result)
+{
+	(void)v;
+	*result = S_IFIFO;
+	return 0;
+}
+
+/*
+ * Operations that don't make sense on pipes.
+ */
+
+static
+int
+pipe_opclose(struct vnode *v)
+{
+	/* pipes are never opened through the VFS, so never closed either */
+	(void)v;
+	return 0;
+}
+
+static
+int
+pipe_open(struct vnode *v, int openflags)
+{
+	(void)v;
+	(void)openflags;
+	return EINVAL;
+}
+
+static
+int
+pipe_badio(struct vnode *v, struct uio *uio)
+{
+	(void)v;
+	(void)uio;
+	return EINVAL;
+}
+
+static
+int
+pipe_ioctl(struct vnode *v, int op, userptr_t data)
+{
+	(void)v;
+	(void)op;
+	(void)data;
+	return EIOCTL;
+}
+
+static
+int
+pipe_tryseek(struct vnode *v, off_t pos)
+{
+	(void)v;
+	(void)pos;
+	return ESPIPE;
+}
+
+static
+int
+pipe_fsync(struct vnode *v)
+{
+	(void)v;
+	return EINVAL;
+}
+
+static
+int
+pipe_mmap(struct vnode *v)
+{
+	(void)v;
+	return ENODEV;
+}
+
+static
+int
+pipe_truncate(struct vnode *v, off_t len)
+{
+	(void)v;
+	(void)len;
+	return EINVAL;
+}
+
+static
+int
+pipe_creat(struct vnode *v, const char *name, bool excl, mode_t mode,
+	   struct vnode **result)
+{
+	(void)v;
+	(void)name;
+	(void)excl;
+	(void)mode;
+	(void)result;
+	return ENOTDIR;
+}
+
+static
+int
+pipe_symlink(struct vnode *v, const char *contents, const char *name)
+{
+	(void)v;
+	(void)contents;
+	(void)name;
+	return ENOTDIR;
+}
+
+static
+int
+pipe_mkdir(struct vnode *v, const char *name, mode_t mode)
+{
+	(void)v;
+	(void)name;
+	(void)mode;
+	return ENOTDIR;
+}
+
+static
+int
+pipe_link(struct vnode *v, const char *name, struct vnode *file)
+{
+	(void)v;
+	(void)name;
+	(void)file;
+	return ENOTDIR;
+}
+
+static
+int
+pipe_nameop(struct vnode *v, const char *name)
+{
+	(void)v;
+	(void)name;
+	return ENOTDIR;
+}
+
+static
+int
+pipe_rename(struct vnode *v1, const char *n1, struct vnode *v2,
+	    const char *n2)
+{
+	(void)v1;
+	(void)n1;
+	(void)v2;
+	(void)n2;
+	return ENOTDIR;
+}
+
+static
+int
+pipe_lookup(struct vnode *v, char *pathname, struct vnode **result)
+{
+	(void)v;
+	(void)pathname;
+	(void)result;
+	return ENOTDIR;
+}
+
+static
+int
+pipe_lookparent(struct vnode *v, char *pathname, struct vnode **result,
+		char *buf, size_t len)
+{
+	(void)v;
+	(void)pathname;
+	(void)result;
+	(void)buf;
+	(void)len;
+	return ENOTDIR;
+}
+
+/*
+ * Function table for both ends of a pipe.
+ */
+static const struct vnode_ops pipe_vnode_ops = {
+	VOP_MAGIC,
+
+	pipe_open,
+	pipe_opclose,
+	pipe_reclaim,
+	pipe_read,
+	pipe_badio,   /* readlink */
+	pipe_badio,   /* getdirentry */
+	pipe_write,
+	pipe_ioctl,
+	pipe_stat,
+	pipe_gettype,
+	pipe_tryseek,
+	pipe_fsync,
+	pipe_mmap,
+	pipe_truncate,
+	pipe_badio,   /* namefile */
+	pipe_creat,
+	pipe_symlink,
+	pipe_mkdir,
+	pipe_link,
+	pipe_nameop,  /* remove */
+	pipe_nameop,  /* rmdir */
+	pipe_rename,
+	pipe_lookup,
+	pipe_lookparent,
+};
+
+/*
+ * Make a new pipe and hand back its two ends.
+ */
+int
+pipe_create(struct vnode **readend, struct vnode **writeend)
+{
+	struct pipe *pp;
+	int result;
+
+	pp = kmalloc(sizeof(*pp));
+	if (pp == NULL) {
+		return ENOMEM;
+	}
+	pp->pp_buf = kmalloc(PIPE_BUFSIZE);
+	if (pp->pp_buf == NULL) {
+		kfree(pp);
+		return ENOMEM;
+	}
+	pp->pp_lock = lock_create("pipe");
+	if (pp->pp_lock == NULL) {
+		kfree(pp->pp_buf);
+		kfree(pp);
+		return ENOMEM;
+	}
+	pp->pp_readable = cv_create("pipe-readable");
+	if (pp->pp_readable == NULL) {
+		lock_destroy(pp->pp_lock);
+		kfree(pp->pp_buf);
+		kfree(pp);
+		return ENOMEM;
+	}
+	pp->pp_writable = cv_create("pipe-writable");
+	if (pp->pp_writable == NULL) {
+		cv_destroy(pp->pp_readable);
+		lock_destroy(pp->pp_lock);
+		kfree(pp->pp_buf);
+		kfree(pp);
+		return ENOMEM;
+	}
+	pp->pp_start = 0;
+	pp->pp_count = 0;
+
+	result = VOP_INIT(&pp->pp_readvn, &pipe_vnode_ops, NULL, pp);
+	if (result) {
+		pipe_destroy(pp);
+		return result;
+	}
+	result = VOP_INIT(&pp->pp_writevn, &pipe_vnode_ops, NULL, pp);
+	if (result) {
+		VOP_CLEANUP(&pp->pp_readvn);
+		pipe_destroy(pp);
+		return result;
+	}
+	pp->pp_readeropen = true;
+	pp->pp_writeropen = true;
+	pp->pp_reading = false;
+	pp->pp_writing = false;
+
+	*readend = &pp->pp_readvn;
+	*writeend = &pp->pp_writevn;
+	return 0;
+}
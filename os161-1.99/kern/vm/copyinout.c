@@ -88,7 +88,7 @@
 
 /*
  * Recovery function. If a fatal fault occurs during copyin, copyout,
- * copyinstr, or copyoutstr, execution resumes here. (This behavior is
+ * copyinv, copyoutv, copyinstr, or copyoutstr, execution resumes here. (This behavior is
  * caused by setting t_machdep.tm_badfaultfunc and is implemented in
  * machine-dependent code.)
  *
@@ -142,12 +142,87 @@ copycheck(const_userptr_t userptr, size_t len, size_t *stoplen)
 	return 0;
 }
 
+/*
+ * Block copy used by copyin, copyout, and the vectored versions.
+ *
+ * Unlike memcpy, this does not give up and go byte-at-a-time when
+ * the length is not a multiple of the word size: if the source and
+ * destination have the same alignment, copy bytes until they're
+ * word-aligned, then copy four words per iteration, then finish with
+ * single words and bytes. System call arguments are usually small
+ * odd-sized structures and buffers, so this matters.
+ */
+static
+void
+copyblock(void *dest, const void *src, size_t len)
+{
+	char *d = dest;
+	const char *s = src;
+	uint32_t *dw;
+	const uint32_t *sw;
+
+	if (((uintptr_t)d - (uintptr_t)s) % sizeof(uint32_t) == 0) {
+		while (len > 0 && (uintptr_t)s % sizeof(uint32_t) != 0) {
+			*d++ = *s++;
+			len--;
+		}
+
+		dw = (uint32_t *)d;
+		sw = (const uint32_t *)s;
+		while (len >= 4*sizeof(uint32_t)) {
+			dw[0] = sw[0];
+			dw[1] = sw[1];
+			dw[2] = sw[2];
+			dw[3] = sw[3];
+			dw += 4;
+			sw += 4;
+			len -= 4*sizeof(uint32_t);
+		}
+		while (len >= sizeof(uint32_t)) {
+			*dw++ = *sw++;
+			len -= sizeof(uint32_t);
+		}
+		d = (char *)dw;
+		s = (const char *)sw;
+	}
+
+	while (len > 0) {
+		*d++ = *s++;
+		len--;
+	}
+}
+
+/*
+ * Check every range in a copy vector. Unlike copyinstr/copyoutstr,
+ * the blocks can't legally be truncated, so any range that runs into
+ * the kernel is EFAULT.
+ */
+static
+int
+copycheckv(const struct copyvec *vec, unsigned nvec)
+{
+	unsigned i;
+	size_t stoplen;
+	int result;
+
+	for (i=0; i<nvec; i++) {
+		result = copycheck(vec[i].cv_uaddr, vec[i].cv_len, &stoplen);
+		if (result) {
+			return result;
+		}
+		if (stoplen != vec[i].cv_len) {
+			return EFAULT;
+		}
+	}
+	return 0;
+}
+
 /*
  * copyin
  *
  * Copy a block of memory of length LEN from user-level address USERSRC 
- * to kernel address DEST. We can use memcpy because it's protected by
- * the tm_badfaultfunc/copyfail logic.
+ * to kernel address DEST. We can use copyblock because it's protected
+ * by the tm_badfaultfunc/copyfail logic.
  */
 int
 copyin(const_userptr_t usersrc, void *dest, size_t len)
@@ -172,7 +247,7 @@ copyin(const_userptr_t usersrc, void *dest, size_t len)
 		return EFAULT;
 	}
 
-	memcpy(dest, (const void *)usersrc, len);
+	copyblock(dest, (const void *)usersrc, len);
 
 	curthread->t_machdep.tm_badfaultfunc = NULL;
 	return 0;
@@ -182,7 +257,7 @@ copyin(const_userptr_t usersrc, void *dest, size_t len)
  * copyout
  *
  * Copy a block of memory of length LEN from kernel address SRC to
- * user-level address USERDEST. We can use memcpy because it's
+ * user-level address USERDEST. We can use copyblock because it's
  * protected by the tm_badfaultfunc/copyfail logic.
  */
 int
@@ -208,7 +283,78 @@ copyout(const void *src, userptr_t userdest, size_t len)
 		return EFAULT;
 	}
 
-	memcpy((void *)userdest, src, len);
+	copyblock((void *)userdest, src, len);
+
+	curthread->t_machdep.tm_badfaultfunc = NULL;
+	return 0;
+}
+
+/*
+ * copyinv
+ *
+ * Copy NVEC blocks of memory from user-level addresses to kernel
+ * addresses, as described by VEC. All the ranges are checked before
+ * anything is copied, and the whole batch runs under one
+ * tm_badfaultfunc/setjmp setup instead of one per block.
+ */
+int
+copyinv(const struct copyvec *vec, unsigned nvec)
+{
+	int result;
+	unsigned i;
+
+	result = copycheckv(vec, nvec);
+	if (result) {
+		return result;
+	}
+
+	curthread->t_machdep.tm_badfaultfunc = copyfail;
+
+	result = setjmp(curthread->t_machdep.tm_copyjmp);
+	if (result) {
+		curthread->t_machdep.tm_badfaultfunc = NULL;
+		return EFAULT;
+	}
+
+	for (i=0; i<nvec; i++) {
+		copyblock(vec[i].cv_kaddr, (const void *)vec[i].cv_uaddr,
+			  vec[i].cv_len);
+	}
+
+	curthread->t_machdep.tm_badfaultfunc = NULL;
+	return 0;
+}
+
+/*
+ * copyoutv
+ *
+ * Copy NVEC blocks of memory from kernel addresses to user-level
+ * addresses, as described by VEC. Like copyinv, all ranges are
+ * checked up front and the copies share one recovery setup.
+ */
+int
+copyoutv(const struct copyvec *vec, unsigned nvec)
+{
+	int result;
+	unsigned i;
+
+	result = copycheckv(vec, nvec);
+	if (result) {
+		return result;
+	}
+
+	curthread->t_machdep.tm_badfaultfunc = copyfail;
+
+	result = setjmp(curthread->t_machdep.tm_copyjmp);
+	if (result) {
+		curthread->t_machdep.tm_badfaultfunc = NULL;
+		return EFAULT;
+	}
+
+	for (i=0; i<nvec; i++) {
+		copyblock((void *)vec[i].cv_uaddr, vec[i].cv_kaddr,
+			  vec[i].cv_len);
+	}
 
 	curthread->t_machdep.tm_badfaultfunc = NULL;
 	return 0;
@@ -229,15 +375,45 @@ copyout(const void *src, userptr_t userdest, size_t len)
  * hit STOPLEN it's because the string has run into the end of
  * userspace. Thus in the latter case we return EFAULT, not 
  * ENAMETOOLONG.
+ *
+ * Whenever the source is word-aligned and a whole word fits below
+ * the limit, we load the word and check it for a null byte with the
+ * usual bit trick: (w - 0x01010101) & ~w & 0x80808080 is nonzero iff
+ * some byte of w is zero. Words without a terminator are stored in
+ * one go; otherwise we fall through to the byte loop, which finds the
+ * terminator. Aligned loads never cross a page, so this never touches
+ * memory the byte loop wouldn't.
  */
+#define COPYSTR_HASZERO(w) \
+	(((w) - (uint32_t)0x01010101) & ~(w) & (uint32_t)0x80808080)
+
 static
 int
 copystr(char *dest, const char *src, size_t maxlen, size_t stoplen,
 	size_t *gotlen)
 {
-	size_t i;
-
-	for (i=0; i<maxlen && i<stoplen; i++) {
+	size_t i, limit;
+	uint32_t w;
+
+	limit = maxlen < stoplen ? maxlen : stoplen;
+
+	i = 0;
+	while (i < limit) {
+		if ((uintptr_t)(src+i) % sizeof(uint32_t) == 0 &&
+		    limit - i >= sizeof(uint32_t)) {
+			w = *(const uint32_t *)(src+i);
+			if (!COPYSTR_HASZERO(w)) {
+				if ((uintptr_t)(dest+i) % sizeof(uint32_t)
+				    == 0) {
+					*(uint32_t *)(dest+i) = w;
+				}
+				else {
+					memcpy(dest+i, &w, sizeof(w));
+				}
+				i += sizeof(uint32_t);
+				continue;
+			}
+		}
 		dest[i] = src[i];
 		if (src[i] == 0) {
 			if (gotlen != NULL) {
@@ -245,6 +421,7 @@ copystr(char *dest, const char *src, size_t maxlen, size_t stoplen,
 			}
 			return 0;
 		}
+		i++;
 	}
 	if (stoplen < maxlen) {
 		/* ran into user-kernel boundary */
@@ -69,6 +69,18 @@ _vmstats_inc(unsigned int index)
 }
 
 /* ---------------------------------------------------------------------- */
+void
+vmstats_get(unsigned int *counts)
+{
+  int i;
+
+  spinlock_acquire(&stats_lock);
+  for (i=0; i<VMSTAT_COUNT; i++) {
+    counts[i] = stats_counts[i];
+  }
+  spinlock_release(&stats_lock);
+}
+
 void
 _vmstats_init(void)
 {
@@ -33,6 +33,9 @@
  * Usage:
  *     sh
  *     sh -c command
+ *
+ * Command lines can be pipelines (a | b | c) and can end in & to run
+ * them in the background as a job.
  */
 
 #include <sys/types.h>
@@ -65,46 +68,79 @@
 /* set to nonzero if __time syscall seems to work */
 static int timing = 0;
 
-/* array of backgrounded jobs (allows "foregrounding") */
-#define MAXBG 128
-static pid_t bgpids[MAXBG];
+/*
+ * The job table. Every background command line gets a job, numbered
+ * from 1, that holds the pids of all of its pipeline stages; a job is
+ * finished and reported when the last of them has been waited for.
+ * Foreground command lines use a job too, but one that isn't kept in
+ * the table.
+ */
+#define MAXJOBS 32
+#define MAXSTAGES 16
+#define JOBTEXT_MAX 64
+
+struct job {
+	int nstages;			/* 0 if the slot is free */
+	int nlive;			/* stages not waited for yet */
+	pid_t pids[MAXSTAGES];		/* 0 once waited for */
+	int status;			/* exit status of the last stage */
+	char text[JOBTEXT_MAX];		/* command line, for reporting */
+};
+
+static struct job jobs[MAXJOBS];
 
 /*
- * can_bg
- * just checks for an open slot.
+ * job_alloc
+ * returns an unused slot in the job table, or -1 if they're all taken.
  */
 static
 int
-can_bg(void)
+job_alloc(void)
 {
 	int i;
-	
-	for (i = 0; i < MAXBG; i++) {
-		if (bgpids[i] == 0) {
-			return 1;
+
+	for (i = 0; i < MAXJOBS; i++) {
+		if (jobs[i].nstages == 0) {
+			return i;
 		}
 	}
-	
-	return 0;
+
+	return -1;
 }
 
-/* 
- * remember_bg
- * sticks the pid in an open slot in the background array.  note the assert --
- * better check can_bg before calling this.
+/*
+ * job_find
+ * finds the background job with PID among its stages.
  */
 static
-void
-remember_bg(pid_t pid)
+struct job *
+job_find(pid_t pid)
 {
-	int i;
-	for (i = 0; i < MAXBG; i++) {
-		if (bgpids[i] == 0) {
-			bgpids[i] = pid;
-			return;
+	int i, j;
+
+	for (i = 0; i < MAXJOBS; i++) {
+		for (j = 0; j < jobs[i].nstages; j++) {
+			if (jobs[i].pids[j] == pid) {
+				return &jobs[i];
+			}
 		}
 	}
-	assert(0);
+	return NULL;
+}
+
+/*
+ * job_reaped
+ * notes that stage N of job J was waited for with result STATUS.
+ */
+static
+void
+job_reaped(struct job *j, int n, int status)
+{
+	j->pids[n] = 0;
+	j->nlive--;
+	if (n == j->nstages - 1) {
+		j->status = status;
+	}
 }
 
 /*
@@ -133,72 +169,121 @@ printstatus(int status)
 }
 
 /*
- * dowait
- * just does a waitpid.
+ * job_report
+ * prints how background job J ended and frees its slot.
  */
 static
 void
-dowait(pid_t pid)
+job_report(struct job *j)
 {
-	int status;
-	if (waitpid(pid, &status, 0)<0) {
-		warn("pid %d", pid);
-	}
-	else {
-		printf("pid %d: ", pid);
-		printstatus(status);
-		printf("\n");
-	}
+	printf("[%d] Done: %s: ", (int)(j - jobs) + 1, j->text);
+	printstatus(j->status);
+	printf("\n");
+	j->nstages = 0;
 }
 
-#ifdef WNOHANG
 /*
- * dowaitpoll
- * like dowait, but uses WNOHANG. returns true if we got something.
+ * waitjob
+ * waits for every stage of a job that is still running. returns the
+ * status of the last stage, or -1 if it couldn't be waited for.
  */
 static
 int
-dowaitpoll(pid_t pid)
+waitjob(struct job *j)
+{
+	int i, status;
+
+	for (i = 0; i < j->nstages; i++) {
+		if (j->pids[i] == 0) {
+			continue;
+		}
+		if (waitpid(j->pids[i], &status, 0) < 0) {
+			warn("pid %d", j->pids[i]);
+			status = -1;
+		}
+		job_reaped(j, i, status);
+	}
+	return j->status;
+}
+
+/*
+ * dowait
+ * just does a waitpid, for a pid the job table doesn't know about.
+ */
+static
+void
+dowait(pid_t pid)
 {
 	int status;
-	pid_t result;
-	result = waitpid(pid, &status, WNOHANG);
-	if (result<0) {
+	if (waitpid(pid, &status, 0)<0) {
 		warn("pid %d", pid);
 	}
-	else if (result!=0) {
+	else {
 		printf("pid %d: ", pid);
 		printstatus(status);
 		printf("\n");
-		return 1;
 	}
-	return 0;
 }
 
+#ifdef WNOHANG
 /*
  * waitpoll
- * poll all background jobs for having exited.
+ * poll all background jobs for having exited, and report the ones
+ * whose stages have all finished.
  */
 static
 void
 waitpoll(void)
 {
-	int i;
-	for (i=0; i < MAXBG; i++) {
-		if (bgpids[i] != 0) {
-			if (dowaitpoll(bgpids[i])) {
-				bgpids[i] = 0;
+	int i, n, status;
+	pid_t result;
+	struct job *j;
+
+	for (i=0; i < MAXJOBS; i++) {
+		j = &jobs[i];
+		for (n = 0; n < j->nstages; n++) {
+			if (j->pids[n] == 0) {
+				continue;
+			}
+			result = waitpid(j->pids[n], &status, WNOHANG);
+			if (result<0) {
+				warn("pid %d", j->pids[n]);
+				job_reaped(j, n, -1);
+			}
+			else if (result!=0) {
+				job_reaped(j, n, status);
 			}
 		}
+		if (j->nstages > 0 && j->nlive == 0) {
+			job_report(j);
+		}
 	}
 }
 #endif /* WNOHANG */
 
+/*
+ * jobarg
+ * turns a "%n" argument into a job, complaining if there's no such job.
+ */
+static
+struct job *
+jobarg(const char *arg)
+{
+	int n;
+
+	n = atoi(arg + 1);
+	if (n < 1 || n > MAXJOBS || jobs[n-1].nstages == 0) {
+		printf("%s: No such job\n", arg);
+		return NULL;
+	}
+	return &jobs[n-1];
+}
+
 /*
  * wait
- * allows the user to "foreground" a process by waiting on it.  without ps to
- * know the pids, this is a little tough to use with an arg, but without an
- * arg it will wait for all the background jobs.
+ * allows the user to "foreground" a job by waiting on it, either by job
+ * number (%n, as printed when it was started) or by the pid of any of
+ * its stages. without an arg it will wait for all the background jobs.
  */
 static
 int
@@ -206,30 +291,69 @@ cmd_wait(int ac, char *av[])
 {
 	int i;
 	pid_t pid;
+	struct job *j;
 
 	if (ac == 2) {
-		pid = atoi(av[1]);
-		dowait(pid);
-		for (i = 0; i < MAXBG; i++) {
-			if (bgpids[i]==pid) {
-				bgpids[i] = 0;
+		if (av[1][0] == '%') {
+			j = jobarg(av[1]);
+			if (j == NULL) {
+				return 1;
+			}
+		}
+		else {
+			pid = atoi(av[1]);
+			j = job_find(pid);
+			if (j == NULL) {
+				dowait(pid);
+				return 0;
 			}
 		}
+		waitjob(j);
+		job_report(j);
 		return 0;
 	}
 	else if (ac == 1) {
-		for (i=0; i < MAXBG; i++) {
-			if (bgpids[i] != 0) {
-				dowait(bgpids[i]);
-				bgpids[i] = 0;
+		for (i=0; i < MAXJOBS; i++) {
+			if (jobs[i].nstages != 0) {
+				waitjob(&jobs[i]);
+				job_report(&jobs[i]);
 			}
 		}
 		return 0;
 	}
-	printf("Usage: wait [pid]\n");
+	printf("Usage: wait [%%job | pid]\n");
 	return 1;
 }
 
+/*
+ * jobs
+ * lists the background jobs that haven't been reported as done yet.
+ */
+static
+int
+cmd_jobs(int ac, char *av[])
+{
+	int i, n;
+
+	if (ac != 1) {
+		printf("Usage: jobs\n");
+		return 1;
+	}
+	for (i=0; i < MAXJOBS; i++) {
+		if (jobs[i].nstages == 0) {
+			continue;
+		}
+		printf("[%d]", i + 1);
+		for (n = 0; n < jobs[i].nstages; n++) {
+			if (jobs[i].pids[n] != 0) {
+				printf(" %d", jobs[i].pids[n]);
+			}
+		}
+		printf(" %s\n", jobs[i].text);
+	}
+	return 0;
+}
+
 /*
  * chdir
  * just an interface to the system call.  no concept of home directory, so
@@ -288,106 +412,270 @@ static struct {
 	{ "cd",    cmd_chdir },
 	{ "chdir", cmd_chdir },
 	{ "exit",  cmd_exit },
+	{ "jobs",  cmd_jobs },
 	{ "wait",  cmd_wait },
 	{ NULL, NULL }
 };
 
+/*
+ * tokenize
+ * splits the command line into words in place, like strtok on
+ * whitespace, except that | and & are words of their own even
+ * when there are no spaces around them. returns the number of words,
+ * or -1 if there are more than MAX.
+ */
+static
+int
+tokenize(char *buf, char **args, int max)
+{
+	static char pipeword[] = "|", bgword[] = "&";
+	char *s = buf;
+	char *special;
+	int nargs = 0;
+
+	while (1) {
+		while (*s == ' ' || *s == '\t' || *s == '\r' || *s == '\n') {
+			s++;
+		}
+		if (*s == 0) {
+			break;
+		}
+		if (nargs >= max) {
+			return -1;
+		}
+		if (*s == '|' || *s == '&') {
+			args[nargs++] = *s == '|' ? pipeword : bgword;
+			s++;
+			continue;
+		}
+		args[nargs++] = s;
+		while (*s != 0 && !strchr(" \t\r\n|&", *s)) {
+			s++;
+		}
+		if (*s == '|' || *s == '&') {
+			/* the NUL goes where the | was, so add it here */
+			special = *s == '|' ? pipeword : bgword;
+			*s++ = 0;
+			if (nargs >= max) {
+				return -1;
+			}
+			args[nargs++] = special;
+		}
+		else if (*s != 0) {
+			*s++ = 0;
+		}
+	}
+	args[nargs] = NULL;
+	return nargs;
+}
+
+/*
+ * runpipeline
+ * starts the stages of a pipeline, each reading the output of the one
+ * before it through a pipe, and records their pids in job J. all the
+ * pipes are made before anything is forked, so a failure leaves
+ * nothing half-started. returns 0, or -1 if nothing was run.
+ */
+static
+int
+runpipeline(char **stages[], int nstages, struct job *j)
+{
+	int fds[2 * (MAXSTAGES - 1)];
+	int i, k;
+	pid_t pid;
+
+	for (i = 0; i < nstages - 1; i++) {
+		if (pipe(&fds[2*i])) {
+			warn("pipe");
+			for (k = 0; k < 2*i; k++) {
+				close(fds[k]);
+			}
+			return -1;
+		}
+	}
+
+	j->nstages = 0;
+	j->nlive = 0;
+	j->status = -1;
+
+	for (i = 0; i < nstages; i++) {
+		pid = fork();
+		if (pid < 0) {
+			/* the stages already running will see EOF or EPIPE */
+			warn("fork");
+			break;
+		}
+		if (pid == 0) {
+			/* child */
+			if (i > 0 && dup2(fds[2*(i-1)], STDIN_FILENO) < 0) {
+				warn("dup2");
+				_exit(1);
+			}
+			if (i < nstages - 1 &&
+			    dup2(fds[2*i + 1], STDOUT_FILENO) < 0) {
+				warn("dup2");
+				_exit(1);
+			}
+			for (k = 0; k < 2*(nstages-1); k++) {
+				close(fds[k]);
+			}
+			execv(stages[i][0], stages[i]);
+			warn("%s", stages[i][0]);
+			/*
+			 * Use _exit() instead of exit() in the child
+			 * process to avoid calling atexit() functions,
+			 * which would cause hostcompat (if present) to
+			 * reset the tty state and mess up our input
+			 * handling.
+			 */
+			_exit(1);
+		}
+		j->pids[i] = pid;
+		j->nstages++;
+		j->nlive++;
+	}
+
+	/* parent; the children have their own copies of the pipes */
+	for (k = 0; k < 2*(nstages-1); k++) {
+		close(fds[k]);
+	}
+
+	if (j->nstages < nstages) {
+		/* not the stage whose status we wanted */
+		j->status = _MKWAIT_EXIT(255);
+		if (j->nstages == 0) {
+			return -1;
+		}
+	}
+	return 0;
+}
+
 /*
  * docommand
- * tokenizes the command line using strtok.  if there aren't any commands,
- * simply returns.  checks to see if it's a builtin, running it if it is.
- * otherwise, it's a standard command.  check for the '&', try to background
- * the job if possible, otherwise just run it and wait on it.
+ * tokenizes the command line and splits it into pipeline stages at
+ * each |. if there aren't any commands, simply returns. a builtin is
+ * run directly; it can't be part of a pipeline or backgrounded.
+ * otherwise, check for the '&', start the stages, and then either
+ * remember the job or wait for all of it. the status is that of the
+ * last stage.
  */
 static
 int
 docommand(char *buf)
 {
 	char *args[NARG_MAX + 1];
-	int nargs, i;
-	char *s;
-	pid_t pid;
+	char **stages[MAXSTAGES];
+	int nargs, nstages, i, slot;
 	int status;
 	int bg=0;
+	struct job fgjob, *j;
+	char text[JOBTEXT_MAX];
 	time_t startsecs, endsecs;
 	unsigned long startnsecs, endnsecs;
 
-	nargs = 0;
-	for (s = strtok(buf, " \t\r\n"); s; s = strtok(NULL, " \t\r\n")) {
-		if (nargs >= NARG_MAX) {
-			printf("%s: Too many arguments "
-			       "(exceeds system limit)\n",
-			       args[0]);
-			return 1;
-		}
-		args[nargs++] = s;
+	/* save the text for reporting; tokenizing chops it up */
+	for (i = 0; i < JOBTEXT_MAX - 1 && buf[i] != 0 && buf[i] != '\n';
+	     i++) {
+		text[i] = buf[i];
+	}
+	text[i] = 0;
+
+	nargs = tokenize(buf, args, NARG_MAX);
+	if (nargs < 0) {
+		printf("%s: Too many arguments "
+		       "(exceeds system limit)\n",
+		       args[0]);
+		return 1;
 	}
-	args[nargs] = NULL;
 
 	if (nargs==0) {
 		/* empty line */
 		return 0;
 	}
 
+	if (!strcmp(args[nargs-1], "&")) {
+		/* background */
+		nargs--;
+		args[nargs] = NULL;
+		bg = 1;
+	}
+
+	nstages = 0;
+	stages[nstages++] = args;
+	for (i = 0; i < nargs; i++) {
+		if (!strcmp(args[i], "&")) {
+			printf("sh: & is only allowed at the end\n");
+			return 1;
+		}
+		if (!strcmp(args[i], "|")) {
+			if (stages[nstages-1] == &args[i] ||
+			    i == nargs-1) {
+				printf("sh: Empty command in pipeline\n");
+				return 1;
+			}
+			if (nstages >= MAXSTAGES) {
+				printf("sh: Too many stages in pipeline "
+				       "(at most %d)\n", MAXSTAGES);
+				return 1;
+			}
+			args[i] = NULL;
+			stages[nstages++] = &args[i+1];
+		}
+	}
+	if (nargs == 0) {
+		printf("sh: Empty command\n");
+		return 1;
+	}
+
 	for (i=0; builtins[i].name; i++) {
 		if (!strcmp(builtins[i].name, args[0])) {
+			if (nstages > 1 || bg) {
+				printf("%s: Builtins can't be piped or run "
+				       "in the background\n", args[0]);
+				return 1;
+			}
 			return builtins[i].func(nargs, args);
 		}
 	}
 
 	/* Not a builtin; run it */
 
-	if (nargs > 0 && !strcmp(args[nargs-1], "&")) {
-		/* background */
-		if (!can_bg()) {
+	if (bg) {
+		slot = job_alloc();
+		if (slot < 0) {
 			printf("%s: Too many background jobs; wait for "
 			       "some to finish before starting more\n",
 			       args[0]);
 			return -1;
 		}
-		nargs--;
-		args[nargs] = NULL;
-		bg = 1;
+		j = &jobs[slot];
+	}
+	else {
+		j = &fgjob;
 	}
 
 	if (timing) {
 		__time(&startsecs, &startnsecs);
 	}
 
-	pid = fork();
-	switch (pid) {
-		case -1:
-			/* error */
-			warn("fork");
-			return _MKWAIT_EXIT(255);
-		case 0:
-			/* child */
-			execv(args[0], args);
-			warn("%s", args[0]);
-			/*
-			 * Use _exit() instead of exit() in the child
-			 * process to avoid calling atexit() functions,
-			 * which would cause hostcompat (if present) to
-			 * reset the tty state and mess up our input
-			 * handling.
-			 */
-			_exit(1);
-		default:
-			break;
+	if (runpipeline(stages, nstages, j)) {
+		j->nstages = 0;
+		return _MKWAIT_EXIT(255);
 	}
 
 	/* parent */
 	if (bg) {
-		/* background this command */
-		remember_bg(pid);
-		printf("[%d] %s ... &\n", pid, args[0]);
+		/* background this command line */
+		strcpy(j->text, text);
+		printf("[%d]", slot + 1);
+		for (i = 0; i < j->nstages; i++) {
+			printf(" %d", j->pids[i]);
+		}
+		printf(" %s\n", j->text);
 		return 0;
 	}
 
-	if (waitpid(pid, &status, 0) < 0) {
-		warn("waitpid");
-		status = -1;
-	}
+	status = waitjob(j);
 
 	if (timing) {
 		__time(&endsecs, &endnsecs);
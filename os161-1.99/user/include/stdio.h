@@ -41,6 +41,57 @@
 /* Constant returned by a bunch of stdio functions on error */
 #define EOF (-1)
 
+/*
+ * Streams. The contents of FILE are private to libc.
+ *
+ * Each stream has a buffer of BUFSIZ bytes (or one supplied with
+ * setvbuf) and one of three buffering modes: _IOFBF (write the
+ * buffer only when full), _IOLBF (also write at each newline), or
+ * _IONBF (no buffering). stdout is line buffered, stdin and stderr
+ * are unbuffered, and streams from fopen are fully buffered.
+ *
+ * As in C, a stream open for both reading and writing needs an
+ * fflush or fseek between a write and a following read.
+ */
+typedef struct __file FILE;
+
+#define BUFSIZ    1024
+#define FOPEN_MAX 20
+
+#define _IOFBF 0
+#define _IOLBF 1
+#define _IONBF 2
+
+extern FILE *stdin;
+extern FILE *stdout;
+extern FILE *stderr;
+
+FILE *fopen(const char *path, const char *mode);
+FILE *fdopen(int fd, const char *mode);
+int fclose(FILE *f);
+int fflush(FILE *f);      /* fflush(NULL) flushes every output stream */
+int setvbuf(FILE *f, char *buf, int mode, size_t size);
+void setbuf(FILE *f, char *buf);
+
+size_t fread(void *buf, size_t size, size_t nitems, FILE *f);
+size_t fwrite(const void *buf, size_t size, size_t nitems, FILE *f);
+int fgetc(FILE *f);
+int getc(FILE *f);
+int ungetc(int ch, FILE *f);
+char *fgets(char *buf, int size, FILE *f);
+int fputc(int ch, FILE *f);
+int putc(int ch, FILE *f);
+int fputs(const char *str, FILE *f);
+
+int fseek(FILE *f, long offset, int whence);
+long ftell(FILE *f);
+void rewind(FILE *f);
+
+int feof(FILE *f);
+int ferror(FILE *f);
+void clearerr(FILE *f);
+int fileno(FILE *f);
+
 /*
  * The actual guts of printf
  * (for libc internal use only)
@@ -53,6 +104,8 @@ int __vprintf(void (*sendfunc)(void *clientdata, const char *, size_t len),
 /* Printf calls for user programs */
 int printf(const char *fmt, ...);
 int vprintf(const char *fmt, __va_list ap);
+int fprintf(FILE *f, const char *fmt, ...);
+int vfprintf(FILE *f, const char *fmt, __va_list ap);
 int snprintf(char *buf, size_t len, const char *fmt, ...);
 int vsnprintf(char *buf, size_t len, const char *fmt, __va_list ap);
 
@@ -63,10 +116,10 @@ int puts(const char *);
 /* Nonstandard C, hence the __. */
 int __puts(const char *);
 
-/* Writes one character. Returns it. */
+/* Writes one character to stdout. Returns it. */
 int putchar(int);
 
-/* Reads one character (0-255) or returns EOF on error. */
+/* Reads one character (0-255) from stdin or returns EOF on error. */
 int getchar(void);
 
 #endif /* _STDIO_H_ */
@@ -117,7 +117,7 @@
 /* Required. */
 __DEAD void _exit(int code);
 int execv(const char *prog, char *const *args);
-pid_t fork(void);
+pid_t __fork(void);
 int waitpid(pid_t pid, int *returncode, int flags);
 /* 
  * Open actually takes either two or three args: the optional third
@@ -153,6 +153,12 @@ int readlink(const char *path, char *buf, size_t buflen);
 int dup2(int filehandle, int newhandle);
 int pipe(int filehandles[2]);
 time_t __time(time_t *seconds, unsigned long *nanoseconds);
+int __vmstats(unsigned *counts, unsigned ncounts); /* see kern/vmstats.h */
+int __threadfork(void (*entry)(void *), void *arg, void *stack,
+		 volatile int *exitaddr);	/* see uthread.h */
+int __futex_wait(volatile int *addr, int val);
+int __futex_wake(volatile int *addr, unsigned n);
+__DEAD void __threadexit(void);		/* see uthread.h */
 int __getcwd(char *buf, size_t buflen);
 /* stat - see sys/stat.h */
 /* lstat - see sys/stat.h */
@@ -163,5 +169,6 @@ int __getcwd(char *buf, size_t buflen);
 
 char *getcwd(char *buf, size_t buflen);		/* calls __getcwd */
 time_t time(time_t *seconds);			/* calls __time */
+pid_t fork(void);				/* calls __fork */
 
 #endif /* _UNISTD_H_ */
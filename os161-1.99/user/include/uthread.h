@@ -0,0 +1,94 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef _UTHREAD_H_
+#define _UTHREAD_H_
+
+/*
+ * User-level threads, mutexes, and condition variables.
+ *
+ * Threads are made with the __threadfork system call and share the
+ * process's address space and open files. Their stacks come from a
+ * fixed pool in libc, so at most UTHREAD_MAX of them (not counting
+ * the original thread) can exist at once; a slot is reused once its
+ * thread has exited and been joined. A thread that returns from its
+ * function exits (with __threadexit, which ends only that thread).
+ * Exiting (or returning from main) ends the whole process, other
+ * threads included.
+ *
+ * Mutexes and condition variables live entirely in user memory and
+ * cost no system calls unless some thread actually has to wait; only
+ * then are __futex_wait and __futex_wake used to sleep and wake up.
+ * They need no setup beyond being zeroed, so UMUTEX_INITIALIZER and
+ * UCOND_INITIALIZER or static storage will do.
+ *
+ * Note that errno and stdio are shared by all the threads and are not
+ * protected against being used by several at once.
+ *
+ * Functions:
+ *    uthread_create - start FUNC(ARG) in a new thread. Returns a
+ *                     handle for uthread_join, or -1 with errno set.
+ *    uthread_join   - wait for a thread to exit, and give its slot
+ *                     back. Each thread must be joined exactly once.
+ *    umutex_lock, umutex_unlock - the usual.
+ *    ucond_wait     - release MUTEX, wait to be signaled, and get
+ *                     MUTEX back. Wakeups may be spurious, so check
+ *                     the condition again afterwards.
+ *    ucond_signal   - wake one waiter, if there is one.
+ *    ucond_broadcast - wake every waiter.
+ */
+
+#define UTHREAD_MAX        8
+#define UTHREAD_STACKSIZE  8192
+
+typedef int uthread_t;
+
+struct umutex {
+	volatile int um_state;		/* 0 free, 1 held, 2 held and waited on */
+};
+
+struct ucond {
+	volatile int uc_seq;		/* bumped by every signal/broadcast */
+	volatile int uc_waiters;	/* how many are in ucond_wait */
+};
+
+#define UMUTEX_INITIALIZER { 0 }
+#define UCOND_INITIALIZER  { 0, 0 }
+
+uthread_t uthread_create(void (*func)(void *), void *arg);
+int uthread_join(uthread_t t);
+
+void umutex_lock(struct umutex *m);
+void umutex_unlock(struct umutex *m);
+
+void ucond_wait(struct ucond *c, struct umutex *m);
+void ucond_signal(struct ucond *c);
+void ucond_broadcast(struct ucond *c);
+
+#endif /* _UTHREAD_H_ */
@@ -0,0 +1,78 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#include <stdio.h>
+#include "stdiolocal.h"
+
+/*
+ * C standard I/O functions - read one character, or push one back.
+ */
+
+int
+fgetc(FILE *f)
+{
+	if ((f->f_flags & F_READING) == 0 || f->f_pos >= f->f_len) {
+		if (__stdio_fill(f)) {
+			return EOF;
+		}
+	}
+	/* Cast through unsigned char so EOF stays distinguishable. */
+	return (int)(unsigned char)f->f_buf[f->f_pos++];
+}
+
+int
+getc(FILE *f)
+{
+	return fgetc(f);
+}
+
+/*
+ * Only one character of pushback is guaranteed. If the buffer has
+ * no room in front of the read position, the pushed-back character
+ * becomes the whole buffer.
+ */
+int
+ungetc(int ch, FILE *f)
+{
+	if (ch == EOF) {
+		return EOF;
+	}
+	if ((f->f_flags & F_READING) == 0 || f->f_pos == 0) {
+		if ((f->f_flags & F_READING) && f->f_pos < f->f_len) {
+			return EOF;
+		}
+		if (__stdio_toread(f)) {
+			return EOF;
+		}
+		f->f_pos = f->f_len = f->f_bufsize;
+	}
+	f->f_buf[--f->f_pos] = ch;
+	f->f_flags &= ~F_EOF;
+	return (unsigned char)ch;
+}
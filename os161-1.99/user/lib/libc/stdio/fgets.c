@@ -0,0 +1,80 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#include <stdio.h>
+#include "stdiolocal.h"
+
+/*
+ * C standard I/O function - read a line, up to SIZE-1 characters,
+ * keeping the newline. Returns NULL if nothing could be read.
+ *
+ * Scans the stream buffer directly rather than going through fgetc.
+ */
+
+char *
+fgets(char *buf, int size, FILE *f)
+{
+	size_t n, lim, i;
+	int gotnl = 0;
+	char c;
+
+	if (size <= 0) {
+		return NULL;
+	}
+
+	n = 0;
+	while (!gotnl && n < (size_t)size - 1) {
+		if ((f->f_flags & F_READING) == 0 || f->f_pos >= f->f_len) {
+			if (__stdio_fill(f)) {
+				break;
+			}
+		}
+		lim = f->f_len - f->f_pos;
+		if (lim > (size_t)size - 1 - n) {
+			lim = (size_t)size - 1 - n;
+		}
+		for (i=0; i<lim; i++) {
+			c = f->f_buf[f->f_pos + i];
+			buf[n + i] = c;
+			if (c == '\n') {
+				i++;
+				gotnl = 1;
+				break;
+			}
+		}
+		f->f_pos += i;
+		n += i;
+	}
+
+	if (n == 0) {
+		return NULL;
+	}
+	buf[n] = 0;
+	return buf;
+}
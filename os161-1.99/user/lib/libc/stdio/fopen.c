@@ -0,0 +1,153 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include "stdiolocal.h"
+
+/*
+ * C standard I/O functions - open and close streams.
+ */
+
+/*
+ * Translate an fopen mode string to open() flags and stream flags.
+ */
+static
+int
+parsemode(const char *mode, int *oflags, unsigned *fflags)
+{
+	switch (mode[0]) {
+	    case 'r':
+		*oflags = O_RDONLY;
+		*fflags = F_READ;
+		break;
+	    case 'w':
+		*oflags = O_WRONLY|O_CREAT|O_TRUNC;
+		*fflags = F_WRITE;
+		break;
+	    case 'a':
+		*oflags = O_WRONLY|O_CREAT|O_APPEND;
+		*fflags = F_WRITE;
+		break;
+	    default:
+		errno = EINVAL;
+		return -1;
+	}
+	for (mode++; *mode; mode++) {
+		if (*mode == '+') {
+			*oflags = (*oflags & ~O_ACCMODE) | O_RDWR;
+			*fflags = F_READ|F_WRITE;
+		}
+		/* 'b' and anything else is ignored */
+	}
+	return 0;
+}
+
+/*
+ * Grab a free stream slot and set it up on FD.
+ */
+static
+FILE *
+setupstream(int fd, unsigned fflags)
+{
+	int i;
+	FILE *f;
+
+	for (i=0; i<FOPEN_MAX; i++) {
+		f = &__stdio_files[i];
+		if ((f->f_flags & F_INUSE) == 0) {
+			f->f_fd = fd;
+			f->f_flags = F_INUSE | fflags;
+			f->f_bufmode = _IOFBF;
+			f->f_buf = NULL;
+			f->f_bufsize = BUFSIZ;
+			f->f_pos = f->f_len = 0;
+			return f;
+		}
+	}
+	errno = EMFILE;
+	return NULL;
+}
+
+FILE *
+fopen(const char *path, const char *mode)
+{
+	int oflags, fd;
+	unsigned fflags;
+	FILE *f;
+
+	if (parsemode(mode, &oflags, &fflags)) {
+		return NULL;
+	}
+	fd = open(path, oflags, 0664);
+	if (fd < 0) {
+		return NULL;
+	}
+	f = setupstream(fd, fflags);
+	if (f == NULL) {
+		close(fd);
+	}
+	return f;
+}
+
+FILE *
+fdopen(int fd, const char *mode)
+{
+	int oflags;
+	unsigned fflags;
+
+	if (parsemode(mode, &oflags, &fflags)) {
+		return NULL;
+	}
+	return setupstream(fd, fflags);
+}
+
+int
+fclose(FILE *f)
+{
+	int result = 0;
+
+	if (f->f_flags & F_WRITING) {
+		if (__stdio_wflush(f)) {
+			result = EOF;
+		}
+	}
+	if (close(f->f_fd)) {
+		result = EOF;
+	}
+	if (f->f_flags & F_MYBUF) {
+		free(f->f_buf);
+	}
+	f->f_buf = NULL;
+	f->f_flags = 0;
+	return result;
+}
@@ -0,0 +1,81 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include "stdiolocal.h"
+
+/*
+ * C standard I/O function - read NITEMS objects of SIZE bytes.
+ *
+ * Requests at least as big as the buffer go straight into the
+ * caller's memory once the buffer has been emptied.
+ */
+
+size_t
+fread(void *buf, size_t size, size_t nitems, FILE *f)
+{
+	char *p = buf;
+	size_t total, done, n;
+	int r;
+
+	total = size * nitems;
+	if (total == 0) {
+		return 0;
+	}
+
+	done = 0;
+	while (done < total) {
+		if ((f->f_flags & F_READING) && f->f_pos < f->f_len) {
+			n = f->f_len - f->f_pos;
+			if (n > total - done) {
+				n = total - done;
+			}
+			memcpy(p + done, f->f_buf + f->f_pos, n);
+			f->f_pos += n;
+			done += n;
+			continue;
+		}
+		if (__stdio_toread(f)) {
+			break;
+		}
+		if (total - done >= f->f_bufsize) {
+			r = __stdio_read(f, p + done, total - done);
+			if (r == 0) {
+				break;
+			}
+			done += r;
+			continue;
+		}
+		if (__stdio_fill(f)) {
+			break;
+		}
+	}
+	return done / size;
+}
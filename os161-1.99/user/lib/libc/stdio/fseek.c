@@ -0,0 +1,83 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#include <stdio.h>
+#include <unistd.h>
+#include "stdiolocal.h"
+
+/*
+ * C standard I/O functions - reposition a stream.
+ */
+
+int
+fseek(FILE *f, long offset, int whence)
+{
+	off_t pos = offset;
+
+	if (f->f_flags & F_WRITING) {
+		if (__stdio_wflush(f)) {
+			return -1;
+		}
+	}
+	if ((f->f_flags & F_READING) && whence == SEEK_CUR) {
+		/* the file offset is ahead of us by the read-ahead */
+		pos -= f->f_len - f->f_pos;
+	}
+	if (lseek(f->f_fd, pos, whence) < 0) {
+		return -1;
+	}
+	f->f_flags &= ~(F_READING|F_WRITING|F_EOF);
+	f->f_pos = f->f_len = 0;
+	return 0;
+}
+
+long
+ftell(FILE *f)
+{
+	off_t pos;
+
+	pos = lseek(f->f_fd, 0, SEEK_CUR);
+	if (pos < 0) {
+		return -1;
+	}
+	if (f->f_flags & F_READING) {
+		pos -= f->f_len - f->f_pos;
+	}
+	else if (f->f_flags & F_WRITING) {
+		pos += f->f_len;
+	}
+	return pos;
+}
+
+void
+rewind(FILE *f)
+{
+	fseek(f, 0, SEEK_SET);
+	f->f_flags &= ~F_ERR;
+}
@@ -0,0 +1,91 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include "stdiolocal.h"
+
+/*
+ * C standard I/O function - write NITEMS objects of SIZE bytes.
+ *
+ * Data is copied into the stream buffer, which is written when it
+ * fills; a write at least as big as the buffer goes straight to the
+ * file once the buffer is empty. Line-buffered streams are flushed
+ * if what's left in the buffer contains a newline.
+ */
+
+size_t
+fwrite(const void *buf, size_t size, size_t nitems, FILE *f)
+{
+	const char *p = buf;
+	size_t total, done, n;
+	int r;
+
+	total = size * nitems;
+	if (total == 0) {
+		return 0;
+	}
+	if ((f->f_flags & F_WRITING) == 0 && __stdio_towrite(f)) {
+		return 0;
+	}
+
+	done = 0;
+	while (done < total) {
+		if (f->f_len == 0 && total - done >= f->f_bufsize) {
+			r = write(f->f_fd, p + done, total - done);
+			if (r <= 0) {
+				f->f_flags |= F_ERR;
+				break;
+			}
+			done += r;
+			continue;
+		}
+		n = f->f_bufsize - f->f_len;
+		if (n > total - done) {
+			n = total - done;
+		}
+		memcpy(f->f_buf + f->f_len, p + done, n);
+		f->f_len += n;
+		done += n;
+		if (f->f_len == f->f_bufsize && __stdio_wflush(f)) {
+			break;
+		}
+	}
+
+	if (f->f_bufmode == _IOLBF && f->f_len > 0) {
+		for (n = f->f_len; n > 0; n--) {
+			if (f->f_buf[n-1] == '\n') {
+				__stdio_wflush(f);
+				break;
+			}
+		}
+	}
+	return done / size;
+}
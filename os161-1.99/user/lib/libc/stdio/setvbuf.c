@@ -0,0 +1,81 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "stdiolocal.h"
+
+/*
+ * C standard I/O functions - choose a stream's buffer and buffering
+ * mode. Pending output is flushed first; changing the buffer out
+ * from under unread input is refused.
+ */
+
+int
+setvbuf(FILE *f, char *buf, int mode, size_t size)
+{
+	if (mode != _IOFBF && mode != _IOLBF && mode != _IONBF) {
+		return EOF;
+	}
+	if (fflush(f)) {
+		return EOF;
+	}
+	if ((f->f_flags & F_READING) && f->f_pos < f->f_len) {
+		return EOF;
+	}
+
+	if (f->f_flags & F_MYBUF) {
+		free(f->f_buf);
+		f->f_flags &= ~F_MYBUF;
+	}
+	f->f_flags &= ~(F_READING|F_WRITING);
+	f->f_pos = f->f_len = 0;
+	f->f_bufmode = mode;
+
+	if (mode == _IONBF) {
+		f->f_buf = &f->f_onechar;
+		f->f_bufsize = 1;
+	}
+	else if (buf != NULL && size > 0) {
+		f->f_buf = buf;
+		f->f_bufsize = size;
+	}
+	else {
+		/* allocated on first use */
+		f->f_buf = NULL;
+		f->f_bufsize = size > 0 ? size : BUFSIZ;
+	}
+	return 0;
+}
+
+void
+setbuf(FILE *f, char *buf)
+{
+	setvbuf(f, buf, buf != NULL ? _IOFBF : _IONBF, BUFSIZ);
+}
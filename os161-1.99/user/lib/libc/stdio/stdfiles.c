@@ -0,0 +1,217 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <errno.h>
+#include "stdiolocal.h"
+
+/*
+ * Stream table and the buffer management shared by the rest of stdio.
+ */
+
+static char stdout_buf[BUFSIZ];
+
+/*
+ * stdin is unbuffered so that programs reading the console a key at a
+ * time with getchar (sh, to do its own echo and line editing) get each
+ * key as it's typed, rather than nothing until a newline.
+ */
+FILE __stdio_files[FOPEN_MAX] = {
+	{ STDIN_FILENO, F_INUSE|F_READ, _IONBF,
+	  &__stdio_files[0].f_onechar, 1, 0, 0, 0 },
+	{ STDOUT_FILENO, F_INUSE|F_WRITE, _IOLBF,
+	  stdout_buf, sizeof(stdout_buf), 0, 0, 0 },
+	{ STDERR_FILENO, F_INUSE|F_WRITE, _IONBF,
+	  &__stdio_files[2].f_onechar, 1, 0, 0, 0 },
+};
+
+FILE *stdin = &__stdio_files[0];
+FILE *stdout = &__stdio_files[1];
+FILE *stderr = &__stdio_files[2];
+
+/*
+ * Make sure F has a buffer. If we can't get memory, quietly fall
+ * back to being unbuffered.
+ */
+int
+__stdio_getbuf(FILE *f)
+{
+	if (f->f_buf != NULL) {
+		return 0;
+	}
+	if (f->f_bufmode != _IONBF) {
+		f->f_buf = malloc(f->f_bufsize);
+		if (f->f_buf != NULL) {
+			f->f_flags |= F_MYBUF;
+			return 0;
+		}
+	}
+	f->f_buf = &f->f_onechar;
+	f->f_bufsize = 1;
+	return 0;
+}
+
+/*
+ * Write out any pending output. The stream stays in write mode.
+ */
+int
+__stdio_wflush(FILE *f)
+{
+	size_t done = 0;
+	int r;
+
+	while (done < f->f_len) {
+		r = write(f->f_fd, f->f_buf + done, f->f_len - done);
+		if (r <= 0) {
+			/* Drop the data; retrying forever won't help. */
+			f->f_flags |= F_ERR;
+			f->f_len = 0;
+			return EOF;
+		}
+		done += r;
+	}
+	f->f_len = 0;
+	return 0;
+}
+
+/*
+ * Throw away read-ahead, moving the file offset back to where the
+ * caller thinks it is. If the file can't seek (the console, a pipe)
+ * keep the data instead, since discarding it would lose input.
+ */
+void
+__stdio_dropread(FILE *f)
+{
+	off_t unread;
+
+	if ((f->f_flags & F_READING) == 0) {
+		return;
+	}
+	unread = f->f_len - f->f_pos;
+	if (unread > 0 && lseek(f->f_fd, -unread, SEEK_CUR) < 0) {
+		return;
+	}
+	f->f_flags &= ~F_READING;
+	f->f_pos = f->f_len = 0;
+}
+
+/*
+ * Put F into write mode.
+ */
+int
+__stdio_towrite(FILE *f)
+{
+	if ((f->f_flags & F_WRITE) == 0) {
+		f->f_flags |= F_ERR;
+		errno = EBADF;
+		return EOF;
+	}
+	if (f->f_flags & F_READING) {
+		__stdio_dropread(f);
+		if (f->f_flags & F_READING) {
+			/* Can't seek back over the read-ahead; lose it. */
+			f->f_flags &= ~F_READING;
+			f->f_pos = f->f_len = 0;
+		}
+	}
+	__stdio_getbuf(f);
+	f->f_flags |= F_WRITING;
+	return 0;
+}
+
+/*
+ * Put F into read mode.
+ */
+int
+__stdio_toread(FILE *f)
+{
+	if ((f->f_flags & F_READ) == 0) {
+		f->f_flags |= F_ERR;
+		errno = EBADF;
+		return EOF;
+	}
+	if (f->f_flags & F_WRITING) {
+		if (__stdio_wflush(f)) {
+			return EOF;
+		}
+		f->f_flags &= ~F_WRITING;
+	}
+	if ((f->f_flags & F_READING) == 0) {
+		__stdio_getbuf(f);
+		f->f_pos = f->f_len = 0;
+		f->f_flags |= F_READING;
+	}
+	return 0;
+}
+
+/*
+ * Read from the file underneath F, setting the EOF and error flags.
+ * Returns the byte count, or 0 at EOF or on error.
+ *
+ * Reading from a line-buffered or unbuffered stream (typically the
+ * console) pushes out stdout first, so prompts appear before we
+ * wait for input.
+ */
+int
+__stdio_read(FILE *f, void *buf, size_t len)
+{
+	int r;
+
+	if (f->f_bufmode != _IOFBF && f != stdout) {
+		fflush(stdout);
+	}
+	r = read(f->f_fd, buf, len);
+	if (r < 0) {
+		f->f_flags |= F_ERR;
+		return 0;
+	}
+	if (r == 0) {
+		f->f_flags |= F_EOF;
+	}
+	return r;
+}
+
+/*
+ * Refill F's buffer. Returns 0, or EOF at end of file or on error.
+ */
+int
+__stdio_fill(FILE *f)
+{
+	int r;
+
+	if (__stdio_toread(f)) {
+		return EOF;
+	}
+	r = __stdio_read(f, f->f_buf, f->f_bufsize);
+	f->f_pos = 0;
+	f->f_len = r;
+	return r > 0 ? 0 : EOF;
+}
@@ -0,0 +1,78 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef _STDIOLOCAL_H_
+#define _STDIOLOCAL_H_
+
+/*
+ * Private definitions for libc's stdio.
+ *
+ * A stream is in one of three states: idle, reading (F_READING; the
+ * buffer holds f_len bytes read from the file, of which the first
+ * f_pos have been consumed), or writing (F_WRITING; the buffer holds
+ * f_len bytes not yet written). Switching between reading and
+ * writing goes through __stdio_toread and __stdio_towrite.
+ *
+ * An unbuffered stream uses the one-byte buffer f_onechar, so the
+ * same code paths serve all three buffering modes; large transfers
+ * bypass the buffer anyway.
+ */
+
+struct __file {
+	int f_fd;		/* underlying file handle */
+	unsigned f_flags;	/* F_* below */
+	int f_bufmode;		/* _IOFBF, _IOLBF, or _IONBF */
+	char *f_buf;		/* buffer, or NULL if not allocated yet */
+	size_t f_bufsize;	/* size of f_buf */
+	size_t f_pos;		/* reading: next byte to hand out */
+	size_t f_len;		/* bytes of data in f_buf */
+	char f_onechar;		/* buffer for unbuffered streams */
+};
+
+#define F_INUSE    0x01		/* slot is allocated */
+#define F_READ     0x02		/* opened for reading */
+#define F_WRITE    0x04		/* opened for writing */
+#define F_EOF      0x08		/* hit end of file */
+#define F_ERR      0x10		/* got an I/O error */
+#define F_MYBUF    0x20		/* f_buf came from malloc */
+#define F_READING  0x40		/* buffer holds read-ahead */
+#define F_WRITING  0x80		/* buffer holds pending output */
+
+/* All streams, including stdin/stdout/stderr in slots 0-2. */
+extern FILE __stdio_files[FOPEN_MAX];
+
+int __stdio_getbuf(FILE *f);
+int __stdio_wflush(FILE *f);
+int __stdio_towrite(FILE *f);
+int __stdio_toread(FILE *f);
+void __stdio_dropread(FILE *f);
+int __stdio_read(FILE *f, void *buf, size_t len);
+int __stdio_fill(FILE *f);
+
+#endif /* _STDIOLOCAL_H_ */
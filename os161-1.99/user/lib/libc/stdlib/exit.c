@@ -27,6 +27,7 @@
  * SUCH DAMAGE.
  */
 
+#include <stdio.h>
 #include <stdlib.h>
 #include <unistd.h>
 
@@ -40,7 +41,9 @@ exit(int code)
 	/*
 	 * In a more complicated libc, this would call functions registered
 	 * with atexit() before calling the syscall to actually exit.
+	 * We do at least need to get buffered stdio output out.
 	 */
+	fflush(NULL);
 
 	_exit(code);
 }
@@ -30,8 +30,19 @@
 /*
  * User-level malloc and free implementation.
  *
- * This is a basic first-fit allocator. It's intended to be simple and
- * easy to follow. It performs abysmally if the heap becomes larger than
+ * The heap is a sequence of blocks, each with a header giving the
+ * offsets to its neighbours (boundary tags), so free can merge with
+ * both neighbours in constant time. Free blocks are kept on
+ * segregated free lists ("bins"): one bin per exact size for small
+ * blocks, so small requests are satisfied straight off the head of a
+ * list, and one bin per power of two for large blocks, searched
+ * best-fit. Neither malloc nor free ever walks the heap.
+ *
+ * The heap grows with sbrk a page multiple at a time, and when the
+ * free block at the top of the heap grows past MALLOC_TRIMSIZE the
+ * whole pages in it are handed back with a negative sbrk.
+ *
+ * It still performs abysmally if the heap becomes larger than
  * physical memory. To get (much) better out-of-core performance, port
  * the kernel's malloc. :-)
  */
@@ -136,9 +147,44 @@ struct mheader {
 ////////////////////////////////////////////////////////////
 
 /*
- * Static variables - the bottom and top addresses of the heap.
+ * Free-list links. These live in the data area of free blocks, which
+ * is why the smallest block holds MBLOCKSIZE bytes of data.
+ */
+struct mfree {
+	struct mheader *mf_next;
+	struct mheader *mf_prev;
+};
+
+#define M_FREE(mh)	((struct mfree *)M_DATA(mh))
+
+/*
+ * Bins. Bin i < MNSMALLBINS holds free blocks with exactly
+ * (i+1)*MBLOCKSIZE bytes of data; the bins above that hold blocks of
+ * [2^k, 2^(k+1)) bytes for successive k. MNBINS covers any size_t.
+ */
+#define MNSMALLBINS	64
+#define MSMALLMAX	(MNSMALLBINS*MBLOCKSIZE)
+#define MNBINS		(MNSMALLBINS + sizeof(size_t)*8)
+
+/*
+ * The heap is grown in multiples of MALLOC_GROWSIZE. A free block at
+ * the top of the heap at least MALLOC_TRIMSIZE big is given back.
+ */
+#define MALLOC_PAGESIZE	4096
+#define MALLOC_GROWSIZE	MALLOC_PAGESIZE
+#define MALLOC_TRIMSIZE	(4*MALLOC_PAGESIZE)
+
+#define M_ROUNDUP(x, n)	(((x) + (n) - 1) & ~(uintptr_t)((n) - 1))
+
+////////////////////////////////////////////////////////////
+
+/*
+ * Static variables - the bottom and top addresses of the heap, the
+ * topmost block (NULL if the heap is empty), and the bins.
  */
 static uintptr_t __heapbase, __heaptop;
+static struct mheader *__heaplast;
+static struct mheader *__malloc_bins[MNBINS];
 
 /*
  * Setup function.
@@ -254,6 +300,110 @@ __malloc_dump(void)
 
 ////////////////////////////////////////////////////////////
 
+/*
+ * Bin management.
+ */
+
+/*
+ * Pick the bin for a block with SIZE bytes of data.
+ */
+static
+unsigned
+__malloc_binfor(size_t size)
+{
+	unsigned bin;
+
+	if (size <= MSMALLMAX) {
+		return size/MBLOCKSIZE - 1;
+	}
+	/* log2(size) - log2(MSMALLMAX), offset past the small bins */
+	bin = MNSMALLBINS;
+	for (size /= MSMALLMAX; size > 1; size >>= 1) {
+		bin++;
+	}
+	return bin;
+}
+
+static
+void
+__malloc_binadd(struct mheader *mh)
+{
+	unsigned bin;
+	struct mheader *head;
+
+	bin = __malloc_binfor(M_SIZE(mh));
+	head = __malloc_bins[bin];
+	M_FREE(mh)->mf_next = head;
+	M_FREE(mh)->mf_prev = NULL;
+	if (head != NULL) {
+		M_FREE(head)->mf_prev = mh;
+	}
+	__malloc_bins[bin] = mh;
+}
+
+static
+void
+__malloc_binremove(struct mheader *mh)
+{
+	struct mfree *mf = M_FREE(mh);
+
+	if (mf->mf_prev != NULL) {
+		M_FREE(mf->mf_prev)->mf_next = mf->mf_next;
+	}
+	else {
+		__malloc_bins[__malloc_binfor(M_SIZE(mh))] = mf->mf_next;
+	}
+	if (mf->mf_next != NULL) {
+		M_FREE(mf->mf_next)->mf_prev = mf->mf_prev;
+	}
+}
+
+/*
+ * Find the smallest free block with at least SIZE bytes of data and
+ * take it off its bin. Small bins are exact, so any block in the
+ * first nonempty one will do; a large bin is scanned for the best
+ * fit. Returns NULL if nothing fits.
+ */
+static
+struct mheader *
+__malloc_binfind(size_t size)
+{
+	unsigned bin;
+	struct mheader *mh, *best;
+
+	for (bin = __malloc_binfor(size); bin < MNBINS; bin++) {
+		if (__malloc_bins[bin] == NULL) {
+			continue;
+		}
+		if (bin < MNSMALLBINS) {
+			best = __malloc_bins[bin];
+		}
+		else {
+			best = NULL;
+			for (mh = __malloc_bins[bin]; mh != NULL;
+			     mh = M_FREE(mh)->mf_next) {
+				if (M_SIZE(mh) < size) {
+					continue;
+				}
+				if (best == NULL || M_SIZE(mh) < M_SIZE(best)) {
+					best = mh;
+					if (M_SIZE(mh) == size) {
+						break;
+					}
+				}
+			}
+			if (best == NULL) {
+				continue;
+			}
+		}
+		__malloc_binremove(best);
+		return best;
+	}
+	return NULL;
+}
+
+////////////////////////////////////////////////////////////
+
 /*
  * Get more memory (at the top of the heap) using sbrk, and 
  * return a pointer to it.
@@ -279,13 +429,32 @@ __malloc_sbrk(size_t size)
 	return x;
 }
 
+/*
+ * Fill in a block header.
+ */
+static
+void
+__malloc_mkblock(struct mheader *mh, size_t prevoff, size_t nextoff,
+		 int inuse)
+{
+	mh->mh_prevblock = M_MKFIELD(prevoff);
+	mh->mh_pad = 0;
+	mh->mh_magic1 = MMAGIC;
+	mh->mh_nextblock = M_MKFIELD(nextoff);
+	mh->mh_inuse = inuse;
+	mh->mh_magic2 = MMAGIC;
+}
+
 /*
  * Make a new (free) block from the block passed in, leaving size
  * bytes for data in the current block. size must be a multiple of
- * MBLOCKSIZE.
+ * MBLOCKSIZE. The new block goes on a bin.
  *
  * Only split if the excess space is at least twice the blocksize -
  * one blocksize to hold a header and one for data.
+ *
+ * The block above mh is never free (free blocks are always merged
+ * with their neighbours), so the new block needs no merging.
  */
 static
 void
@@ -314,16 +483,50 @@ __malloc_split(struct mheader *mh, size_t size)
 		errx(1, "malloc: Internal error (split screwed up?)");
 	}
 
-	mhnew->mh_prevblock = M_MKFIELD(size + MBLOCKSIZE);
-	mhnew->mh_pad = 0;
-	mhnew->mh_magic1 = MMAGIC;
-	mhnew->mh_nextblock = M_MKFIELD(oldsize - size);
-	mhnew->mh_inuse = 0;
-	mhnew->mh_magic2 = MMAGIC;
+	__malloc_mkblock(mhnew, size + MBLOCKSIZE, oldsize - size, 0);
 
 	if (mhnext != (struct mheader *) __heaptop) {
 		mhnext->mh_prevblock = mhnew->mh_nextblock;
 	}
+	else {
+		__heaplast = mhnew;
+	}
+	__malloc_binadd(mhnew);
+}
+
+/*
+ * Grow the heap so there's a free block with at least size bytes of
+ * data at the top, and return it (not on any bin). If the topmost
+ * block is already free, it gets extended instead of starting a new
+ * block beside it.
+ */
+static
+struct mheader *
+__malloc_grow(size_t size)
+{
+	struct mheader *mh;
+	size_t need, prevoff;
+
+	mh = __heaplast;
+	if (mh != NULL && !mh->mh_inuse) {
+		need = M_ROUNDUP(size - M_SIZE(mh), MALLOC_GROWSIZE);
+		if (__malloc_sbrk(need) == NULL) {
+			return NULL;
+		}
+		__malloc_binremove(mh);
+		mh->mh_nextblock = M_MKFIELD(M_NEXTOFF(mh) + need);
+		return mh;
+	}
+
+	need = M_ROUNDUP(size + MBLOCKSIZE, MALLOC_GROWSIZE);
+	prevoff = mh == NULL ? 0 : M_NEXTOFF(mh);
+	mh = __malloc_sbrk(need);
+	if (mh == NULL) {
+		return NULL;
+	}
+	__malloc_mkblock(mh, prevoff, need, 0);
+	__heaplast = mh;
+	return mh;
 }
 
 /*
@@ -333,8 +536,6 @@ void *
 malloc(size_t size)
 {
 	struct mheader *mh;
-	uintptr_t i;
-	size_t rightprevblock;
 
 	if (__heapbase==0) {
 		__malloc_init();
@@ -351,74 +552,32 @@ malloc(size_t size)
 	__malloc_dump();
 #endif
 
-	/* Round size up to an integral number of blocks. */
-	size = ((size + MBLOCKSIZE - 1) & ~(size_t)(MBLOCKSIZE-1));
-
 	/*
-	 * First-fit search algorithm for available blocks.
-	 * Check to make sure the next/previous sizes all agree.
+	 * Round size up to an integral number of blocks, with room
+	 * for the free-list links once it's freed.
 	 */
-	rightprevblock = 0;
-	for (i=__heapbase; i<__heaptop; i += M_NEXTOFF(mh)) {
-		mh = (struct mheader *) i;
-		if (!M_OK(mh)) {
-			errx(1, "malloc: Heap corrupt; header at 0x%lx"
-			     " has bad magic bits",
-			     (unsigned long) i);
-		}
-		if (mh->mh_prevblock != rightprevblock) {
-			errx(1, "malloc: Heap corrupt; header at 0x%lx"
-			     " has bad previous-block size %lu "
-			     "(should be %lu)",
-			     (unsigned long) i, 
-			     (unsigned long) mh->mh_prevblock << MBLOCKSHIFT,
-			     (unsigned long) rightprevblock << MBLOCKSHIFT);
-		}
-		rightprevblock = mh->mh_nextblock;
-
-		/* Can't allocate a block that's in use. */
-		if (mh->mh_inuse) {
-			continue;
-		}
-
-		/* Can't allocate a block that isn't big enough. */
-		if (M_SIZE(mh) < size) {
-			continue;
-		}
-
-		/* Try splitting block. */
-		__malloc_split(mh, size);
-
-		/*
-		 * Now, allocate.
-		 */
-		mh->mh_inuse = 1;
-
-#ifdef MALLOCDEBUG
-		warnx("malloc: allocating at %p", M_DATA(mh));
-		__malloc_dump();
-#endif
-		return M_DATA(mh);
+	if (size > (size_t)-1 - MALLOC_GROWSIZE - MBLOCKSIZE) {
+		return NULL;
 	}
-	if (i!=__heaptop) {
-		errx(1, "malloc: Heap corrupt; ran off end");
+	size = ((size + MBLOCKSIZE - 1) & ~(size_t)(MBLOCKSIZE-1));
+	if (size == 0) {
+		size = MBLOCKSIZE;
 	}
 
-	/*
-	 * Didn't find anything. Expand the heap.
-	 */
-
-	mh = __malloc_sbrk(size + MBLOCKSIZE);
+	mh = __malloc_binfind(size);
 	if (mh == NULL) {
-		return NULL;
+		/* Didn't find anything. Expand the heap. */
+		mh = __malloc_grow(size);
+		if (mh == NULL) {
+			return NULL;
+		}
+	}
+	if (!M_OK(mh) || mh->mh_inuse) {
+		errx(1, "malloc: Heap corrupt; free block at %p is bad", mh);
 	}
 
-	mh->mh_prevblock = rightprevblock;
-	mh->mh_magic1 = MMAGIC;
-	mh->mh_magic2 = MMAGIC;
-	mh->mh_pad = 0;
+	__malloc_split(mh, size);
 	mh->mh_inuse = 1;
-	mh->mh_nextblock = M_MKFIELD(size + MBLOCKSIZE);
 
 #ifdef MALLOCDEBUG
 	warnx("malloc: allocating at %p", M_DATA(mh));
@@ -445,11 +604,12 @@ __malloc_deadbeef(void *ptr, size_t size)
 }
 
 /*
- * Attempt to merge two adjacent blocks (mh below mhnext).
+ * Merge two adjacent free blocks (mh below mhnext). mhnext must
+ * already be off its bin; mh's bin is the caller's problem too.
  */
 static
 void
-__malloc_trymerge(struct mheader *mh, struct mheader *mhnext)
+__malloc_merge(struct mheader *mh, struct mheader *mhnext)
 {
 	struct mheader *mhnextnext;
 
@@ -457,10 +617,6 @@ __malloc_trymerge(struct mheader *mh, struct mheader *mhnext)
 		errx(1, "free: Heap corrupt (%p and %p inconsistent)",
 		     mh, mhnext);
 	}
-	if (mh->mh_inuse || mhnext->mh_inuse) {
-		/* can't merge */
-		return;
-	}
 
 	mhnextnext = M_NEXT(mhnext);
 
@@ -470,11 +626,51 @@ __malloc_trymerge(struct mheader *mh, struct mheader *mhnext)
 	if (mhnextnext != (struct mheader *)__heaptop) {
 		mhnextnext->mh_prevblock = mh->mh_nextblock;
 	}
+	else {
+		__heaplast = mh;
+	}
 
 	/* Deadbeef out the memory used by the now-obsolete header */
 	__malloc_deadbeef(mhnext, sizeof(struct mheader));
 }
 
+/*
+ * Give whole pages at the top of the heap back to the kernel, given
+ * the free (and unbinned) topmost block. Returns nonzero if the block
+ * went away entirely.
+ *
+ * If the kernel won't shrink the heap, just keep the memory.
+ */
+static
+int
+__malloc_trim(struct mheader *mh)
+{
+	uintptr_t newtop;
+
+	newtop = M_ROUNDUP((uintptr_t)mh, MALLOC_PAGESIZE);
+	if (newtop != (uintptr_t)mh &&
+	    newtop - (uintptr_t)mh < 2*MBLOCKSIZE) {
+		/* not enough room left below for a block */
+		newtop += MALLOC_PAGESIZE;
+	}
+	if (__heaptop - newtop < MALLOC_PAGESIZE) {
+		return 0;
+	}
+	if (sbrk(-(int)(__heaptop - newtop)) == (void *)-1) {
+		return 0;
+	}
+	__heaptop = newtop;
+
+	if (newtop == (uintptr_t)mh) {
+		/* the whole block is gone */
+		__heaplast = (mh == (struct mheader *)__heapbase) ?
+			NULL : M_PREV(mh);
+		return 1;
+	}
+	mh->mh_nextblock = M_MKFIELD(newtop - (uintptr_t)mh);
+	return 0;
+}
+
 /*
  * The actual free() implementation.
  */
@@ -517,19 +713,38 @@ free(void *x)
 	/* mark it free */
 	mh->mh_inuse = 0;
 
-	/* wipe it */
+#ifdef MALLOCDEBUG
+	/*
+	 * Wipe it. This makes use-after-free bugs show up, but costs
+	 * time proportional to the block size, so only when debugging.
+	 */
 	__malloc_deadbeef(M_DATA(mh), M_SIZE(mh));
+#endif
 
-	/* Try merging with the block above (but not if we're at the top) */
+	/* Merge with the block above if it's free (and we're not at the top) */
 	mhnext = M_NEXT(mh);
-	if (mhnext != (struct mheader *)__heaptop) {
-		__malloc_trymerge(mh, mhnext);
+	if (mhnext != (struct mheader *)__heaptop && !mhnext->mh_inuse) {
+		__malloc_binremove(mhnext);
+		__malloc_merge(mh, mhnext);
 	}
 
-	/* Try merging with the block below (but not if we're at the bottom) */
+	/* Merge with the block below if it's free (and we're not at the bottom) */
 	if (mh != (struct mheader *)__heapbase) {
 		mhprev = M_PREV(mh);
-		__malloc_trymerge(mhprev, mh);
+		if (!mhprev->mh_inuse) {
+			__malloc_binremove(mhprev);
+			__malloc_merge(mhprev, mh);
+			mh = mhprev;
+		}
+	}
+
+	/* If this leaves a big free block at the top, shrink the heap. */
+	if (mh == __heaplast && M_SIZE(mh) >= MALLOC_TRIMSIZE &&
+	    __malloc_trim(mh)) {
+		mh = NULL;
+	}
+	if (mh != NULL) {
+		__malloc_binadd(mh);
 	}
 
 #ifdef MALLOCDEBUG
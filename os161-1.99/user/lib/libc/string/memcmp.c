@@ -27,6 +27,7 @@
  * SUCH DAMAGE.
  */
 
+#include <stdint.h>
 #include <string.h>
 
 /*
@@ -39,8 +40,37 @@ memcmp(const void *av, const void *bv, size_t len)
 {
 	const unsigned char *a = av;
 	const unsigned char *b = bv;
+	const unsigned long *aw, *bw;
 	size_t i;
 
+	/*
+	 * If the blocks have the same alignment, skip the identical
+	 * prefix a word at a time, as in memcpy. The first word that
+	 * differs is left for the byte loop, which finds the first
+	 * differing byte in it; comparing the words themselves would
+	 * get the order wrong on little-endian machines.
+	 */
+	if (((uintptr_t)a - (uintptr_t)b) % sizeof(long) == 0) {
+		while (len > 0 && (uintptr_t)a % sizeof(long) != 0) {
+			if (*a != *b) {
+				return (int)(*a - *b);
+			}
+			a++;
+			b++;
+			len--;
+		}
+
+		aw = (const unsigned long *)a;
+		bw = (const unsigned long *)b;
+		while (len >= sizeof(long) && *aw == *bw) {
+			aw++;
+			bw++;
+			len -= sizeof(long);
+		}
+		a = (const unsigned char *)aw;
+		b = (const unsigned char *)bw;
+	}
+
 	for (i=0; i<len; i++) {
 		if (a[i] != b[i]) {
 			return (int)(a[i] - b[i]);
@@ -27,6 +27,7 @@
  * SUCH DAMAGE.
  */
 
+#include <stdint.h>
 #include <string.h>
 
 /*
@@ -36,11 +37,41 @@
 void *
 memset(void *ptr, int ch, size_t len)
 {
-	char *p = ptr;
-	size_t i;
-	
-	for (i=0; i<len; i++) {
-		p[i] = ch;
+	unsigned char *p = ptr;
+	unsigned long *pw;
+	unsigned long w;
+
+	/*
+	 * Same scheme as bzero: bytes until the pointer is aligned,
+	 * then four words at a time, then single words, then the
+	 * leftover bytes. The word is the byte repeated, which is
+	 * the byte times 0x0101...01.
+	 */
+
+	while (len > 0 && (uintptr_t)p % sizeof(long) != 0) {
+		*p++ = ch;
+		len--;
+	}
+
+	w = (unsigned char)ch * ((unsigned long)-1 / 0xff);
+	pw = (unsigned long *)p;
+	while (len >= 4*sizeof(long)) {
+		pw[0] = w;
+		pw[1] = w;
+		pw[2] = w;
+		pw[3] = w;
+		pw += 4;
+		len -= 4*sizeof(long);
+	}
+	while (len >= sizeof(long)) {
+		*pw++ = w;
+		len -= sizeof(long);
+	}
+	p = (unsigned char *)pw;
+
+	while (len > 0) {
+		*p++ = ch;
+		len--;
 	}
 
 	return ptr;
@@ -98,6 +98,9 @@ __printerr(int use_errno, const char *fmt, va_list ap)
 		prog = "(program name unknown)";
 	}
 
+	/* stdout is buffered; keep its output ahead of ours. */
+	fflush(stdout);
+
 	/* print the program name */
 	__senderrstr(prog);
 	__senderrstr(": ");
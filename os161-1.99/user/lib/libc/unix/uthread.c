@@ -0,0 +1,247 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#include <unistd.h>
+#include <errno.h>
+#include <uthread.h>
+
+/*
+ * User-level threads and synchronization; see uthread.h.
+ *
+ * The mutex is the three-state one from Drepper's "Futexes Are
+ * Tricky": 0 is free, 1 is held, and 2 is held with (possibly)
+ * someone asleep on it, so unlocking only enters the kernel if it
+ * might have to wake someone. Condition variables are a sequence
+ * number that waiters sleep on; a signal bumps it, and only calls
+ * the kernel if someone is waiting.
+ */
+
+/*
+ * Atomically: if *P is OLD, make it NEW. Returns what *P was, which
+ * is OLD on success. Uses LL/SC, as the kernel's spinlocks do.
+ */
+static
+int
+atomic_cas(volatile int *p, int old, int new)
+{
+	int prev, tmp;
+
+	__asm volatile(
+		".set push;"		/* save assembler mode */
+		".set mips32;"		/* allow MIPS32 instructions */
+		"1: ll %0, 0(%2);"	/*   prev = *p */
+		"bne %0, %3, 2f;"	/*   if (prev != old) give up */
+		"move %1, %4;"		/*   tmp = new */
+		"sc %1, 0(%2);"		/*   *p = tmp; tmp = success? */
+		"beqz %1, 1b;"		/*   lost it; try again */
+		"2:;"
+		".set pop"		/* restore assembler mode */
+		: "=&r" (prev), "=&r" (tmp)
+		: "r" (p), "r" (old), "r" (new)
+		: "memory");
+	return prev;
+}
+
+/* Atomically set *P to NEW, returning the old value. */
+static
+int
+atomic_swap(volatile int *p, int new)
+{
+	int old;
+
+	do {
+		old = *p;
+	} while (atomic_cas(p, old, new) != old);
+	return old;
+}
+
+/* Atomically add N to *P. */
+static
+void
+atomic_add(volatile int *p, int n)
+{
+	int old;
+
+	do {
+		old = *p;
+	} while (atomic_cas(p, old, old + n) != old);
+}
+
+////////////////////////////////////////////////////////////
+// threads
+
+struct uthread_slot {
+	volatile int us_inuse;		/* from uthread_create to uthread_join */
+	volatile int us_running;	/* cleared by the kernel at exit */
+	void (*us_func)(void *);
+	void *us_arg;
+};
+
+static struct uthread_slot slots[UTHREAD_MAX];
+static char stacks[UTHREAD_MAX][UTHREAD_STACKSIZE]
+	__attribute__((__aligned__(8)));
+
+/*
+ * Where new threads start. The slot can't be reused until we've been
+ * joined, which can't happen until we exit, so it's safe to use.
+ */
+static
+void
+uthread_start(void *arg)
+{
+	struct uthread_slot *us = arg;
+
+	us->us_func(us->us_arg);
+	__threadexit();
+}
+
+uthread_t
+uthread_create(void (*func)(void *), void *arg)
+{
+	struct uthread_slot *us;
+	char *stacktop;
+	int i;
+
+	for (i=0; i<UTHREAD_MAX; i++) {
+		if (atomic_cas(&slots[i].us_inuse, 0, 1) == 0) {
+			break;
+		}
+	}
+	if (i == UTHREAD_MAX) {
+		errno = EAGAIN;
+		return -1;
+	}
+
+	us = &slots[i];
+	us->us_func = func;
+	us->us_arg = arg;
+	us->us_running = 1;
+
+	/* leave the 16-byte argument area the MIPS calling convention wants */
+	stacktop = stacks[i] + UTHREAD_STACKSIZE - 16;
+
+	if (__threadfork(uthread_start, us, stacktop, &us->us_running) < 0) {
+		us->us_running = 0;
+		us->us_inuse = 0;
+		return -1;
+	}
+	return i;
+}
+
+int
+uthread_join(uthread_t t)
+{
+	struct uthread_slot *us;
+	int running;
+
+	if (t < 0 || t >= UTHREAD_MAX || slots[t].us_inuse == 0) {
+		errno = EINVAL;
+		return -1;
+	}
+	us = &slots[t];
+
+	while ((running = us->us_running) != 0) {
+		__futex_wait(&us->us_running, running);
+	}
+	us->us_inuse = 0;
+	return 0;
+}
+
+////////////////////////////////////////////////////////////
+// mutexes
+
+void
+umutex_lock(struct umutex *m)
+{
+	int c;
+
+	c = atomic_cas(&m->um_state, 0, 1);
+	if (c == 0) {
+		/* got it without a fight */
+		return;
+	}
+
+	/* mark it contended, and sleep until it's free */
+	if (c != 2) {
+		c = atomic_swap(&m->um_state, 2);
+	}
+	while (c != 0) {
+		__futex_wait(&m->um_state, 2);
+		c = atomic_swap(&m->um_state, 2);
+	}
+}
+
+void
+umutex_unlock(struct umutex *m)
+{
+	if (atomic_swap(&m->um_state, 0) == 2) {
+		__futex_wake(&m->um_state, 1);
+	}
+}
+
+////////////////////////////////////////////////////////////
+// condition variables
+
+void
+ucond_wait(struct ucond *c, struct umutex *m)
+{
+	int seq;
+
+	/*
+	 * Read the sequence number before letting go of the mutex; if
+	 * anyone signals after that, the wait below sees the change
+	 * and returns at once instead of sleeping through it.
+	 */
+	seq = c->uc_seq;
+	atomic_add(&c->uc_waiters, 1);
+	umutex_unlock(m);
+
+	__futex_wait(&c->uc_seq, seq);
+
+	atomic_add(&c->uc_waiters, -1);
+	umutex_lock(m);
+}
+
+void
+ucond_signal(struct ucond *c)
+{
+	atomic_add(&c->uc_seq, 1);
+	if (c->uc_waiters > 0) {
+		__futex_wake(&c->uc_seq, 1);
+	}
+}
+
+void
+ucond_broadcast(struct ucond *c)
+{
+	atomic_add(&c->uc_seq, 1);
+	if (c->uc_waiters > 0) {
+		__futex_wake(&c->uc_seq, (unsigned)-1);
+	}
+}
@@ -31,6 +31,7 @@
 #include <stdint.h>
 #include <string.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <assert.h>
 #include <limits.h>
 #include <err.h>
@@ -154,23 +155,652 @@ dumpbits(uint32_t fsblocks)
 	printf("\n");
 }
 
+////////////////////////////////////////////////////////////
+// Index
+//
+// For the queries (--owner, --frag-report, --du) we walk the tree
+// once and remember who owns each block and how each file is laid
+// out, instead of dumping everything.
+
+#define MAXFILEBLOCKS (SFS_NDIRECT + SFS_DBPERIDB)
+
+/* What each block is used for */
+#define BK_FREE      0	/* not used by anything we found */
+#define BK_SUPER     1
+#define BK_BITMAP    2
+#define BK_INODE     3
+#define BK_INDIRECT  4
+#define BK_DATA      5
+
+/*
+ * One per directory entry. The first entry found for an inode holds
+ * what we know about it; any later one (a hard link) only has its
+ * name, its directory, and if_target pointing at the first.
+ */
+struct ixfile {
+	unsigned if_target;	/* the entry it links to, or IX_NONE */
+	uint32_t if_ino;
+	uint16_t if_type;
+	uint16_t if_links;	/* directory entries found for it */
+	uint32_t if_size;
+	uint32_t if_nblocks;	/* inode, indirect and data blocks */
+	uint32_t if_nextents;	/* runs of consecutive data blocks */
+	unsigned if_parent;	/* directory this entry is in */
+	unsigned if_child;	/* first entry, if a directory */
+	unsigned if_sibling;	/* next entry in the same directory */
+	unsigned if_mark;	/* for --du, to count hard links once */
+	char *if_name;
+};
+
+#define IX_NONE ((unsigned)-1)
+
+static uint32_t fsblocks;
+static uint8_t *bitmap;		/* the on-disk freemap */
+static uint8_t *blockkind;	/* BK_* for each block */
+static unsigned *blockowner;	/* index into files[] for each block */
+static struct ixfile *files;
+static unsigned nfiles, maxfiles;
+
+static
+void *
+domalloc(size_t len)
+{
+	void *x;
+
+	x = malloc(len);
+	if (x == NULL) {
+		errx(1, "Out of memory");
+	}
+	return x;
+}
+
+static
+int
+bitmap_isset(uint32_t block)
+{
+	return (bitmap[block/CHAR_BIT] & (1 << (block % CHAR_BIT))) != 0;
+}
+
+static
+unsigned
+ix_addfile(uint32_t ino, unsigned parent, const char *name)
+{
+	struct ixfile *newfiles;
+	struct ixfile *f;
+
+	if (nfiles == maxfiles) {
+		maxfiles = maxfiles ? maxfiles*2 : 64;
+		newfiles = domalloc(maxfiles * sizeof(struct ixfile));
+		if (nfiles > 0) {
+			memcpy(newfiles, files, nfiles*sizeof(struct ixfile));
+			free(files);
+		}
+		files = newfiles;
+	}
+	f = &files[nfiles];
+	f->if_target = IX_NONE;
+	f->if_ino = ino;
+	f->if_type = SFS_TYPE_INVAL;
+	f->if_links = 1;
+	f->if_size = 0;
+	f->if_nblocks = 0;
+	f->if_nextents = 0;
+	f->if_parent = parent;
+	f->if_child = IX_NONE;
+	f->if_sibling = IX_NONE;
+	f->if_mark = 0;
+	f->if_name = domalloc(strlen(name)+1);
+	strcpy(f->if_name, name);
+
+	if (parent != IX_NONE) {
+		f->if_sibling = files[parent].if_child;
+		files[parent].if_child = nfiles;
+	}
+	return nfiles++;
+}
+
+/* Returns 0 if the block can't be claimed. */
+static
+int
+ix_claim(uint32_t block, uint8_t kind, unsigned ix)
+{
+	if (block >= fsblocks) {
+		warnx("Inode %u: block %u out of range",
+		      files[ix].if_ino, block);
+		return 0;
+	}
+	if (blockkind[block] != BK_FREE) {
+		warnx("Inode %u: block %u already in use", 
+		      files[ix].if_ino, block);
+		return 0;
+	}
+	blockkind[block] = kind;
+	blockowner[block] = ix;
+	files[ix].if_nblocks++;
+	return 1;
+}
+
+/*
+ * Get the data block numbers of an inode, up to its size, into
+ * BLOCKS (zero for holes). Returns how many there are.
+ */
+static
+uint32_t
+getblocks(const struct sfs_inode *sfi, uint32_t *blocks)
+{
+	uint32_t ib[SFS_DBPERIDB];
+	uint32_t nb, i;
+
+	nb = SFS_ROUNDUP(SWAPL(sfi->sfi_size), SFS_BLOCKSIZE) / SFS_BLOCKSIZE;
+	if (nb > MAXFILEBLOCKS) {
+		nb = MAXFILEBLOCKS;
+	}
+	if (nb > SFS_NDIRECT && SWAPL(sfi->sfi_indirect) != 0 &&
+	    SWAPL(sfi->sfi_indirect) < fsblocks) {
+		diskread(ib, SWAPL(sfi->sfi_indirect));
+	}
+	else {
+		bzero(ib, sizeof(ib));
+	}
+	for (i=0; i<nb; i++) {
+		if (i < SFS_NDIRECT) {
+			blocks[i] = SWAPL(sfi->sfi_direct[i]);
+		}
+		else {
+			blocks[i] = SWAPL(ib[i - SFS_NDIRECT]);
+		}
+	}
+	return nb;
+}
+
+static void ix_dir(unsigned ix, const uint32_t *blocks, uint32_t nb);
+
+/*
+ * Read the inode for files[IX], claim its blocks, and go into it if
+ * it's a directory.
+ */
+static
+void
+ix_inode(unsigned ix)
+{
+	struct sfs_inode sfi;
+	uint32_t blocks[MAXFILEBLOCKS];
+	uint32_t nb, i, prev;
+	struct ixfile *f = &files[ix];
+
+	diskread(&sfi, f->if_ino);
+	f->if_type = SWAPS(sfi.sfi_type);
+	f->if_size = SWAPL(sfi.sfi_size);
+
+	nb = getblocks(&sfi, blocks);
+	if (SWAPL(sfi.sfi_indirect) != 0) {
+		ix_claim(SWAPL(sfi.sfi_indirect), BK_INDIRECT, ix);
+	}
+	prev = 0;
+	for (i=0; i<nb; i++) {
+		if (blocks[i] == 0) {
+			prev = 0;
+			continue;
+		}
+		if (!ix_claim(blocks[i], BK_DATA, ix)) {
+			blocks[i] = 0;
+			prev = 0;
+			continue;
+		}
+		if (prev == 0 || blocks[i] != prev+1) {
+			f->if_nextents++;
+		}
+		prev = blocks[i];
+	}
+
+	if (f->if_type == SFS_TYPE_DIR) {
+		ix_dir(ix, blocks, nb);
+	}
+}
+
+static
+void
+ix_dir(unsigned ix, const uint32_t *blocks, uint32_t nb)
+{
+	struct sfs_dir sds[SFS_BLOCKSIZE/sizeof(struct sfs_dir)];
+	unsigned nsds = SFS_BLOCKSIZE/sizeof(struct sfs_dir);
+	uint32_t nentries, b, ino;
+	unsigned i, child, link;
+
+	nentries = files[ix].if_size / sizeof(struct sfs_dir);
+
+	for (b=0; b<nb && b*nsds < nentries; b++) {
+		if (blocks[b] == 0) {
+			continue;
+		}
+		diskread(sds, blocks[b]);
+		for (i=0; i<nsds && b*nsds+i < nentries; i++) {
+			ino = SWAPL(sds[i].sfd_ino);
+			sds[i].sfd_name[SFS_NAMELEN-1] = 0;
+			if (ino == SFS_NOINO ||
+			    !strcmp(sds[i].sfd_name, ".") ||
+			    !strcmp(sds[i].sfd_name, "..")) {
+				continue;
+			}
+			if (ino >= fsblocks) {
+				warnx("Directory %u: %s: inode %u out of range",
+				      files[ix].if_ino, sds[i].sfd_name, ino);
+				continue;
+			}
+			if (blockkind[ino] == BK_INODE) {
+				/* seen before: a hard link */
+				child = blockowner[ino];
+				if (files[child].if_type == SFS_TYPE_DIR) {
+					warnx("Directory %u: %s: extra link to "
+					      "directory %u (ignored)",
+					      files[ix].if_ino,
+					      sds[i].sfd_name, ino);
+					continue;
+				}
+				files[child].if_links++;
+				link = ix_addfile(ino, ix, sds[i].sfd_name);
+				files[link].if_target = child;
+				continue;
+			}
+			if (blockkind[ino] != BK_FREE) {
+				warnx("Directory %u: %s: inode %u is "
+				      "not an inode block",
+				      files[ix].if_ino, sds[i].sfd_name, ino);
+				continue;
+			}
+			child = ix_addfile(ino, ix, sds[i].sfd_name);
+			ix_claim(ino, BK_INODE, child);
+			ix_inode(child);
+		}
+	}
+}
+
+static
+void
+buildindex(uint32_t nblocks)
+{
+	uint32_t i, nbitblocks;
+	unsigned root;
+
+	fsblocks = nblocks;
+	nbitblocks = SFS_BITBLOCKS(fsblocks);
+
+	bitmap = domalloc(nbitblocks * SFS_BLOCKSIZE);
+	for (i=0; i<nbitblocks; i++) {
+		diskread(bitmap + i*SFS_BLOCKSIZE, SFS_MAP_LOCATION+i);
+	}
+
+	blockkind = domalloc(fsblocks * sizeof(blockkind[0]));
+	blockowner = domalloc(fsblocks * sizeof(blockowner[0]));
+	for (i=0; i<fsblocks; i++) {
+		blockkind[i] = BK_FREE;
+		blockowner[i] = IX_NONE;
+	}
+	blockkind[SFS_SB_LOCATION] = BK_SUPER;
+	for (i=0; i<nbitblocks; i++) {
+		blockkind[SFS_MAP_LOCATION+i] = BK_BITMAP;
+	}
+
+	root = ix_addfile(SFS_ROOT_LOCATION, IX_NONE, "");
+	ix_claim(SFS_ROOT_LOCATION, BK_INODE, root);
+	ix_inode(root);
+}
+
+static
+void
+printpath(unsigned ix)
+{
+	if (files[ix].if_parent == IX_NONE) {
+		printf("/");
+		return;
+	}
+	if (files[files[ix].if_parent].if_parent != IX_NONE) {
+		printpath(files[ix].if_parent);
+	}
+	printf("/%s", files[ix].if_name);
+}
+
+////////////////////////////////////////////////////////////
+// Queries
+
+static
+void
+query_owner(uint32_t block)
+{
+	struct sfs_inode sfi;
+	uint32_t blocks[MAXFILEBLOCKS];
+	uint32_t nb, i;
+	unsigned ix;
+
+	if (block >= fsblocks) {
+		errx(1, "Block %u out of range (volume has %u blocks)",
+		     block, fsblocks);
+	}
+
+	printf("Block %u: ", block);
+	ix = blockowner[block];
+	switch (blockkind[block]) {
+	    case BK_FREE:
+		if (bitmap_isset(block)) {
+			printf("marked in use, but not used by anything "
+			       "(leaked)\n");
+		}
+		else {
+			printf("free\n");
+		}
+		return;
+	    case BK_SUPER:
+		printf("superblock\n");
+		return;
+	    case BK_BITMAP:
+		printf("freemap block %u\n", block - SFS_MAP_LOCATION);
+		return;
+	    case BK_INODE:
+		printf("inode of ");
+		break;
+	    case BK_INDIRECT:
+		printf("indirect block of ");
+		break;
+	    case BK_DATA:
+		diskread(&sfi, files[ix].if_ino);
+		nb = getblocks(&sfi, blocks);
+		for (i=0; i<nb; i++) {
+			if (blocks[i] == block) {
+				break;
+			}
+		}
+		printf("block %u of ", i);
+		break;
+	}
+	printpath(ix);
+	printf(" (inode %u)\n", files[ix].if_ino);
+}
+
+#define FRAGTOP 10
+
+static
+void
+query_frag(void)
+{
+	unsigned top[FRAGTOP];
+	unsigned ntop = 0, i, j, ix;
+	unsigned nregular = 0, ndirs = 0, nfragmented = 0;
+	uint64_t datablocks = 0, extents = 0, fileextents = 0;
+	uint32_t b, run, nfree = 0, freeextents = 0, largestfree = 0;
+	uint32_t leaked = 0, unmarked = 0;
+	unsigned avg;
+
+	for (ix=0; ix<nfiles; ix++) {
+		struct ixfile *f = &files[ix];
+
+		if (f->if_target != IX_NONE) {
+			continue;
+		}
+		if (f->if_type == SFS_TYPE_DIR) {
+			ndirs++;
+		}
+		else {
+			nregular++;
+			fileextents += f->if_nextents;
+		}
+		extents += f->if_nextents;
+		if (f->if_nextents > 1) {
+			nfragmented++;
+		}
+
+		/* keep the FRAGTOP most fragmented, most first */
+		if (f->if_nextents < 2) {
+			continue;
+		}
+		for (i=0; i<ntop; i++) {
+			if (f->if_nextents > files[top[i]].if_nextents ||
+			    (f->if_nextents == files[top[i]].if_nextents &&
+			     f->if_nblocks > files[top[i]].if_nblocks)) {
+				break;
+			}
+		}
+		if (i == FRAGTOP) {
+			continue;
+		}
+		if (ntop < FRAGTOP) {
+			ntop++;
+		}
+		for (j=ntop-1; j>i; j--) {
+			top[j] = top[j-1];
+		}
+		top[i] = ix;
+	}
+
+	run = 0;
+	for (b=0; b<fsblocks; b++) {
+		if (blockkind[b] == BK_DATA) {
+			datablocks++;
+		}
+		if (blockkind[b] == BK_FREE && bitmap_isset(b)) {
+			leaked++;
+		}
+		if (blockkind[b] != BK_FREE && !bitmap_isset(b)) {
+			unmarked++;
+		}
+		if (!bitmap_isset(b)) {
+			nfree++;
+			if (run == 0) {
+				freeextents++;
+			}
+			run++;
+			if (run > largestfree) {
+				largestfree = run;
+			}
+		}
+		else {
+			run = 0;
+		}
+	}
+
+	/* directories are counted in the totals but not the average */
+	avg = nregular ? (unsigned)(fileextents * 100 / nregular) : 0;
+	printf("Files: %u, directories: %u\n", nregular, ndirs);
+	printf("Data blocks: %llu in %llu extents "
+	       "(%u.%02u extents per file)\n",
+	       (unsigned long long) datablocks, (unsigned long long) extents,
+	       avg / 100, avg % 100);
+	printf("Fragmented (more than one extent): %u\n", nfragmented);
+	printf("Free blocks: %u in %u extents, largest %u\n",
+	       nfree, freeextents, largestfree);
+	if (leaked > 0 || unmarked > 0) {
+		printf("Freemap disagrees: %u leaked, %u in use but "
+		       "marked free\n", leaked, unmarked);
+	}
+	if (ntop > 0) {
+		printf("Most fragmented:\n");
+		printf("  extents  blocks  path\n");
+		for (i=0; i<ntop; i++) {
+			printf("  %7u  %6u  ", files[top[i]].if_nextents,
+			       files[top[i]].if_nblocks);
+			printpath(top[i]);
+			printf("\n");
+		}
+	}
+}
+
+/* Find PATH in the index; returns IX_NONE if it isn't there. */
+static
+unsigned
+lookup(const char *path)
+{
+	char buf[SFS_NAMELEN];
+	const char *s;
+	size_t len;
+	unsigned ix = 0, child;
+
+	while (*path != 0) {
+		while (*path == '/') {
+			path++;
+		}
+		if (*path == 0) {
+			break;
+		}
+		s = strchr(path, '/');
+		len = s ? (size_t)(s - path) : strlen(path);
+		if (len >= sizeof(buf)) {
+			return IX_NONE;
+		}
+		memcpy(buf, path, len);
+		buf[len] = 0;
+		path += len;
+
+		if (!strcmp(buf, ".")) {
+			continue;
+		}
+		if (!strcmp(buf, "..")) {
+			if (files[ix].if_parent != IX_NONE) {
+				ix = files[ix].if_parent;
+			}
+			continue;
+		}
+		for (child = files[ix].if_child; child != IX_NONE;
+		     child = files[child].if_sibling) {
+			if (!strcmp(files[child].if_name, buf)) {
+				break;
+			}
+		}
+		if (child == IX_NONE) {
+			return IX_NONE;
+		}
+		ix = child;
+	}
+	return ix;
+}
+
+/*
+ * Like du: print the blocks used under each directory, deepest
+ * first. Hard-linked files count once, under whichever of their
+ * names is reached first.
+ */
+static
+uint32_t
+du(unsigned ix, unsigned mark)
+{
+	uint32_t total;
+	unsigned child;
+
+	if (files[ix].if_target != IX_NONE) {
+		return du(files[ix].if_target, mark);
+	}
+	if (files[ix].if_mark == mark) {
+		return 0;
+	}
+	files[ix].if_mark = mark;
+	total = files[ix].if_nblocks;
+
+	for (child = files[ix].if_child; child != IX_NONE;
+	     child = files[child].if_sibling) {
+		total += du(child, mark);
+	}
+	if (files[ix].if_type == SFS_TYPE_DIR) {
+		printf("%u\t", total);
+		printpath(ix);
+		printf("\n");
+	}
+	return total;
+}
+
+static
+void
+query_du(const char *path)
+{
+	static unsigned mark;
+	unsigned ix;
+
+	ix = lookup(path);
+	if (ix == IX_NONE) {
+		errx(1, "%s: No such file or directory", path);
+	}
+	if (files[ix].if_target != IX_NONE) {
+		/* a hard link; print it under the name we were given */
+		printf("%u\t", files[files[ix].if_target].if_nblocks);
+		printpath(ix);
+		printf("\n");
+		return;
+	}
+	if (files[ix].if_type != SFS_TYPE_DIR) {
+		printf("%u\t", files[ix].if_nblocks);
+		printpath(ix);
+		printf("\n");
+		return;
+	}
+	du(ix, ++mark);
+}
+
+////////////////////////////////////////////////////////////
+
+#define USAGE "Usage: dumpsfs [--owner block] [--frag-report] [--du path] " \
+	"device/diskfile"
+
+#define MAXQUERIES 16
+
 int
 main(int argc, char **argv)
 {
 	uint32_t nblocks;
+	const char *queries[MAXQUERIES], *args[MAXQUERIES];
+	unsigned nqueries = 0, i;
 
 #ifdef HOST
 	hostcompat_init(argc, argv);
 #endif
 
+	/* queries are answered in the order given */
+	while (argc > 2 && argv[1][0] == '-' && argv[1][1] == '-') {
+		if (nqueries == MAXQUERIES) {
+			errx(1, "Too many queries");
+		}
+		queries[nqueries] = argv[1];
+		if (!strcmp(argv[1], "--frag-report")) {
+			args[nqueries] = NULL;
+			argc--;
+			argv++;
+		}
+		else if (!strcmp(argv[1], "--owner") ||
+			 !strcmp(argv[1], "--du")) {
+			if (argc < 4) {
+				errx(1, "%s", USAGE);
+			}
+			args[nqueries] = argv[2];
+			argc -= 2;
+			argv += 2;
+		}
+		else {
+			errx(1, "%s", USAGE);
+		}
+		nqueries++;
+	}
+
 	if (argc!=2) {
-		errx(1, "Usage: dumpsfs device/diskfile");
+		errx(1, "%s", USAGE);
 	}
 
 	opendisk(argv[1]);
 	nblocks = dumpsb();
-	dumpbits(nblocks);
-	dumpdir(SFS_ROOT_LOCATION);
+
+	if (nqueries == 0) {
+		dumpbits(nblocks);
+		dumpdir(SFS_ROOT_LOCATION);
+	}
+	else {
+		buildindex(nblocks);
+		for (i=0; i<nqueries; i++) {
+			if (!strcmp(queries[i], "--owner")) {
+				query_owner(atoi(args[i]));
+			}
+			else if (!strcmp(queries[i], "--frag-report")) {
+				query_frag();
+			}
+			else {
+				query_du(args[i]);
+			}
+		}
+	}
 
 	closedisk();
 
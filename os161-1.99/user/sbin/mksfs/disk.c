@@ -37,6 +37,10 @@
 #include <fcntl.h>
 #include <err.h>
 
+#ifdef HOST
+#include <sys/mman.h>
+#endif
+
 #include "support.h"
 #include "disk.h"
 
@@ -50,6 +54,12 @@
 static int fd=-1;
 static uint32_t nblocks;
 
+#ifdef HOST
+/* The whole image, header included, once diskmap has been called. */
+static char *mapbase;
+static size_t maplen;
+#endif
+
 void
 opendisk(const char *path)
 {
@@ -90,6 +100,75 @@ opendisk(const char *path)
 #endif
 }
 
+#ifdef HOST
+/*
+ * Create a fresh disk image of NBLOCKS blocks at PATH, replacing
+ * whatever was there. Only the header is written; the rest is set
+ * with ftruncate, so the image starts out sparse and reads as zeros.
+ */
+void
+makedisk(const char *path, uint32_t nblocks)
+{
+	char header[BLOCKSIZE];
+	int mfd;
+	ssize_t len;
+
+	mfd = open(path, O_RDWR|O_CREAT|O_TRUNC, 0664);
+	if (mfd<0) {
+		err(1, "%s", path);
+	}
+
+	memset(header, 0, sizeof(header));
+	strcpy(header, HOSTSTRING);
+	do {
+		len = write(mfd, header, sizeof(header));
+	} while (len < 0 && (errno==EINTR || errno==EAGAIN));
+	if (len < 0) {
+		err(1, "%s: write", path);
+	}
+	if (len != sizeof(header)) {
+		errx(1, "%s: short write", path);
+	}
+
+	if (ftruncate(mfd, ((off_t)nblocks+1) * BLOCKSIZE)) {
+		err(1, "%s: ftruncate", path);
+	}
+	if (close(mfd)) {
+		err(1, "%s: close", path);
+	}
+}
+#endif
+
+/*
+ * Map the image into memory so diskread and diskwrite don't need a
+ * pair of system calls per block. This also makes them safe to call
+ * from several threads at once. Only host builds can do it; returns
+ * -1 (and everything keeps going through read and write) otherwise.
+ */
+int
+diskmap(void)
+{
+#ifdef HOST
+	void *p;
+
+	assert(fd>=0);
+	if (mapbase != NULL) {
+		return 0;
+	}
+	diskflush();
+	maplen = (size_t)(nblocks+1) * BLOCKSIZE;
+	p = mmap(NULL, maplen, PROT_READ|PROT_WRITE, MAP_SHARED, fd, 0);
+	if (p == MAP_FAILED) {
+		return -1;
+	}
+	mapbase = p;
+	return 0;
+#else
+	assert(fd>=0);
+	return -1;
+#endif
+}
+
 uint32_t
 diskblocksize(void)
 {
@@ -104,26 +183,29 @@ diskblocks(void)
 	return nblocks;
 }
 
+/*
+ * Write COUNT consecutive blocks starting at BLOCK with one seek and
+ * (usually) one write.
+ */
+static
 void
-diskwrite(const void *data, uint32_t block)
+writeblocks(const void *data, uint32_t block, uint32_t count)
 {
 	const char *cdata = data;
-	uint32_t tot=0;
-	int len;
-
-	assert(fd>=0);
+	size_t tot=0, amount = (size_t)count * BLOCKSIZE;
+	ssize_t len;
 
 #ifdef HOST
 	// skip over disk file header
 	block++;
 #endif
 
-	if (lseek(fd, block*BLOCKSIZE, SEEK_SET)<0) {
+	if (lseek(fd, (off_t)block*BLOCKSIZE, SEEK_SET)<0) {
 		err(1, "lseek");
 	}
 
-	while (tot < BLOCKSIZE) {
-		len = write(fd, cdata + tot, BLOCKSIZE - tot);
+	while (tot < amount) {
+		len = write(fd, cdata + tot, amount - tot);
 		if (len < 0) {
 			if (errno==EINTR || errno==EAGAIN) {
 				continue;
@@ -137,6 +219,54 @@ diskwrite(const void *data, uint32_t block)
 	}
 }
 
+/*
+ * Writes are gathered up while they go to consecutive blocks, and
+ * go to disk as one large write when the run breaks, the buffer
+ * fills, or someone reads or closes the disk. mksfs allocates blocks
+ * in order, so nearly everything it writes ends up batched.
+ */
+#define BATCHBLOCKS 128
+
+static char batchbuf[BATCHBLOCKS*BLOCKSIZE];
+static uint32_t batchstart, batchcount;
+
+void
+diskflush(void)
+{
+	assert(fd>=0);
+	if (batchcount > 0) {
+		writeblocks(batchbuf, batchstart, batchcount);
+		batchcount = 0;
+	}
+}
+
+void
+diskwrite(const void *data, uint32_t block)
+{
+	assert(fd>=0);
+
+#ifdef HOST
+	if (mapbase != NULL) {
+		if (block >= nblocks) {
+			errx(1, "write: block %lu past end of disk",
+			     (unsigned long) block);
+		}
+		memcpy(mapbase + (size_t)(block+1)*BLOCKSIZE, data, BLOCKSIZE);
+		return;
+	}
+#endif
+
+	if (batchcount > 0 && (block != batchstart + batchcount ||
+			       batchcount == BATCHBLOCKS)) {
+		diskflush();
+	}
+	if (batchcount == 0) {
+		batchstart = block;
+	}
+	memcpy(batchbuf + batchcount*BLOCKSIZE, data, BLOCKSIZE);
+	batchcount++;
+}
+
 void
 diskread(void *data, uint32_t block)
 {
@@ -146,12 +276,26 @@ diskread(void *data, uint32_t block)
 
 	assert(fd>=0);
 
+#ifdef HOST
+	if (mapbase != NULL) {
+		if (block >= nblocks) {
+			errx(1, "read: block %lu past end of disk",
+			     (unsigned long) block);
+		}
+		memcpy(data, mapbase + (size_t)(block+1)*BLOCKSIZE, BLOCKSIZE);
+		return;
+	}
+#endif
+
+	/* make sure we see anything still waiting to be written */
+	diskflush();
+
 #ifdef HOST
 	// skip over disk file header
 	block++;
 #endif
 
-	if (lseek(fd, block*BLOCKSIZE, SEEK_SET)<0) {
+	if (lseek(fd, (off_t)block*BLOCKSIZE, SEEK_SET)<0) {
 		err(1, "lseek");
 	}
 
@@ -174,6 +318,18 @@ void
 closedisk(void)
 {
 	assert(fd>=0);
+	diskflush();
+#ifdef HOST
+	if (mapbase != NULL) {
+		if (msync(mapbase, maplen, MS_SYNC)) {
+			err(1, "msync");
+		}
+		if (munmap(mapbase, maplen)) {
+			err(1, "munmap");
+		}
+		mapbase = NULL;
+	}
+#endif
 	if (close(fd)) {
 		err(1, "close");
 	}
@@ -28,11 +28,17 @@
  */
 
 void opendisk(const char *path);
+#ifdef HOST
+void makedisk(const char *path, uint32_t nblocks);
+#endif
+
+int diskmap(void);
 
 uint32_t diskblocksize(void);
 uint32_t diskblocks(void);
 
 void diskwrite(const void *data, uint32_t block);
 void diskread(void *data, uint32_t block);
+void diskflush(void);
 
 void closedisk(void);
@@ -42,6 +42,13 @@
 
 #include <netinet/in.h> // for arpa/inet.h
 #include <arpa/inet.h>  // for ntohl
+#include <sys/stat.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <errno.h>
 #include "hostcompat.h"
 #define SWAPL(x) ntohl(x)
 #define SWAPS(x) ntohs(x)
@@ -57,6 +64,12 @@
 
 #define MAXBITBLOCKS 32
 
+#ifdef HOST
+#define USAGE "Usage: mksfs [-s size] [-d hostdir] device/diskfile volume-name"
+#else
+#define USAGE "Usage: mksfs device/diskfile volume-name"
+#endif
+
 static
 void
 check(void)
@@ -113,14 +126,16 @@ doallocbit(uint32_t bit)
 	bitbuf[byte] |= mask;
 }
 
+/*
+ * Mark the blocks that are always in use: superblock, root inode,
+ * the bitmap itself, and the bits past the end of the volume.
+ */
 static
 void
-writebitmap(uint32_t fsblocks)
+initbitmap(uint32_t fsblocks)
 {
-
 	uint32_t nbits = SFS_BITMAPSIZE(fsblocks);
 	uint32_t nblocks = SFS_BITBLOCKS(fsblocks);
-	char *ptr;
 	uint32_t i;
 
 	if (nblocks > MAXBITBLOCKS) {
@@ -136,6 +151,15 @@ writebitmap(uint32_t fsblocks)
 	for (i=fsblocks; i<nbits; i++) {
 		doallocbit(i);
 	}
+}
+
+static
+void
+writebitmap(uint32_t fsblocks)
+{
+	uint32_t nblocks = SFS_BITBLOCKS(fsblocks);
+	char *ptr;
+	uint32_t i;
 
 	for (i=0; i<nblocks; i++) {
 		ptr = bitbuf + i*SFS_BLOCKSIZE;
@@ -143,18 +167,401 @@ writebitmap(uint32_t fsblocks)
 	}
 }
 
+#ifdef HOST
+
+////////////////////////////////////////////////////////////
+// Prepopulating from a host directory
+
+/* Largest file an inode can describe. */
+#define MAXFILEBLOCKS (SFS_NDIRECT + SFS_DBPERIDB)
+
+static uint32_t allocnext, allocmax;
+
+/*
+ * Blocks are handed out in order, so each file's inode and data
+ * come out adjacent and diskwrite can send them as one write.
+ */
+static
+uint32_t
+allocblock(void)
+{
+	uint32_t block;
+
+	while (allocnext < allocmax) {
+		block = allocnext++;
+		if ((bitbuf[block/CHAR_BIT] & (1<<(block % CHAR_BIT))) == 0) {
+			doallocbit(block);
+			return block;
+		}
+	}
+	errx(1, "Filesystem full");
+	return 0;
+}
+
+static
+void *
+domalloc(size_t len)
+{
+	void *x;
+
+	x = malloc(len);
+	if (x == NULL) {
+		errx(1, "Out of memory");
+	}
+	return x;
+}
+
+/*
+ * Write inode INO, and SIZE bytes of DATA as its contents. DATA must
+ * be padded with zeros out to a whole number of blocks.
+ */
+static
+void
+writeinode(uint32_t ino, uint16_t type, uint16_t linkcount,
+	   const char *data, uint32_t size, const char *what)
+{
+	struct sfs_inode sfi;
+	uint32_t indir[SFS_DBPERIDB];
+	uint32_t blocks[MAXFILEBLOCKS];
+	uint32_t nb, i, indirblock = 0;
+
+	nb = SFS_ROUNDUP(size, SFS_BLOCKSIZE) / SFS_BLOCKSIZE;
+	if (nb > MAXFILEBLOCKS) {
+		errx(1, "%s: Too large for SFS (max %u bytes)", what,
+		     MAXFILEBLOCKS * SFS_BLOCKSIZE);
+	}
+
+	bzero((void *)&sfi, sizeof(sfi));
+	bzero((void *)indir, sizeof(indir));
+	for (i=0; i<nb; i++) {
+		if (i == SFS_NDIRECT) {
+			indirblock = allocblock();
+		}
+		blocks[i] = allocblock();
+		if (i < SFS_NDIRECT) {
+			sfi.sfi_direct[i] = SWAPL(blocks[i]);
+		}
+		else {
+			indir[i - SFS_NDIRECT] = SWAPL(blocks[i]);
+		}
+	}
+	sfi.sfi_size = SWAPL(size);
+	sfi.sfi_type = SWAPS(type);
+	sfi.sfi_linkcount = SWAPS(linkcount);
+	sfi.sfi_indirect = SWAPL(indirblock);
+
+	/* in allocation order, to keep the batches going */
+	diskwrite(&sfi, ino);
+	for (i=0; i<nb; i++) {
+		if (i == SFS_NDIRECT) {
+			diskwrite(indir, indirblock);
+		}
+		diskwrite(data + i*SFS_BLOCKSIZE, blocks[i]);
+	}
+}
+
+static
+void
+populate_file(const char *path, uint32_t ino, const struct stat *st)
+{
+	char *data;
+	size_t size, tot;
+	ssize_t len;
+	int fd;
+
+	if (st->st_size > MAXFILEBLOCKS * SFS_BLOCKSIZE) {
+		errx(1, "%s: Too large for SFS (max %u bytes)", path,
+		     MAXFILEBLOCKS * SFS_BLOCKSIZE);
+	}
+	size = st->st_size;
+
+	fd = open(path, O_RDONLY);
+	if (fd < 0) {
+		err(1, "%s", path);
+	}
+	/* (+1 so empty files don't ask for zero bytes) */
+	data = domalloc(SFS_ROUNDUP(size, SFS_BLOCKSIZE) + 1);
+	bzero(data, SFS_ROUNDUP(size, SFS_BLOCKSIZE) + 1);
+	for (tot = 0; tot < size; tot += len) {
+		len = read(fd, data + tot, size - tot);
+		if (len < 0) {
+			if (errno==EINTR || errno==EAGAIN) {
+				len = 0;
+				continue;
+			}
+			err(1, "%s: read", path);
+		}
+		if (len == 0) {
+			errx(1, "%s: File shrank while reading", path);
+		}
+	}
+	close(fd);
+
+	writeinode(ino, SFS_TYPE_FILE, 1, data, size, path);
+	free(data);
+}
+
+static
+int
+namecmp(const void *a, const void *b)
+{
+	return strcmp(*(char *const *)a, *(char *const *)b);
+}
+
+/*
+ * Copy the host directory PATH into directory inode INO. Names are
+ * sorted so the same tree always gives the same image.
+ */
+static
+void
+populate_dir(const char *path, uint32_t ino, uint32_t parentino)
+{
+	DIR *dir;
+	struct dirent *de;
+	struct stat st;
+	char **names, *sub;
+	struct sfs_dir *ents;
+	unsigned nnames, maxnames, nents, subdirs, i;
+	uint32_t child;
+
+	dir = opendir(path);
+	if (dir == NULL) {
+		err(1, "%s", path);
+	}
+	nnames = 0;
+	maxnames = 16;
+	names = domalloc(maxnames * sizeof(char *));
+	while ((de = readdir(dir)) != NULL) {
+		if (!strcmp(de->d_name, ".") || !strcmp(de->d_name, "..")) {
+			continue;
+		}
+		if (strlen(de->d_name) >= SFS_NAMELEN) {
+			errx(1, "%s/%s: Name too long for SFS", path,
+			     de->d_name);
+		}
+		if (nnames == maxnames) {
+			maxnames *= 2;
+			names = realloc(names, maxnames * sizeof(char *));
+			if (names == NULL) {
+				errx(1, "Out of memory");
+			}
+		}
+		names[nnames] = domalloc(strlen(de->d_name) + 1);
+		strcpy(names[nnames], de->d_name);
+		nnames++;
+	}
+	closedir(dir);
+	qsort(names, nnames, sizeof(char *), namecmp);
+
+	ents = domalloc(SFS_ROUNDUP((nnames+2) * sizeof(struct sfs_dir),
+				    SFS_BLOCKSIZE));
+	bzero(ents, SFS_ROUNDUP((nnames+2) * sizeof(struct sfs_dir),
+				SFS_BLOCKSIZE));
+	ents[0].sfd_ino = SWAPL(ino);
+	strcpy(ents[0].sfd_name, ".");
+	ents[1].sfd_ino = SWAPL(parentino);
+	strcpy(ents[1].sfd_name, "..");
+	nents = 2;
+	subdirs = 0;
+
+	for (i=0; i<nnames; i++) {
+		sub = domalloc(strlen(path) + strlen(names[i]) + 2);
+		sprintf(sub, "%s/%s", path, names[i]);
+		if (lstat(sub, &st)) {
+			err(1, "%s", sub);
+		}
+		if (S_ISDIR(st.st_mode)) {
+			child = allocblock();
+			populate_dir(sub, child, ino);
+			subdirs++;
+		}
+		else if (S_ISREG(st.st_mode)) {
+			child = allocblock();
+			populate_file(sub, child, &st);
+		}
+		else {
+			warnx("%s: Not a file or directory; skipped", sub);
+			free(sub);
+			free(names[i]);
+			continue;
+		}
+		ents[nents].sfd_ino = SWAPL(child);
+		strcpy(ents[nents].sfd_name, names[i]);
+		nents++;
+		free(sub);
+		free(names[i]);
+	}
+	free(names);
+
+	writeinode(ino, SFS_TYPE_DIR, subdirs+2, (const char *)ents,
+		   nents * sizeof(struct sfs_dir), path);
+	free(ents);
+}
+
+/*
+ * Blocks needed for an inode with SIZE bytes of contents: the inode,
+ * the data, and the indirect block if there is one.
+ */
+static
+uint64_t
+inodeblocks(uint64_t size, const char *what)
+{
+	uint64_t nb;
+
+	nb = SFS_ROUNDUP(size, SFS_BLOCKSIZE) / SFS_BLOCKSIZE;
+	if (nb > MAXFILEBLOCKS) {
+		errx(1, "%s: Too large for SFS (max %u bytes)", what,
+		     MAXFILEBLOCKS * SFS_BLOCKSIZE);
+	}
+	return 1 + nb + (nb > SFS_NDIRECT ? 1 : 0);
+}
+
+/*
+ * Walk the host tree at PATH the way populate_dir will, rejecting
+ * anything SFS can't hold, and return how many blocks it will take.
+ * This runs before the image is touched, so a tree that won't fit
+ * doesn't leave a half-written image behind.
+ */
+static
+uint64_t
+checktree(const char *path)
+{
+	DIR *dir;
+	struct dirent *de;
+	struct stat st;
+	char *sub;
+	uint64_t blocks;
+	unsigned nents;
+
+	dir = opendir(path);
+	if (dir == NULL) {
+		err(1, "%s", path);
+	}
+	blocks = 0;
+	nents = 2;
+	while ((de = readdir(dir)) != NULL) {
+		if (!strcmp(de->d_name, ".") || !strcmp(de->d_name, "..")) {
+			continue;
+		}
+		if (strlen(de->d_name) >= SFS_NAMELEN) {
+			errx(1, "%s/%s: Name too long for SFS", path,
+			     de->d_name);
+		}
+		sub = domalloc(strlen(path) + strlen(de->d_name) + 2);
+		sprintf(sub, "%s/%s", path, de->d_name);
+		if (lstat(sub, &st)) {
+			err(1, "%s", sub);
+		}
+		if (S_ISDIR(st.st_mode)) {
+			blocks += checktree(sub);
+			nents++;
+		}
+		else if (S_ISREG(st.st_mode)) {
+			blocks += inodeblocks(st.st_size, sub);
+			nents++;
+		}
+		free(sub);
+	}
+	closedir(dir);
+
+	return blocks + inodeblocks(nents * sizeof(struct sfs_dir), path);
+}
+
+/* Make sure NEEDED blocks fit in a volume of FSBLOCKS. */
+static
+void
+checkfit(const char *hostdir, uint64_t needed, uint32_t fsblocks)
+{
+	uint32_t avail;
+
+	avail = fsblocks - (SFS_MAP_LOCATION + SFS_BITBLOCKS(fsblocks));
+	if (needed > avail) {
+		errx(1, "%s: Needs %llu blocks, but the volume only has %lu "
+		     "free", hostdir, (unsigned long long)needed,
+		     (unsigned long)avail);
+	}
+}
+
+static
+void
+populate(const char *hostdir, uint32_t fsblocks)
+{
+	allocnext = SFS_MAP_LOCATION + SFS_BITBLOCKS(fsblocks);
+	allocmax = fsblocks;
+	populate_dir(hostdir, SFS_ROOT_LOCATION, SFS_ROOT_LOCATION);
+}
+
+/*
+ * Parse an image size: a number of bytes, optionally followed by
+ * K, M, or G. Rounded down to whole blocks.
+ */
+static
+uint32_t
+parsesize(const char *str)
+{
+	unsigned long long val;
+	char *end;
+
+	errno = 0;
+	val = strtoull(str, &end, 0);
+	if (errno || end == str) {
+		errx(1, "Invalid size %s", str);
+	}
+	switch (*end) {
+	    case 'g': case 'G': val *= 1024;	/* FALLTHROUGH */
+	    case 'm': case 'M': val *= 1024;	/* FALLTHROUGH */
+	    case 'k': case 'K': val *= 1024; end++; break;
+	    case 0: break;
+	    default: errx(1, "Invalid size %s", str);
+	}
+	if (*end != 0) {
+		errx(1, "Invalid size %s", str);
+	}
+	val /= SFS_BLOCKSIZE;
+	if (val < SFS_MAP_LOCATION + 1 || val > 0xffffffffULL) {
+		errx(1, "Size %s out of range", str);
+	}
+	return val;
+}
+
+#endif /* HOST */
+
 int
 main(int argc, char **argv)
 {
 	uint32_t size, blocksize;
 	char *volname, *s;
+#ifdef HOST
+	uint32_t imagesize = 0;
+	const char *hostdir = NULL;
+	uint64_t treeblocks = 0;
+#endif
 
 #ifdef HOST
 	hostcompat_init(argc, argv);
 #endif
 
+	/*
+	 * Host builds can also create the image (-s size, sparse) and
+	 * copy a host directory tree into it (-d dir).
+	 */
+	while (argc > 1 && argv[1][0] == '-') {
+		if (argc < 3 || argv[1][1] == 0 || argv[1][2] != 0) {
+			errx(1, "%s", USAGE);
+		}
+		switch (argv[1][1]) {
+#ifdef HOST
+		    case 's': imagesize = parsesize(argv[2]); break;
+		    case 'd': hostdir = argv[2]; break;
+#endif
+		    default: errx(1, "%s", USAGE);
+		}
+		argc -= 2;
+		argv += 2;
+	}
+
 	if (argc!=3) {
-		errx(1, "Usage: mksfs device/diskfile volume-name");
+		errx(1, "%s", USAGE);
 	}
 
 	check();
@@ -176,6 +583,23 @@ main(int argc, char **argv)
 		errx(1, "Illegal volume name %s", volname);
 	}
 
+#ifdef HOST
+	if (hostdir != NULL) {
+		/* less the root inode, which has its own reserved block */
+		treeblocks = checktree(hostdir) - 1;
+	}
+	if (imagesize > 0) {
+		/* check before clobbering anything */
+		if (SFS_BITBLOCKS(imagesize) > MAXBITBLOCKS) {
+			errx(1, "Filesystem too large "
+			     "- increase MAXBITBLOCKS and recompile");
+		}
+		if (hostdir != NULL) {
+			checkfit(hostdir, treeblocks, imagesize);
+		}
+		makedisk(argv[1], imagesize);
+	}
+#endif
 	opendisk(argv[1]);
 	blocksize = diskblocksize();
 
@@ -185,8 +609,24 @@ main(int argc, char **argv)
 	}
 	size = diskblocks();
 
+#ifdef HOST
+	if (hostdir != NULL) {
+		checkfit(hostdir, treeblocks, size);
+	}
+#endif
+
+	initbitmap(size);
 	writesuper(volname, size);
+#ifdef HOST
+	if (hostdir != NULL) {
+		populate(hostdir, size);
+	}
+	else {
+		writerootdir();
+	}
+#else
 	writerootdir();
+#endif
 	writebitmap(size);
 
 	closedisk();
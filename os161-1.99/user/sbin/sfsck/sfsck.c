@@ -42,9 +42,12 @@
 #ifdef HOST
 #include <netinet/in.h> // for arpa/inet.h
 #include <arpa/inet.h>  // for ntohl
+#include <pthread.h>
+#include <unistd.h>     // for sysconf
 #include "hostcompat.h"
 #define SWAPL(x) ntohl(x)
 #define SWAPS(x) ntohs(x)
+#define USE_THREADS
 
 #else
 
@@ -64,15 +67,27 @@
 #define EXIT_RECOV    1
 #define EXIT_CLEAN    0
 
+#define MAXWORKERS    64
+
 static int badness=0;
 
+#ifdef USE_THREADS
+static pthread_mutex_t badness_lock = PTHREAD_MUTEX_INITIALIZER;
+#endif
+
 static
 void
 setbadness(int code)
 {
+#ifdef USE_THREADS
+	pthread_mutex_lock(&badness_lock);
+#endif
 	if (badness < code) {
 		badness = code;
 	}
+#ifdef USE_THREADS
+	pthread_mutex_unlock(&badness_lock);
+#endif
 }
 
 ////////////////////////////////////////////////////////////
@@ -183,44 +198,64 @@ typedef enum {
 static uint32_t nblocks, bitblocks;
 static uint32_t uniquecounter = 1;
 
-static unsigned long count_blocks=0, count_dirs=0, count_files=0;
+static unsigned long count_dirs=0, count_files=0;
 
 ////////////////////////////////////////////////////////////
 
-static uint8_t *bitmapdata;
-static uint8_t *tofreedata;
+/*
+ * A map of the blocks we've found in use, to check the on-disk
+ * bitmap against. Everything the directory walk finds goes in
+ * mainmap. When file blocks are checked by more than one worker,
+ * each worker marks its own map and they're merged into mainmap
+ * afterwards (see blockmap_merge).
+ */
+struct blockmap {
+	uint8_t *used;		/* blocks found in use */
+	uint8_t *tofree;	/* blocks being released */
+	unsigned long count;	/* blocks marked, except B_PASTEND */
+};
+
+static struct blockmap mainmap;
 
 static
 void
-bitmap_init(uint32_t bitblocks)
+blockmap_init(struct blockmap *map)
 {
 	size_t i, mapsize = bitblocks * SFS_BLOCKSIZE;
-	bitmapdata = domalloc(mapsize * sizeof(uint8_t));
-	tofreedata = domalloc(mapsize * sizeof(uint8_t));
+	map->used = domalloc(mapsize * sizeof(uint8_t));
+	map->tofree = domalloc(mapsize * sizeof(uint8_t));
 	for (i=0; i<mapsize; i++) {
-		bitmapdata[i] = tofreedata[i] = 0;
+		map->used[i] = map->tofree[i] = 0;
 	}
+	map->count = 0;
+}
+
+static
+void
+blockmap_cleanup(struct blockmap *map)
+{
+	free(map->used);
+	free(map->tofree);
 }
 
 static
 const char *
-blockusagestr(blockusage_t how, uint32_t howdesc)
+blockusagestr(blockusage_t how, uint32_t howdesc, char *rv, size_t rvlen)
 {
-	static char rv[256];
 	switch (how) {
 	    case B_SUPERBLOCK: return "superblock";
 	    case B_BITBLOCK: return "bitmap block";
 	    case B_INODE: return "inode";
 	    case B_IBLOCK: 
-		snprintf(rv, sizeof(rv), "indirect block of inode %lu", 
+		snprintf(rv, rvlen, "indirect block of inode %lu", 
 			 (unsigned long) howdesc);
 		break;
 	    case B_DIRDATA:
-		snprintf(rv, sizeof(rv), "directory data from inode %lu", 
+		snprintf(rv, rvlen, "directory data from inode %lu", 
 			 (unsigned long) howdesc);
 		break;
 	    case B_DATA:
-		snprintf(rv, sizeof(rv), "file data from inode %lu", 
+		snprintf(rv, rvlen, "file data from inode %lu", 
 			 (unsigned long) howdesc);
 		break;
 	    case B_TOFREE:
@@ -234,40 +269,76 @@ blockusagestr(blockusage_t how, uint32_t howdesc)
 
 static
 void
-bitmap_mark(uint32_t block, blockusage_t how, uint32_t howdesc)
+bitmap_mark(struct blockmap *map, uint32_t block, blockusage_t how,
+	    uint32_t howdesc)
 {
 	unsigned index = block/8;
 	uint8_t mask = ((uint8_t)1)<<(block%8);
+	char desc[64];
 
 	if (how == B_TOFREE) {
-		if (tofreedata[index] & mask) {
+		if (map->tofree[index] & mask) {
 			/* already marked to free once, ignore */
 			return;
 		}
-		if (bitmapdata[index] & mask) {
+		if (map->used[index] & mask) {
 			/* block is used elsewhere, ignore */
 			return;
 		}
-		tofreedata[index] |= mask;
+		map->tofree[index] |= mask;
 		return;
 	}
 
-	if (tofreedata[index] & mask) {
+	if (map->tofree[index] & mask) {
 		/* really using the block, don't free it */
-		tofreedata[index] &= ~mask;
+		map->tofree[index] &= ~mask;
 	}
 
-	if (bitmapdata[index] & mask) {
+	if (map->used[index] & mask) {
 		warnx("Block %lu (used as %s) already in use! (NOT FIXED)",
-		      (unsigned long) block, blockusagestr(how, howdesc));
+		      (unsigned long) block,
+		      blockusagestr(how, howdesc, desc, sizeof(desc)));
 		setbadness(EXIT_UNRECOV);
 	}
 
-	bitmapdata[index] |= mask;
+	map->used[index] |= mask;
 
 	if (how != B_PASTEND) {
-		count_blocks++;
+		map->count++;
+	}
+}
+
+/*
+ * Fold a worker's map into mainmap. A block both maps have in use
+ * was claimed twice; we no longer know by whom the first time, only
+ * that the worker's use was for a file. Blocks stay marked to free
+ * only if nobody ended up using them, which is the same answer
+ * bitmap_mark gives whatever order the marks come in.
+ */
+static
+void
+blockmap_merge(struct blockmap *to, const struct blockmap *from)
+{
+	size_t i, mapsize = bitblocks * SFS_BLOCKSIZE;
+	uint8_t dup;
+	unsigned bit;
+
+	for (i=0; i<mapsize; i++) {
+		dup = to->used[i] & from->used[i];
+		for (bit=0; dup != 0; bit++, dup >>= 1) {
+			if (dup & 1) {
+				warnx("Block %lu (used as file data or "
+				      "indirect block) already in use! "
+				      "(NOT FIXED)",
+				      (unsigned long) (i*CHAR_BIT + bit));
+				setbadness(EXIT_UNRECOV);
+			}
+		}
+		to->used[i] |= from->used[i];
+		to->tofree[i] = (to->tofree[i] | from->tofree[i]) &
+			~to->used[i];
 	}
+	to->count += from->count;
 }
 
 static
@@ -299,64 +370,177 @@ reportbits(uint32_t bitblock, uint32_t byte, uint8_t val, const char *what)
 	}
 }
 
+/*
+ * Check one block of the on-disk bitmap against what we found, and
+ * fix it. Counts of blocks wrongly shown free and wrongly shown
+ * allocated are added to *ALLOCP and *FREEP.
+ */
 static
 void
-check_bitmap(void)
+check_bitmap_block(uint32_t i, uint32_t *allocp, uint32_t *freep)
 {
 	uint8_t bits[SFS_BLOCKSIZE], *found, *tofree, tmp;
-	uint32_t alloccount=0, freecount=0, i, j;
+	uint32_t j;
 	int bchanged;
 
-	for (i=0; i<bitblocks; i++) {
-		diskread(bits, SFS_MAP_LOCATION+i);
-		swapbits(bits);
-		found = bitmapdata + i*SFS_BLOCKSIZE;
-		tofree = tofreedata + i*SFS_BLOCKSIZE;
-		bchanged = 0;
+	diskread(bits, SFS_MAP_LOCATION+i);
+	swapbits(bits);
+	found = mainmap.used + i*SFS_BLOCKSIZE;
+	tofree = mainmap.tofree + i*SFS_BLOCKSIZE;
+	bchanged = 0;
 
-		for (j=0; j<SFS_BLOCKSIZE; j++) {
-			/* we shouldn't have blocks marked both ways */
-			assert((found[j] & tofree[j])==0);
+	for (j=0; j<SFS_BLOCKSIZE; j++) {
+		/* we shouldn't have blocks marked both ways */
+		assert((found[j] & tofree[j])==0);
 
-			if (bits[j]==found[j]) {
-				continue;
-			}
+		if (bits[j]==found[j]) {
+			continue;
+		}
 
-			if (bits[j]==(found[j] | tofree[j])) {
-				bits[j] = found[j];
-				bchanged = 1;
-				continue;
-			}
+		if (bits[j]==(found[j] | tofree[j])) {
+			bits[j] = found[j];
+			bchanged = 1;
+			continue;
+		}
 
-			/* free the ones we're freeing */
-			bits[j] &= ~tofree[j];
+		/* free the ones we're freeing */
+		bits[j] &= ~tofree[j];
 
-			/* are we short any? */
-			if ((bits[j] & found[j]) != found[j]) {
-				tmp = found[j] & ~bits[j];
-				alloccount += countbits(tmp);
-				if (tmp != 0) {
-					reportbits(i, j, tmp, "free");
-				}
+		/* are we short any? */
+		if ((bits[j] & found[j]) != found[j]) {
+			tmp = found[j] & ~bits[j];
+			*allocp += countbits(tmp);
+			if (tmp != 0) {
+				reportbits(i, j, tmp, "free");
 			}
+		}
 
-			/* do we have any extra? */
-			if ((bits[j] & found[j]) != bits[j]) {
-				tmp = bits[j] & ~found[j];
-				freecount += countbits(tmp);
-				if (tmp != 0) {
-					reportbits(i, j, tmp, "allocated");
-				}
+		/* do we have any extra? */
+		if ((bits[j] & found[j]) != bits[j]) {
+			tmp = bits[j] & ~found[j];
+			*freep += countbits(tmp);
+			if (tmp != 0) {
+				reportbits(i, j, tmp, "allocated");
 			}
+		}
 
-			bits[j] = found[j];
-			bchanged = 1;
+		bits[j] = found[j];
+		bchanged = 1;
+	}
+
+	if (bchanged) {
+		swapbits(bits);
+		diskwrite(bits, SFS_MAP_LOCATION+i);
+	}
+}
+
+////////////////////////////////////////////////////////////
+
+/*
+ * Worker threads (host builds only). A pass that can be split up is
+ * run as a function called once per worker, each on its own thread.
+ * With one worker, which is all OS/161 gets, the function just runs
+ * in the main thread.
+ */
+struct worker {
+	unsigned w_num;
+	struct blockmap *w_map;		/* where to mark blocks */
+	struct blockmap w_ownmap;	/* w_map's storage, if not mainmap */
+	uint32_t w_alloccount;		/* check_bitmap results */
+	uint32_t w_freecount;
+#ifdef USE_THREADS
+	pthread_t w_thread;
+#endif
+};
+
+static struct worker workers[MAXWORKERS];
+static unsigned nworkers = 1;
+
+/*
+ * Set up the workers once we know how big the fs is. A lone worker
+ * marks mainmap directly.
+ */
+static
+void
+workers_init(void)
+{
+	unsigned i;
+
+	for (i=0; i<nworkers; i++) {
+		workers[i].w_num = i;
+		if (nworkers == 1) {
+			workers[i].w_map = &mainmap;
+		}
+		else {
+			blockmap_init(&workers[i].w_ownmap);
+			workers[i].w_map = &workers[i].w_ownmap;
 		}
+		workers[i].w_alloccount = 0;
+		workers[i].w_freecount = 0;
+	}
+}
 
-		if (bchanged) {
-			swapbits(bits);
-			diskwrite(bits, SFS_MAP_LOCATION+i);
+static
+void
+runworkers(void *(*func)(void *))
+{
+	unsigned i;
+
+#ifdef USE_THREADS
+	int result;
+
+	if (nworkers > 1) {
+		for (i=0; i<nworkers; i++) {
+			result = pthread_create(&workers[i].w_thread, NULL,
+						func, &workers[i]);
+			if (result) {
+				errx(EXIT_FATAL, "pthread_create: %s",
+				     strerror(result));
+			}
 		}
+		for (i=0; i<nworkers; i++) {
+			pthread_join(workers[i].w_thread, NULL);
+		}
+		return;
+	}
+#endif
+
+	for (i=0; i<nworkers; i++) {
+		func(&workers[i]);
+	}
+}
+
+////////////////////////////////////////////////////////////
+
+/*
+ * Each worker takes an equal slice of the bitmap blocks.
+ */
+static
+void *
+check_bitmap_worker(void *arg)
+{
+	struct worker *w = arg;
+	uint32_t i, first, last;
+
+	first = (uint64_t)bitblocks * w->w_num / nworkers;
+	last = (uint64_t)bitblocks * (w->w_num+1) / nworkers;
+	for (i=first; i<last; i++) {
+		check_bitmap_block(i, &w->w_alloccount, &w->w_freecount);
+	}
+	return NULL;
+}
+
+static
+void
+check_bitmap(void)
+{
+	uint32_t alloccount=0, freecount=0;
+	unsigned i;
+
+	runworkers(check_bitmap_worker);
+	for (i=0; i<nworkers; i++) {
+		alloccount += workers[i].w_alloccount;
+		freecount += workers[i].w_freecount;
 	}
 
 	if (alloccount > 0) {
@@ -373,38 +557,27 @@ check_bitmap(void)
 
 ////////////////////////////////////////////////////////////
 
-struct inodememory {
-	uint32_t ino;
-	uint32_t linkcount;	/* files only; 0 for dirs */
-};
+/*
+ * What the directory walk has seen of each inode, indexed by block
+ * number: 0 if nothing, INODE_DIR for a directory, and otherwise the
+ * number of links found to a file. A table makes each lookup O(1);
+ * it costs four bytes per block, which is fine even on OS/161 for
+ * the disk sizes it can handle.
+ */
+#define INODE_DIR	((uint32_t)-1)
 
-static struct inodememory *inodes = NULL;
-static int ninodes=0, maxinodes=0;
+static uint32_t *inodeseen;
 
 static
 void
-addmemory(uint32_t ino, uint32_t linkcount)
+inodeseen_init(void)
 {
-	assert(ninodes <= maxinodes);
-	if (ninodes == maxinodes) {
-#ifdef NO_REALLOC
-		int newmax = (maxinodes+1)*2;
-		void *p = domalloc(newmax * sizeof(struct inodememory));
-		if (inodes) {
-			memcpy(p, inodes, ninodes);
-			free(inodes);
-		}
-		inodes = p;
-#else
-		maxinodes = (maxinodes+1)*2;
-		inodes = realloc(inodes, maxinodes * sizeof(uint32_t));
-		if (inodes==NULL) {
-			errx(EXIT_FATAL, "Out of memory");
-		}
-#endif
+	uint32_t i;
+
+	inodeseen = domalloc(nblocks * sizeof(uint32_t));
+	for (i=0; i<nblocks; i++) {
+		inodeseen[i] = 0;
 	}
-	inodes[ninodes].ino = ino;
-	inodes[ninodes].linkcount = linkcount;
 }
 
 /* returns nonzero if directory already remembered */
@@ -412,66 +585,35 @@ static
 int
 remember_dir(uint32_t ino, const char *pathsofar)
 {
-	int i;
-
 	/* don't use this for now */
 	(void)pathsofar;
 
-	for (i=0; i<ninodes; i++) {
-		if (inodes[i].ino==ino) {
-			assert(inodes[i].linkcount==0);
-			return 1;
-		}
+	assert(ino < nblocks);
+	if (inodeseen[ino] != 0) {
+		assert(inodeseen[ino] == INODE_DIR);
+		return 1;
 	}
-
-	addmemory(ino, 0);
+	inodeseen[ino] = INODE_DIR;
 
 	return 0;
 }
 
+/*
+ * Count a link to a file. Its blocks and link count are checked
+ * later, once, by check_files.
+ */
 static
 void
 observe_filelink(uint32_t ino)
 {
-	int i;
-	for (i=0; i<ninodes; i++) {
-		if (inodes[i].ino==ino) {
-			assert(inodes[i].linkcount>0);
-			inodes[i].linkcount++;
-			return;
-		}
-	}
-	bitmap_mark(ino, B_INODE, ino);
-	addmemory(ino, 1);
-}
-
-static
-void
-adjust_filelinks(void)
-{
-	struct sfs_inode sfi;
-	int i;
-
-	for (i=0; i<ninodes; i++) {
-		if (inodes[i].linkcount==0) {
-			/* directory */
-			continue;
-		}
-		diskread(&sfi, inodes[i].ino);
-		swapinode(&sfi);
-		assert(sfi.sfi_type == SFS_TYPE_FILE);
-		if (sfi.sfi_linkcount != inodes[i].linkcount) {
-			warnx("File %lu link count %lu should be %lu (fixed)",
-			      (unsigned long) inodes[i].ino,
-			      (unsigned long) sfi.sfi_linkcount,
-			      (unsigned long) inodes[i].linkcount);
-			sfi.sfi_linkcount = inodes[i].linkcount;
-			setbadness(EXIT_RECOV);
-			swapinode(&sfi);
-			diskwrite(&sfi, inodes[i].ino);
-		}
-		count_files++;
+	assert(ino < nblocks);
+	if (inodeseen[ino] != 0) {
+		assert(inodeseen[ino] != INODE_DIR);
+		inodeseen[ino]++;
+		return;
 	}
+	bitmap_mark(&mainmap, ino, B_INODE, ino);
+	inodeseen[ino] = 1;
 }
 
 ////////////////////////////////////////////////////////////
@@ -529,10 +671,12 @@ check_sb(void)
 	assert(nblocks>0);
 	assert(bitblocks>0);
 
-	bitmap_init(bitblocks);
+	blockmap_init(&mainmap);
 	for (i=nblocks; i<bitblocks*SFS_BLOCKBITS; i++) {
-		bitmap_mark(i, B_PASTEND, 0);
+		bitmap_mark(&mainmap, i, B_PASTEND, 0);
 	}
+	inodeseen_init();
+	workers_init();
 
 	if (checknullstring(sp.sp_volname, sizeof(sp.sp_volname))) {
 		warnx("Volume name not null-terminated (fixed)");
@@ -550,9 +694,9 @@ check_sb(void)
 		diskwrite(&sp, SFS_SB_LOCATION);
 	}
 
-	bitmap_mark(SFS_SB_LOCATION, B_SUPERBLOCK, 0);
+	bitmap_mark(&mainmap, SFS_SB_LOCATION, B_SUPERBLOCK, 0);
 	for (i=0; i<bitblocks; i++) {
-		bitmap_mark(SFS_MAP_LOCATION+i, B_BITBLOCK, i);
+		bitmap_mark(&mainmap, SFS_MAP_LOCATION+i, B_BITBLOCK, i);
 	}
 }
 
@@ -560,7 +704,8 @@ check_sb(void)
 
 static
 void
-check_indirect_block(uint32_t ino, uint32_t *ientry, uint32_t *blockp,
+check_indirect_block(struct blockmap *map,
+		     uint32_t ino, uint32_t *ientry, uint32_t *blockp,
 		     uint32_t nblocks, uint32_t *badcountp, 
 		     int isdir, int indirection)
 {
@@ -570,7 +715,6 @@ check_indirect_block(uint32_t ino, uint32_t *ientry, uint32_t *blockp,
 	if (*ientry !=0) {
 		diskread(entries, *ientry);
 		swapindir(entries);
-		bitmap_mark(*ientry, B_IBLOCK, ino);
 	}
 	else {
 		for (i=0; i<SFS_DBPERIDB; i++) {
@@ -580,7 +724,7 @@ check_indirect_block(uint32_t ino, uint32_t *ientry, uint32_t *blockp,
 
 	if (indirection > 1) {
 		for (i=0; i<SFS_DBPERIDB; i++) {
-			check_indirect_block(ino, &entries[i], 
+			check_indirect_block(map, ino, &entries[i], 
 					     blockp, nblocks, 
 					     badcountp,
 					     isdir,
@@ -593,7 +737,7 @@ check_indirect_block(uint32_t ino, uint32_t *ientry, uint32_t *blockp,
 		for (i=0; i<SFS_DBPERIDB; i++) {
 			if (*blockp < nblocks) {
 				if (entries[i] != 0) {
-					bitmap_mark(entries[i],
+					bitmap_mark(map, entries[i],
 						    isdir ? B_DIRDATA : B_DATA,
 						    ino);
 				}
@@ -601,9 +745,8 @@ check_indirect_block(uint32_t ino, uint32_t *ientry, uint32_t *blockp,
 			else {
 				if (entries[i] != 0) {
 					(*badcountp)++;
-					bitmap_mark(entries[i],
-						    isdir ? B_DIRDATA : B_DATA,
-						    ino);
+					bitmap_mark(map, entries[i],
+						    B_TOFREE, 0);
 					entries[i] = 0;
 				}
 			}
@@ -618,12 +761,14 @@ check_indirect_block(uint32_t ino, uint32_t *ientry, uint32_t *blockp,
 	if (ct==0) {
 		if (*ientry != 0) {
 			(*badcountp)++;
-			bitmap_mark(*ientry, B_TOFREE, 0);
+			bitmap_mark(map, *ientry, B_TOFREE, 0);
 			*ientry = 0;
 		}
 	}
 	else {
 		assert(*ientry != 0);
+		/* marked only now so an emptied block can still be freed */
+		bitmap_mark(map, *ientry, B_IBLOCK, ino);
 		if (*badcountp > 0) {
 			swapindir(entries);
 			diskwrite(entries, *ientry);
@@ -634,7 +779,8 @@ check_indirect_block(uint32_t ino, uint32_t *ientry, uint32_t *blockp,
 /* returns nonzero if inode modified */
 static
 int
-check_inode_blocks(uint32_t ino, struct sfs_inode *sfi, int isdir)
+check_inode_blocks(struct blockmap *map,
+		   uint32_t ino, struct sfs_inode *sfi, int isdir)
 {
 	uint32_t size, block, nblocks, badcount;
 
@@ -646,49 +792,50 @@ check_inode_blocks(uint32_t ino, struct sfs_inode *sfi, int isdir)
 	for (block=0; block<SFS_NDIRECT; block++) {
 		if (block < nblocks) {
 			if (sfi->sfi_direct[block] != 0) {
-				bitmap_mark(sfi->sfi_direct[block],
+				bitmap_mark(map, sfi->sfi_direct[block],
 					    isdir ? B_DIRDATA : B_DATA, ino);
 			}
 		}
 		else {
 			if (sfi->sfi_direct[block] != 0) {
 				badcount++;
-				bitmap_mark(sfi->sfi_direct[block],
+				bitmap_mark(map, sfi->sfi_direct[block],
 					    B_TOFREE, 0);
-			}			
+				sfi->sfi_direct[block] = 0;
+			}
 		}
 	}
 
 #ifdef SFS_NIDIRECT
 	for (i=0; i<SFS_NIDIRECT; i++) {
-		check_indirect_block(ino, &sfi->sfi_indirect[i], 
+		check_indirect_block(map, ino, &sfi->sfi_indirect[i], 
 				     &block, nblocks, &badcount, isdir, 1);
 	}
 #else
-	check_indirect_block(ino, &sfi->sfi_indirect, 
+	check_indirect_block(map, ino, &sfi->sfi_indirect, 
 			     &block, nblocks, &badcount, isdir, 1);
 #endif
 
 #ifdef SFS_NDIDIRECT
 	for (i=0; i<SFS_NDIDIRECT; i++) {
-		check_indirect_block(ino, &sfi->sfi_dindirect[i], 
+		check_indirect_block(map, ino, &sfi->sfi_dindirect[i], 
 				     &block, nblocks, &badcount, isdir, 2);
 	}
 #else
 #ifdef HAS_DIDIRECT
-	check_indirect_block(ino, &sfi->sfi_dindirect, 
+	check_indirect_block(map, ino, &sfi->sfi_dindirect, 
 			     &block, nblocks, &badcount, isdir, 2);
 #endif
 #endif
 
 #ifdef SFS_NTIDIRECT
 	for (i=0; i<SFS_NTIDIRECT; i++) {
-		check_indirect_block(ino, &sfi->sfi_tindirect[i], 
+		check_indirect_block(map, ino, &sfi->sfi_tindirect[i], 
 				     &block, nblocks, &badcount, isdir, 3);
 	}
 #else
 #ifdef HAS_TIDIRECT
-	check_indirect_block(ino, &sfi->sfi_tindirect, 
+	check_indirect_block(map, ino, &sfi->sfi_tindirect, 
 			     &block, nblocks, &badcount, isdir, 3);
 #endif
 #endif
@@ -705,6 +852,112 @@ check_inode_blocks(uint32_t ino, struct sfs_inode *sfi, int isdir)
 
 ////////////////////////////////////////////////////////////
 
+/*
+ * Check a file's blocks, and set its link count to the number of
+ * links the directory walk found.
+ */
+static
+void
+check_file(struct blockmap *map, uint32_t ino, uint32_t linkcount)
+{
+	struct sfs_inode sfi;
+	int ichanged;
+
+	diskread(&sfi, ino);
+	swapinode(&sfi);
+	assert(sfi.sfi_type == SFS_TYPE_FILE);
+
+	ichanged = check_inode_blocks(map, ino, &sfi, 0);
+
+	if (sfi.sfi_linkcount != linkcount) {
+		warnx("File %lu link count %lu should be %lu (fixed)",
+		      (unsigned long) ino,
+		      (unsigned long) sfi.sfi_linkcount,
+		      (unsigned long) linkcount);
+		sfi.sfi_linkcount = linkcount;
+		setbadness(EXIT_RECOV);
+		ichanged = 1;
+	}
+
+	if (ichanged) {
+		swapinode(&sfi);
+		diskwrite(&sfi, ino);
+	}
+}
+
+/*
+ * Workers take chunks of the inode table until it runs out, so one
+ * worker stuck with a few huge files doesn't hold up the rest.
+ */
+#define FILECHUNK	1024
+
+static uint32_t nextfilechunk;
+#ifdef USE_THREADS
+static pthread_mutex_t nextfilechunk_lock = PTHREAD_MUTEX_INITIALIZER;
+#endif
+
+static
+void *
+check_files_worker(void *arg)
+{
+	struct worker *w = arg;
+	uint32_t start, end, ino;
+
+	for (;;) {
+#ifdef USE_THREADS
+		pthread_mutex_lock(&nextfilechunk_lock);
+#endif
+		start = nextfilechunk;
+		if (start < nblocks) {
+			nextfilechunk += FILECHUNK;
+		}
+#ifdef USE_THREADS
+		pthread_mutex_unlock(&nextfilechunk_lock);
+#endif
+		if (start >= nblocks) {
+			break;
+		}
+
+		end = nblocks - start < FILECHUNK ? nblocks : start+FILECHUNK;
+		for (ino=start; ino<end; ino++) {
+			if (inodeseen[ino] != 0 && inodeseen[ino] != INODE_DIR) {
+				check_file(w->w_map, ino, inodeseen[ino]);
+			}
+		}
+	}
+	return NULL;
+}
+
+/*
+ * Check every file the directory walk found, then merge the
+ * workers' block maps into mainmap for check_bitmap.
+ */
+static
+void
+check_files(void)
+{
+	uint32_t ino;
+	unsigned i;
+
+	for (ino=0; ino<nblocks; ino++) {
+		if (inodeseen[ino] != 0 && inodeseen[ino] != INODE_DIR) {
+			count_files++;
+		}
+	}
+
+	nextfilechunk = 0;
+	runworkers(check_files_worker);
+
+	if (nworkers > 1) {
+		for (i=0; i<nworkers; i++) {
+			blockmap_merge(&mainmap, &workers[i].w_ownmap);
+			blockmap_cleanup(&workers[i].w_ownmap);
+		}
+	}
+}
+
+////////////////////////////////////////////////////////////
+
 static
 uint32_t
 ibmap(uint32_t iblock, uint32_t offset, uint32_t entrysize)
@@ -984,7 +1237,7 @@ check_dir(uint32_t ino, uint32_t parentino, const char *pathsofar)
 		return 1;
 	}
 
-	bitmap_mark(ino, B_INODE, ino);
+	bitmap_mark(&mainmap, ino, B_INODE, ino);
 	count_dirs++;
 
 	if (sfi.sfi_size % sizeof(struct sfs_dir) != 0) {
@@ -996,7 +1249,7 @@ check_dir(uint32_t ino, uint32_t parentino, const char *pathsofar)
 		ichanged = 1;
 	}
 
-	if (check_inode_blocks(ino, &sfi, 1)) {
+	if (check_inode_blocks(&mainmap, ino, &sfi, 1)) {
 		ichanged = 1;
 	}
 
@@ -1149,12 +1402,6 @@ check_dir(uint32_t ino, uint32_t parentino, const char *pathsofar)
 
 			switch (subsfi.sfi_type) {
 			    case SFS_TYPE_FILE:
-				if (check_inode_blocks(direntries[i].sfd_ino,
-						       &subsfi, 0)) {
-					swapinode(&subsfi);
-					diskwrite(&subsfi, 
-						  direntries[i].sfd_ino);
-				}
 				observe_filelink(direntries[i].sfd_ino);
 				break;
 			    case SFS_TYPE_DIR:
@@ -1243,29 +1490,64 @@ check_root_dir(void)
 int
 main(int argc, char **argv)
 {
+	const char *path;
+	int maxworkers = 0;
+
 #ifdef HOST
 	hostcompat_init(argc, argv);
 #endif
 
-	if (argc!=2) {
-		errx(EXIT_USAGE, "Usage: sfsck device/diskfile");
+	/*
+	 * -j sets the number of worker threads; the default is one
+	 * per CPU. Without threads (on OS/161) it's always one.
+	 */
+	if (argc==4 && !strcmp(argv[1], "-j")) {
+		maxworkers = atoi(argv[2]);
+		if (maxworkers < 1) {
+			errx(EXIT_USAGE, "-j: need at least one worker");
+		}
+		path = argv[3];
+	}
+	else if (argc==2) {
+		path = argv[1];
+	}
+	else {
+		errx(EXIT_USAGE, "Usage: sfsck [-j workers] device/diskfile");
 	}
 
 	assert(sizeof(struct sfs_super)==SFS_BLOCKSIZE);
 	assert(sizeof(struct sfs_inode)==SFS_BLOCKSIZE);
 	assert(SFS_BLOCKSIZE % sizeof(struct sfs_dir) == 0);
 
-	opendisk(argv[1]);
+	opendisk(path);
+
+#ifdef USE_THREADS
+	/*
+	 * Workers need the image mapped, since diskread and diskwrite
+	 * otherwise share one file offset.
+	 */
+	if (maxworkers == 0) {
+		maxworkers = sysconf(_SC_NPROCESSORS_ONLN);
+	}
+	if (maxworkers > 1 && diskmap() == 0) {
+		nworkers = maxworkers > MAXWORKERS ? MAXWORKERS : maxworkers;
+	}
+	else if (maxworkers > 1) {
+		warnx("Cannot map the image; using one worker");
+	}
+#else
+	(void)maxworkers;
+#endif
 
 	check_sb();
 	check_root_dir();
+	check_files();
 	check_bitmap();
-	adjust_filelinks();
 
 	closedisk();
 
 	warnx("%lu blocks used (of %lu); %lu directories; %lu files",
-	      count_blocks, (unsigned long) nblocks, count_dirs, count_files);
+	      mainmap.count, (unsigned long) nblocks, count_dirs, count_files);
 
 	switch (badness) {
 	    case EXIT_USAGE:
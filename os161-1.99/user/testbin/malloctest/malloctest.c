@@ -638,14 +638,31 @@ static struct {
 	{ -1, NULL, NULL }
 };
 
+/*
+ * Run a test, and report how long it took, so the tests double as
+ * a benchmark for the allocator.
+ */
 static
 int
 dotest(int tn)
 {
 	int i;
+	time_t s0, s1;
+	unsigned long ns0, ns1, secs, nsecs;
+
 	for (i=0; tests[i].num>=0; i++) {
 		if (tests[i].num == tn) {
+			__time(&s0, &ns0);
 			tests[i].func();
+			__time(&s1, &ns1);
+			if (ns1 < ns0) {
+				ns1 += 1000000000;
+				s1--;
+			}
+			secs = s1 - s0;
+			nsecs = ns1 - ns0;
+			printf("Test %d took %lu.%09lu seconds\n",
+			       tn, secs, nsecs);
 			return 0;
 		}
 	}
@@ -37,10 +37,28 @@
  *
  *    Once the VM system assignment is complete your system should be
  *    able to survive this.
+ *
+ *    Given any options, it's instead a benchmark of how the memory
+ *    access pattern interacts with the TLB and paging:
+ *
+ *    matmult [-n dim] [-k naive|interchange|tiled] [-t tile] [-p procs]
+ *       -n   multiply dim x dim matrices (default 72, at most MAXDIM)
+ *       -k   i-j-k loop (strides down B's columns), i-k-j loop (walks
+ *            rows only), or i-k-j over tile x tile blocks
+ *       -t   tile size for -k tiled (default 16)
+ *       -p   fork this many processes, each computing a band of rows
+ *
+ *    It reports elapsed time and how the systemwide VM counters
+ *    (see kern/vmstats.h) moved while it ran.
  */
 
 #include <unistd.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <err.h>
+#include <sys/wait.h>
+#include <kern/vmstats.h>
 
 #define Dim 	72	/* sum total of the arrays doesn't fit in 
 			 * physical memory 
@@ -53,8 +71,9 @@ int B[Dim][Dim];
 int C[Dim][Dim];
 int T[Dim][Dim][Dim];
 
+static
 int
-main()
+classic(void)
 {
     int i, j, k, r;
 
@@ -88,3 +107,288 @@ main()
     printf("Passed.\n");
     return 0;
 }
+
+////////////////////////////////////////////////////////////
+// Benchmark
+
+/*
+ * The benchmark's three matrices are carved out of T, so it needs
+ * no more memory than the classic test does.
+ */
+#define MAXDIM		352	/* 3*MAXDIM*MAXDIM <= Dim*Dim*Dim */
+#define MAXPROCS	16
+
+enum kernel { K_NAIVE, K_INTERCHANGE, K_TILED };
+static const char *const kernelnames[] = { "naive", "interchange", "tiled" };
+
+static int n = Dim;
+static int tile = 16;
+static int nprocs = 1;
+static enum kernel kernel = K_NAIVE;
+static int *a, *b, *c;
+
+#define AT(m, i, j) ((m)[(i)*n + (j)])
+
+static
+void
+mm_naive(int lo, int hi)
+{
+	int i, j, k, sum;
+
+	for (i = lo; i < hi; i++) {
+		for (j = 0; j < n; j++) {
+			sum = 0;
+			for (k = 0; k < n; k++) {
+				sum += AT(a, i, k) * AT(b, k, j);
+			}
+			AT(c, i, j) = sum;
+		}
+	}
+}
+
+static
+void
+mm_interchange(int lo, int hi)
+{
+	int i, j, k, aik;
+
+	for (i = lo; i < hi; i++) {
+		for (k = 0; k < n; k++) {
+			aik = AT(a, i, k);
+			for (j = 0; j < n; j++) {
+				AT(c, i, j) += aik * AT(b, k, j);
+			}
+		}
+	}
+}
+
+static
+void
+mm_tiled(int lo, int hi)
+{
+	int i0, j0, k0, i, j, k, imax, jmax, kmax, aik;
+
+	for (i0 = lo; i0 < hi; i0 += tile) {
+		imax = i0 + tile < hi ? i0 + tile : hi;
+		for (k0 = 0; k0 < n; k0 += tile) {
+			kmax = k0 + tile < n ? k0 + tile : n;
+			for (j0 = 0; j0 < n; j0 += tile) {
+				jmax = j0 + tile < n ? j0 + tile : n;
+				for (i = i0; i < imax; i++) {
+					for (k = k0; k < kmax; k++) {
+						aik = AT(a, i, k);
+						for (j = j0; j < jmax; j++) {
+							AT(c, i, j) +=
+							    aik * AT(b, k, j);
+						}
+					}
+				}
+			}
+		}
+	}
+}
+
+/*
+ * Compute rows LO through HI-1 of C, then check them. With
+ * A[i][j] = i and B[i][j] = j, C[i][j] is n*i*j. Returns the number
+ * of wrong entries.
+ */
+static
+int
+band(int lo, int hi)
+{
+	int i, j, bad = 0;
+
+	for (i = lo; i < hi; i++) {
+		for (j = 0; j < n; j++) {
+			AT(c, i, j) = 0;
+		}
+	}
+
+	switch (kernel) {
+	    case K_NAIVE: mm_naive(lo, hi); break;
+	    case K_INTERCHANGE: mm_interchange(lo, hi); break;
+	    case K_TILED: mm_tiled(lo, hi); break;
+	}
+
+	for (i = lo; i < hi; i++) {
+		for (j = 0; j < n; j++) {
+			if (AT(c, i, j) != n * i * j) {
+				bad++;
+			}
+		}
+	}
+	return bad;
+}
+
+/*
+ * Each process takes an equal band of rows. Children can't hand
+ * their rows back (there's no shared memory), so each checks its
+ * own and reports through its exit status.
+ */
+static
+int
+runbands(void)
+{
+	pid_t pids[MAXPROCS];
+	int p, lo, hi, status, failures = 0;
+
+	if (nprocs == 1) {
+		return band(0, n) ? 1 : 0;
+	}
+
+	for (p = 0; p < nprocs; p++) {
+		lo = n * p / nprocs;
+		hi = n * (p+1) / nprocs;
+		pids[p] = fork();
+		if (pids[p] < 0) {
+			warn("fork");
+			failures++;
+			continue;
+		}
+		if (pids[p] == 0) {
+			_exit(band(lo, hi) ? 1 : 0);
+		}
+	}
+	for (p = 0; p < nprocs; p++) {
+		if (pids[p] < 0) {
+			continue;
+		}
+		if (waitpid(pids[p], &status, 0) < 0) {
+			warn("waitpid");
+			failures++;
+		}
+		else if (WIFSIGNALED(status)) {
+			warnx("proc %d: signal %d", p, WTERMSIG(status));
+			failures++;
+		}
+		else if (WEXITSTATUS(status) != 0) {
+			warnx("proc %d: wrong answers", p);
+			failures++;
+		}
+	}
+	return failures;
+}
+
+static
+void
+usage(void)
+{
+	errx(1, "Usage: matmult [-n dim] [-k naive|interchange|tiled] "
+	     "[-t tile] [-p procs]");
+}
+
+static
+int
+bench(int argc, char **argv)
+{
+	unsigned before[VMSTAT_COUNT], after[VMSTAT_COUNT];
+	time_t s0, s1;
+	unsigned long ns0, ns1, msecs;
+	int i, j, failures, havestats;
+
+	for (i = 1; i < argc; i++) {
+		if (argv[i][0] != '-' || argv[i][1] == 0 || argv[i][2] != 0 ||
+		    i+1 >= argc) {
+			usage();
+		}
+		switch (argv[i][1]) {
+		    case 'n': n = atoi(argv[++i]); break;
+		    case 't': tile = atoi(argv[++i]); break;
+		    case 'p': nprocs = atoi(argv[++i]); break;
+		    case 'k':
+			i++;
+			for (j = 0; j < 3; j++) {
+				if (!strcmp(argv[i], kernelnames[j])) {
+					break;
+				}
+			}
+			if (j == 3) {
+				usage();
+			}
+			kernel = j;
+			break;
+		    default: usage(); break;
+		}
+	}
+	if (n < 1 || n > MAXDIM) {
+		errx(1, "Dimension must be between 1 and %d", MAXDIM);
+	}
+	if (tile < 1) {
+		errx(1, "Tile size must be at least 1");
+	}
+	if (nprocs < 1 || nprocs > MAXPROCS || nprocs > n) {
+		errx(1, "Process count must be between 1 and %d",
+		     n < MAXPROCS ? n : MAXPROCS);
+	}
+
+	a = &T[0][0][0];
+	b = a + n*n;
+	c = b + n*n;
+	for (i = 0; i < n; i++) {
+		for (j = 0; j < n; j++) {
+			AT(a, i, j) = i;
+			AT(b, i, j) = j;
+		}
+	}
+
+	havestats = __vmstats(before, VMSTAT_COUNT) >= 0;
+	__time(&s0, &ns0);
+
+	failures = runbands();
+
+	__time(&s1, &ns1);
+	if (havestats) {
+		havestats = __vmstats(after, VMSTAT_COUNT) >= 0;
+	}
+
+	msecs = (s1 - s0) * 1000 + ns1 / 1000000 - ns0 / 1000000;
+	printf("matmult: %dx%d, %s", n, n, kernelnames[kernel]);
+	if (kernel == K_TILED) {
+		printf(" (tile %d)", tile);
+	}
+	printf(", %d proc%s: %lu ms\n", nprocs, nprocs == 1 ? "" : "s",
+	       msecs);
+	if (havestats) {
+		printf("TLB faults %u (free %u, replace %u), "
+		       "invalidations %u\n",
+		       after[VMSTAT_TLB_FAULT] - before[VMSTAT_TLB_FAULT],
+		       after[VMSTAT_TLB_FAULT_FREE] -
+		       before[VMSTAT_TLB_FAULT_FREE],
+		       after[VMSTAT_TLB_FAULT_REPLACE] -
+		       before[VMSTAT_TLB_FAULT_REPLACE],
+		       after[VMSTAT_TLB_INVALIDATE] -
+		       before[VMSTAT_TLB_INVALIDATE]);
+		printf("Page faults %u (zeroed %u, disk %u), "
+		       "swap writes %u\n",
+		       (after[VMSTAT_PAGE_FAULT_ZERO] -
+			before[VMSTAT_PAGE_FAULT_ZERO]) +
+		       (after[VMSTAT_PAGE_FAULT_DISK] -
+			before[VMSTAT_PAGE_FAULT_DISK]),
+		       after[VMSTAT_PAGE_FAULT_ZERO] -
+		       before[VMSTAT_PAGE_FAULT_ZERO],
+		       after[VMSTAT_PAGE_FAULT_DISK] -
+		       before[VMSTAT_PAGE_FAULT_DISK],
+		       after[VMSTAT_SWAP_FILE_WRITE] -
+		       before[VMSTAT_SWAP_FILE_WRITE]);
+	}
+	else {
+		printf("(no VM statistics from the kernel)\n");
+	}
+
+	if (failures) {
+		printf("FAILED\n");
+		return 1;
+	}
+	printf("Passed.\n");
+	return 0;
+}
+
+int
+main(int argc, char **argv)
+{
+    if (argc > 1) {
+	    return bench(argc, argv);
+    }
+    return classic();
+}
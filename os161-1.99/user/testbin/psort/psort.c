@@ -34,6 +34,9 @@
  * because of various limitations of OS/161 it is massively
  * inefficient. But that's ok; the goal is to stress the VM and buffer
  * cache.
+ *
+ * With -b it also works as a benchmark: each phase reports its wall
+ * time and how much I/O it did, summed over all the processes.
  */
 
 #include <sys/types.h>
@@ -41,6 +44,7 @@
 #include <sys/wait.h>
 #include <stdio.h>
 #include <stdarg.h>
+#include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
 #include <assert.h>
@@ -48,6 +52,10 @@
 #include <fcntl.h>
 #include <errno.h>
 
+#ifdef HOST
+#include "hostcompat.h"
+#endif
+
 #ifndef RANDOM_MAX
 /* Note: this is correct for OS/161 but not for some Unix C libraries */
 #define RANDOM_MAX RAND_MAX
@@ -59,6 +67,9 @@
 #define PATH_RANDOM  "rand:"
 
 #define WORKNUM      (128*1024)
+#define MINSLICE     128	/* fewest keys of buffer per merge input */
+#define NAMESIZE     32
+#define CATBUFSIZE   1024	/* /bin/cat's buffer, for -b */
 
 
 static int workspace[WORKNUM];
@@ -68,6 +79,8 @@ static const char *progname;
 static int numprocs = 4;
 static int numkeys = 10000;
 static long randomseed = 15432753;
+static int runkeys = WORKNUM;	/* most keys sorted in memory at once */
+static int benchmark = 0;
 
 static off_t correctsize;
 static unsigned long checksum;
@@ -213,6 +226,53 @@ complain(const char *fmt, ...)
 
 ////////////////////////////////////////////////////////////
 
+/*
+ * I/O accounting for -b. Each process counts the reads and writes
+ * it does through doread and dowrite. Children start from zero and
+ * leave their counts in a stats file for the parent to add up.
+ */
+struct iostats {
+	unsigned long long is_bytesread;
+	unsigned long long is_byteswritten;
+	unsigned long is_reads;
+	unsigned long is_writes;
+};
+
+static struct iostats iostats;
+
+static
+void
+iostats_add(struct iostats *to, const struct iostats *from)
+{
+	to->is_bytesread += from->is_bytesread;
+	to->is_byteswritten += from->is_byteswritten;
+	to->is_reads += from->is_reads;
+	to->is_writes += from->is_writes;
+}
+
+static
+void
+iostats_sub(struct iostats *to, const struct iostats *from)
+{
+	to->is_bytesread -= from->is_bytesread;
+	to->is_byteswritten -= from->is_byteswritten;
+	to->is_reads -= from->is_reads;
+	to->is_writes -= from->is_writes;
+}
+
+static
+uint64_t
+now_ns(void)
+{
+	time_t secs;
+	unsigned long nsecs;
+
+	__time(&secs, &nsecs);
+	return (uint64_t)secs * 1000000000 + nsecs;
+}
+
+////////////////////////////////////////////////////////////
+
 static
 int
 doopen(const char *path, int flags, int mode)
@@ -323,6 +383,8 @@ doread(const char *path, int fd, void *buf, size_t len)
 		complain("%s: read", path);
 		exit(1);
 	}
+	iostats.is_reads++;
+	iostats.is_bytesread += result;
 	return (size_t) result;
 }
 
@@ -350,6 +412,8 @@ dowrite(const char *path, int fd, const void *buf, size_t len)
 		complain("%s: write", path);
 		exit(1);
 	}
+	iostats.is_writes++;
+	iostats.is_byteswritten += result;
 	if ((size_t) result != len) {
 		complainx("%s: write: short count", path);
 		exit(1);
@@ -405,6 +469,135 @@ dofork(void)
 
 ////////////////////////////////////////////////////////////
 
+static
+const char *
+statsname(int a)
+{
+	static char rv[NAMESIZE];
+	snprintf(rv, sizeof(rv), "stats-%d", a);
+	return rv;
+}
+
+/*
+ * Leave this process's I/O counts for the parent. Goes straight to
+ * write so it doesn't count itself.
+ */
+static
+void
+putstats(void)
+{
+	const char *name;
+	int fd;
+
+	if (!benchmark) {
+		return;
+	}
+	name = statsname(me);
+	fd = doopen(name, O_WRONLY|O_CREAT|O_TRUNC, 0664);
+	if (write(fd, &iostats, sizeof(iostats)) != sizeof(iostats)) {
+		complain("%s: write", name);
+		exit(1);
+	}
+	doclose(name, fd);
+}
+
+static
+void
+getstats(int guy, struct iostats *total)
+{
+	struct iostats theirs;
+	const char *name;
+	int fd;
+
+	name = statsname(guy);
+	fd = doopen(name, O_RDONLY, 0);
+	if (read(fd, &theirs, sizeof(theirs)) != sizeof(theirs)) {
+		complainx("%s: read: short count", name);
+		exit(1);
+	}
+	doclose(name, fd);
+	doremove(name);
+	iostats_add(total, &theirs);
+}
+
+/* Per-phase results for -b */
+#define MAXPHASES 8
+
+struct phase {
+	const char *ph_name;
+	uint64_t ph_ns;
+	struct iostats ph_io;
+};
+
+static struct phase phases[MAXPHASES];
+static unsigned numphases;
+
+static uint64_t phasestart;
+static struct iostats phasestartio;	/* our own counts at the start */
+static struct iostats phasechildio;	/* children's, added as they finish */
+
+static
+void
+phase_begin(void)
+{
+	phasestart = now_ns();
+	phasestartio = iostats;
+	bzero(&phasechildio, sizeof(phasechildio));
+}
+
+static
+void
+phase_end(const char *name)
+{
+	struct phase *ph;
+
+	assert(numphases < MAXPHASES);
+	ph = &phases[numphases++];
+	ph->ph_name = name;
+	ph->ph_ns = now_ns() - phasestart;
+	ph->ph_io = iostats;
+	iostats_sub(&ph->ph_io, &phasestartio);
+	iostats_add(&ph->ph_io, &phasechildio);
+}
+
+static
+void
+printphase(const char *name, uint64_t ns, const struct iostats *io)
+{
+	unsigned long long bytes, kbps;
+
+	bytes = io->is_bytesread + io->is_byteswritten;
+	kbps = ns > 0 ? bytes * 1000000000ULL / ns / 1024 : 0;
+	printf("%-10s %9llu %10llu %10llu %8lu %8lu %9llu\n", name,
+	       (unsigned long long) (ns / 1000000),
+	       io->is_bytesread / 1024, io->is_byteswritten / 1024,
+	       io->is_reads, io->is_writes, kbps);
+}
+
+static
+void
+report(void)
+{
+	struct iostats total;
+	uint64_t totalns = 0;
+	unsigned i;
+
+	bzero(&total, sizeof(total));
+	printf("psort: %d procs, %d keys, runs of %d keys\n",
+	       numprocs, numkeys, runkeys);
+	printf("%-10s %9s %10s %10s %8s %8s %9s\n", "phase", "msec",
+	       "read KB", "write KB", "reads", "writes", "KB/sec");
+	for (i=0; i<numphases; i++) {
+		printphase(phases[i].ph_name, phases[i].ph_ns,
+			   &phases[i].ph_io);
+		totalns += phases[i].ph_ns;
+		iostats_add(&total, &phases[i].ph_io);
+	}
+	printphase("total", totalns, &total);
+}
+
+////////////////////////////////////////////////////////////
+
 static
 int
 dowait(int guy, pid_t pid)
@@ -444,7 +637,9 @@ doforkall(const char *phasename, void (*func)(void))
 		else if (pids[i] == 0) {
 			/* child */
 			me = i;
+			bzero(&iostats, sizeof(iostats));
 			func();
+			putstats();
 			exit(0);
 		}
 	}
@@ -459,6 +654,12 @@ doforkall(const char *phasename, void (*func)(void))
 		complainx("%s failed.", phasename);
 		exit(1);
 	}
+
+	if (benchmark) {
+		for (i=0; i<numprocs; i++) {
+			getstats(i, &phasechildio);
+		}
+	}
 }
 
 static
@@ -595,7 +796,7 @@ static
 const char *
 binname(int a, int b)
 {
-	static char rv[32];
+	static char rv[NAMESIZE];
 	snprintf(rv, sizeof(rv), "bin-%d-%d", a, b);
 	return rv;
 }
@@ -604,18 +805,185 @@ static
 const char *
 mergedname(int a)
 {
-	static char rv[32];
+	static char rv[NAMESIZE];
 	snprintf(rv, sizeof(rv), "merged-%d", a);
 	return rv;
 }
 
+/*
+ * Buffered key output, so keys go to disk in large writes rather
+ * than one at a time. The buffer is a slice of workspace.
+ */
+struct keywriter {
+	char kw_name[NAMESIZE];
+	int kw_fd;
+	int *kw_buf;
+	int kw_size;		/* keys the buffer holds */
+	int kw_count;		/* keys in it now */
+};
+
+static
+void
+kw_open(struct keywriter *kw, const char *name, int *buf, int size)
+{
+	strcpy(kw->kw_name, name);
+	kw->kw_fd = doopen(name, O_WRONLY|O_CREAT|O_TRUNC, 0664);
+	kw->kw_buf = buf;
+	kw->kw_size = size;
+	kw->kw_count = 0;
+}
+
+static
+void
+kw_flush(struct keywriter *kw)
+{
+	if (kw->kw_count > 0) {
+		dowrite(kw->kw_name, kw->kw_fd, kw->kw_buf,
+			kw->kw_count * sizeof(int));
+		kw->kw_count = 0;
+	}
+}
+
+static
+void
+kw_put(struct keywriter *kw, int key)
+{
+	kw->kw_buf[kw->kw_count++] = key;
+	if (kw->kw_count == kw->kw_size) {
+		kw_flush(kw);
+	}
+}
+
+static
+void
+kw_close(struct keywriter *kw)
+{
+	kw_flush(kw);
+	doclose(kw->kw_name, kw->kw_fd);
+}
+
+/*
+ * Buffered key input from one sorted file, for the merges.
+ */
+struct keyreader {
+	char kr_name[NAMESIZE];
+	int kr_fd;
+	int *kr_buf;
+	int kr_size;
+	int kr_pos, kr_count;
+};
+
+/* Refill the buffer if it's empty. Returns 0 at EOF. */
+static
+int
+kr_fill(struct keyreader *kr)
+{
+	size_t len;
+
+	if (kr->kr_pos < kr->kr_count) {
+		return 1;
+	}
+	len = doread(kr->kr_name, kr->kr_fd, kr->kr_buf,
+		     kr->kr_size * sizeof(int));
+	if (len % sizeof(int) != 0) {
+		complainx("%s: read: short count", kr->kr_name);
+		exit(1);
+	}
+	kr->kr_pos = 0;
+	kr->kr_count = len / sizeof(int);
+	return kr->kr_count > 0;
+}
+
+static
+int
+kr_open(struct keyreader *kr, const char *name, int *buf, int size)
+{
+	strcpy(kr->kr_name, name);
+	kr->kr_fd = doopen(name, O_RDONLY, 0);
+	kr->kr_buf = buf;
+	kr->kr_size = size;
+	kr->kr_pos = kr->kr_count = 0;
+	return kr_fill(kr);
+}
+
+/*
+ * Merge sorted files into one, k ways at once. The inputs sit in a
+ * heap ordered by their next key. Workspace is split evenly among
+ * the input buffers and the output buffer.
+ */
+static
+void
+heap_down(struct keyreader *krs, int *heap, int num, int pos)
+{
+	int child, tmp;
+
+	while ((child = 2*pos+1) < num) {
+		if (child+1 < num &&
+		    krs[heap[child+1]].kr_buf[krs[heap[child+1]].kr_pos] <
+		    krs[heap[child]].kr_buf[krs[heap[child]].kr_pos]) {
+			child++;
+		}
+		if (krs[heap[pos]].kr_buf[krs[heap[pos]].kr_pos] <=
+		    krs[heap[child]].kr_buf[krs[heap[child]].kr_pos]) {
+			break;
+		}
+		tmp = heap[pos];
+		heap[pos] = heap[child];
+		heap[child] = tmp;
+		pos = child;
+	}
+}
+
+static
+void
+mergefiles(char (*innames)[NAMESIZE], int num, const char *outname)
+{
+	struct keyreader krs[num];
+	struct keywriter kw;
+	int heap[num];
+	int slice, numheap, i;
+	struct keyreader *kr;
+
+	slice = WORKNUM / (num+1);
+	if (slice < MINSLICE) {
+		complainx("%s: too many files (%d) to merge at once",
+			  outname, num);
+		exit(1);
+	}
+
+	numheap = 0;
+	for (i=0; i<num; i++) {
+		if (kr_open(&krs[i], innames[i], workspace + i*slice, slice)) {
+			heap[numheap++] = i;
+		}
+	}
+	for (i=numheap/2-1; i>=0; i--) {
+		heap_down(krs, heap, numheap, i);
+	}
+
+	kw_open(&kw, outname, workspace + num*slice, slice);
+	while (numheap > 0) {
+		kr = &krs[heap[0]];
+		kw_put(&kw, kr->kr_buf[kr->kr_pos++]);
+		if (!kr_fill(kr)) {
+			heap[0] = heap[--numheap];
+		}
+		heap_down(krs, heap, numheap, 0);
+	}
+	kw_close(&kw);
+
+	for (i=0; i<num; i++) {
+		doclose(krs[i].kr_name, krs[i].kr_fd);
+	}
+}
+
 static
 void
 bin(void)
 {
-	int infd, outfds[numprocs];
-	const char *name;
-	int i, mykeys, keys_done, keys_to_do;
+	struct keywriter outs[numprocs];
+	int infd;
+	int i, mykeys, keys_done, keys_to_do, chunk, slice;
 	int key, pivot, binnum;
 
 	infd = doopen(PATH_KEYS, O_RDONLY, 0);
@@ -623,9 +991,12 @@ bin(void)
 	mykeys = getmykeys();
 	seekmyplace(PATH_KEYS, infd);
 
+	/* read into the first half of workspace, bin from the second */
+	chunk = WORKNUM / 2;
+	slice = (WORKNUM - chunk) / numprocs;
 	for (i=0; i<numprocs; i++) {
-		name = binname(me, i);
-		outfds[i] = doopen(name, O_WRONLY|O_CREAT|O_TRUNC, 0664);
+		kw_open(&outs[i], binname(me, i),
+			workspace + chunk + i*slice, slice);
 	}
 
 	pivot = (RANDOM_MAX / numprocs);
@@ -633,8 +1004,8 @@ bin(void)
 	keys_done = 0;
 	while (keys_done < mykeys) {
 		keys_to_do = mykeys - keys_done;
-		if (keys_to_do > WORKNUM) {
-			keys_to_do = WORKNUM;
+		if (keys_to_do > chunk) {
+			keys_to_do = chunk;
 		}
 
 		doexactread(PATH_KEYS, infd, workspace,
@@ -650,7 +1021,7 @@ bin(void)
 			}
 			assert(binnum >= 0);
 			assert(binnum < numprocs);
-			dowrite("bin", outfds[binnum], &key, sizeof(key));
+			kw_put(&outs[binnum], key);
 		}
 
 		keys_done += keys_to_do;
@@ -658,7 +1029,48 @@ bin(void)
 	doclose(PATH_KEYS, infd);
 
 	for (i=0; i<numprocs; i++) {
-		doclose(binname(me, i), outfds[i]);
+		kw_close(&outs[i]);
+	}
+}
+
+static
+void
+runname(char *buf, int a, int b, int r)
+{
+	snprintf(buf, NAMESIZE, "run-%d-%d-%d", a, b, r);
+}
+
+/*
+ * Sort one bin that's bigger than a run: sort it a run at a time
+ * into run files, then merge those back into the bin.
+ */
+static
+void
+sortbin_external(const char *name, int fd, int numbinkeys, int binnum)
+{
+	int numruns = (numbinkeys + runkeys - 1) / runkeys;
+	char runnames[numruns][NAMESIZE];
+	int r, keys, runfd;
+
+	for (r=0; r<numruns; r++) {
+		keys = numbinkeys - r*runkeys;
+		if (keys > runkeys) {
+			keys = runkeys;
+		}
+		doexactread(name, fd, workspace, keys * sizeof(int));
+		sortints(workspace, keys);
+
+		runname(runnames[r], me, binnum, r);
+		runfd = doopen(runnames[r], O_WRONLY|O_CREAT|O_TRUNC, 0664);
+		dowrite(runnames[r], runfd, workspace, keys * sizeof(int));
+		doclose(runnames[r], runfd);
+	}
+	doclose(name, fd);
+
+	mergefiles(runnames, numruns, name);
+
+	for (r=0; r<numruns; r++) {
+		doremove(runnames[r]);
 	}
 }
 
@@ -667,23 +1079,27 @@ void
 sortbins(void)
 {
 	const char *name;
+	char namebuf[NAMESIZE];
 	int i, fd;
 	off_t binsize;
 
 	for (i=0; i<numprocs; i++) {
-		name = binname(me, i);
+		strcpy(namebuf, binname(me, i));
+		name = namebuf;
 		binsize = getsize(name);
 		if (binsize % sizeof(int) != 0) {
 			complainx("%s: bin size %ld no good", name,
 				  (long) binsize);
 			exit(1);
 		}
-		if (binsize > (off_t) sizeof(workspace)) {
-			complainx("proc %d: %s: bin too large", me, name);
-			exit(1);
-		}
 
 		fd = doopen(name, O_RDWR, 0);
+
+		if (binsize > (off_t) (runkeys * sizeof(int))) {
+			sortbin_external(name, fd, binsize / sizeof(int), i);
+			continue;
+		}
+
 		doexactread(name, fd, workspace, binsize);
 
 		sortints(workspace, binsize/sizeof(int));
@@ -698,89 +1114,20 @@ static
 void
 mergebins(void)
 {
-	int infds[numprocs], outfd;
-	int values[numprocs], ready[numprocs];
-	const char *name, *outname;
-	int i, result;
-	int numready, place, val, worknum;
-
-	outname = mergedname(me);
-	outfd = doopen(outname, O_WRONLY|O_CREAT|O_TRUNC, 0664);
-
-	for (i=0; i<numprocs; i++) {
-		name = binname(i, me);
-		infds[i] = doopen(name, O_RDONLY, 0);
-		values[i] = 0;
-		ready[i] = 0;
-	}
-
-	worknum = 0;
-
-	while (1) {
-		numready = 0;
-		for (i=0; i<numprocs; i++) {
-			if (infds[i] < 0) {
-				continue;
-			}
-
-			if (!ready[i]) {
-				result = doread("bin", infds[i], 
-						&val, sizeof(int));
-				if (result == 0) {
-					doclose("bin", infds[i]);
-					infds[i] = -1;
-					continue;
-				}
-				if ((size_t) result != sizeof(int)) {
-					complainx("%s: read: short count",
-						  binname(i, me));
-					exit(1);
-				}
-				values[i] = val;
-				ready[i] = 1;
-			}
-			numready++;
-		}
-		if (numready == 0) {
-			break;
-		}
-
-		/* find the smallest */
-		place = -1;
-		for (i=0; i<numprocs; i++) {
-			if (!ready[i]) {
-				continue;
-			}
-			if (place < 0 || values[i] < val) {
-				val = values[i];
-				place = i;
-			}
-		}
-		assert(place >= 0);
-
-		workspace[worknum++] = val;
-		if (worknum >= WORKNUM) {
-			assert(worknum == WORKNUM);
-			dowrite(outname, outfd, workspace,
-				worknum * sizeof(int));
-			worknum = 0;
-		}
-		ready[place] = 0;
-	}
-
-	dowrite(outname, outfd, workspace, worknum * sizeof(int));
-	doclose(outname, outfd);
+	char names[numprocs][NAMESIZE];
+	int i;
 
 	for (i=0; i<numprocs; i++) {
-		assert(infds[i] < 0);
+		strcpy(names[i], binname(i, me));
 	}
+	mergefiles(names, numprocs, mergedname(me));
 }
 
 static
 void
 assemble(void)
 {
-	off_t mypos;
+	off_t mypos, mysize;
 	int i, fd;
 	const char *args[3];
 
@@ -799,6 +1146,17 @@ assemble(void)
 
 	doclose(PATH_SORTED, fd);
 
+	/*
+	 * cat does the copying, so count it for it. It moves CATBUFSIZE
+	 * bytes per call, and reads once more to see EOF.
+	 */
+	mysize = getsize(mergedname(me));
+	iostats.is_bytesread += mysize;
+	iostats.is_byteswritten += mysize;
+	iostats.is_reads += (mysize + CATBUFSIZE - 1) / CATBUFSIZE + 1;
+	iostats.is_writes += (mysize + CATBUFSIZE - 1) / CATBUFSIZE;
+	putstats();
+
 	args[0] = "cat";
 	args[1] = mergedname(me);
 	args[2] = NULL;
@@ -853,18 +1211,24 @@ sort(void)
 	int i, j;
 
 	/* Step 1. Toss into bins. */
+	phase_begin();
 	doforkall("Tossing", bin);
 	checksize_bins();
+	phase_end("bin");
 	complainx("Done tossing into bins.");
 
 	/* Step 2: Sort the bins. */
+	phase_begin();
 	doforkall("Sorting", sortbins);
 	checksize_bins();
+	phase_end("sortbins");
 	complainx("Done sorting the bins.");
 
 	/* Step 3: Merge corresponding bins. */
+	phase_begin();
 	doforkall("Merging", mergebins);
 	checksize_merge();
+	phase_end("mergebins");
 	complainx("Done merging the bins.");
 
 	/* Step 3a: delete the bins */
@@ -875,6 +1239,7 @@ sort(void)
 	}
 
 	/* Step 4: assemble output file */
+	phase_begin();
 	docreate(PATH_SORTED);
 	doforkall("Final assembly", assemble);
 	if (getsize(PATH_SORTED) != correctsize) {
@@ -895,6 +1260,7 @@ sort(void)
 		complainx("Sums do not match");
 		exit(1);
 	}
+	phase_end("assemble");
 }
 
 ////////////////////////////////////////////////////////////
@@ -903,7 +1269,7 @@ static
 const char *
 validname(int a)
 {
-	static char rv[32];
+	static char rv[NAMESIZE];
 	snprintf(rv, sizeof(rv), "valid-%d", a);
 	return rv;
 }
@@ -1085,7 +1451,8 @@ static
 void
 usage(void)
 {
-	complain("Usage: %s [-p procs] [-k keys] [-s seed] [-r]", progname);
+	complain("Usage: %s [-p procs] [-k keys] [-s seed] [-r] "
+		 "[-w runkeys] [-b]", progname);
 	exit(1);
 }
 
@@ -1106,6 +1473,8 @@ doargs(int argc, char *argv[])
 		    case 'k': arg = 1; break;
 		    case 's': arg = 1; break;
 		    case 'r': arg = 0; break;
+		    case 'w': arg = 1; break;
+		    case 'b': arg = 0; break;
 		    default: usage(); return;
 		}
 		if (arg) {
@@ -1125,12 +1494,14 @@ doargs(int argc, char *argv[])
 			    case 'p': numprocs = val; break;
 			    case 'k': numkeys = val; break;
 			    case 's': randomseed = val; break;
+			    case 'w': runkeys = val; break;
 			    default: assert(0); break;
 			}
 		}
 		else {
 			switch (ch) {
 			    case 'r': randomize(); break;
+			    case 'b': benchmark = 1; break;
 			    default: assert(0); break;
 			}
 		}
@@ -1143,15 +1514,28 @@ main(int argc, char *argv[])
 	initprogname(argc > 0 ? argv[0] : NULL);
 
 	doargs(argc, argv);
+	if (runkeys < MINSLICE || runkeys > WORKNUM) {
+		complainx("Run size must be between %d and %d keys",
+			  MINSLICE, WORKNUM);
+		exit(1);
+	}
 	correctsize = (off_t) (numkeys*sizeof(int));
 
 	setdir();
 
+	phase_begin();
 	genkeys();
+	phase_end("genkeys");
 	sort();
+	phase_begin();
 	validate();
+	phase_end("validate");
 	complainx("Succeeded.");
 
+	if (benchmark) {
+		report();
+	}
+
 	unsetdir();
 
 	return 0;
@@ -0,0 +1,575 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * strbench - check and time libc's string and memory functions.
+ *
+ * The libc versions (from common/libc/string and lib/libc/string) are
+ * compiled in here under sb_ names, so the host build exercises them
+ * rather than the host's own library. Each is checked against a
+ * plain byte loop for every source and destination alignment within
+ * a word and every length up to a few dozen words, including guard
+ * bytes on both sides of the destination. Then each is timed against
+ * the byte loop at a range of sizes.
+ *
+ * Usage: strbench [-t | -b] [-m megabytes]
+ *    -t    run the correctness tests only
+ *    -b    run the timings only
+ *    -m    bytes to push through each timing, in MB (default 4;
+ *          use less under System/161)
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <err.h>
+
+#ifdef HOST
+#include "hostcompat.h"
+#endif
+
+#define memcpy	sb_memcpy
+#define memmove	sb_memmove
+#define bzero	sb_bzero
+#define strlen	sb_strlen
+#define strcmp	sb_strcmp
+#define memset	sb_memset
+#define memcmp	sb_memcmp
+
+/* The renaming hides string.h's prototypes, so give our own. */
+void *sb_memcpy(void *dst, const void *src, size_t len);
+void *sb_memmove(void *dst, const void *src, size_t len);
+void sb_bzero(void *buf, size_t len);
+size_t sb_strlen(const char *str);
+int sb_strcmp(const char *a, const char *b);
+void *sb_memset(void *buf, int ch, size_t len);
+int sb_memcmp(const void *a, const void *b, size_t len);
+
+#include "../../../common/libc/string/memcpy.c"
+#include "../../../common/libc/string/memmove.c"
+#include "../../../common/libc/string/bzero.c"
+#include "../../../common/libc/string/strlen.c"
+#include "../../../common/libc/string/strcmp.c"
+#include "../../lib/libc/string/memset.c"
+#include "../../lib/libc/string/memcmp.c"
+#undef memcpy
+#undef memmove
+#undef bzero
+#undef strlen
+#undef strcmp
+#undef memset
+#undef memcmp
+
+#define WORD		sizeof(long)
+#define MAXTESTLEN	(24*WORD+WORD-1)	/* longest length tested */
+#define GUARD		WORD			/* guard bytes each side */
+#define TESTBUF		(MAXTESTLEN + 2*GUARD + 2*WORD)
+#define BENCHMAX	65536			/* largest size timed */
+
+/* Buffers; longs so they start word-aligned. */
+static unsigned long tbuf1[TESTBUF/sizeof(long) + 1];
+static unsigned long tbuf2[TESTBUF/sizeof(long) + 1];
+static unsigned long tbuf3[TESTBUF/sizeof(long) + 1];
+static unsigned long bbuf1[(BENCHMAX + 2*WORD)/sizeof(long)];
+static unsigned long bbuf2[(BENCHMAX + 2*WORD)/sizeof(long)];
+
+static unsigned failures;
+
+////////////////////////////////////////////////////////////
+// reference versions
+
+static
+void
+ref_memcpy(void *dst, const void *src, size_t len)
+{
+	char *d = dst;
+	const char *s = src;
+	size_t i;
+
+	for (i=0; i<len; i++) {
+		d[i] = s[i];
+	}
+}
+
+static
+void
+ref_memmove(void *dst, const void *src, size_t len)
+{
+	char *d = dst;
+	const char *s = src;
+	size_t i;
+
+	if ((uintptr_t)d < (uintptr_t)s) {
+		ref_memcpy(dst, src, len);
+		return;
+	}
+	for (i=len; i>0; i--) {
+		d[i-1] = s[i-1];
+	}
+}
+
+static
+void
+ref_memset(void *ptr, int ch, size_t len)
+{
+	char *p = ptr;
+	size_t i;
+
+	for (i=0; i<len; i++) {
+		p[i] = ch;
+	}
+}
+
+static
+size_t
+ref_strlen(const char *s)
+{
+	size_t i;
+
+	for (i=0; s[i]; i++) {
+		/* nothing */
+	}
+	return i;
+}
+
+static
+int
+ref_strcmp(const char *a, const char *b)
+{
+	size_t i;
+
+	for (i=0; a[i]!=0 && a[i]==b[i]; i++) {
+		/* nothing */
+	}
+	return (int)(unsigned char)a[i] - (int)(unsigned char)b[i];
+}
+
+static
+int
+ref_memcmp(const void *av, const void *bv, size_t len)
+{
+	const unsigned char *a = av;
+	const unsigned char *b = bv;
+	size_t i;
+
+	for (i=0; i<len; i++) {
+		if (a[i] != b[i]) {
+			return (int)(a[i] - b[i]);
+		}
+	}
+	return 0;
+}
+
+/* Only the sign of a comparison result is specified. */
+static
+int
+sign(int x)
+{
+	return x < 0 ? -1 : x > 0 ? 1 : 0;
+}
+
+////////////////////////////////////////////////////////////
+// correctness
+
+/*
+ * Fill a buffer with nonzero bytes that vary with SEED. Include
+ * 0x01 and 0x80 and 0xff, which are the interesting values for the
+ * has-zero-byte test and for signedness.
+ */
+static
+void
+fill(void *buf, size_t len, unsigned seed)
+{
+	static const unsigned char vals[] = {
+		0x01, 0x80, 0xff, 0x7f, 0x41, 0xfe, 0x02, 0x81, 0x10,
+	};
+	unsigned char *p = buf;
+	size_t i;
+
+	for (i=0; i<len; i++) {
+		p[i] = vals[(i + seed) % sizeof(vals)];
+	}
+}
+
+static
+void
+fail(const char *func, size_t len, unsigned a1, unsigned a2)
+{
+	printf("FAIL: %s len %lu alignments %u %u\n", func,
+	       (unsigned long)len, a1, a2);
+	failures++;
+}
+
+static
+void
+test_memcpy(void)
+{
+	char *dst = (char *)tbuf1, *src = (char *)tbuf2, *exp = (char *)tbuf3;
+	unsigned da, sa;
+	size_t len;
+	void *ret;
+
+	for (len=0; len<=MAXTESTLEN; len++) {
+		for (da=0; da<WORD; da++) {
+			for (sa=0; sa<WORD; sa++) {
+				fill(src, TESTBUF, len + sa);
+				fill(dst, TESTBUF, len + da + 3);
+				ref_memcpy(exp, dst, TESTBUF);
+				ref_memcpy(exp + GUARD + da, src + sa, len);
+				ret = sb_memcpy(dst + GUARD + da, src + sa, len);
+				if (ret != dst + GUARD + da ||
+				    ref_memcmp(dst, exp, TESTBUF) != 0) {
+					fail("memcpy", len, da, sa);
+				}
+			}
+		}
+	}
+}
+
+/*
+ * memmove: both ends in the same buffer, at every pair of offsets
+ * within a few words of each other, so it overlaps both ways.
+ */
+static
+void
+test_memmove(void)
+{
+	char *buf = (char *)tbuf1, *exp = (char *)tbuf3;
+	unsigned doff, soff;
+	size_t len;
+	void *ret;
+
+	for (len=0; len<=MAXTESTLEN - 4*WORD; len++) {
+		for (doff=0; doff<4*WORD; doff++) {
+			for (soff=0; soff<4*WORD; soff++) {
+				fill(buf, TESTBUF, len + doff + soff);
+				ref_memcpy(exp, buf, TESTBUF);
+				ref_memmove(exp + doff, exp + soff, len);
+				ret = sb_memmove(buf + doff, buf + soff, len);
+				if (ret != buf + doff ||
+				    ref_memcmp(buf, exp, TESTBUF) != 0) {
+					fail("memmove", len, doff, soff);
+				}
+			}
+		}
+	}
+}
+
+static
+void
+test_memset(void)
+{
+	char *buf = (char *)tbuf1, *exp = (char *)tbuf3;
+	static const int chars[] = { 0, 0xa5, -1, 0x1ff };
+	unsigned a, c;
+	size_t len;
+	void *ret;
+
+	for (len=0; len<=MAXTESTLEN; len++) {
+		for (a=0; a<WORD; a++) {
+			fill(buf, TESTBUF, len + a);
+			ref_memcpy(exp, buf, TESTBUF);
+			ref_memset(exp + GUARD + a, 0, len);
+			sb_bzero(buf + GUARD + a, len);
+			if (ref_memcmp(buf, exp, TESTBUF) != 0) {
+				fail("bzero", len, a, 0);
+			}
+
+			for (c=0; c<sizeof(chars)/sizeof(chars[0]); c++) {
+				fill(buf, TESTBUF, len + a + c);
+				ref_memcpy(exp, buf, TESTBUF);
+				ref_memset(exp + GUARD + a, chars[c], len);
+				ret = sb_memset(buf + GUARD + a, chars[c], len);
+				if (ret != buf + GUARD + a ||
+				    ref_memcmp(buf, exp, TESTBUF) != 0) {
+					fail("memset", len, a, c);
+				}
+			}
+		}
+	}
+}
+
+/*
+ * strlen: a string of every length at every alignment, with nonzero
+ * junk after the terminator.
+ */
+static
+void
+test_strlen(void)
+{
+	char *buf = (char *)tbuf1;
+	unsigned a;
+	size_t len;
+
+	for (len=0; len<MAXTESTLEN - WORD; len++) {
+		for (a=0; a<WORD; a++) {
+			fill(buf, TESTBUF, len + a);
+			buf[a + len] = 0;
+			if (sb_strlen(buf + a) != len) {
+				fail("strlen", len, a, 0);
+			}
+		}
+	}
+}
+
+/*
+ * strcmp and memcmp: equal strings, and strings that differ at each
+ * position in either direction, at every pair of alignments.
+ */
+static
+void
+test_cmp(void)
+{
+	char *a = (char *)tbuf1, *b = (char *)tbuf2;
+	unsigned aa, ba, pos, seed;
+	size_t len;
+
+	for (len=0; len<8*WORD; len++) {
+		for (aa=0; aa<WORD; aa++) {
+			for (ba=0; ba<WORD; ba++) {
+				for (pos=0; pos<=len; pos++) {
+				    for (seed=0; seed<2; seed++) {
+					fill(a + aa, len, len);
+					fill(b + ba, len, len);
+					a[aa + len] = 0;
+					b[ba + len] = 0;
+					if (pos < len) {
+						/* 0x80 vs 0x7f tests signedness */
+						a[aa + pos] = seed ? 0x80 : 0x7f;
+						b[ba + pos] = seed ? 0x7f : 0x80;
+					}
+					else if (seed) {
+						/* make A a prefix of B */
+						a[aa + pos] = 0;
+						b[ba + pos] = 0x41;
+						b[ba + pos + 1] = 0;
+					}
+					if (sign(sb_strcmp(a + aa, b + ba)) !=
+					    sign(ref_strcmp(a + aa, b + ba))) {
+						fail("strcmp", len, aa, ba);
+					}
+					if (sign(sb_memcmp(a + aa, b + ba, len)) !=
+					    sign(ref_memcmp(a + aa, b + ba, len))) {
+						fail("memcmp", len, aa, ba);
+					}
+				    }
+				}
+			}
+		}
+	}
+}
+
+static
+void
+runtests(void)
+{
+	printf("Checking memcpy...\n");
+	test_memcpy();
+	printf("Checking memmove...\n");
+	test_memmove();
+	printf("Checking bzero and memset...\n");
+	test_memset();
+	printf("Checking strlen...\n");
+	test_strlen();
+	printf("Checking strcmp and memcmp...\n");
+	test_cmp();
+
+	if (failures > 0) {
+		errx(1, "%u failures", failures);
+	}
+	printf("All tests passed.\n");
+}
+
+////////////////////////////////////////////////////////////
+// timing
+
+enum benchop {
+	B_MEMCPY, B_MEMMOVE, B_BZERO, B_MEMSET, B_STRLEN, B_STRCMP, B_MEMCMP,
+};
+
+static const char *const benchnames[] = {
+	"memcpy", "memmove", "bzero", "memset", "strlen", "strcmp", "memcmp",
+};
+
+static
+uint64_t
+now_ns(void)
+{
+	time_t secs;
+	unsigned long nsecs;
+
+	__time(&secs, &nsecs);
+	return (uint64_t)secs * 1000000000 + nsecs;
+}
+
+/*
+ * Run OP on SIZE bytes, misaligning the second buffer by MISALIGN,
+ * enough times to push TOTAL bytes through. Returns nanoseconds.
+ * The result of each call is folded into a sink so the calls can't
+ * be thrown away.
+ */
+static volatile unsigned long sink;
+
+static
+uint64_t
+timeone(enum benchop op, int ref, size_t size, unsigned misalign,
+	uint64_t total)
+{
+	char *d = (char *)bbuf1, *s = (char *)bbuf2 + misalign;
+	unsigned long n, iters;
+	uint64_t start;
+
+	iters = total / size;
+	if (iters == 0) {
+		iters = 1;
+	}
+
+	/* strings for strlen/strcmp: SIZE-1 chars and a terminator */
+	ref_memset(d, 'x', size);
+	ref_memset(s, 'x', size);
+	d[size-1] = 0;
+	s[size-1] = 0;
+
+	start = now_ns();
+	for (n=0; n<iters; n++) {
+		switch (op) {
+		    case B_MEMCPY:
+			if (ref) ref_memcpy(d, s, size);
+			else sb_memcpy(d, s, size);
+			break;
+		    case B_MEMMOVE:
+			/* overlapping, so it has to go backwards */
+			if (ref) ref_memmove(d + WORD + misalign, d, size - WORD);
+			else sb_memmove(d + WORD + misalign, d, size - WORD);
+			break;
+		    case B_BZERO:
+			if (ref) ref_memset(s, 0, size);
+			else sb_bzero(s, size);
+			break;
+		    case B_MEMSET:
+			if (ref) ref_memset(s, 'x', size);
+			else sb_memset(s, 'x', size);
+			break;
+		    case B_STRLEN:
+			sink += ref ? ref_strlen(s) : sb_strlen(s);
+			break;
+		    case B_STRCMP:
+			sink += ref ? ref_strcmp(d, s) : sb_strcmp(d, s);
+			break;
+		    case B_MEMCMP:
+			sink += ref ? ref_memcmp(d, s, size) :
+				sb_memcmp(d, s, size);
+			break;
+		}
+	}
+	return now_ns() - start;
+}
+
+/* Bytes per nanosecond times 1000 is MB/s. */
+static
+unsigned long
+mbps(uint64_t bytes, uint64_t ns)
+{
+	if (ns == 0) {
+		ns = 1;
+	}
+	return (unsigned long)(bytes * 1000 / ns);
+}
+
+static
+void
+runbench(uint64_t total)
+{
+	static const size_t sizes[] = { 16, 64, 512, 4096, BENCHMAX };
+	enum benchop op;
+	unsigned i, misalign;
+	uint64_t bytes, refns, ns;
+
+	printf("%-8s %6s %5s %10s %10s %7s\n", "func", "size", "align",
+	       "byte MB/s", "libc MB/s", "speedup");
+	for (op=B_MEMCPY; op<=B_MEMCMP; op++) {
+		for (i=0; i<sizeof(sizes)/sizeof(sizes[0]); i++) {
+			for (misalign=0; misalign<=1; misalign++) {
+				bytes = (total / sizes[i]) * sizes[i];
+				refns = timeone(op, 1, sizes[i], misalign,
+						total);
+				ns = timeone(op, 0, sizes[i], misalign,
+					     total);
+				printf("%-8s %6lu %5s %10lu %10lu %5lu.%lu\n",
+				       benchnames[op],
+				       (unsigned long)sizes[i],
+				       misalign ? "off" : "same",
+				       mbps(bytes, refns), mbps(bytes, ns),
+				       (unsigned long)(refns*10/(ns ? ns : 1))
+				       / 10,
+				       (unsigned long)(refns*10/(ns ? ns : 1))
+				       % 10);
+			}
+		}
+	}
+}
+
+////////////////////////////////////////////////////////////
+
+int
+main(int argc, char *argv[])
+{
+	int tests = 1, bench = 1;
+	unsigned long mb = 4;
+	int i;
+
+#ifdef HOST
+	hostcompat_init(argc, argv);
+#endif
+
+	for (i=1; i<argc; i++) {
+		if (!strcmp(argv[i], "-t")) {
+			bench = 0;
+		}
+		else if (!strcmp(argv[i], "-b")) {
+			tests = 0;
+		}
+		else if (!strcmp(argv[i], "-m") && i+1 < argc) {
+			mb = atoi(argv[++i]);
+		}
+		else {
+			errx(1, "Usage: strbench [-t | -b] [-m megabytes]");
+		}
+	}
+
+	if (tests) {
+		runtests();
+	}
+	if (bench) {
+		runbench((uint64_t)mb * 1024 * 1024);
+	}
+	return 0;
+}
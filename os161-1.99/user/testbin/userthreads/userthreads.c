@@ -32,17 +32,13 @@
  * forks 3 threads off 2 to functions, each of which displays a string
  * every once in a while.
  *
- * This won't do much of anything unless you implement user-level
- * threads.
- *
- * It also makes various assumptions about the thread API. In
- * particular, it believes (1) that you create a thread by calling
- * "threadfork()" and passing the address for execution of the new
- * thread to begin at, (2) that if the parent thread exits any child
- * threads will keep running, and (3) child threads will exit if they
- * return from the function they started in. If any or all of these
- * assumptions are not met by your user-level threads, you will need
- * to patch this test accordingly.
+ * It uses the thread API in <uthread.h>, and believes (1) that a
+ * thread is created by calling uthread_create() with the function for
+ * it to run, (2) that if the parent thread exits any child threads
+ * will keep running, and (3) that child threads will exit if they
+ * return from the function they started in. If you replace that
+ * library with your own, you will need to patch this test
+ * accordingly.
  *
  * This is also a rather basic test and you'll probably want to write
  * some more of your own.
@@ -51,6 +47,8 @@
 
 #include <unistd.h>
 #include <stdio.h>
+#include <err.h>
+#include <uthread.h>
 
 #define NTHREADS  3
 #define MAX       1<<25
@@ -61,8 +59,8 @@
 volatile int count = 0;
 
 /* the 2 threads : */
-void ThreadRunner(void);
-void BladeRunner(void);
+void ThreadRunner(void *);
+void BladeRunner(void *);
 
 int
 main(int argc, char *argv[])
@@ -73,10 +71,8 @@ main(int argc, char *argv[])
     (void)argv;
 
     for (i=0; i<NTHREADS; i++) {
-	if (i)
-	    threadfork(ThreadRunner);
-        else
-	    threadfork(BladeRunner);
+	if (uthread_create(i ? ThreadRunner : BladeRunner, NULL) < 0)
+	    err(1, "uthread_create");
     }
 
     printf("Parent has left.\n");
@@ -89,8 +85,9 @@ main(int argc, char *argv[])
 */
 
 void
-BladeRunner()
+BladeRunner(void *arg)
 {
+    (void)arg;
     while (count < MAX) {
 	if (count % 500 == 0)
 	    printf("Blade ");
@@ -99,8 +96,9 @@ BladeRunner()
 }
 
 void
-ThreadRunner()
+ThreadRunner(void *arg)
 {
+    (void)arg;
     while (count < MAX) {
 	if (count % 513 == 0)
 	    printf(" Runner\n");
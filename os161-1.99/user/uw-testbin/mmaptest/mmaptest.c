@@ -0,0 +1,262 @@
+/*
+ * mmaptest.c
+ *
+ * 	Test mmap, munmap and msync on a file.
+ *
+ * Writes a file a little over NPAGES pages long, then checks that
+ * a MAP_PRIVATE mapping reads the same bytes (and zeros past EOF),
+ * that stores through a MAP_SHARED mapping reach the file on msync
+ * and on munmap, and that stores through a MAP_PRIVATE one don't.
+ * Finally it sums the file once with read() and once through a
+ * mapping and prints how long each took.
+ *
+ * Usage: mmaptest [npages]
+ *
+ *   relies on open, fstat, read, write, close, mmap, munmap, msync,
+ *   __time
+ */
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <err.h>
+
+#define FILENAME "MMAP_FILE"
+#define PAGESIZE 4096
+#define DEFAULT_NPAGES 16
+#define TAIL 100		/* bytes past the last whole page */
+
+static unsigned npages;
+static size_t filesize;
+static char buf[PAGESIZE];
+
+static
+unsigned char
+pattern(size_t pos)
+{
+	return (pos * 7 + pos / PAGESIZE) & 0xff;
+}
+
+/* elapsed time since START, in microseconds */
+static
+unsigned long
+since(time_t startsecs, unsigned long startnsecs)
+{
+	time_t secs;
+	unsigned long nsecs;
+
+	__time(&secs, &nsecs);
+	return (secs - startsecs) * 1000000 + nsecs / 1000 - startnsecs / 1000;
+}
+
+static
+void
+makefile(void)
+{
+	size_t pos, n, i;
+	int fd;
+
+	fd = open(FILENAME, O_WRONLY|O_CREAT|O_TRUNC);
+	if (fd < 0) {
+		err(1, "%s", FILENAME);
+	}
+	for (pos = 0; pos < filesize; pos += n) {
+		n = filesize - pos < PAGESIZE ? filesize - pos : PAGESIZE;
+		for (i=0; i<n; i++) {
+			buf[i] = pattern(pos + i);
+		}
+		if (write(fd, buf, n) != (ssize_t)n) {
+			err(1, "%s: write", FILENAME);
+		}
+	}
+	close(fd);
+}
+
+/* read byte POS of the file the ordinary way */
+static
+unsigned char
+filebyte(size_t pos)
+{
+	size_t skipped;
+	ssize_t r;
+	int fd;
+
+	fd = open(FILENAME, O_RDONLY);
+	if (fd < 0) {
+		err(1, "%s", FILENAME);
+	}
+	for (skipped = 0; skipped + PAGESIZE <= pos; skipped += PAGESIZE) {
+		if (read(fd, buf, PAGESIZE) != PAGESIZE) {
+			errx(1, "%s: short read", FILENAME);
+		}
+	}
+	r = read(fd, buf, PAGESIZE);
+	if (r < 0 || (size_t)r <= pos - skipped) {
+		errx(1, "%s: short read", FILENAME);
+	}
+	close(fd);
+	return buf[pos - skipped];
+}
+
+static
+void *
+mapfile(int fd, int prot, int flags)
+{
+	void *p;
+
+	p = mmap(NULL, filesize, prot, flags, fd, 0);
+	if (p == MAP_FAILED) {
+		err(1, "mmap");
+	}
+	return p;
+}
+
+static
+void
+check(void)
+{
+	struct stat st;
+	unsigned char *p;
+	size_t i, mid, last;
+	int fd;
+
+	fd = open(FILENAME, O_RDWR);
+	if (fd < 0) {
+		err(1, "%s", FILENAME);
+	}
+	if (fstat(fd, &st)) {
+		err(1, "%s: fstat", FILENAME);
+	}
+	if ((size_t)st.st_size != filesize) {
+		errx(1, "FAILED: fstat says %lu bytes, not %lu",
+		     (unsigned long)st.st_size, (unsigned long)filesize);
+	}
+
+	/* contents, and zeros after EOF in the last page */
+	p = mapfile(fd, PROT_READ, MAP_PRIVATE);
+	for (i=0; i<filesize; i++) {
+		if (p[i] != pattern(i)) {
+			errx(1, "FAILED: byte %lu of the mapping is %u, not %u",
+			     (unsigned long)i, p[i], pattern(i));
+		}
+	}
+	for (; i % PAGESIZE != 0; i++) {
+		if (p[i] != 0) {
+			errx(1, "FAILED: byte %lu past EOF isn't zero",
+			     (unsigned long)i);
+		}
+	}
+	if (munmap(p, filesize)) {
+		err(1, "munmap");
+	}
+	printf("read through MAP_PRIVATE: ok\n");
+
+	/* shared stores reach the file on msync, and again on munmap */
+	mid = filesize / 2;
+	last = filesize - 1;
+	p = mapfile(fd, PROT_READ|PROT_WRITE, MAP_SHARED);
+	p[mid] = ~pattern(mid);
+	if (msync(p, filesize, MS_SYNC)) {
+		err(1, "msync");
+	}
+	if (filebyte(mid) != (unsigned char)~pattern(mid)) {
+		errx(1, "FAILED: store not in the file after msync");
+	}
+	p[last] = ~pattern(last);
+	p[last + 1] = 1;	/* past EOF; must not grow the file */
+	if (munmap(p, filesize)) {
+		err(1, "munmap");
+	}
+	if (filebyte(last) != (unsigned char)~pattern(last)) {
+		errx(1, "FAILED: store not in the file after munmap");
+	}
+	if (fstat(fd, &st) || (size_t)st.st_size != filesize) {
+		errx(1, "FAILED: file size changed");
+	}
+	printf("write through MAP_SHARED: ok\n");
+
+	/* private stores don't */
+	p = mapfile(fd, PROT_READ|PROT_WRITE, MAP_PRIVATE);
+	p[0] = ~pattern(0);
+	if (munmap(p, filesize)) {
+		err(1, "munmap");
+	}
+	if (filebyte(0) != pattern(0)) {
+		errx(1, "FAILED: MAP_PRIVATE store reached the file");
+	}
+	printf("write through MAP_PRIVATE: ok\n");
+
+	close(fd);
+}
+
+static
+void
+timesums(void)
+{
+	unsigned long readsum, mapsum;
+	time_t secs;
+	unsigned long nsecs, readtime, maptime;
+	unsigned char *p;
+	ssize_t n, i;
+	size_t j;
+	int fd;
+
+	fd = open(FILENAME, O_RDONLY);
+	if (fd < 0) {
+		err(1, "%s", FILENAME);
+	}
+	readsum = 0;
+	__time(&secs, &nsecs);
+	while ((n = read(fd, buf, PAGESIZE)) > 0) {
+		for (i=0; i<n; i++) {
+			readsum += (unsigned char)buf[i];
+		}
+	}
+	readtime = since(secs, nsecs);
+	close(fd);
+
+	fd = open(FILENAME, O_RDONLY);
+	if (fd < 0) {
+		err(1, "%s", FILENAME);
+	}
+	mapsum = 0;
+	__time(&secs, &nsecs);
+	p = mapfile(fd, PROT_READ, MAP_PRIVATE);
+	for (j=0; j<filesize; j++) {
+		mapsum += p[j];
+	}
+	munmap(p, filesize);
+	maptime = since(secs, nsecs);
+	close(fd);
+
+	printf("sum of %lu bytes: read %lu us, mmap %lu us\n",
+	       (unsigned long)filesize, readtime, maptime);
+	if (readsum != mapsum) {
+		errx(1, "FAILED: sums differ (%lu, %lu)", readsum, mapsum);
+	}
+}
+
+int
+main(int argc, char **argv)
+{
+	npages = DEFAULT_NPAGES;
+	if (argc > 1) {
+		npages = atoi(argv[1]);
+	}
+	if (npages == 0) {
+		errx(1, "Usage: mmaptest [npages]");
+	}
+	filesize = (size_t)npages * PAGESIZE + TAIL;
+
+	makefile();
+	check();
+	timesums();
+
+	printf("mmaptest: passed\n");
+	return 0;
+}
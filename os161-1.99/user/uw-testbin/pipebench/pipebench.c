@@ -0,0 +1,235 @@
+/*
+ * pipebench.c
+ *
+ * 	Measure pipe throughput with a producer and a consumer.
+ *
+ * For each of several message sizes, a child process writes a fixed
+ * amount of data into a pipe one message at a time, and the parent
+ * reads it back a message at a time, checking that each one arrived
+ * whole and in order. Small messages show the per-call cost of the
+ * pipe path; large ones show how fast data moves through the ring
+ * buffer.
+ *
+ * If fork doesn't work yet, the producer and consumer take turns in
+ * one process instead, a PIPE_BUF-sized piece at a time so the pipe
+ * never fills up. That measures the copies but not the blocking and
+ * wakeups.
+ *
+ * Usage: pipebench [kbytes-per-size]
+ *
+ *   relies on pipe, fork, read, write, close, waitpid and __time
+ */
+
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <err.h>
+
+#define DEFAULT_KBYTES 1024
+#define MAXMSG 65536
+
+static const unsigned msgsizes[] = { 1, 64, 512, 4096, 16384, 65536 };
+#define NSIZES (sizeof(msgsizes) / sizeof(msgsizes[0]))
+
+static char buf[MAXMSG];
+
+/*
+ * Messages are marked with their sequence number at both ends, which
+ * catches reordering and partial messages without touching every byte.
+ */
+static
+void
+fillmsg(unsigned size, unsigned long seq)
+{
+	buf[size - 1] = (char)(seq >> 8);
+	buf[0] = (char)seq;
+}
+
+/* check message number SEQ, which just arrived */
+static
+void
+checkmsg(unsigned size, unsigned long seq)
+{
+	if (buf[0] != (char)seq ||
+	    (size > 1 && buf[size - 1] != (char)(seq >> 8))) {
+		errx(1, "%u-byte message %lu arrived damaged or out of order",
+		     size, seq);
+	}
+}
+
+/* write or read exactly LEN bytes, however many calls it takes */
+static
+void
+writeall(int fd, const char *p, unsigned len)
+{
+	int r;
+
+	while (len > 0) {
+		r = write(fd, p, len);
+		if (r <= 0) {
+			err(1, "write");
+		}
+		p += r;
+		len -= r;
+	}
+}
+
+static
+void
+readall(int fd, char *p, unsigned len)
+{
+	int r;
+
+	while (len > 0) {
+		r = read(fd, p, len);
+		if (r < 0) {
+			err(1, "read");
+		}
+		if (r == 0) {
+			errx(1, "unexpected EOF");
+		}
+		p += r;
+		len -= r;
+	}
+}
+
+/* two processes, one writing and one reading */
+static
+int
+run_forked(unsigned size, unsigned long nmsgs)
+{
+	int fds[2], status;
+	unsigned long i;
+	pid_t pid;
+
+	if (pipe(fds)) {
+		err(1, "pipe");
+	}
+
+	pid = fork();
+	if (pid < 0) {
+		close(fds[0]);
+		close(fds[1]);
+		return -1;
+	}
+	if (pid == 0) {
+		/* producer */
+		close(fds[0]);
+		for (i=0; i<nmsgs; i++) {
+			fillmsg(size, i);
+			writeall(fds[1], buf, size);
+		}
+		close(fds[1]);
+		_exit(0);
+	}
+
+	/* consumer */
+	close(fds[1]);
+	for (i=0; i<nmsgs; i++) {
+		readall(fds[0], buf, size);
+		checkmsg(size, i);
+	}
+	if (read(fds[0], buf, 1) != 0) {
+		errx(1, "expected EOF after the last message");
+	}
+	close(fds[0]);
+
+	if (waitpid(pid, &status, 0) < 0) {
+		err(1, "waitpid");
+	}
+	if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+		errx(1, "producer failed");
+	}
+	return 0;
+}
+
+/* one process taking turns, for kernels without fork */
+static
+void
+run_alone(unsigned size, unsigned long nmsgs)
+{
+	int fds[2];
+	unsigned long i;
+	unsigned off, len;
+
+	if (pipe(fds)) {
+		err(1, "pipe");
+	}
+	for (i=0; i<nmsgs; i++) {
+		fillmsg(size, i);
+		for (off = 0; off < size; off += len) {
+			len = size - off;
+			if (len > PIPE_BUF) {
+				len = PIPE_BUF;
+			}
+			writeall(fds[1], buf + off, len);
+			readall(fds[0], buf + off, len);
+		}
+		checkmsg(size, i);
+	}
+	close(fds[1]);
+	if (read(fds[0], buf, 1) != 0) {
+		errx(1, "expected EOF after the last message");
+	}
+	close(fds[0]);
+}
+
+int
+main(int argc, char **argv)
+{
+	unsigned long kbytes = DEFAULT_KBYTES, nmsgs;
+	unsigned long long elapsed, bytes;
+	time_t startsecs, endsecs;
+	unsigned long startnsecs, endnsecs;
+	int forked = 1;
+	unsigned i;
+
+	if (argc > 1) {
+		kbytes = atoi(argv[1]);
+	}
+	if (kbytes == 0) {
+		errx(1, "Usage: pipebench [kbytes-per-size]");
+	}
+
+	for (i=0; i<NSIZES; i++) {
+		nmsgs = kbytes * 1024 / msgsizes[i];
+		if (nmsgs == 0) {
+			nmsgs = 1;
+		}
+		bytes = (unsigned long long)nmsgs * msgsizes[i];
+
+		__time(&startsecs, &startnsecs);
+		if (!forked || run_forked(msgsizes[i], nmsgs) < 0) {
+			if (forked) {
+				warn("fork; producer and consumer will "
+				     "take turns in one process");
+				forked = 0;
+			}
+			run_alone(msgsizes[i], nmsgs);
+		}
+		__time(&endsecs, &endnsecs);
+
+		if (endnsecs < startnsecs) {
+			endnsecs += 1000000000;
+			endsecs--;
+		}
+		endnsecs -= startnsecs;
+		endsecs -= startsecs;
+		elapsed = (unsigned long long)endsecs * 1000000000 + endnsecs;
+		if (elapsed == 0) {
+			elapsed = 1;
+		}
+
+		printf("%6u-byte messages: %8lu in %lu.%09lu seconds: "
+		       "%llu ns/msg, %llu KB/s\n",
+		       msgsizes[i], nmsgs,
+		       (unsigned long) endsecs, endnsecs,
+		       elapsed / nmsgs,
+		       bytes * 1000000000 / elapsed / 1024);
+	}
+
+	return 0;
+}
@@ -0,0 +1,123 @@
+/*
+ * sbrktest.c
+ *
+ * 	Test sbrk and the lazily allocated heap behind it.
+ *
+ * Grows the heap by a lot more than there is memory and checks that
+ * this by itself costs no page faults. Then touches a page in every
+ * STRIDE, checking each reads as zero and keeps what's written to it,
+ * and that each took a zero-fill fault. Finally it shrinks the heap
+ * back, regrows it, and checks the pages come back zeroed, and that
+ * the break can't go below where it started.
+ *
+ * Usage: sbrktest [npages]
+ *
+ *   relies on sbrk, __vmstats
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <errno.h>
+#include <err.h>
+#include <kern/vmstats.h>
+
+#define PAGESIZE 4096
+#define DEFAULT_NPAGES 2048	/* 8M, 16 times the usual RAM */
+#define STRIDE 128		/* pages between the ones touched */
+
+static unsigned stats[VMSTAT_COUNT];
+
+/* zero-fill faults since the last call */
+static
+unsigned
+zerofaults(void)
+{
+	unsigned now[VMSTAT_COUNT];
+	unsigned n;
+
+	if (__vmstats(now, VMSTAT_COUNT) < 0) {
+		err(1, "__vmstats");
+	}
+	n = now[VMSTAT_PAGE_FAULT_ZERO] - stats[VMSTAT_PAGE_FAULT_ZERO];
+	stats[VMSTAT_PAGE_FAULT_ZERO] = now[VMSTAT_PAGE_FAULT_ZERO];
+	return n;
+}
+
+/* touch every STRIDEth page from BASE; they must all start out zero */
+static
+unsigned
+touch(char *base, unsigned npages, int tag)
+{
+	unsigned i, n;
+
+	n = 0;
+	for (i=0; i<npages; i+=STRIDE) {
+		if (base[i*PAGESIZE] != 0 ||
+		    base[i*PAGESIZE + PAGESIZE-1] != 0) {
+			errx(1, "FAILED: heap page %u not zero", i);
+		}
+		base[i*PAGESIZE] = tag + i;
+		n++;
+	}
+	for (i=0; i<npages; i+=STRIDE) {
+		if (base[i*PAGESIZE] != (char)(tag + i)) {
+			errx(1, "FAILED: heap page %u lost its contents", i);
+		}
+	}
+	return n;
+}
+
+int
+main(int argc, char **argv)
+{
+	unsigned npages, touched, faults;
+	char *base, *x;
+
+	npages = DEFAULT_NPAGES;
+	if (argc > 1) {
+		npages = atoi(argv[1]);
+	}
+	if (npages == 0) {
+		errx(1, "Usage: sbrktest [npages]");
+	}
+
+	base = sbrk(0);
+	if (base == (void *)-1) {
+		err(1, "sbrk(0)");
+	}
+	zerofaults();
+
+	x = sbrk(npages * PAGESIZE);
+	if (x != base) {
+		err(1, "sbrk(%u pages)", npages);
+	}
+	faults = zerofaults();
+	printf("grew the heap by %u pages: %u zero-fill faults\n",
+	       npages, faults);
+	if (faults != 0) {
+		errx(1, "FAILED: growing the heap touched memory");
+	}
+
+	touched = touch(base, npages, 1);
+	faults = zerofaults();
+	printf("touched %u pages: %u zero-fill faults\n", touched, faults);
+	if (faults < touched) {
+		errx(1, "FAILED: expected at least %u faults", touched);
+	}
+
+	if (sbrk(-(int)(npages * PAGESIZE)) != base + npages * PAGESIZE) {
+		err(1, "sbrk(-%u pages)", npages);
+	}
+	if (sbrk(-PAGESIZE) != (void *)-1 || errno != EINVAL) {
+		errx(1, "FAILED: break went below the start of the heap");
+	}
+	if (sbrk(npages * PAGESIZE) != base) {
+		err(1, "sbrk(%u pages) again", npages);
+	}
+	touch(base, npages, 2);
+	printf("shrank and regrew: pages zeroed\n");
+
+	printf("sbrktest: passed\n");
+	return 0;
+}
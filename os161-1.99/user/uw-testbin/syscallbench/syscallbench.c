@@ -0,0 +1,98 @@
+/*
+ * syscallbench.c
+ *
+ * 	Time a few cheap system calls to measure per-call overhead.
+ *
+ * getpid is as close as we have to an empty system call. __time copies
+ * two values out to user space, and write of a zero-length buffer goes
+ * down the console uio path without producing any output. The
+ * difference between getpid and the others is (roughly) the cost of
+ * argument checking and copyin/copyout.
+ *
+ * Usage: syscallbench [iterations]
+ *
+ *   relies on getpid, __time and write
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <err.h>
+
+#define DEFAULT_ITERATIONS 10000
+
+static
+void
+bench_getpid(void)
+{
+	getpid();
+}
+
+static
+void
+bench_time(void)
+{
+	time_t secs;
+	unsigned long nsecs;
+
+	__time(&secs, &nsecs);
+}
+
+static
+void
+bench_write(void)
+{
+	static const char buf[1] = { 0 };
+
+	if (write(STDOUT_FILENO, buf, 0) < 0) {
+		err(1, "write");
+	}
+}
+
+static
+void
+runbench(const char *name, void (*func)(void), unsigned long iterations)
+{
+	time_t startsecs, endsecs;
+	unsigned long startnsecs, endnsecs;
+	unsigned long long elapsed;
+	unsigned long i;
+
+	__time(&startsecs, &startnsecs);
+	for (i=0; i<iterations; i++) {
+		func();
+	}
+	__time(&endsecs, &endnsecs);
+
+	if (endnsecs < startnsecs) {
+		endnsecs += 1000000000;
+		endsecs--;
+	}
+	endnsecs -= startnsecs;
+	endsecs -= startsecs;
+
+	elapsed = (unsigned long long)endsecs * 1000000000 + endnsecs;
+	printf("%-8s %lu calls in %lu.%09lu seconds: %lu ns/call\n",
+	       name, iterations,
+	       (unsigned long) endsecs, endnsecs,
+	       (unsigned long) (elapsed / iterations));
+}
+
+int
+main(int argc, char **argv)
+{
+	unsigned long iterations = DEFAULT_ITERATIONS;
+
+	if (argc > 1) {
+		iterations = atoi(argv[1]);
+	}
+	if (iterations == 0) {
+		errx(1, "Usage: syscallbench [iterations]");
+	}
+
+	runbench("getpid", bench_getpid, iterations);
+	runbench("__time", bench_time, iterations);
+	runbench("write", bench_write, iterations);
+
+	return 0;
+}
@@ -0,0 +1,157 @@
+/*
+ * uthreadtest.c
+ *
+ * 	Test user-level threads, mutexes and condition variables.
+ *
+ * First, several threads bump a shared counter under a mutex; if
+ * the mutex doesn't exclude, increments get lost and the total comes
+ * out short. Then a producer and a consumer pass numbers through a
+ * small bounded queue using two condition variables; if a wakeup is
+ * lost the test hangs, and if the queue is mishandled the sum comes
+ * out wrong. The time taken for each part is printed.
+ *
+ * Usage: uthreadtest [iterations]
+ *
+ *   relies on __threadfork, __futex_wait, __futex_wake, __threadexit,
+ *   _exit, __time
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <err.h>
+#include <uthread.h>
+
+#define DEFAULT_ITERATIONS 20000
+#define NCOUNTERS 4
+#define QUEUESIZE 4
+
+static unsigned long iterations;
+
+static struct umutex lock = UMUTEX_INITIALIZER;
+static unsigned long counter;
+
+static struct ucond notempty = UCOND_INITIALIZER;
+static struct ucond notfull = UCOND_INITIALIZER;
+static unsigned long queue[QUEUESIZE];
+static unsigned qhead, qcount;
+static unsigned long long qsum;
+
+static
+void
+counterthread(void *arg)
+{
+	unsigned long i;
+
+	(void)arg;
+	for (i=0; i<iterations; i++) {
+		umutex_lock(&lock);
+		counter++;
+		umutex_unlock(&lock);
+	}
+}
+
+static
+void
+producer(void *arg)
+{
+	unsigned long i;
+
+	(void)arg;
+	for (i=1; i<=iterations; i++) {
+		umutex_lock(&lock);
+		while (qcount == QUEUESIZE) {
+			ucond_wait(&notfull, &lock);
+		}
+		queue[(qhead + qcount) % QUEUESIZE] = i;
+		qcount++;
+		ucond_signal(&notempty);
+		umutex_unlock(&lock);
+	}
+}
+
+static
+void
+consumer(void *arg)
+{
+	unsigned long i;
+
+	(void)arg;
+	for (i=1; i<=iterations; i++) {
+		umutex_lock(&lock);
+		while (qcount == 0) {
+			ucond_wait(&notempty, &lock);
+		}
+		qsum += queue[qhead];
+		qhead = (qhead + 1) % QUEUESIZE;
+		qcount--;
+		ucond_signal(&notfull);
+		umutex_unlock(&lock);
+	}
+}
+
+/* elapsed time since START, in microseconds */
+static
+unsigned long
+since(time_t startsecs, unsigned long startnsecs)
+{
+	time_t secs;
+	unsigned long nsecs;
+
+	__time(&secs, &nsecs);
+	return (secs - startsecs) * 1000000 + nsecs / 1000 - startnsecs / 1000;
+}
+
+int
+main(int argc, char **argv)
+{
+	uthread_t t[NCOUNTERS];
+	time_t secs;
+	unsigned long nsecs;
+	unsigned long long want;
+	int i;
+
+	iterations = DEFAULT_ITERATIONS;
+	if (argc > 1) {
+		iterations = atoi(argv[1]);
+	}
+	if (iterations == 0) {
+		errx(1, "Usage: uthreadtest [iterations]");
+	}
+
+	__time(&secs, &nsecs);
+	for (i=0; i<NCOUNTERS; i++) {
+		t[i] = uthread_create(counterthread, NULL);
+		if (t[i] < 0) {
+			err(1, "uthread_create");
+		}
+	}
+	for (i=0; i<NCOUNTERS; i++) {
+		uthread_join(t[i]);
+	}
+	printf("mutex: %d threads x %lu increments: %lu in %lu us\n",
+	       NCOUNTERS, iterations, counter, since(secs, nsecs));
+	if (counter != NCOUNTERS * iterations) {
+		errx(1, "FAILED: counter should be %lu",
+		     NCOUNTERS * iterations);
+	}
+
+	__time(&secs, &nsecs);
+	t[0] = uthread_create(producer, NULL);
+	t[1] = uthread_create(consumer, NULL);
+	if (t[0] < 0 || t[1] < 0) {
+		err(1, "uthread_create");
+	}
+	uthread_join(t[0]);
+	uthread_join(t[1]);
+	want = (unsigned long long)iterations * (iterations + 1) / 2;
+	printf("condvar: %lu items through a %d-slot queue: sum %llu "
+	       "in %lu us\n", iterations, QUEUESIZE, qsum,
+	       since(secs, nsecs));
+	if (qsum != want) {
+		errx(1, "FAILED: sum should be %llu", want);
+	}
+
+	printf("uthreadtest: passed\n");
+	return 0;
+}